@@ -0,0 +1,151 @@
+//
+//  EpcBenchmark.c
+//  FlowTrial
+//
+//  Created by Wade Sellers on 12/16/14.
+//  Copyright (c) 2014 Wade Sellers. All rights reserved.
+//
+//  Microbenchmark for the plain C inventory modules, runnable anywhere with a C
+//  compiler (no Foundation, no Xcode). From the top of the repository:
+//
+//    cc -O2 -std=gnu99 -IFlowTrial -o epc-benchmark Benchmarks/EpcBenchmark.c
+//       FlowTrial/EpcTable.c FlowTrial/RawFindQueue.c FlowTrial/ReaderSimulator.c -lm
+//
+//  (one command, split here to fit)
+//    ./epc-benchmark [numTags] [numFinds]
+//
+//  The finds come from ReaderSimulator. Each pass is timed a few times and the
+//  best run is reported:
+//
+//    heap copy     What UgiEpc costs: each find's bytes copied into a new heap
+//                  buffer, hashed from there and freed, then looked up
+//    EpcKey        Each find made into an EpcKey on the stack and looked up
+//    RawFindQueue  Each find pushed and popped through the queue
+//
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include "EpcKey.h"
+#include "EpcTable.h"
+#include "RawFindQueue.h"
+#include "ReaderSimulator.h"
+
+#define DEFAULT_NUM_TAGS 10000
+#define DEFAULT_NUM_FINDS 2000000
+#define RUNS 5
+#define QUEUE_CAPACITY 4096
+
+static double now(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+//
+// Look up every find in a table of the population, copying its bytes to the heap first
+//
+static uint64_t runHeapCopy(const RawFind *finds, uint32_t numFinds, const EpcTable *table) {
+    uint64_t found = 0;
+    for (uint32_t i = 0; i < numFinds; i++) {
+        uint8_t *bytes = malloc(finds[i].epc.length);
+        memcpy(bytes, finds[i].epc.bytes, finds[i].epc.length);
+        EpcKey key = EpcKeyMake(bytes, finds[i].epc.length);
+        found += EpcTableFind(table, &key) != EPC_TABLE_NOT_FOUND;
+        free(bytes);
+    }
+    return found;
+}
+
+//
+// The same, with the key built straight from the find's bytes
+//
+static uint64_t runEpcKey(const RawFind *finds, uint32_t numFinds, const EpcTable *table) {
+    uint64_t found = 0;
+    for (uint32_t i = 0; i < numFinds; i++) {
+        EpcKey key = EpcKeyMake(finds[i].epc.bytes, finds[i].epc.length);
+        found += EpcTableFind(table, &key) != EPC_TABLE_NOT_FOUND;
+    }
+    return found;
+}
+
+//
+// Push every find through the queue, popping whenever it is full
+//
+static uint64_t runQueue(const RawFind *finds, uint32_t numFinds, RawFindQueue *queue) {
+    static RawFind popped[QUEUE_CAPACITY];
+    uint64_t count = 0;
+    for (uint32_t i = 0; i < numFinds; i++) {
+        if (!RawFindQueuePush(queue, &finds[i])) {
+            count += RawFindQueuePop(queue, popped, QUEUE_CAPACITY);
+            RawFindQueuePush(queue, &finds[i]);
+        }
+    }
+    return count + RawFindQueuePop(queue, popped, QUEUE_CAPACITY);
+}
+
+static void report(const char *name, double seconds, uint32_t numFinds, uint64_t check) {
+    printf("%-14s %8.1f ns/find %12.0f finds/sec  (%llu)\n",
+           name, seconds * 1e9 / numFinds, numFinds / seconds, (unsigned long long)check);
+}
+
+int main(int argc, char **argv) {
+    uint32_t numTags = argc > 1 ? (uint32_t)strtoul(argv[1], NULL, 10) : DEFAULT_NUM_TAGS;
+    uint32_t numFinds = argc > 2 ? (uint32_t)strtoul(argv[2], NULL, 10) : DEFAULT_NUM_FINDS;
+    if (numTags == 0 || numFinds == 0) {
+        fprintf(stderr, "usage: %s [numTags] [numFinds]\n", argv[0]);
+        return 1;
+    }
+
+    ReaderSimulatorConfig config;
+    ReaderSimulatorDefaultConfig(&config);
+    config.numTags = numTags;
+    config.readsPerSecond = 1000000;
+    ReaderSimulator simulator;
+    RawFind *finds = malloc(numFinds * sizeof(RawFind));
+    if (!finds || !ReaderSimulatorInit(&simulator, &config, 0)) {
+        fprintf(stderr, "out of memory\n");
+        return 1;
+    }
+    uint32_t count = 0;
+    while (count < numFinds) {
+        count += ReaderSimulatorRun(&simulator, 1, finds + count, numFinds - count);
+    }
+    ReaderSimulatorFree(&simulator);
+
+    EpcTable table;
+    RawFindQueue queue;
+    if (!EpcTableInit(&table, numTags) || !RawFindQueueInit(&queue, QUEUE_CAPACITY)) {
+        fprintf(stderr, "out of memory\n");
+        return 1;
+    }
+    for (uint32_t i = 0; i < numTags; i++) {
+        EpcKey key = ReaderSimulatorTagEpc(&config, i);
+        EpcTableInsert(&table, &key, NULL);
+    }
+
+    printf("%u tags, %u finds, best of %d runs\n", numTags, numFinds, RUNS);
+    double best[3] = { 1e9, 1e9, 1e9 };
+    uint64_t check[3] = { 0, 0, 0 };
+    for (int run = 0; run < RUNS; run++) {
+        double start = now();
+        check[0] = runHeapCopy(finds, numFinds, &table);
+        double middle = now();
+        check[1] = runEpcKey(finds, numFinds, &table);
+        double end = now();
+        check[2] = runQueue(finds, numFinds, &queue);
+        double last = now();
+        best[0] = middle - start < best[0] ? middle - start : best[0];
+        best[1] = end - middle < best[1] ? end - middle : best[1];
+        best[2] = last - end < best[2] ? last - end : best[2];
+    }
+    report("heap copy", best[0], numFinds, check[0]);
+    report("EpcKey", best[1], numFinds, check[1]);
+    report("RawFindQueue", best[2], numFinds, check[2]);
+
+    RawFindQueueFree(&queue);
+    EpcTableFree(&table);
+    free(finds);
+    return 0;
+}
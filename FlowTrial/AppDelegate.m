@@ -9,6 +9,11 @@
 #import "AppDelegate.h"
 #import <Parse/Parse.h>
 #import "Ugi.h"
+#import "InventoryStore.h"
+#import "OfflineWriteQueue.h"
+
+//! Seconds between syncs of the Inventory mirror while the app is active
+#define INVENTORY_SYNC_INTERVAL 60
 
 @interface AppDelegate ()
 
@@ -39,6 +44,8 @@
 - (void)applicationWillResignActive:(UIApplication *)application {
     // Sent when the application is about to move from active to inactive state. This can occur for certain types of temporary interruptions (such as an incoming phone call or SMS message) or when the user quits the application and it begins the transition to the background state.
     // Use this method to pause ongoing tasks, disable timers, and throttle down OpenGL ES frame rates. Games should use this method to pause the game.
+    [[InventoryStore sharedStore] stopSyncing];
+    [[OfflineWriteQueue sharedQueue] stopFlushing];
 }
 
 - (void)applicationDidEnterBackground:(UIApplication *)application {
@@ -52,6 +59,8 @@
 
 - (void)applicationDidBecomeActive:(UIApplication *)application {
     // Restart any tasks that were paused (or not yet started) while the application was inactive. If the application was previously in the background, optionally refresh the user interface.
+    [[InventoryStore sharedStore] startSyncingWithInterval:INVENTORY_SYNC_INTERVAL];
+    [[OfflineWriteQueue sharedQueue] startFlushing];
 }
 
 - (void)applicationWillTerminate:(UIApplication *)application {
@@ -0,0 +1,145 @@
+//
+//  BarcodeIndex.c
+//  FlowTrial
+//
+//  Created by Wade Sellers on 12/29/14.
+//  Copyright (c) 2014 Wade Sellers. All rights reserved.
+//
+
+#include "BarcodeIndex.h"
+
+#include <stdlib.h>
+#include <string.h>
+
+bool BarcodeIndexInit(BarcodeIndex *index, uint32_t capacity) {
+    memset(index, 0, sizeof(*index));
+    index->capacity = capacity > 16 ? capacity : 16;
+    index->entries = malloc(index->capacity * sizeof(BarcodeIndexEntry));
+    index->sorted = true;
+    return index->entries != NULL;
+}
+
+void BarcodeIndexFree(BarcodeIndex *index) {
+    free(index->entries);
+    memset(index, 0, sizeof(*index));
+}
+
+void BarcodeIndexRemoveAll(BarcodeIndex *index) {
+    index->count = 0;
+    index->sorted = true;
+}
+
+//
+// Make room for at least capacity entries
+//
+static bool reserve(BarcodeIndex *index, uint32_t capacity) {
+    if (capacity <= index->capacity) {
+        return true;
+    }
+    uint32_t newCapacity = index->capacity * 2 > capacity ? index->capacity * 2 : capacity;
+    BarcodeIndexEntry *entries = realloc(index->entries, newCapacity * sizeof(BarcodeIndexEntry));
+    if (!entries) {
+        return false;
+    }
+    index->entries = entries;
+    index->capacity = newCapacity;
+    return true;
+}
+
+bool BarcodeIndexAdd(BarcodeIndex *index, int64_t barcode, uint32_t item) {
+    if (!reserve(index, index->count + 1)) {
+        return false;
+    }
+    index->entries[index->count].barcode = barcode;
+    index->entries[index->count].item = item;
+    index->count++;
+    index->sorted = false;
+    return true;
+}
+
+static int compareEntries(const void *a, const void *b) {
+    const BarcodeIndexEntry *x = a, *y = b;
+    if (x->barcode != y->barcode) {
+        return x->barcode < y->barcode ? -1 : 1;
+    }
+    return x->item < y->item ? -1 : x->item > y->item;
+}
+
+void BarcodeIndexSort(BarcodeIndex *index) {
+    if (!index->sorted) {
+        qsort(index->entries, index->count, sizeof(BarcodeIndexEntry), compareEntries);
+        index->sorted = true;
+    }
+}
+
+bool BarcodeIndexMerge(BarcodeIndex *index, BarcodeIndexEntry *entries, uint32_t count) {
+    if (count == 0) {
+        return true;
+    }
+    // Allocate everything first, so running out of memory leaves the index as it was
+    uint32_t maxItem = 0;
+    for (uint32_t i = 0; i < count; i++) {
+        maxItem = entries[i].item > maxItem ? entries[i].item : maxItem;
+    }
+    uint8_t *changed = calloc(maxItem / 8 + 1, 1);
+    if (!changed || !reserve(index, index->count + count)) {
+        free(changed);
+        return false;
+    }
+    BarcodeIndexSort(index);
+    qsort(entries, count, sizeof(BarcodeIndexEntry), compareEntries);
+
+    // Drop the changed items' old entries, keeping the rest in order
+    for (uint32_t i = 0; i < count; i++) {
+        changed[entries[i].item / 8] |= (uint8_t)(1 << (entries[i].item % 8));
+    }
+    uint32_t kept = 0;
+    for (uint32_t i = 0; i < index->count; i++) {
+        uint32_t item = index->entries[i].item;
+        if (item <= maxItem && (changed[item / 8] & (1 << (item % 8)))) {
+            continue;
+        }
+        index->entries[kept++] = index->entries[i];
+    }
+    free(changed);
+
+    // Merge from the back, so nothing is overwritten before it has moved
+    uint32_t i = kept;
+    uint32_t j = count;
+    uint32_t k = kept + count;
+    while (j > 0) {
+        if (i > 0 && compareEntries(&index->entries[i - 1], &entries[j - 1]) > 0) {
+            index->entries[--k] = index->entries[--i];
+        } else {
+            index->entries[--k] = entries[--j];
+        }
+    }
+    index->count = kept + count;
+    return true;
+}
+
+//
+// Position of the first entry with a barcode >= barcode (branch-free halving, so the
+// loop runs the same number of times whatever the data)
+//
+static uint32_t lowerBound(const BarcodeIndex *index, int64_t barcode) {
+    const BarcodeIndexEntry *base = index->entries;
+    uint32_t length = index->count;
+    while (length > 1) {
+        uint32_t half = length / 2;
+        base = base[half - 1].barcode < barcode ? base + half : base;
+        length -= half;
+    }
+    uint32_t position = (uint32_t)(base - index->entries);
+    return length == 1 && base->barcode < barcode ? position + 1 : position;
+}
+
+uint32_t BarcodeIndexFind(const BarcodeIndex *index, int64_t barcode, uint32_t *first) {
+    uint32_t position = lowerBound(index, barcode);
+    uint32_t end = position;
+    while (end < index->count && index->entries[end].barcode == barcode) {
+        end++;
+    }
+    *first = position;
+    return end - position;
+}
@@ -0,0 +1,95 @@
+//
+//  BarcodeIndex.h
+//  FlowTrial
+//
+//  Created by Wade Sellers on 12/29/14.
+//  Copyright (c) 2014 Wade Sellers. All rights reserved.
+//
+
+#ifndef FlowTrial_BarcodeIndex_h
+#define FlowTrial_BarcodeIndex_h
+
+#include <stdbool.h>
+#include <stdint.h>
+
+/**
+ One barcode and the position of its item in the caller's array
+ */
+typedef struct {
+    int64_t barcode;
+    uint32_t item;
+} BarcodeIndexEntry;
+
+/**
+ BarcodeIndex maps numeric barcodes to item positions with a sorted array.
+
+ Entries are added in any order and then sorted once; lookups are a binary search over
+ 16-byte entries (about 14 steps for 10,000 items) and all the items with a barcode are
+ next to each other. When some items change, BarcodeIndexMerge sorts just their entries
+ and merges them in with one pass over the index, rather than sorting it all again.
+ */
+typedef struct {
+    BarcodeIndexEntry *entries;
+    uint32_t count;
+    uint32_t capacity;
+    bool sorted;
+} BarcodeIndex;
+
+/**
+ Initialize an index
+
+ @param index     Index to initialize
+ @param capacity  Number of entries to size for (grows as needed)
+ @return          false if out of memory
+ */
+bool BarcodeIndexInit(BarcodeIndex *index, uint32_t capacity);
+
+/**
+ Free an index's memory
+ */
+void BarcodeIndexFree(BarcodeIndex *index);
+
+/**
+ Remove all entries, keeping the memory
+ */
+void BarcodeIndexRemoveAll(BarcodeIndex *index);
+
+/**
+ Add an entry. BarcodeIndexSort must be called before looking anything up.
+
+ @param index     Index
+ @param barcode   Barcode
+ @param item      Position of the item
+ @return          false if out of memory
+ */
+bool BarcodeIndexAdd(BarcodeIndex *index, int64_t barcode, uint32_t item);
+
+/**
+ Sort the entries added so far (by barcode, then item)
+ */
+void BarcodeIndexSort(BarcodeIndex *index);
+
+/**
+ Replace the entries of some items, keeping the index sorted
+
+ Any entries already in the index for the items in entries are removed, then entries
+ are sorted and merged in: O(count log count) plus one pass over the index.
+
+ @param index     Index (sorted first if it isn't)
+ @param entries   New entries, one per changed item; sorted in place
+ @param count     Number of entries
+ @return          false if out of memory (the index is unchanged)
+ */
+bool BarcodeIndexMerge(BarcodeIndex *index, BarcodeIndexEntry *entries, uint32_t count);
+
+/**
+ Find the items with a barcode
+
+ @param index     Sorted index
+ @param barcode   Barcode
+ @param first     Set to the position in entries of the first match
+ @return          Number of matches (entries[first ..< first + count])
+ */
+uint32_t BarcodeIndexFind(const BarcodeIndex *index, int64_t barcode, uint32_t *first);
+
+#endif
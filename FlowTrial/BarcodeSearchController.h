@@ -0,0 +1,96 @@
+//
+//  BarcodeSearchController.h
+//  FlowTrial
+//
+//  Created by Wade Sellers on 12/31/14.
+//  Copyright (c) 2014 Wade Sellers. All rights reserved.
+//
+
+#import <Foundation/Foundation.h>
+#import "InventoryStore.h"
+
+@class BarcodeSearchController;
+
+/**
+ Told about the results of the latest search, on the main thread
+ */
+@protocol BarcodeSearchControllerDelegate <NSObject>
+
+/**
+ Items were found for the latest search: first those already in the store (if any), then
+ what Parse has, which may be the same items updated, or none
+
+ @param controller  Search controller
+ @param items       InventoryItem objects with the barcode
+ @param barcode     Barcode searched for
+ @param fromCache   YES if the items came from the store and Parse hasn't answered yet
+ */
+- (void) barcodeSearch:(BarcodeSearchController *)controller
+            foundItems:(NSArray *)items
+            forBarcode:(NSNumber *)barcode
+             fromCache:(BOOL)fromCache;
+
+@end
+
+/**
+ Makes the query that searches Parse for a barcode
+
+ @param barcode Barcode to search for
+ @return        Query for the Inventory objects with the barcode
+ */
+typedef PFQuery *(^BarcodeSearchQueryBlock)(NSNumber *barcode);
+
+/**
+ Searches Inventory by barcode as it is typed or scanned.
+
+ Text is searched once it has stopped changing for debounceInterval, so a burst of
+ keystrokes from a handheld scanner costs one search. Each search shows what the
+ InventoryStore has straight away, then asks Parse and shows that. Starting a search
+ cancels the query of the one before it, and results are tagged with the search's
+ generation, so a slow answer to an old search never replaces a newer one. Text that
+ isn't a barcode (cleared, or typed over with letters) cancels the search before it.
+
+ Use from the main thread.
+ */
+@interface BarcodeSearchController : NSObject
+
+//! Store to answer from first and to add what Parse returns to
+@property (readonly, nonatomic) InventoryStore *store;
+
+//! Delegate to report results to
+@property (weak, nonatomic) id<BarcodeSearchControllerDelegate> delegate;
+
+//! Seconds text must stay unchanged before it is searched (default 0.3)
+@property (nonatomic) NSTimeInterval debounceInterval;
+
+//! Makes each search's query (default: Inventory by barcode, InventoryItem's keys only); tests replace it
+@property (nonatomic, copy) BarcodeSearchQueryBlock queryBlock;
+
+/**
+ Create a search controller
+
+ @param store   Store to answer from first
+ @return        New controller
+ */
+- (id) initWithStore:(InventoryStore *)store;
+
+/**
+ Search text once it stops changing. Call as the search text changes.
+
+ @param text    Search text; text that isn't a barcode cancels the search before it
+ */
+- (void) searchText:(NSString *)text;
+
+/**
+ Search text now, skipping the wait. Call when search is pressed.
+
+ @param text    Search text; text that isn't a barcode cancels the search before it
+ */
+- (void) searchTextNow:(NSString *)text;
+
+/**
+ Cancel the search waiting or running; nothing more is reported for it
+ */
+- (void) cancel;
+
+@end
@@ -0,0 +1,123 @@
+//
+//  BarcodeSearchController.m
+//  FlowTrial
+//
+//  Created by Wade Sellers on 12/31/14.
+//  Copyright (c) 2014 Wade Sellers. All rights reserved.
+//
+
+#import <Bolts/BFExecutor.h>
+#import "BarcodeSearchController.h"
+#import "Formatters.h"
+
+#define DEFAULT_DEBOUNCE_INTERVAL 0.3
+
+@interface BarcodeSearchController ()
+
+@property (readwrite, nonatomic) InventoryStore *store;
+@property NSTimer *debounceTimer;
+@property NSString *pendingText;
+
+//! Query of the latest search, while it runs
+@property PFQuery *query;
+@property NSNumber *queryBarcode;
+
+//! Bumped by every search and cancel; results of older generations are dropped
+@property NSUInteger generation;
+
+@end
+
+@implementation BarcodeSearchController
+
+- (id) initWithStore:(InventoryStore *)store {
+    self = [super init];
+    if (self) {
+        self.store = store;
+        self.debounceInterval = DEFAULT_DEBOUNCE_INTERVAL;
+        self.queryBlock = ^PFQuery *(NSNumber *barcode) {
+            PFQuery *query = [PFQuery queryWithClassName:InventoryClassName];
+            [query whereKey:@"barcode" equalTo:barcode];
+            [InventoryItem selectKeysOfQuery:query];
+            return query;
+        };
+    }
+    return self;
+}
+
+- (void) dealloc {
+    [self.query cancel];
+}
+
+- (void) searchText:(NSString *)text {
+    if (![Formatters numberFromString:text]) {
+        // No need to wait: nothing will be searched, and what is showing is out of date
+        [self cancel];
+        return;
+    }
+    [self.debounceTimer invalidate];
+    self.pendingText = text;
+    self.debounceTimer = [NSTimer scheduledTimerWithTimeInterval:self.debounceInterval
+                                                          target:self
+                                                        selector:@selector(debounceTimerFired:)
+                                                        userInfo:nil
+                                                         repeats:NO];
+}
+
+- (void) debounceTimerFired:(NSTimer *)timer {
+    [self searchTextNow:self.pendingText];
+}
+
+- (void) searchTextNow:(NSString *)text {
+    [self.debounceTimer invalidate];
+    self.debounceTimer = nil;
+    self.pendingText = nil;
+
+    NSNumber *barcode = [Formatters numberFromString:text];
+    if (!barcode) {
+        // The results showing are for text that is gone
+        [self cancel];
+        return;
+    }
+    // Typing stopped and search was pressed: the query already running answers both
+    if (self.query && [barcode isEqualToNumber:self.queryBarcode]) {
+        return;
+    }
+    [self.query cancel];
+    NSUInteger generation = ++self.generation;
+
+    NSArray *cached = [self.store itemsForBarcode:barcode.longLongValue];
+    if (cached.count > 0) {
+        [self.delegate barcodeSearch:self foundItems:cached forBarcode:barcode fromCache:YES];
+    }
+
+    PFQuery *query = self.queryBlock(barcode);
+    self.query = query;
+    self.queryBarcode = barcode;
+    [[query findObjectsInBackground] continueWithExecutor:[BFExecutor mainThreadExecutor]
+                                                withBlock:^id(BFTask *task) {
+        if (generation != self.generation) {
+            return nil;  // Superseded
+        }
+        self.query = nil;
+        self.queryBarcode = nil;
+        if (task.error) {
+            NSLog(@"BarcodeSearchController: search for %@ failed: %@", barcode, task.error.userInfo);
+        } else if (!task.exception && !task.isCancelled) {
+            NSArray *items = [self.store addObjects:task.result];
+            [self.delegate barcodeSearch:self foundItems:items forBarcode:barcode fromCache:NO];
+        }
+        return nil;
+    }];
+}
+
+- (void) cancel {
+    [self.debounceTimer invalidate];
+    self.debounceTimer = nil;
+    self.pendingText = nil;
+    [self.query cancel];
+    self.query = nil;
+    self.queryBarcode = nil;
+    self.generation++;
+}
+
+@end
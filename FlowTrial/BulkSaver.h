@@ -0,0 +1,85 @@
+//
+//  BulkSaver.h
+//  FlowTrial
+//
+//  Created by Wade Sellers on 12/31/14.
+//  Copyright (c) 2014 Wade Sellers. All rights reserved.
+//
+
+#import <Foundation/Foundation.h>
+#import <Bolts/BFTask.h>
+#import <Parse/Parse.h>
+
+//! Error domain for saves that didn't complete
+extern NSString * const BulkSaverErrorDomain;
+
+//! Error code: some objects could not be saved (NSUnderlyingErrorKey has the last Parse error)
+#define BULK_SAVER_ERROR_INCOMPLETE 1
+
+//! Error userInfo key: the objects that were not saved (NSArray)
+extern NSString * const BulkSaverFailedObjectsKey;
+
+//! Error userInfo key: the objects that were saved (NSArray)
+extern NSString * const BulkSaverSavedObjectsKey;
+
+/**
+ Called on the main thread as batches are saved
+
+ @param saved   Objects saved so far
+ @param total   Objects to save
+ */
+typedef void (^BulkSaverProgressHandler)(NSUInteger saved, NSUInteger total);
+
+/**
+ Sends one batch
+
+ @param objects PFObjects in the batch
+ @return        Task that completes when the request does; fails if any object wasn't saved
+ */
+typedef BFTask *(^BulkSaverSaveBlock)(NSArray *objects);
+
+/**
+ Saves many PFObjects with a few requests instead of one request each.
+
+ Objects are split into batches of batchSize, each saved with saveAllInBackground: (one
+ request to Parse's batch endpoint for up to 50 objects). Up to maxConcurrentBatches
+ batches are in flight at once, shared by every save running on this saver; the rest
+ wait their turn. A batch that fails for a reason worth retrying (no connection, a
+ timeout, a server error) is retried up to maxAttempts times, waiting retryDelay, then
+ twice that, and so on (with jitter, so batches that failed together don't retry
+ together); any other failure is final for that batch. Objects a failed attempt did save
+ are no longer dirty, so a retry only sends what is left, and when a batch fails for good
+ those objects are reported as saved, not failed.
+
+ Use from the main thread.
+ */
+@interface BulkSaver : NSObject
+
+//! Objects per request (default 50, Parse's batch limit)
+@property (nonatomic) NSUInteger batchSize;
+
+//! Most batches in flight at once (default 4)
+@property (nonatomic) NSUInteger maxConcurrentBatches;
+
+//! Attempts per batch, including the first (default 5)
+@property (nonatomic) NSUInteger maxAttempts;
+
+//! Seconds before the first retry of a batch, doubling each retry (default 1)
+@property (nonatomic) NSTimeInterval retryDelay;
+
+//! Sends each batch (default: +[PFObject saveAllInBackground:]); tests replace it
+@property (nonatomic, copy) BulkSaverSaveBlock saveBlock;
+
+/**
+ Save objects
+
+ @param objects     PFObjects to save
+ @param progress    Called as batches are saved (may be nil)
+ @return            Task whose result is the objects, once all are saved. If any batch
+                    fails for good, the task fails once the other batches are done, with
+                    a BULK_SAVER_ERROR_INCOMPLETE error that lists what was and wasn't saved.
+ */
+- (BFTask *) saveObjects:(NSArray *)objects
+                progress:(BulkSaverProgressHandler)progress;
+
+@end
@@ -0,0 +1,209 @@
+//
+//  BulkSaver.m
+//  FlowTrial
+//
+//  Created by Wade Sellers on 12/31/14.
+//  Copyright (c) 2014 Wade Sellers. All rights reserved.
+//
+
+#import <Bolts/BFExecutor.h>
+#import <Bolts/BFTaskCompletionSource.h>
+#import "BulkSaver.h"
+
+NSString * const BulkSaverErrorDomain = @"BulkSaverErrorDomain";
+NSString * const BulkSaverFailedObjectsKey = @"failedObjects";
+NSString * const BulkSaverSavedObjectsKey = @"savedObjects";
+
+#define DEFAULT_BATCH_SIZE 50
+#define DEFAULT_MAX_CONCURRENT_BATCHES 4
+#define DEFAULT_MAX_ATTEMPTS 5
+#define DEFAULT_RETRY_DELAY 1.0
+
+///////////////////////////////////////////////////////////////////////////////////////
+#pragma mark - BulkSaveJob
+///////////////////////////////////////////////////////////////////////////////////////
+
+/**
+ One call to saveObjects:progress:
+ */
+@interface BulkSaveJob : NSObject
+
+@property (nonatomic) NSUInteger total;
+@property (nonatomic) NSUInteger unfinishedBatches;
+@property (nonatomic) NSMutableArray *savedObjects;
+@property (nonatomic) NSMutableArray *failedObjects;
+@property (nonatomic) NSError *lastError;
+@property (nonatomic, copy) BulkSaverProgressHandler progress;
+@property (nonatomic) BFTaskCompletionSource *source;
+
+@end
+
+@implementation BulkSaveJob
+@end
+
+/**
+ Objects saved with one request
+ */
+@interface BulkSaveBatch : NSObject
+
+@property (nonatomic) NSArray *objects;
+@property (nonatomic) NSUInteger attempts;
+@property (nonatomic) BulkSaveJob *job;
+
+@end
+
+@implementation BulkSaveBatch
+@end
+
+///////////////////////////////////////////////////////////////////////////////////////
+#pragma mark - BulkSaver
+///////////////////////////////////////////////////////////////////////////////////////
+
+@interface BulkSaver ()
+
+@property NSMutableArray *waitingBatches;
+@property NSUInteger runningBatches;
+
+@end
+
+@implementation BulkSaver
+
+- (id) init {
+    self = [super init];
+    if (self) {
+        self.batchSize = DEFAULT_BATCH_SIZE;
+        self.maxConcurrentBatches = DEFAULT_MAX_CONCURRENT_BATCHES;
+        self.maxAttempts = DEFAULT_MAX_ATTEMPTS;
+        self.retryDelay = DEFAULT_RETRY_DELAY;
+        self.saveBlock = ^BFTask *(NSArray *objects) {
+            return [PFObject saveAllInBackground:objects];
+        };
+        self.waitingBatches = [NSMutableArray array];
+    }
+    return self;
+}
+
+- (BFTask *) saveObjects:(NSArray *)objects
+                progress:(BulkSaverProgressHandler)progress {
+    if (objects.count == 0) {
+        return [BFTask taskWithResult:@[]];
+    }
+    BulkSaveJob *job = [[BulkSaveJob alloc] init];
+    job.total = objects.count;
+    job.savedObjects = [NSMutableArray arrayWithCapacity:objects.count];
+    job.failedObjects = [NSMutableArray array];
+    job.progress = progress;
+    job.source = [BFTaskCompletionSource taskCompletionSource];
+
+    NSUInteger batchSize = MAX(self.batchSize, 1);
+    for (NSUInteger start = 0; start < objects.count; start += batchSize) {
+        BulkSaveBatch *batch = [[BulkSaveBatch alloc] init];
+        batch.objects = [objects subarrayWithRange:NSMakeRange(start, MIN(batchSize, objects.count - start))];
+        batch.job = job;
+        job.unfinishedBatches++;
+        [self.waitingBatches addObject:batch];
+    }
+    [self startBatches];
+    return job.source.task;
+}
+
+#pragma mark - Batches
+
+//
+// Start waiting batches while there is room
+//
+- (void) startBatches {
+    while (self.runningBatches < MAX(self.maxConcurrentBatches, 1) && self.waitingBatches.count > 0) {
+        BulkSaveBatch *batch = self.waitingBatches[0];
+        [self.waitingBatches removeObjectAtIndex:0];
+        self.runningBatches++;
+        batch.attempts++;
+
+        [self.saveBlock(batch.objects) continueWithExecutor:[BFExecutor mainThreadExecutor]
+                                                  withBlock:^id(BFTask *task) {
+            self.runningBatches--;
+            if (task.error || task.exception || task.isCancelled) {
+                [self batch:batch failedWithError:task.error];
+            } else {
+                [self batchSaved:batch];
+            }
+            [self startBatches];
+            return nil;
+        }];
+    }
+}
+
+- (void) batchSaved:(BulkSaveBatch *)batch {
+    BulkSaveJob *job = batch.job;
+    [job.savedObjects addObjectsFromArray:batch.objects];
+    if (job.progress) {
+        job.progress(job.savedObjects.count, job.total);
+    }
+    [self finishBatch:batch];
+}
+
+- (void) batch:(BulkSaveBatch *)batch failedWithError:(NSError *)error {
+    if (error && [self isTransientError:error] && batch.attempts < self.maxAttempts) {
+        // Back off: retryDelay * 2^(attempts - 1), less up to half at random
+        NSTimeInterval delay = self.retryDelay * (1 << MIN(batch.attempts - 1, 16));
+        delay *= 0.5 + 0.5 * arc4random_uniform(1001) / 1000.0;
+        NSLog(@"BulkSaver: attempt %lu of %lu objects failed, retrying in %.1fs: %@",
+              (unsigned long)batch.attempts, (unsigned long)batch.objects.count, delay, error);
+        dispatch_after(dispatch_time(DISPATCH_TIME_NOW, (int64_t)(delay * NSEC_PER_SEC)), dispatch_get_main_queue(), ^{
+            [self.waitingBatches insertObject:batch atIndex:0];
+            [self startBatches];
+        });
+        return;
+    }
+    // The batch endpoint saves objects one by one, so an attempt that failed may have
+    // saved some of them
+    BulkSaveJob *job = batch.job;
+    for (PFObject *object in batch.objects) {
+        if (object.objectId && !object.isDirty) {
+            [job.savedObjects addObject:object];
+        } else {
+            [job.failedObjects addObject:object];
+        }
+    }
+    if (error) {
+        job.lastError = error;
+    }
+    [self finishBatch:batch];
+}
+
+- (void) finishBatch:(BulkSaveBatch *)batch {
+    BulkSaveJob *job = batch.job;
+    if (--job.unfinishedBatches > 0) {
+        return;
+    }
+    if (job.failedObjects.count == 0) {
+        [job.source setResult:job.savedObjects];
+        return;
+    }
+    NSMutableDictionary *userInfo = [NSMutableDictionary dictionary];
+    userInfo[NSLocalizedDescriptionKey] = [NSString stringWithFormat:@"%lu of %lu objects could not be saved",
+                                           (unsigned long)job.failedObjects.count, (unsigned long)job.total];
+    userInfo[BulkSaverFailedObjectsKey] = job.failedObjects;
+    userInfo[BulkSaverSavedObjectsKey] = job.savedObjects;
+    if (job.lastError) {
+        userInfo[NSUnderlyingErrorKey] = job.lastError;
+    }
+    [job.source setError:[NSError errorWithDomain:BulkSaverErrorDomain
+                                             code:BULK_SAVER_ERROR_INCOMPLETE
+                                         userInfo:userInfo]];
+}
+
+//
+// Errors that say nothing about the objects themselves, so trying again may work
+//
+- (BOOL) isTransientError:(NSError *)error {
+    if ([error.domain isEqualToString:NSURLErrorDomain]) {
+        return YES;
+    }
+    return [error.domain isEqualToString:PFParseErrorDomain] &&
+           (error.code == kPFErrorConnectionFailed ||
+            error.code == kPFErrorTimeout ||
+            error.code == kPFErrorInternalServer);
+}
+
+@end
@@ -0,0 +1,40 @@
+//
+//  CloudLoginService.h
+//  FlowTrial
+//
+//  Created by Wade Sellers on 12/31/14.
+//  Copyright (c) 2014 Wade Sellers. All rights reserved.
+//
+
+#import <Foundation/Foundation.h>
+#import "LoginService.h"
+
+/**
+ LoginService backed by the "logIn" and "signUp" Cloud Code functions (cloud/main.js):
+ one request each, answered by a lookup on the User class's username.
+
+ Both are called with "username", "password" and "keys" (LoginServiceUserKeys()). logIn
+ finds the one User with that username, selecting only the password and the keys,
+ compares the password on the server, and responds with { "sessionToken": ..., "user":
+ { "objectId": ..., keys... } }; signUp creates the User and responds the same way. A
+ beforeSave on User keeps usernames unique. Failures come back as script errors whose
+ message is "BAD_LOGIN" or "USERNAME_TAKEN".
+ */
+@interface CloudLoginService : NSObject <LoginService>
+
+//! Name of the log in Cloud Code function (default "logIn")
+@property (nonatomic) NSString *functionName;
+
+//! Name of the sign up Cloud Code function (default "signUp")
+@property (nonatomic) NSString *signUpFunctionName;
+
+/**
+ The LoginService error for an error from a Cloud Code function
+
+ @param error   Error the function call failed with
+ @return        LOGIN_SERVICE_ERROR_BAD_LOGIN or LOGIN_SERVICE_ERROR_USERNAME_TAKEN (with
+                error as NSUnderlyingErrorKey), or error itself if it is neither
+ */
++ (NSError *) loginErrorWithCloudError:(NSError *)error;
+
+@end
@@ -0,0 +1,81 @@
+//
+//  CloudLoginService.m
+//  FlowTrial
+//
+//  Created by Wade Sellers on 12/31/14.
+//  Copyright (c) 2014 Wade Sellers. All rights reserved.
+//
+
+#import <Bolts/BFExecutor.h>
+#import "CloudLoginService.h"
+
+#define DEFAULT_FUNCTION_NAME @"logIn"
+#define DEFAULT_SIGN_UP_FUNCTION_NAME @"signUp"
+
+// Messages of the script errors the functions fail with (cloud/main.js)
+static NSString * const BadLoginMessage = @"BAD_LOGIN";
+static NSString * const UsernameTakenMessage = @"USERNAME_TAKEN";
+
+@implementation CloudLoginService
+
+- (id) init {
+    self = [super init];
+    if (self) {
+        self.functionName = DEFAULT_FUNCTION_NAME;
+        self.signUpFunctionName = DEFAULT_SIGN_UP_FUNCTION_NAME;
+    }
+    return self;
+}
+
++ (NSError *) loginErrorWithCloudError:(NSError *)error {
+    if (![error.domain isEqualToString:PFParseErrorDomain]) {
+        return error;
+    }
+    NSString *message = error.userInfo[@"error"];
+    NSInteger code;
+    if (error.code == kPFErrorObjectNotFound ||
+        ([message isKindOfClass:[NSString class]] && [message isEqualToString:BadLoginMessage])) {
+        code = LOGIN_SERVICE_ERROR_BAD_LOGIN;
+    } else if (error.code == kPFErrorUsernameTaken ||
+               ([message isKindOfClass:[NSString class]] && [message isEqualToString:UsernameTakenMessage])) {
+        code = LOGIN_SERVICE_ERROR_USERNAME_TAKEN;
+    } else {
+        return error;
+    }
+    return [NSError errorWithDomain:LoginServiceErrorDomain code:code userInfo:@{ NSUnderlyingErrorKey: error }];
+}
+
+- (BFTask *) logInWithUsername:(NSString *)username password:(NSString *)password {
+    return [self callFunction:self.functionName username:username password:password];
+}
+
+- (BFTask *) signUpWithUsername:(NSString *)username password:(NSString *)password {
+    return [self callFunction:self.signUpFunctionName username:username password:password];
+}
+
+//
+// Call logIn or signUp, which answer the same way
+//
+- (BFTask *) callFunction:(NSString *)functionName username:(NSString *)username password:(NSString *)password {
+    NSDictionary *parameters = @{ @"username": username ?: @"",
+                                  @"password": password ?: @"",
+                                  @"keys": LoginServiceUserKeys() };
+    return [[PFCloud callFunctionInBackground:functionName withParameters:parameters]
+            continueWithExecutor:[BFExecutor mainThreadExecutor] withBlock:^id(BFTask *task) {
+        if (task.error) {
+            return [BFTask taskWithError:[CloudLoginService loginErrorWithCloudError:task.error]];
+        }
+        if (task.exception || task.isCancelled) {
+            return task;
+        }
+        LoginSession *session = [LoginSession sessionWithResponse:task.result];
+        if (!session) {
+            return [BFTask taskWithError:[NSError errorWithDomain:LoginServiceErrorDomain
+                                                             code:LOGIN_SERVICE_ERROR_BAD_RESPONSE
+                                                         userInfo:nil]];
+        }
+        return session;
+    }];
+}
+
+@end
@@ -0,0 +1,58 @@
+//
+//  EpcFilter.c
+//  FlowTrial
+//
+//  Created by Wade Sellers on 12/19/14.
+//  Copyright (c) 2014 Wade Sellers. All rights reserved.
+//
+
+#include "EpcFilter.h"
+
+#include <stdlib.h>
+
+//! Bloom filter bits per EPC; with 8 bits set per EPC, about 0.1% false positives or fewer
+#define EPC_FILTER_BITS_PER_KEY 16
+
+static void addToBloom(EpcFilter *filter, const EpcKey *key) {
+    uint64_t *block = filter->blocks + (size_t)(key->hash & filter->blockMask) * 8;
+    uint64_t bits = EpcFilterBlockBits(key->hash);
+    for (int word = 0; word < 8; word++, bits >>= 6) {
+        block[word] |= (uint64_t)1 << (bits & 63);
+    }
+}
+
+EpcFilter *EpcFilterCreate(const EpcKey *keys, uint32_t count, bool ignore) {
+    EpcFilter *filter = calloc(1, sizeof(EpcFilter));
+    if (!filter) {
+        return NULL;
+    }
+    filter->ignore = ignore;
+
+    uint64_t bits = (uint64_t)count * EPC_FILTER_BITS_PER_KEY;
+    uint32_t numBlocks = 1;
+    while ((uint64_t)numBlocks * 512 < bits) {
+        numBlocks <<= 1;
+    }
+    filter->blocks = calloc((size_t)numBlocks * 8, sizeof(uint64_t));
+    filter->blockMask = numBlocks - 1;
+    if (!filter->blocks || !EpcTableInit(&filter->exact, count)) {
+        EpcFilterFree(filter);
+        return NULL;
+    }
+    for (uint32_t i = 0; i < count; i++) {
+        if (EpcTableInsert(&filter->exact, &keys[i], NULL) == EPC_TABLE_NOT_FOUND) {
+            EpcFilterFree(filter);
+            return NULL;
+        }
+        addToBloom(filter, &keys[i]);
+    }
+    return filter;
+}
+
+void EpcFilterFree(EpcFilter *filter) {
+    if (filter) {
+        free(filter->blocks);
+        EpcTableFree(&filter->exact);
+        free(filter);
+    }
+}
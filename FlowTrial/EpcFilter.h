@@ -0,0 +1,105 @@
+//
+//  EpcFilter.h
+//  FlowTrial
+//
+//  Created by Wade Sellers on 12/19/14.
+//  Copyright (c) 2014 Wade Sellers. All rights reserved.
+//
+
+#ifndef FlowTrial_EpcFilter_h
+#define FlowTrial_EpcFilter_h
+
+#include <stdbool.h>
+#include <stdint.h>
+
+#include "EpcKey.h"
+#include "EpcTable.h"
+
+/**
+ A compiled EPC filter: a list of EPCs to find (or to ignore), built once and then
+ tested against every raw find on the reader's thread.
+
+ The test is in two steps. A blocked Bloom filter (one 512-bit block per EPC, picked
+ by the EPC's hash, with 8 bits set inside that block) rejects all but about 0.1% of
+ the EPCs not in the list with a single cache line read. EPCs that get past it are checked
+ exactly against an EpcTable. So the cost per find barely depends on the list's length:
+ one block read, plus an exact lookup only for EPCs in the list and the few false positives.
+ */
+typedef struct {
+    uint64_t *blocks;         //!< Bloom filter, 8 words per block
+    uint32_t blockMask;       //!< Number of blocks - 1
+    EpcTable exact;           //!< The EPCs themselves
+    bool ignore;              //!< true if the list is EPCs to ignore rather than EPCs to find
+} EpcFilter;
+
+/**
+ Build a filter
+
+ @param keys    EPCs
+ @param count   Number of EPCs
+ @param ignore  true to ignore these EPCs, false to find only these EPCs
+ @return        New filter (free with EpcFilterFree), NULL if out of memory
+ */
+EpcFilter *EpcFilterCreate(const EpcKey *keys, uint32_t count, bool ignore);
+
+/**
+ Free a filter
+ */
+void EpcFilterFree(EpcFilter *filter);
+
+/**
+ The bits an EPC sets in its Bloom block, 6 bits per word: a 64-bit mix (the splitmix64
+ finalizer) of the EPC's hash. The block is picked by the hash's low bits, and every bit
+ of the mix depends on all of the hash, so the bits within a block don't follow from
+ which block it is.
+ */
+static inline uint64_t EpcFilterBlockBits(uint32_t hash) {
+    uint64_t h = hash * 0x9E3779B97F4A7C15ull;
+    h = (h ^ (h >> 30)) * 0xBF58476D1CE4E5B9ull;
+    h = (h ^ (h >> 27)) * 0x94D049BB133111EBull;
+    return h ^ (h >> 31);
+}
+
+/**
+ Might the EPC be in the filter's list? The Bloom filter step only: false for nearly
+ every EPC that isn't, never false for one that is.
+
+ @param filter  Filter
+ @param key     EPC
+ @return        false if the EPC is certainly not in the list
+ */
+static inline bool EpcFilterMayContain(const EpcFilter *filter, const EpcKey *key) {
+    const uint64_t *block = filter->blocks + (size_t)(key->hash & filter->blockMask) * 8;
+    // One bit per 64-bit word
+    uint64_t bits = EpcFilterBlockBits(key->hash);
+    for (int word = 0; word < 8; word++, bits >>= 6) {
+        if (!(block[word] & ((uint64_t)1 << (bits & 63)))) {
+            return false;
+        }
+    }
+    return true;
+}
+
+/**
+ Is the EPC in the filter's list?
+
+ @param filter  Filter
+ @param key     EPC
+ @return        true if the EPC is in the list
+ */
+static inline bool EpcFilterContains(const EpcFilter *filter, const EpcKey *key) {
+    return EpcFilterMayContain(filter, key) && EpcTableFind(&filter->exact, key) != EPC_TABLE_NOT_FOUND;
+}
+
+/**
+ Should a find be kept?
+
+ @param filter  Filter
+ @param key     EPC found
+ @return        true to keep the find, false to filter it out
+ */
+static inline bool EpcFilterAccepts(const EpcFilter *filter, const EpcKey *key) {
+    return EpcFilterContains(filter, key) != filter->ignore;
+}
+
+#endif
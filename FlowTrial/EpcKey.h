@@ -0,0 +1,104 @@
+//
+//  EpcKey.h
+//  FlowTrial
+//
+//  Created by Wade Sellers on 12/16/14.
+//  Copyright (c) 2014 Wade Sellers. All rights reserved.
+//
+
+#ifndef FlowTrial_EpcKey_h
+#define FlowTrial_EpcKey_h
+
+#include <stdbool.h>
+#include <stdint.h>
+#include <string.h>
+
+///////////////////////////////////////////////////////////////////////////////////////
+#pragma mark - Constants and Types
+///////////////////////////////////////////////////////////////////////////////////////
+
+//! Same as UGI_MAX_EPC_LENGTH, repeated here so this header does not need Foundation
+#define EPC_KEY_MAX_LENGTH 27
+
+/**
+ EpcKey is a fixed-size value type for an EPC code.
+
+ UgiEpc keeps its bytes in an NSData, so every find costs an object plus a buffer.
+ EpcKey keeps the bytes inline (unused bytes are always zero) along with the length
+ and a precomputed hash, so it can be copied by assignment, stored in plain C arrays
+ and compared without touching the heap. The whole struct is 32 bytes.
+ */
+typedef struct {
+    uint8_t bytes[EPC_KEY_MAX_LENGTH];  //!< EPC bytes, zero filled past length
+    uint8_t length;                     //!< Number of valid bytes
+    uint32_t hash;                      //!< EpcKeyHashBytes(bytes, length)
+} EpcKey;
+
+///////////////////////////////////////////////////////////////////////////////////////
+#pragma mark - Functions
+///////////////////////////////////////////////////////////////////////////////////////
+
+/**
+ Hash EPC bytes (32-bit FNV-1a)
+
+ @param bytes   EPC bytes
+ @param length  Number of bytes
+ @return        Hash value
+ */
+static inline uint32_t EpcKeyHashBytes(const uint8_t *bytes, int length) {
+    uint32_t hash = 2166136261u;
+    for (int i = 0; i < length; i++) {
+        hash ^= bytes[i];
+        hash *= 16777619u;
+    }
+    return hash;
+}
+
+/**
+ Create an EpcKey from raw bytes. Bytes past EPC_KEY_MAX_LENGTH are ignored.
+
+ @param bytes   EPC bytes
+ @param length  Number of bytes
+ @return        EpcKey value
+ */
+static inline EpcKey EpcKeyMake(const uint8_t *bytes, int length) {
+    EpcKey key;
+    if (length < 0) {
+        length = 0;
+    } else if (length > EPC_KEY_MAX_LENGTH) {
+        length = EPC_KEY_MAX_LENGTH;
+    }
+    memset(key.bytes, 0, sizeof(key.bytes));
+    if (length > 0) {
+        memcpy(key.bytes, bytes, (size_t)length);
+    }
+    key.length = (uint8_t)length;
+    key.hash = EpcKeyHashBytes(key.bytes, length);
+    return key;
+}
+
+/**
+ Are two keys the same EPC?
+
+ The hash is checked first; since unused bytes are zero the rest is a single
+ fixed-size compare.
+ */
+static inline bool EpcKeyEqual(const EpcKey *a, const EpcKey *b) {
+    return a->hash == b->hash &&
+           memcmp(a->bytes, b->bytes, EPC_KEY_MAX_LENGTH + 1) == 0;
+}
+
+/**
+ Order two keys (bytes first, then length), for sorting
+
+ @return  <0, 0 or >0 like memcmp
+ */
+static inline int EpcKeyCompare(const EpcKey *a, const EpcKey *b) {
+    int result = memcmp(a->bytes, b->bytes, EPC_KEY_MAX_LENGTH);
+    if (result != 0) {
+        return result;
+    }
+    return (int)a->length - (int)b->length;
+}
+
+#endif
@@ -0,0 +1,133 @@
+//
+//  EpcTable.c
+//  FlowTrial
+//
+//  Created by Wade Sellers on 12/17/14.
+//  Copyright (c) 2014 Wade Sellers. All rights reserved.
+//
+
+#include "EpcTable.h"
+
+#include <stdlib.h>
+
+#define EPC_TABLE_MIN_SLOTS 16
+
+static uint32_t slotCountForCapacity(uint32_t capacity) {
+    uint32_t slots = EPC_TABLE_MIN_SLOTS;
+    while (slots < capacity * 2) {
+        slots <<= 1;
+    }
+    return slots;
+}
+
+static bool allocateSlots(EpcTable *table, uint32_t numSlots) {
+    uint32_t *hashes = calloc(numSlots, sizeof(uint32_t));
+    uint32_t *indexes = calloc(numSlots, sizeof(uint32_t));
+    if (!hashes || !indexes) {
+        free(hashes);
+        free(indexes);
+        return false;
+    }
+    free(table->slotHashes);
+    free(table->slotIndexes);
+    table->slotHashes = hashes;
+    table->slotIndexes = indexes;
+    table->slotMask = numSlots - 1;
+    return true;
+}
+
+static void placeInSlot(EpcTable *table, uint32_t hash, uint32_t index) {
+    uint32_t slot = hash & table->slotMask;
+    while (table->slotIndexes[slot] != 0) {
+        slot = (slot + 1) & table->slotMask;
+    }
+    table->slotHashes[slot] = hash;
+    table->slotIndexes[slot] = index + 1;
+}
+
+//
+// On failure the table keeps its old capacity and slots, and stays usable
+//
+static bool grow(EpcTable *table) {
+    if (table->keyCapacity > UINT32_MAX / 4) {
+        return false;
+    }
+    uint32_t keyCapacity = table->keyCapacity * 2;
+    EpcKey *keys = realloc(table->keys, keyCapacity * sizeof(EpcKey));
+    if (!keys) {
+        return false;
+    }
+    // The bigger array is kept either way; the capacity only changes once the slots match it
+    table->keys = keys;
+    if (!allocateSlots(table, slotCountForCapacity(keyCapacity))) {
+        return false;
+    }
+    table->keyCapacity = keyCapacity;
+    for (uint32_t i = 0; i < table->count; i++) {
+        placeInSlot(table, table->keys[i].hash, i);
+    }
+    return true;
+}
+
+bool EpcTableInit(EpcTable *table, uint32_t capacity) {
+    memset(table, 0, sizeof(*table));
+    if (capacity < EPC_TABLE_MIN_SLOTS / 2) {
+        capacity = EPC_TABLE_MIN_SLOTS / 2;
+    }
+    table->keys = malloc(capacity * sizeof(EpcKey));
+    if (!table->keys || !allocateSlots(table, slotCountForCapacity(capacity))) {
+        EpcTableFree(table);
+        return false;
+    }
+    table->keyCapacity = capacity;
+    return true;
+}
+
+void EpcTableFree(EpcTable *table) {
+    free(table->keys);
+    free(table->slotHashes);
+    free(table->slotIndexes);
+    memset(table, 0, sizeof(*table));
+}
+
+void EpcTableRemoveAll(EpcTable *table) {
+    if (table->slotIndexes) {
+        memset(table->slotIndexes, 0, (table->slotMask + 1) * sizeof(uint32_t));
+    }
+    table->count = 0;
+}
+
+uint32_t EpcTableFind(const EpcTable *table, const EpcKey *key) {
+    if (!table->slotIndexes) {
+        return EPC_TABLE_NOT_FOUND;
+    }
+    uint32_t slot = key->hash & table->slotMask;
+    uint32_t index;
+    while ((index = table->slotIndexes[slot]) != 0) {
+        if (table->slotHashes[slot] == key->hash && EpcKeyEqual(&table->keys[index - 1], key)) {
+            return index - 1;
+        }
+        slot = (slot + 1) & table->slotMask;
+    }
+    return EPC_TABLE_NOT_FOUND;
+}
+
+uint32_t EpcTableInsert(EpcTable *table, const EpcKey *key, bool *inserted) {
+    if (inserted) {
+        *inserted = false;
+    }
+    uint32_t index = EpcTableFind(table, key);
+    if (index != EPC_TABLE_NOT_FOUND) {
+        return index;
+    }
+    if (!table->keys || (table->count == table->keyCapacity && !grow(table))) {
+        return EPC_TABLE_NOT_FOUND;
+    }
+    index = table->count++;
+    table->keys[index] = *key;
+    placeInSlot(table, key->hash, index);
+    if (inserted) {
+        *inserted = true;
+    }
+    return index;
+}
@@ -0,0 +1,76 @@
+//
+//  EpcTable.h
+//  FlowTrial
+//
+//  Created by Wade Sellers on 12/17/14.
+//  Copyright (c) 2014 Wade Sellers. All rights reserved.
+//
+
+#ifndef FlowTrial_EpcTable_h
+#define FlowTrial_EpcTable_h
+
+#include <stdbool.h>
+#include <stdint.h>
+
+#include "EpcKey.h"
+
+//! Returned by EpcTableFind when the key is not present, and by EpcTableInsert if out of memory
+#define EPC_TABLE_NOT_FOUND UINT32_MAX
+
+/**
+ EpcTable is an open-addressing hash set of EpcKeys.
+
+ Keys are kept densely in insertion order (keys[0..count-1]), so the position of a key
+ is a stable index callers can use for their own parallel arrays, and iterating is a
+ straight walk over memory. The slot arrays only hold (hash, index+1) pairs; probing is
+ linear and compares the 32-bit hashes before touching a key, so a probe sequence stays
+ inside one or two cache lines. The table grows to keep the load factor under 1/2.
+ */
+typedef struct {
+    EpcKey *keys;             //!< Keys in insertion order
+    uint32_t count;           //!< Number of keys
+    uint32_t keyCapacity;     //!< Allocated size of keys
+    uint32_t *slotHashes;     //!< Hash of the key in each slot
+    uint32_t *slotIndexes;    //!< Index into keys + 1, 0 for an empty slot
+    uint32_t slotMask;        //!< Number of slots - 1 (number of slots is a power of 2)
+} EpcTable;
+
+/**
+ Initialize a table
+
+ @param table     Table to initialize
+ @param capacity  Number of keys to size for (the table grows past this as needed)
+ @return          false if out of memory
+ */
+bool EpcTableInit(EpcTable *table, uint32_t capacity);
+
+/**
+ Free a table's memory (the table can be initialized again afterwards)
+ */
+void EpcTableFree(EpcTable *table);
+
+/**
+ Remove all keys, keeping the memory
+ */
+void EpcTableRemoveAll(EpcTable *table);
+
+/**
+ Find a key
+
+ @param table  Table to search
+ @param key    Key to find
+ @return       Index of the key, or EPC_TABLE_NOT_FOUND
+ */
+uint32_t EpcTableFind(const EpcTable *table, const EpcKey *key);
+
+/**
+ Add a key if it is not already present
+
+ @param table     Table to add to
+ @param key       Key to add
+ @param inserted  Set to true if the key was added, false if it was already there (may be NULL)
+ @return          Index of the key, or EPC_TABLE_NOT_FOUND if out of memory
+ */
+uint32_t EpcTableInsert(EpcTable *table, const EpcKey *key, bool *inserted);
+
+#endif
@@ -0,0 +1,50 @@
+//
+//  Formatters.h
+//  FlowTrial
+//
+//  Created by Wade Sellers on 12/30/14.
+//  Copyright (c) 2014 Wade Sellers. All rights reserved.
+//
+
+#import <Foundation/Foundation.h>
+
+/**
+ Shared date and number formatting, safe to call from any thread.
+
+ NSDateFormatter and NSNumberFormatter are expensive to create and the app shows hundreds
+ of items at a time, so formatters are never created per call. The MM/dd/yyyy dates the
+ app shows go through a fast path that does the calendar arithmetic directly, without
+ ICU: the time zone offset comes from a small cache of daylight saving spans, and the
+ day, month and year from integer arithmetic. When the user's locale would format
+ differently (a non-Gregorian calendar, or non-ASCII digits), which is checked once per
+ locale change by comparing with a real NSDateFormatter, everything goes through a
+ cached NSDateFormatter instead.
+ */
+@interface Formatters : NSObject
+
+/**
+ Format a date as MM/dd/yyyy in the default time zone, like an NSDateFormatter with
+ that format
+
+ @param date    Date (nil gives nil)
+ @return        Formatted date
+ */
++ (NSString *) shortDateString:(NSDate *)date;
+
+/**
+ Parse a number like an NSNumberFormatter with NSNumberFormatterDecimalStyle. Plain
+ digits (barcodes) are parsed directly.
+
+ @param string  String to parse
+ @return        Number, nil if string isn't one
+ */
++ (NSNumber *) numberFromString:(NSString *)string;
+
+/**
+ Stop using the fast path, for comparing against NSDateFormatter in tests and benchmarks
+
+ @param enabled NO to always use NSDateFormatter
+ */
++ (void) setFastPathEnabled:(BOOL)enabled;
+
+@end
@@ -0,0 +1,256 @@
+//
+//  Formatters.m
+//  FlowTrial
+//
+//  Created by Wade Sellers on 12/30/14.
+//  Copyright (c) 2014 Wade Sellers. All rights reserved.
+//
+
+#import <pthread.h>
+#import "Formatters.h"
+
+#define SHORT_DATE_FORMAT @"MM/dd/yyyy"
+#define SHORT_DATE_LENGTH 10
+#define SECONDS_PER_DAY 86400
+
+//! Time zone offset spans kept (a few years' worth of daylight saving periods)
+#define OFFSET_SPAN_CACHE_SIZE 8
+
+//! How far either side of a date to look for daylight saving transitions
+#define TRANSITION_SEARCH_SECONDS (400.0 * SECONDS_PER_DAY)
+
+//! Years the fast path handles; NSDateFormatter switches to the Julian calendar before 1582
+#define FAST_PATH_MIN_YEAR 1600
+#define FAST_PATH_MAX_YEAR 9999
+
+static NSString * const DateFormatterKey = @"Formatters.date";
+static NSString * const NumberFormatterKey = @"Formatters.number";
+
+/**
+ A stretch of time with one offset from GMT
+ */
+typedef struct {
+    double from;        //!< Seconds since 1970, inclusive
+    double until;       //!< Seconds since 1970, exclusive
+    int32_t offset;     //!< Seconds from GMT
+} OffsetSpan;
+
+typedef enum {
+    FAST_PATH_UNKNOWN = 0,
+    FAST_PATH_USABLE,
+    FAST_PATH_UNUSABLE
+} FastPathState;
+
+// All guarded by cacheLock
+static pthread_mutex_t cacheLock = PTHREAD_MUTEX_INITIALIZER;
+static OffsetSpan offsetSpans[OFFSET_SPAN_CACHE_SIZE];
+static int numOffsetSpans;
+static int nextOffsetSpan;
+static NSTimeZone *cachedTimeZone;
+static FastPathState fastPathState;
+static BOOL fastPathEnabled = YES;
+static uint64_t generation;                 // Bumped when the time zone or locale changes
+
+#pragma mark - Calendar arithmetic
+
+//
+// Gregorian year, month and day of a count of days since 1970-01-01
+// (H. Hinnant's civil_from_days)
+//
+static void civilFromDays(int64_t days, int *year, int *month, int *day) {
+    days += 719468;
+    int64_t era = (days >= 0 ? days : days - 146096) / 146097;
+    unsigned dayOfEra = (unsigned)(days - era * 146097);
+    unsigned yearOfEra = (dayOfEra - dayOfEra / 1460 + dayOfEra / 36524 - dayOfEra / 146096) / 365;
+    unsigned dayOfYear = dayOfEra - (365 * yearOfEra + yearOfEra / 4 - yearOfEra / 100);
+    unsigned shiftedMonth = (5 * dayOfYear + 2) / 153;
+    *day = (int)(dayOfYear - (153 * shiftedMonth + 2) / 5 + 1);
+    *month = (int)(shiftedMonth < 10 ? shiftedMonth + 3 : shiftedMonth - 9);
+    *year = (int)((int64_t)yearOfEra + era * 400 + (*month <= 2));
+}
+
+//
+// The span with the same offset from GMT around a time, found from the time zone's
+// daylight saving transitions
+//
+static OffsetSpan spanAround(NSTimeZone *timeZone, double seconds) {
+    OffsetSpan span;
+    span.offset = (int32_t)[timeZone secondsFromGMTForDate:[NSDate dateWithTimeIntervalSince1970:seconds]];
+    span.from = seconds - TRANSITION_SEARCH_SECONDS;
+    NSDate *transition = [timeZone nextDaylightSavingTimeTransitionAfterDate:[NSDate dateWithTimeIntervalSince1970:span.from]];
+    while (transition && transition.timeIntervalSince1970 <= seconds) {
+        span.from = transition.timeIntervalSince1970;
+        transition = [timeZone nextDaylightSavingTimeTransitionAfterDate:transition];
+    }
+    span.until = seconds + TRANSITION_SEARCH_SECONDS;
+    if (transition && transition.timeIntervalSince1970 < span.until) {
+        span.until = transition.timeIntervalSince1970;
+    }
+    return span;
+}
+
+static int32_t offsetAt(double seconds) {
+    pthread_mutex_lock(&cacheLock);
+    for (int i = 0; i < numOffsetSpans; i++) {
+        if (seconds >= offsetSpans[i].from && seconds < offsetSpans[i].until) {
+            int32_t offset = offsetSpans[i].offset;
+            pthread_mutex_unlock(&cacheLock);
+            return offset;
+        }
+    }
+    if (!cachedTimeZone) {
+        cachedTimeZone = [NSTimeZone defaultTimeZone];
+    }
+    NSTimeZone *timeZone = cachedTimeZone;
+    uint64_t spanGeneration = generation;
+    pthread_mutex_unlock(&cacheLock);
+
+    OffsetSpan span = spanAround(timeZone, seconds);
+
+    pthread_mutex_lock(&cacheLock);
+    if (spanGeneration == generation) {
+        offsetSpans[nextOffsetSpan] = span;
+        nextOffsetSpan = (nextOffsetSpan + 1) % OFFSET_SPAN_CACHE_SIZE;
+        numOffsetSpans = MAX(numOffsetSpans, nextOffsetSpan == 0 ? OFFSET_SPAN_CACHE_SIZE : nextOffsetSpan);
+    }
+    pthread_mutex_unlock(&cacheLock);
+    return span.offset;
+}
+
+//
+// MM/dd/yyyy without a formatter; nil outside the years the fast path handles
+//
+static NSString *fastShortDate(NSDate *date) {
+    double seconds = date.timeIntervalSince1970;
+    int64_t days = (int64_t)floor((seconds + offsetAt(seconds)) / SECONDS_PER_DAY);
+    int year, month, day;
+    civilFromDays(days, &year, &month, &day);
+    if (year < FAST_PATH_MIN_YEAR || year > FAST_PATH_MAX_YEAR) {
+        return nil;
+    }
+    char text[SHORT_DATE_LENGTH] = {
+        (char)('0' + month / 10), (char)('0' + month % 10), '/',
+        (char)('0' + day / 10), (char)('0' + day % 10), '/',
+        (char)('0' + year / 1000), (char)('0' + year / 100 % 10), (char)('0' + year / 10 % 10), (char)('0' + year % 10)
+    };
+    return [[NSString alloc] initWithBytes:text length:SHORT_DATE_LENGTH encoding:NSASCIIStringEncoding];
+}
+
+#pragma mark - Formatters
+
+//
+// A formatter for the calling thread, made again after the time zone or locale changes
+//
+static id threadFormatter(NSString *key, id (^create)(void)) {
+    pthread_mutex_lock(&cacheLock);
+    uint64_t currentGeneration = generation;
+    pthread_mutex_unlock(&cacheLock);
+
+    NSMutableDictionary *dictionary = [NSThread currentThread].threadDictionary;
+    NSArray *entry = dictionary[key];
+    if (!entry || [entry[0] unsignedLongLongValue] != currentGeneration) {
+        entry = @[ @(currentGeneration), create() ];
+        dictionary[key] = entry;
+    }
+    return entry[1];
+}
+
+static NSDateFormatter *dateFormatter(void) {
+    return threadFormatter(DateFormatterKey, ^id{
+        NSDateFormatter *formatter = [[NSDateFormatter alloc] init];
+        [formatter setDateFormat:SHORT_DATE_FORMAT];
+        return formatter;
+    });
+}
+
+static NSNumberFormatter *numberFormatter(void) {
+    return threadFormatter(NumberFormatterKey, ^id{
+        NSNumberFormatter *formatter = [[NSNumberFormatter alloc] init];
+        [formatter setNumberStyle:NSNumberFormatterDecimalStyle];
+        return formatter;
+    });
+}
+
+//
+// Does the fast path give what NSDateFormatter gives in this locale?
+//
+static BOOL fastPathMatchesFormatter(void) {
+    // Two digit months and days, either side of the year's end, and a daylight saving summer
+    const double probes[] = { 0, 981201600, 1404302400, 1419983940, 1420070400 };
+    NSDateFormatter *formatter = dateFormatter();
+    for (size_t i = 0; i < sizeof(probes) / sizeof(probes[0]); i++) {
+        NSDate *date = [NSDate dateWithTimeIntervalSince1970:probes[i]];
+        if (![fastShortDate(date) isEqualToString:[formatter stringFromDate:date]]) {
+            return NO;
+        }
+    }
+    return YES;
+}
+
+@implementation Formatters
+
++ (void) initialize {
+    if (self != [Formatters class]) {
+        return;
+    }
+    void (^reset)(NSNotification *) = ^(NSNotification *notification) {
+        pthread_mutex_lock(&cacheLock);
+        numOffsetSpans = 0;
+        nextOffsetSpan = 0;
+        cachedTimeZone = nil;
+        fastPathState = FAST_PATH_UNKNOWN;
+        generation++;
+        pthread_mutex_unlock(&cacheLock);
+    };
+    NSNotificationCenter *center = [NSNotificationCenter defaultCenter];
+    [center addObserverForName:NSSystemTimeZoneDidChangeNotification object:nil queue:nil usingBlock:reset];
+    [center addObserverForName:NSCurrentLocaleDidChangeNotification object:nil queue:nil usingBlock:reset];
+}
+
++ (NSString *) shortDateString:(NSDate *)date {
+    if (!date) {
+        return nil;
+    }
+    pthread_mutex_lock(&cacheLock);
+    FastPathState state = fastPathEnabled ? fastPathState : FAST_PATH_UNUSABLE;
+    pthread_mutex_unlock(&cacheLock);
+    if (state == FAST_PATH_UNKNOWN) {
+        state = fastPathMatchesFormatter() ? FAST_PATH_USABLE : FAST_PATH_UNUSABLE;
+        pthread_mutex_lock(&cacheLock);
+        fastPathState = state;
+        pthread_mutex_unlock(&cacheLock);
+    }
+    if (state == FAST_PATH_USABLE) {
+        NSString *string = fastShortDate(date);
+        if (string) {
+            return string;
+        }
+    }
+    return [dateFormatter() stringFromDate:date];
+}
+
++ (NSNumber *) numberFromString:(NSString *)string {
+    // Plain digits that fit in a long long
+    unichar characters[18];
+    NSUInteger length = string.length;
+    if (length > 0 && length <= sizeof(characters) / sizeof(characters[0])) {
+        [string getCharacters:characters range:NSMakeRange(0, length)];
+        long long value = 0;
+        NSUInteger i = 0;
+        while (i < length && characters[i] >= '0' && characters[i] <= '9') {
+            value = value * 10 + (characters[i++] - '0');
+        }
+        if (i == length) {
+            return @(value);
+        }
+    }
+    return [numberFormatter() numberFromString:string];
+}
+
++ (void) setFastPathEnabled:(BOOL)enabled {
+    pthread_mutex_lock(&cacheLock);
+    fastPathEnabled = enabled;
+    pthread_mutex_unlock(&cacheLock);
+}
+
+@end
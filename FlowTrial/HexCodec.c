@@ -0,0 +1,188 @@
+//
+//  HexCodec.c
+//  FlowTrial
+//
+//  Created by Wade Sellers on 12/22/14.
+//  Copyright (c) 2014 Wade Sellers. All rights reserved.
+//
+
+#include "HexCodec.h"
+
+#if defined(__ARM_NEON) || defined(__ARM_NEON__)
+#include <arm_neon.h>
+#define HEX_CODEC_NEON 1
+#elif defined(__SSE2__)
+#include <emmintrin.h>
+#define HEX_CODEC_SSE2 1
+#endif
+
+static const char hexDigits[16] = {
+    '0', '1', '2', '3', '4', '5', '6', '7', '8', '9', 'A', 'B', 'C', 'D', 'E', 'F'
+};
+
+//! Value of a hex digit, 0xFF if the character is not one
+static inline uint8_t hexValue(uint8_t c) {
+    if (c >= '0' && c <= '9') {
+        return (uint8_t)(c - '0');
+    }
+    c |= 0x20;
+    if (c >= 'a' && c <= 'f') {
+        return (uint8_t)(c - 'a' + 10);
+    }
+    return 0xFF;
+}
+
+#pragma mark - NEON
+
+#if HEX_CODEC_NEON
+
+//! Nibbles (0...15) to uppercase hex digits: '0' + n, plus 7 more past 9
+static inline uint8x16_t nibblesToHex(uint8x16_t nibbles) {
+    uint8x16_t letters = vandq_u8(vcgtq_u8(nibbles, vdupq_n_u8(9)), vdupq_n_u8(7));
+    return vaddq_u8(vaddq_u8(nibbles, vdupq_n_u8('0')), letters);
+}
+
+//! Hex digits to nibbles; *valid is cleared in any lane that was not a hex digit
+static inline uint8x16_t hexToNibbles(uint8x16_t chars, uint8x16_t *valid) {
+    uint8x16_t digits = vsubq_u8(chars, vdupq_n_u8('0'));
+    uint8x16_t isDigit = vcltq_u8(digits, vdupq_n_u8(10));
+    uint8x16_t letters = vsubq_u8(vorrq_u8(chars, vdupq_n_u8(0x20)), vdupq_n_u8('a'));
+    uint8x16_t isLetter = vcltq_u8(letters, vdupq_n_u8(6));
+    *valid = vandq_u8(*valid, vorrq_u8(isDigit, isLetter));
+    return vbslq_u8(isDigit, digits, vaddq_u8(letters, vdupq_n_u8(10)));
+}
+
+static inline bool allLanesSet(uint8x16_t mask) {
+    uint64x2_t words = vreinterpretq_u64_u8(mask);
+    return (vgetq_lane_u64(words, 0) & vgetq_lane_u64(words, 1)) == UINT64_MAX;
+}
+
+static size_t encodeBlocks(const uint8_t *bytes, size_t length, char *out) {
+    size_t done = 0;
+    for (; done + 16 <= length; done += 16) {
+        uint8x16_t input = vld1q_u8(bytes + done);
+        uint8x16x2_t digits;
+        digits.val[0] = nibblesToHex(vshrq_n_u8(input, 4));
+        digits.val[1] = nibblesToHex(vandq_u8(input, vdupq_n_u8(0x0F)));
+        // Interleaving store: high digit, low digit, high digit, ...
+        vst2q_u8((uint8_t *)out + done * 2, digits);
+    }
+    return done;
+}
+
+static size_t decodeBlocks(const char *hex, size_t length, uint8_t *out, bool *valid) {
+    size_t done = 0;
+    uint8x16_t allValid = vdupq_n_u8(0xFF);
+    for (; done + 16 <= length; done += 16) {
+        // De-interleaving load: val[0] is the high digits, val[1] the low digits
+        uint8x16x2_t chars = vld2q_u8((const uint8_t *)hex + done * 2);
+        uint8x16_t high = hexToNibbles(chars.val[0], &allValid);
+        uint8x16_t low = hexToNibbles(chars.val[1], &allValid);
+        vst1q_u8(out + done, vorrq_u8(vshlq_n_u8(high, 4), low));
+    }
+    *valid = allLanesSet(allValid);
+    return done;
+}
+
+#pragma mark - SSE2
+
+#elif HEX_CODEC_SSE2
+
+static inline __m128i nibblesToHex(__m128i nibbles) {
+    __m128i letters = _mm_and_si128(_mm_cmpgt_epi8(nibbles, _mm_set1_epi8(9)), _mm_set1_epi8(7));
+    return _mm_add_epi8(_mm_add_epi8(nibbles, _mm_set1_epi8('0')), letters);
+}
+
+//
+// Signed compares: characters >= 0x80 are negative, so they fall outside both ranges
+//
+static inline __m128i hexToNibbles(__m128i chars, __m128i *valid) {
+    __m128i digits = _mm_sub_epi8(chars, _mm_set1_epi8('0'));
+    __m128i isDigit = _mm_and_si128(_mm_cmpgt_epi8(chars, _mm_set1_epi8('0' - 1)),
+                                    _mm_cmplt_epi8(chars, _mm_set1_epi8('9' + 1)));
+    __m128i lower = _mm_or_si128(chars, _mm_set1_epi8(0x20));
+    __m128i isLetter = _mm_and_si128(_mm_cmpgt_epi8(lower, _mm_set1_epi8('a' - 1)),
+                                     _mm_cmplt_epi8(lower, _mm_set1_epi8('f' + 1)));
+    __m128i letters = _mm_sub_epi8(lower, _mm_set1_epi8('a' - 10));
+    *valid = _mm_and_si128(*valid, _mm_or_si128(isDigit, isLetter));
+    return _mm_or_si128(_mm_and_si128(isDigit, digits), _mm_andnot_si128(isDigit, letters));
+}
+
+static size_t encodeBlocks(const uint8_t *bytes, size_t length, char *out) {
+    size_t done = 0;
+    __m128i lowNibble = _mm_set1_epi8(0x0F);
+    for (; done + 16 <= length; done += 16) {
+        __m128i input = _mm_loadu_si128((const __m128i *)(bytes + done));
+        __m128i high = nibblesToHex(_mm_and_si128(_mm_srli_epi16(input, 4), lowNibble));
+        __m128i low = nibblesToHex(_mm_and_si128(input, lowNibble));
+        _mm_storeu_si128((__m128i *)(out + done * 2), _mm_unpacklo_epi8(high, low));
+        _mm_storeu_si128((__m128i *)(out + done * 2 + 16), _mm_unpackhi_epi8(high, low));
+    }
+    return done;
+}
+
+static size_t decodeBlocks(const char *hex, size_t length, uint8_t *out, bool *valid) {
+    size_t done = 0;
+    __m128i allValid = _mm_set1_epi8(-1);
+    __m128i lowByte = _mm_set1_epi16(0x00FF);
+    for (; done + 16 <= length; done += 16) {
+        __m128i first = hexToNibbles(_mm_loadu_si128((const __m128i *)(hex + done * 2)), &allValid);
+        __m128i second = hexToNibbles(_mm_loadu_si128((const __m128i *)(hex + done * 2 + 16)), &allValid);
+        // Each 16-bit lane holds a high digit (low byte) and a low digit (high byte)
+        first = _mm_or_si128(_mm_slli_epi16(_mm_and_si128(first, lowByte), 4), _mm_srli_epi16(first, 8));
+        second = _mm_or_si128(_mm_slli_epi16(_mm_and_si128(second, lowByte), 4), _mm_srli_epi16(second, 8));
+        _mm_storeu_si128((__m128i *)(out + done), _mm_packus_epi16(first, second));
+    }
+    *valid = _mm_movemask_epi8(allValid) == 0xFFFF;
+    return done;
+}
+
+#pragma mark - Scalar
+
+#else
+
+static size_t encodeBlocks(const uint8_t *bytes, size_t length, char *out) {
+    (void)bytes;
+    (void)length;
+    (void)out;
+    return 0;
+}
+
+static size_t decodeBlocks(const char *hex, size_t length, uint8_t *out, bool *valid) {
+    (void)hex;
+    (void)length;
+    (void)out;
+    *valid = true;
+    return 0;
+}
+
+#endif
+
+void HexEncode(const uint8_t *bytes, size_t length, char *out) {
+    size_t i = encodeBlocks(bytes, length, out);
+    for (; i < length; i++) {
+        out[i * 2] = hexDigits[bytes[i] >> 4];
+        out[i * 2 + 1] = hexDigits[bytes[i] & 0x0F];
+    }
+}
+
+bool HexDecode(const char *hex, size_t hexLength, uint8_t *out) {
+    if (hexLength & 1) {
+        return false;
+    }
+    size_t length = hexLength / 2;
+    bool valid;
+    size_t i = decodeBlocks(hex, length, out, &valid);
+    if (!valid) {
+        return false;
+    }
+    for (; i < length; i++) {
+        uint8_t high = hexValue((uint8_t)hex[i * 2]);
+        uint8_t low = hexValue((uint8_t)hex[i * 2 + 1]);
+        if ((high | low) & 0xF0) {
+            return false;
+        }
+        out[i] = (uint8_t)((high << 4) | low);
+    }
+    return true;
+}
@@ -0,0 +1,51 @@
+//
+//  HexCodec.h
+//  FlowTrial
+//
+//  Created by Wade Sellers on 12/22/14.
+//  Copyright (c) 2014 Wade Sellers. All rights reserved.
+//
+
+#ifndef FlowTrial_HexCodec_h
+#define FlowTrial_HexCodec_h
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+/**
+ Hex encode/decode into caller-provided buffers, with the same output as UgiUtil
+ (uppercase digits, either case accepted on input).
+
+ 16 bytes at a time are done with NEON on the device and SSE2 in the simulator, the
+ rest with a table. Nothing allocates, so converting an EPC costs a few nanoseconds
+ rather than the object churn of building an NSString a character at a time.
+ */
+
+//! Characters needed to encode length bytes (no terminator is written)
+#define HEX_ENCODED_LENGTH(length) ((length) * 2)
+
+//! Characters needed for the longest EPC, plus a terminator
+#define HEX_EPC_BUFFER_SIZE (27 * 2 + 1)
+
+/**
+ Encode bytes as uppercase hex digits
+
+ @param bytes   Bytes to encode
+ @param length  Number of bytes
+ @param out     Buffer for HEX_ENCODED_LENGTH(length) characters
+ */
+void HexEncode(const uint8_t *bytes, size_t length, char *out);
+
+/**
+ Decode hex digits (uppercase or lowercase)
+
+ @param hex        Hex digits
+ @param hexLength  Number of characters, must be even
+ @param out        Buffer for hexLength / 2 bytes
+ @return           false if the length is odd or a character is not a hex digit
+                   (out is then partly written)
+ */
+bool HexDecode(const char *hex, size_t hexLength, uint8_t *out);
+
+#endif
@@ -0,0 +1,125 @@
+//
+//  InventoryController+Tasks.h
+//  FlowTrial
+//
+//  Created by Wade Sellers on 12/31/14.
+//  Copyright (c) 2014 Wade Sellers. All rights reserved.
+//
+
+#import <Foundation/Foundation.h>
+#import <Bolts/BFTask.h>
+#import "InventoryController.h"
+
+//! Error domain for reader tasks; tag access failures use their UgiTagAccessReturnValues as code
+extern NSString * const ReaderTaskErrorDomain;
+
+//! Error code: no inventory with a UgiInventory is running (tag access needs one)
+#define READER_TASK_ERROR_NOT_RUNNING 100
+
+//! Error code: the reader's firmware is not compatible with the SDK
+#define READER_TASK_ERROR_INCOMPATIBLE_READER 101
+
+//! Error code: the reader did not connect in time
+#define READER_TASK_ERROR_CONNECT_TIMEOUT 102
+
+//! Error code: the reader started connecting, then disconnected
+#define READER_TASK_ERROR_CONNECT_FAILED 103
+
+//! Error code: inventory could not be started (see InventoryController's start methods)
+#define READER_TASK_ERROR_START_FAILED 104
+
+//! Error code: the connection timeout was not positive
+#define READER_TASK_ERROR_INVALID_TIMEOUT 105
+
+//! Error code: a tag access didn't complete in READER_TASK_TAG_ACCESS_TIMEOUT_SECONDS
+#define READER_TASK_ERROR_TAG_ACCESS_TIMEOUT 106
+
+//! Seconds a tag access may take before it fails, so later commands don't wait on it forever
+#define READER_TASK_TAG_ACCESS_TIMEOUT_SECONDS 10
+
+/**
+ Reader operations as BFTasks, so multi-step flows (connect, start inventory, read the TID
+ of every new tag, upload) compose with continueWith... instead of nesting notification,
+ delegate and completion block callbacks.
+
+ Every operation goes through commandQueue and runs after the ones started before it, in
+ order; results are delivered on the main thread. Enqueue the steps of a flow up front
+ (for example a readTag: task for every tag found) and the reader goes from one to the
+ next without waiting for the app.
+
+ Use from the main thread.
+ */
+@interface InventoryController (Tasks)
+
+/**
+ Connect to the reader
+
+ @param timeout     Seconds to wait for the reader; must be positive, since later
+                    commands wait for this one
+ @return            Task whose result is YES (NSNumber) once connected; fails with
+                    READER_TASK_ERROR_INCOMPATIBLE_READER, READER_TASK_ERROR_CONNECT_TIMEOUT,
+                    READER_TASK_ERROR_CONNECT_FAILED (the reader went from connecting to
+                    not connected) or READER_TASK_ERROR_INVALID_TIMEOUT
+ */
+- (BFTask *) openConnectionWithTimeout:(NSTimeInterval)timeout;
+
+/**
+ Start running inventory to find any tags
+
+ @param configuration  Configuration to use
+ @return               Task whose result is the UgiInventory (NSNull if the transport has
+                       none); fails with READER_TASK_ERROR_START_FAILED if inventory isn't
+                       running afterwards
+ */
+- (BFTask *) startInventoryTaskWithConfiguration:(UgiRfidConfiguration *)configuration;
+
+/**
+ Read a tag's memory
+
+ @param epc           EPC of tag to read
+ @param memoryBank    Memory bank to read
+ @param offset        Byte offset to read at (must be a multiple of 2)
+ @param minNumBytes   Minimum number of bytes to read (must be a multiple of 2)
+ @param maxNumBytes   Maximum number of bytes to read (must be a multiple of 2)
+ @return              Task whose result is the data read (NSData); fails with
+                      READER_TASK_ERROR_TAG_ACCESS_TIMEOUT if the read doesn't complete in time
+ */
+- (BFTask *) readTag:(UgiEpc *)epc
+          memoryBank:(UgiMemoryBank)memoryBank
+              offset:(int)offset
+         minNumBytes:(int)minNumBytes
+         maxNumBytes:(int)maxNumBytes;
+
+/**
+ Write a tag's memory
+
+ @param epc           EPC of tag to write to
+ @param memoryBank    Memory bank to write to
+ @param offset        Byte offset to write at (must be a multiple of 2)
+ @param data          Data to write
+ @param previousData  Previous value for this data (nil if unknown)
+ @param password      Password to use (UGI_NO_PASSWORD for not password protected)
+ @return              Task whose result is the UgiTag written; fails with
+                      READER_TASK_ERROR_TAG_ACCESS_TIMEOUT if the write doesn't complete in time
+ */
+- (BFTask *) writeTag:(UgiEpc *)epc
+           memoryBank:(UgiMemoryBank)memoryBank
+               offset:(int)offset
+                 data:(NSData *)data
+         previousData:(NSData *)previousData
+         withPassword:(int)password;
+
+/**
+ Program a tag (change its EPC)
+
+ @param oldEpc      EPC of tag to change
+ @param newEpc      EPC to write to the tag
+ @param password    Password to use (UGI_NO_PASSWORD for not password protected)
+ @return            Task whose result is the UgiTag programmed; fails with
+                    READER_TASK_ERROR_TAG_ACCESS_TIMEOUT if programming doesn't complete in time
+ */
+- (BFTask *) programTag:(UgiEpc *)oldEpc
+                  toEpc:(UgiEpc *)newEpc
+           withPassword:(int)password;
+
+@end
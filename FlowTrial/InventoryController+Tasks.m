@@ -0,0 +1,177 @@
+//
+//  InventoryController+Tasks.m
+//  FlowTrial
+//
+//  Created by Wade Sellers on 12/31/14.
+//  Copyright (c) 2014 Wade Sellers. All rights reserved.
+//
+
+#import <Bolts/BFTaskCompletionSource.h>
+#import "InventoryController+Tasks.h"
+
+NSString * const ReaderTaskErrorDomain = @"ReaderTaskErrorDomain";
+
+static BFTask *errorTask(NSInteger code) {
+    return [BFTask taskWithError:[NSError errorWithDomain:ReaderTaskErrorDomain code:code userInfo:nil]];
+}
+
+//
+// A source for a tag access task, which fails if the SDK hasn't completed it in time
+// (the inventory may have gone away with the command outstanding)
+//
+static BFTaskCompletionSource *tagAccessSource(void) {
+    BFTaskCompletionSource *source = [BFTaskCompletionSource taskCompletionSource];
+    dispatch_after(dispatch_time(DISPATCH_TIME_NOW, (int64_t)(READER_TASK_TAG_ACCESS_TIMEOUT_SECONDS * NSEC_PER_SEC)),
+                   dispatch_get_main_queue(), ^{
+        [source trySetError:[NSError errorWithDomain:ReaderTaskErrorDomain
+                                                code:READER_TASK_ERROR_TAG_ACCESS_TIMEOUT
+                                            userInfo:nil]];
+    });
+    return source;
+}
+
+//
+// Complete a tag access task from its SDK completion, unless it has timed out
+//
+static void completeTagAccess(BFTaskCompletionSource *source, id result, UgiTagAccessReturnValues returnValue) {
+    if (returnValue == UGI_TAG_ACCESS_OK) {
+        [source trySetResult:result];
+    } else {
+        [source trySetError:[NSError errorWithDomain:ReaderTaskErrorDomain code:returnValue userInfo:nil]];
+    }
+}
+
+@implementation InventoryController (Tasks)
+
+#pragma mark - Connection
+
+- (BFTask *) openConnectionWithTimeout:(NSTimeInterval)timeout {
+    if (!(timeout > 0)) {
+        // Every command queued after this one would wait for a reader that may never come
+        return errorTask(READER_TASK_ERROR_INVALID_TIMEOUT);
+    }
+    return [self.commandQueue enqueue:^BFTask *{
+        id<ReaderTransport> transport = self.transport;
+        if (!transport.isConnected) {
+            [transport openConnection];
+        }
+        if (transport.isConnected) {
+            return [BFTask taskWithResult:@YES];
+        }
+
+        BFTaskCompletionSource *source = [BFTaskCompletionSource taskCompletionSource];
+        __block BOOL connecting = NO;
+        id observer = [[NSNotificationCenter defaultCenter] addObserverForName:[Ugi singleton].NOTIFICAION_NAME_CONNECTION_STATE_CHANGED
+                                                                        object:nil
+                                                                         queue:[NSOperationQueue mainQueue]
+                                                                    usingBlock:^(NSNotification *notification) {
+            UgiConnectionStates state = [notification.object intValue];
+            if (state == UGI_CONNECTION_STATE_CONNECTED) {
+                [source trySetResult:@YES];
+            } else if (state == UGI_CONNECTION_STATE_CONNECTING) {
+                connecting = YES;
+            } else if (state == UGI_CONNECTION_STATE_NOT_CONNECTED && connecting) {
+                [source trySetError:[NSError errorWithDomain:ReaderTaskErrorDomain
+                                                        code:READER_TASK_ERROR_CONNECT_FAILED
+                                                    userInfo:nil]];
+            } else if (state == UGI_CONNECTION_STATE_INCOMPATIBLE_READER) {
+                [source trySetError:[NSError errorWithDomain:ReaderTaskErrorDomain
+                                                        code:READER_TASK_ERROR_INCOMPATIBLE_READER
+                                                    userInfo:nil]];
+            }
+        }];
+        dispatch_after(dispatch_time(DISPATCH_TIME_NOW, (int64_t)(timeout * NSEC_PER_SEC)), dispatch_get_main_queue(), ^{
+            [source trySetError:[NSError errorWithDomain:ReaderTaskErrorDomain
+                                                    code:READER_TASK_ERROR_CONNECT_TIMEOUT
+                                                userInfo:nil]];
+        });
+        return [source.task continueWithBlock:^id(BFTask *task) {
+            [[NSNotificationCenter defaultCenter] removeObserver:observer];
+            return task;
+        }];
+    }];
+}
+
+#pragma mark - Inventory
+
+- (BFTask *) startInventoryTaskWithConfiguration:(UgiRfidConfiguration *)configuration {
+    return [self.commandQueue enqueue:^BFTask *{
+        UgiInventory *inventory = [self startInventoryWithConfiguration:configuration];
+        if (!self.isRunning) {
+            return errorTask(READER_TASK_ERROR_START_FAILED);
+        }
+        return [BFTask taskWithResult:inventory ?: [NSNull null]];
+    }];
+}
+
+#pragma mark - Tag access
+
+- (BFTask *) readTag:(UgiEpc *)epc
+          memoryBank:(UgiMemoryBank)memoryBank
+              offset:(int)offset
+         minNumBytes:(int)minNumBytes
+         maxNumBytes:(int)maxNumBytes {
+    return [self.commandQueue enqueue:^BFTask *{
+        // Checked when the command runs: inventory may have stopped while it waited
+        UgiInventory *inventory = self.isRunning ? self.inventory : nil;
+        if (!inventory) {
+            return errorTask(READER_TASK_ERROR_NOT_RUNNING);
+        }
+        BFTaskCompletionSource *source = tagAccessSource();
+        [inventory readTag:epc
+                memoryBank:memoryBank
+                    offset:offset
+               minNumBytes:minNumBytes
+               maxNumBytes:maxNumBytes
+             whenCompleted:^(UgiTag *tag, NSData *data, UgiTagAccessReturnValues result) {
+            completeTagAccess(source, data ?: [NSData data], result);
+        }];
+        return source.task;
+    }];
+}
+
+- (BFTask *) writeTag:(UgiEpc *)epc
+           memoryBank:(UgiMemoryBank)memoryBank
+               offset:(int)offset
+                 data:(NSData *)data
+         previousData:(NSData *)previousData
+         withPassword:(int)password {
+    return [self.commandQueue enqueue:^BFTask *{
+        UgiInventory *inventory = self.isRunning ? self.inventory : nil;
+        if (!inventory) {
+            return errorTask(READER_TASK_ERROR_NOT_RUNNING);
+        }
+        BFTaskCompletionSource *source = tagAccessSource();
+        [inventory writeTag:epc
+                 memoryBank:memoryBank
+                     offset:offset
+                       data:data
+               previousData:previousData
+               withPassword:password
+              whenCompleted:^(UgiTag *tag, UgiTagAccessReturnValues result) {
+            completeTagAccess(source, tag, result);
+        }];
+        return source.task;
+    }];
+}
+
+- (BFTask *) programTag:(UgiEpc *)oldEpc
+                  toEpc:(UgiEpc *)newEpc
+           withPassword:(int)password {
+    return [self.commandQueue enqueue:^BFTask *{
+        UgiInventory *inventory = self.isRunning ? self.inventory : nil;
+        if (!inventory) {
+            return errorTask(READER_TASK_ERROR_NOT_RUNNING);
+        }
+        BFTaskCompletionSource *source = tagAccessSource();
+        [inventory programTag:oldEpc
+                        toEpc:newEpc
+                 withPassword:password
+                whenCompleted:^(UgiTag *tag, UgiTagAccessReturnValues result) {
+            completeTagAccess(source, tag, result);
+        }];
+        return source.task;
+    }];
+}
+
+@end
@@ -0,0 +1,208 @@
+//
+//  InventoryController.h
+//  FlowTrial
+//
+//  Created by Wade Sellers on 12/17/14.
+//  Copyright (c) 2014 Wade Sellers. All rights reserved.
+//
+
+#import <Foundation/Foundation.h>
+#import "Ugi.h"
+#import "TagFindBatch.h"
+#import "ReadHistorySlab.h"
+#import "RawFindQueue.h"
+#import "ReaderTransport.h"
+#import "ReaderCommandQueue.h"
+
+/**
+ Delegate for InventoryController: the UgiInventoryDelegate callbacks, plus batched
+ delivery of subsequent finds.
+ */
+@protocol InventoryControllerDelegate <UgiInventoryDelegate>
+
+@optional
+
+/**
+ Subsequent finds for every tag found again during the last flush window.
+
+ If the delegate implements this, inventoryTagSubsequentFinds:numFinds:withDetailedPerReadData:
+ is not called. The batch is only valid for the duration of the call.
+
+ @param batch  Finds since the last batch
+ */
+- (void) inventoryTagSubsequentFindsBatch:(const TagFindBatch *)batch;
+
+@end
+
+/**
+ Diagnostic data: the reader's counters plus the raw find queue's
+ */
+typedef struct {
+    UgiDiagnosticData reader;            //!< Reader diagnostics (from the Ugi singleton)
+    BOOL readerDataValid;                //!< NO if the reader has never been connected
+    uint64_t rawFindsQueued;             //!< Raw finds accepted by the queue
+    uint64_t rawFindsDropped;            //!< Raw finds dropped because the queue was full
+    uint64_t rawFindsBacklog;            //!< Raw finds waiting for the main thread right now
+    uint32_t rawFindQueueHighWater;      //!< Most raw finds ever waiting at once
+    uint32_t rawFindQueueCapacity;       //!< Size of the raw find queue
+} InventoryDiagnosticData;
+
+/**
+ Handler for raw finds, called on the main thread
+
+ @param finds  Raw finds, in the order they were seen (only valid during the call)
+ @param count  Number of finds
+ */
+typedef void (^RawFindHandler)(const RawFind *finds, uint32_t count);
+
+/**
+ InventoryController runs RFID inventory for the app. It is the UgiInventoryDelegate
+ passed to the Ugi singleton, keeps its own index of found tags, and forwards the
+ delegate callbacks to the app's delegate.
+
+ Use getTagByEpc: and tags here rather than on UgiInventory: lookups are O(1) on the
+ EPC bytes and tags does not build a new array on every read.
+ */
+@interface InventoryController : NSObject <UgiInventoryDelegate, RawFindFilter>
+
+///////////////////////////////////////////////////////////////////////////////////////
+#pragma mark - Properties
+///////////////////////////////////////////////////////////////////////////////////////
+
+//! Delegate that inventory callbacks are forwarded to
+@property (weak, nonatomic) id<InventoryControllerDelegate> delegate;
+
+//! How often batched subsequent finds are delivered, in milliseconds (default is 16, about one display frame)
+@property (nonatomic) int batchFlushIntervalMSec;
+
+//! Deliver a batch early once it holds this many finds (0 = no limit, the default)
+@property (nonatomic) int batchMaxFinds;
+
+/**
+ Handler for every raw find, before inventory bookkeeping. Finds are handed over from
+ the SDK's low-level filter thread through a lock-free queue and delivered on the main
+ thread in chunks. nil (the default) turns raw find capture off.
+ */
+@property (copy) RawFindHandler rawFindHandler;
+
+/**
+ Where inventory is run. Defaults to the Grokker (UgiReaderTransport); set a
+ SimulatedReaderTransport to run without one. Only change this while inventory is stopped.
+ */
+@property (nonatomic) id<ReaderTransport> transport;
+
+//! Queue that reader commands from InventoryController+Tasks run on, one at a time
+@property (readonly, nonatomic) ReaderCommandQueue *commandQueue;
+
+//! Is inventory running? Cleared by stopInventory, and when the transport stops inventory by itself
+//! (except on UGI_INVENTORY_COMPLETED_LOST_CONNECTION, after which the SDK resumes it)
+@property (readonly, nonatomic) BOOL isRunning;
+
+//! The inventory that is running, nil if none or if the transport has no UgiInventory (simulated)
+@property (readonly, nonatomic) UgiInventory *inventory;
+
+//! Tags found in this inventory, in the order found. This is a live array, copy it to keep a snapshot
+@property (readonly, nonatomic) NSArray *tags;
+
+///////////////////////////////////////////////////////////////////////////////////////
+#pragma mark - Lifecycle
+///////////////////////////////////////////////////////////////////////////////////////
+
+/**
+ Get the singleton object.
+
+ @return The one and only InventoryController
+ */
++ (InventoryController *) singleton;
+
+///////////////////////////////////////////////////////////////////////////////////////
+#pragma mark - Start / stop
+///////////////////////////////////////////////////////////////////////////////////////
+
+/**
+ Start running inventory to find any tags
+
+ @param configuration  Configuration to use
+ @return               UgiInventory object for this inventory (nil if the transport has none, or if
+                       inventory couldn't start for lack of memory; check isRunning)
+ */
+- (UgiInventory *) startInventoryWithConfiguration:(UgiRfidConfiguration *)configuration;
+
+/**
+ Start running inventory to find specific tags
+
+ Short lists are passed to the reader, which filters on its own. Longer lists are
+ compiled into an EpcFilter that is applied on the SDK's low-level filter thread, so
+ finds of other tags are dropped before they cost anything else.
+
+ @param configuration  Configuration to use
+ @param epcs           EPCs to find (UgiEpc), all other EPCs are ignored
+ @return               UgiInventory object for this inventory
+ */
+- (UgiInventory *) startInventoryWithConfiguration:(UgiRfidConfiguration *)configuration
+                                          withEpcs:(NSArray *)epcs;
+
+/**
+ Start running inventory, ignoring some tags
+
+ @param configuration  Configuration to use
+ @param epcsToIgnore   EPCs to ignore (UgiEpc)
+ @return               UgiInventory object for this inventory
+ */
+- (UgiInventory *) startInventoryWithConfiguration:(UgiRfidConfiguration *)configuration
+                                  withEpcsToIgnore:(NSArray *)epcsToIgnore;
+
+/**
+ Stop running inventory. The found tags stay available until inventory is started again.
+ Does nothing if inventory isn't running.
+ */
+- (void) stopInventory;
+
+///////////////////////////////////////////////////////////////////////////////////////
+#pragma mark - Tag access
+///////////////////////////////////////////////////////////////////////////////////////
+
+/**
+ Get the UgiTag for an EPC.
+
+ @param epc  EPC to find
+ @return     UgiTag object if the tag has been found, nil if the tag has not been found.
+ */
+- (UgiTag *) getTagByEpc:(UgiEpc *)epc;
+
+/**
+ Get a tag's read history without creating a UgiTagReadState
+
+ @param tag  Tag (must have been found in this inventory)
+ @return     View of the tag's history as of the current interval
+ */
+- (ReadHistoryView) readHistoryForTag:(UgiTag *)tag;
+
+/**
+ Is the tag visible (found within the last historyIntervalMSec*historyDepth)?
+
+ @param tag  Tag
+ @return     YES if visible
+ */
+- (BOOL) isTagVisible:(UgiTag *)tag;
+
+//! Read history of every tag, indexed by position in tags
+@property (readonly, nonatomic) const ReadHistorySlab *readHistory;
+
+///////////////////////////////////////////////////////////////////////////////////////
+#pragma mark - Diagnostic data
+///////////////////////////////////////////////////////////////////////////////////////
+
+/**
+ Get diagnostic data
+
+ If rawFindsDropped is going up, the main thread is not keeping up with the reader.
+
+ @param data   Buffer to fill
+ @param reset  YES to reset counters
+ @return       YES if successful
+ */
+- (BOOL) getDiagnosticData:(InventoryDiagnosticData *)data
+             resetCounters:(BOOL)reset;
+
+@end
@@ -0,0 +1,482 @@
+//
+//  InventoryController.m
+//  FlowTrial
+//
+//  Created by Wade Sellers on 12/17/14.
+//  Copyright (c) 2014 Wade Sellers. All rights reserved.
+//
+
+#import "InventoryController.h"
+#import "TagIndex.h"
+#import "UgiEpc+EpcKey.h"
+#import "EpcFilter.h"
+#import "UgiReaderTransport.h"
+
+#define DEFAULT_BATCH_FLUSH_INTERVAL_MSEC 16
+#define DEFAULT_HISTORY_INTERVAL_MSEC 500
+#define DEFAULT_HISTORY_DEPTH 20
+#define RAW_FIND_QUEUE_CAPACITY 16384
+#define RAW_FIND_DRAIN_CHUNK 256
+
+//
+// EPC lists up to this size are handed to the SDK, which passes them on to the reader.
+// Longer lists are filtered on the host, and our compiled filter is much cheaper there
+// than the SDK's per-EPC delegate calls.
+//
+#define MAX_EPCS_SENT_TO_READER 32
+
+@interface InventoryController ()
+
+@property (readwrite, nonatomic) UgiInventory *inventory;
+@property (readwrite, nonatomic) BOOL isRunning;
+@property (readwrite, nonatomic) ReaderCommandQueue *commandQueue;
+@property TagIndex *tagIndex;
+@property BOOL batchFlushScheduled;
+@property dispatch_source_t historyTimer;
+
+@end
+
+@implementation InventoryController {
+    TagFindBatch _batch;
+    ReadHistorySlab _history;
+    RawFindQueue _rawFinds;
+    RawFindQueueStats _rawFindsAtReset;
+    EpcFilter *_epcFilter;
+    int _stopsInFlight;             // stopInventory calls whose transport stop hasn't completed
+}
+
++ (InventoryController *) singleton {
+    static InventoryController *singleton;
+    static dispatch_once_t onceToken;
+    dispatch_once(&onceToken, ^{
+        singleton = [[InventoryController alloc] init];
+    });
+    return singleton;
+}
+
+- (id) init {
+    self = [super init];
+    if (self) {
+        self.transport = [[UgiReaderTransport alloc] init];
+        self.tagIndex = [[TagIndex alloc] init];
+        self.commandQueue = [[ReaderCommandQueue alloc] init];
+        self.batchFlushIntervalMSec = DEFAULT_BATCH_FLUSH_INTERVAL_MSEC;
+        if (!TagFindBatchInit(&_batch) ||
+            !ReadHistorySlabInit(&_history, DEFAULT_HISTORY_DEPTH, 256) ||
+            !RawFindQueueInit(&_rawFinds, RAW_FIND_QUEUE_CAPACITY)) {
+            return nil;
+        }
+    }
+    return self;
+}
+
+- (void) dealloc {
+    TagFindBatchFree(&_batch);
+    ReadHistorySlabFree(&_history);
+    RawFindQueueFree(&_rawFinds);
+    EpcFilterFree(_epcFilter);
+}
+
+- (NSArray *) tags {
+    return self.tagIndex.tags;
+}
+
+#pragma mark - Start / stop
+
+- (UgiInventory *) startInventoryWithConfiguration:(UgiRfidConfiguration *)configuration {
+    if (![self prepareForInventory:configuration epcFilter:NULL]) {
+        return nil;
+    }
+    self.inventory = [self.transport startInventory:self withConfiguration:configuration withEpcs:nil];
+    return self.inventory;
+}
+
+- (UgiInventory *) startInventoryWithConfiguration:(UgiRfidConfiguration *)configuration
+                                          withEpcs:(NSArray *)epcs {
+    if (epcs.count <= MAX_EPCS_SENT_TO_READER) {
+        if (![self prepareForInventory:configuration epcFilter:NULL]) {
+            return nil;
+        }
+        self.inventory = [self.transport startInventory:self withConfiguration:configuration withEpcs:epcs];
+    } else {
+        // Without its filter the inventory would report every tag, so it doesn't start at all
+        EpcFilter *epcFilter = [self compileFilter:epcs ignore:NO];
+        if (!epcFilter || ![self prepareForInventory:configuration epcFilter:epcFilter]) {
+            return nil;
+        }
+        self.inventory = [self.transport startInventory:self withConfiguration:configuration withEpcs:nil];
+    }
+    return self.inventory;
+}
+
+- (UgiInventory *) startInventoryWithConfiguration:(UgiRfidConfiguration *)configuration
+                                  withEpcsToIgnore:(NSArray *)epcsToIgnore {
+    if (epcsToIgnore.count <= MAX_EPCS_SENT_TO_READER) {
+        if (![self prepareForInventory:configuration epcFilter:NULL]) {
+            return nil;
+        }
+        self.inventory = [self.transport startInventoryIgnoringEpcs:self
+                                                  withConfiguration:configuration
+                                                   withEpcsToIgnore:epcsToIgnore];
+    } else {
+        EpcFilter *epcFilter = [self compileFilter:epcsToIgnore ignore:YES];
+        if (!epcFilter || ![self prepareForInventory:configuration epcFilter:epcFilter]) {
+            return nil;
+        }
+        self.inventory = [self.transport startInventory:self withConfiguration:configuration withEpcs:nil];
+    }
+    return self.inventory;
+}
+
+//
+// Get ready to start: on failure the filter is freed and inventory is left stopped
+//
+- (BOOL) prepareForInventory:(UgiRfidConfiguration *)configuration
+                   epcFilter:(EpcFilter *)epcFilter {
+    if (self.isRunning) {
+        [self stopInventory];
+    }
+    if (![self resetHistoryForConfiguration:configuration]) {
+        EpcFilterFree(epcFilter);
+        return NO;
+    }
+    self.isRunning = YES;
+    TagFindBatchReset(&_batch);
+    [self.tagIndex removeAllTags];
+    [self discardRawFinds];
+    __atomic_store_n(&_epcFilter, epcFilter, __ATOMIC_RELEASE);
+    return YES;
+}
+
+- (void) stopInventory {
+    // Each inventory's filter is handed to exactly one stop completion
+    if (!self.isRunning) {
+        return;
+    }
+    [self finishInventory];
+    //
+    // The filter is read on the SDK's thread, so it is only freed once inventory has
+    // completely stopped. A new inventory may have installed its own filter by then.
+    //
+    EpcFilter *epcFilter = _epcFilter;
+    _stopsInFlight++;
+    [self.transport stopInventoryWithCompletion:^{
+        self->_stopsInFlight--;
+        EpcFilter *expected = epcFilter;
+        __atomic_compare_exchange_n(&self->_epcFilter, &expected, NULL, NO, __ATOMIC_ACQ_REL, __ATOMIC_ACQUIRE);
+        EpcFilterFree(epcFilter);
+    }];
+}
+
+//
+// Hand over what was found and stop keeping history: everything stopping does on our side
+//
+- (void) finishInventory {
+    [self drainRawFinds];
+    [self flushBatch];
+    [self stopHistoryTimer];
+    self.inventory = nil;
+    self.isRunning = NO;
+}
+
+- (EpcFilter *) compileFilter:(NSArray *)epcs
+                       ignore:(BOOL)ignore {
+    EpcKey *keys = malloc(MAX(epcs.count, 1) * sizeof(EpcKey));
+    if (!keys) {
+        return NULL;
+    }
+    uint32_t count = 0;
+    for (UgiEpc *epc in epcs) {
+        keys[count++] = [epc epcKey];
+    }
+    EpcFilter *epcFilter = EpcFilterCreate(keys, count, ignore);
+    free(keys);
+    return epcFilter;
+}
+
+#pragma mark - Tag access
+
+- (UgiTag *) getTagByEpc:(UgiEpc *)epc {
+    return [self.tagIndex tagForEpc:epc];
+}
+
+- (ReadHistoryView) readHistoryForTag:(UgiTag *)tag {
+    EpcKey key = [tag.epc epcKey];
+    NSUInteger tagIndex = [self.tagIndex indexOfKey:&key];
+    return ReadHistorySlabView(&_history, tagIndex == NSNotFound ? UINT32_MAX : (uint32_t)tagIndex);
+}
+
+- (BOOL) isTagVisible:(UgiTag *)tag {
+    EpcKey key = [tag.epc epcKey];
+    NSUInteger tagIndex = [self.tagIndex indexOfKey:&key];
+    return tagIndex != NSNotFound && ReadHistorySlabIsVisible(&_history, (uint32_t)tagIndex);
+}
+
+- (const ReadHistorySlab *) readHistory {
+    return &_history;
+}
+
+#pragma mark - History
+
+//
+// The history is advanced on our own timer rather than in inventoryHistoryInterval,
+// since the SDK only calls that while something is visible
+//
+- (BOOL) resetHistoryForConfiguration:(UgiRfidConfiguration *)configuration {
+    [self stopHistoryTimer];
+    uint32_t depth = configuration.historyDepth > 0 ? configuration.historyDepth : DEFAULT_HISTORY_DEPTH;
+    if (depth != _history.depth) {
+        ReadHistorySlabFree(&_history);
+        if (!ReadHistorySlabInit(&_history, depth, 256)) {
+            // Depth 0, so the next start allocates again
+            ReadHistorySlabFree(&_history);
+            return NO;
+        }
+    } else {
+        ReadHistorySlabReset(&_history);
+    }
+
+    int intervalMSec = configuration.historyIntervalMSec > 0 ? configuration.historyIntervalMSec : DEFAULT_HISTORY_INTERVAL_MSEC;
+    self.historyTimer = dispatch_source_create(DISPATCH_SOURCE_TYPE_TIMER, 0, 0, dispatch_get_main_queue());
+    dispatch_source_set_timer(self.historyTimer,
+                              dispatch_time(DISPATCH_TIME_NOW, (int64_t)intervalMSec * NSEC_PER_MSEC),
+                              (uint64_t)intervalMSec * NSEC_PER_MSEC,
+                              NSEC_PER_MSEC);
+    __weak InventoryController *weakSelf = self;
+    dispatch_source_set_event_handler(self.historyTimer, ^{
+        [weakSelf advanceHistory];
+    });
+    dispatch_resume(self.historyTimer);
+    return YES;
+}
+
+- (void) stopHistoryTimer {
+    if (self.historyTimer) {
+        dispatch_source_cancel(self.historyTimer);
+        self.historyTimer = nil;
+    }
+}
+
+- (void) advanceHistory {
+    [self drainRawFinds];
+    ReadHistorySlabAdvance(&_history);
+}
+
+#pragma mark - Raw finds
+
+- (void) drainRawFinds {
+    RawFind finds[RAW_FIND_DRAIN_CHUNK];
+    uint32_t count;
+    while ((count = RawFindQueuePop(&_rawFinds, finds, RAW_FIND_DRAIN_CHUNK)) > 0) {
+        RawFindHandler handler = self.rawFindHandler;
+        if (handler) {
+            handler(finds, count);
+        }
+    }
+}
+
+//
+// Leftovers from a previous inventory. The queue itself can't be reset here since
+// the SDK's thread may still be pushing to it.
+//
+- (void) discardRawFinds {
+    RawFind finds[RAW_FIND_DRAIN_CHUNK];
+    while (RawFindQueuePop(&_rawFinds, finds, RAW_FIND_DRAIN_CHUNK) > 0) {
+    }
+}
+
+#pragma mark - Diagnostic data
+
+- (BOOL) getDiagnosticData:(InventoryDiagnosticData *)data
+             resetCounters:(BOOL)reset {
+    memset(data, 0, sizeof(*data));
+    data->readerDataValid = [self.transport getDiagnosticData:&data->reader resetCounters:reset];
+
+    RawFindQueueStats stats;
+    RawFindQueueGetStats(&_rawFinds, &stats);
+    data->rawFindsQueued = stats.pushed - _rawFindsAtReset.pushed;
+    data->rawFindsDropped = stats.dropped - _rawFindsAtReset.dropped;
+    data->rawFindsBacklog = stats.pushed - stats.popped;
+    data->rawFindQueueHighWater = stats.highWater;
+    data->rawFindQueueCapacity = stats.capacity;
+    if (reset) {
+        _rawFindsAtReset = stats;
+    }
+    return YES;
+}
+
+#pragma mark - Subsequent finds
+
+- (BOOL) delegateWantsBatches {
+    return [self.delegate respondsToSelector:@selector(inventoryTagSubsequentFindsBatch:)];
+}
+
+- (void) recordSubsequentFinds:(UgiTag *)tag
+                      numFinds:(int)num
+       withDetailedPerReadData:(NSArray *)detailedPerReadData {
+    EpcKey key = [tag.epc epcKey];
+    NSUInteger tagIndex = [self.tagIndex indexOfKey:&key];
+    if (tagIndex == NSNotFound) {
+        return;
+    }
+    ReadHistorySlabRecord(&_history, (uint32_t)tagIndex, num);
+    if (![self delegateWantsBatches]) {
+        return;
+    }
+    double rssiI, rssiQ;
+    UgiDetailedPerReadData *lastRead = [detailedPerReadData lastObject];
+    if (lastRead) {
+        rssiI = lastRead.rssiI;
+        rssiQ = lastRead.rssiQ;
+    } else {
+        UgiTagReadState *readState = tag.readState;
+        rssiI = readState.mostRecentRssiI;
+        rssiQ = readState.mostRecentRssiQ;
+    }
+    TagFindBatchAdd(&_batch, (uint32_t)tagIndex, num, rssiI, rssiQ);
+
+    if (self.batchMaxFinds > 0 && _batch.totalFinds >= (uint32_t)self.batchMaxFinds) {
+        [self flushBatch];
+    } else if (!self.batchFlushScheduled) {
+        self.batchFlushScheduled = YES;
+        __weak InventoryController *weakSelf = self;
+        dispatch_after(dispatch_time(DISPATCH_TIME_NOW, (int64_t)self.batchFlushIntervalMSec * NSEC_PER_MSEC),
+                       dispatch_get_main_queue(), ^{
+            [weakSelf flushBatch];
+        });
+    }
+}
+
+- (void) flushBatch {
+    self.batchFlushScheduled = NO;
+    [self drainRawFinds];
+    if (_batch.count == 0) {
+        return;
+    }
+    if ([self delegateWantsBatches]) {
+        [self.delegate inventoryTagSubsequentFindsBatch:&_batch];
+    }
+    TagFindBatchReset(&_batch);
+}
+
+#pragma mark - UgiInventoryDelegate
+
+//
+// Subsequent finds are always wanted for the read history. inventoryHistoryInterval
+// is only claimed when our delegate wants it.
+//
+- (BOOL) respondsToSelector:(SEL)selector {
+    if (selector == @selector(inventoryHistoryInterval) ||
+        selector == @selector(inventoryFilter:)) {
+        return [self.delegate respondsToSelector:selector];
+    }
+    if (selector == @selector(inventoryFilterLowLevel:) || selector == @selector(inventoryFilterRawFind:)) {
+        return _epcFilter != NULL || self.rawFindHandler != nil ||
+               [self.delegate respondsToSelector:@selector(inventoryFilterLowLevel:)];
+    }
+    return [super respondsToSelector:selector];
+}
+
+- (void) inventoryDidStart {
+    if ([self.delegate respondsToSelector:@selector(inventoryDidStart)]) {
+        [self.delegate inventoryDidStart];
+    }
+}
+
+- (void) inventoryDidStopWithResult:(UgiInventoryCompletedReturnValues)result {
+    //
+    // A stop we didn't ask for (a timed run ending, the reader closing or failing) ends
+    // the inventory. Losing the connection doesn't: the SDK carries on when it is back.
+    //
+    if (self.isRunning && _stopsInFlight == 0 && result != UGI_INVENTORY_COMPLETED_LOST_CONNECTION) {
+        [self finishInventory];
+        // The transport has stopped, so nothing reads the filter any more
+        EpcFilterFree(__atomic_exchange_n(&_epcFilter, NULL, __ATOMIC_ACQ_REL));
+    }
+    if ([self.delegate respondsToSelector:@selector(inventoryDidStopWithResult:)]) {
+        [self.delegate inventoryDidStopWithResult:result];
+    }
+}
+
+//
+// Called on the SDK's thread for every raw find; all it has is the EPC
+//
+- (BOOL) inventoryFilterLowLevel:(UgiEpc *)epc {
+    RawFind find;
+    memset(&find, 0, sizeof(find));
+    find.epc = [epc epcKey];
+    return [self filterRawFind:&find epc:epc];
+}
+
+//
+// Called instead by transports that know more of each find
+//
+- (BOOL) inventoryFilterRawFind:(const RawFind *)find {
+    return [self filterRawFind:find epc:nil];
+}
+
+//
+// Apply the EPC filter, queue the find for rawFindHandler and ask the delegate.
+// A timestamp of 0 means now.
+//
+- (BOOL) filterRawFind:(const RawFind *)find epc:(UgiEpc *)epc {
+    EpcFilter *epcFilter = __atomic_load_n(&_epcFilter, __ATOMIC_ACQUIRE);
+    if (epcFilter && !EpcFilterAccepts(epcFilter, &find->epc)) {
+        return YES;
+    }
+    if (self.rawFindHandler) {
+        RawFind queued = *find;
+        if (queued.timestamp == 0) {
+            queued.timestamp = CFAbsoluteTimeGetCurrent();
+        }
+        RawFindQueuePush(&_rawFinds, &queued);
+    }
+    id<InventoryControllerDelegate> delegate = self.delegate;
+    if ([delegate respondsToSelector:@selector(inventoryFilterLowLevel:)]) {
+        return [delegate inventoryFilterLowLevel:epc ?: [UgiEpc epcFromKey:&find->epc]];
+    }
+    return NO;
+}
+
+- (BOOL) inventoryFilter:(UgiEpc *)epc {
+    if ([self.delegate respondsToSelector:@selector(inventoryFilter:)]) {
+        return [self.delegate inventoryFilter:epc];
+    }
+    return NO;
+}
+
+- (void) inventoryTagFound:(UgiTag *)tag
+   withDetailedPerReadData:(NSArray *)detailedPerReadData {
+    NSUInteger tagIndex = [self.tagIndex addTag:tag];
+    if (tagIndex != NSNotFound) {
+        ReadHistorySlabRecord(&_history, (uint32_t)tagIndex, 1);
+    }
+    if ([self.delegate respondsToSelector:@selector(inventoryTagFound:withDetailedPerReadData:)]) {
+        [self.delegate inventoryTagFound:tag withDetailedPerReadData:detailedPerReadData];
+    }
+}
+
+- (void) inventoryTagChanged:(UgiTag *)tag
+                 isFirstFind:(BOOL)firstFind {
+    if ([self.delegate respondsToSelector:@selector(inventoryTagChanged:isFirstFind:)]) {
+        [self.delegate inventoryTagChanged:tag isFirstFind:firstFind];
+    }
+}
+
+- (void) inventoryTagSubsequentFinds:(UgiTag *)tag
+                                      numFinds:(int)num
+             withDetailedPerReadData:(NSArray *)detailedPerReadData {
+    [self recordSubsequentFinds:tag numFinds:num withDetailedPerReadData:detailedPerReadData];
+    if (![self delegateWantsBatches] &&
+        [self.delegate respondsToSelector:@selector(inventoryTagSubsequentFinds:numFinds:withDetailedPerReadData:)]) {
+        [self.delegate inventoryTagSubsequentFinds:tag numFinds:num withDetailedPerReadData:detailedPerReadData];
+    }
+}
+
+- (void) inventoryHistoryInterval {
+    if ([self.delegate respondsToSelector:@selector(inventoryHistoryInterval)]) {
+        [self.delegate inventoryHistoryInterval];
+    }
+}
+
+@end
@@ -0,0 +1,68 @@
+//
+//  InventoryItem.h
+//  FlowTrial
+//
+//  Created by Wade Sellers on 12/29/14.
+//  Copyright (c) 2014 Wade Sellers. All rights reserved.
+//
+
+#import <Foundation/Foundation.h>
+#import <Parse/Parse.h>
+#import "UgiJson.h"
+
+//! Parse class of inventory records
+extern NSString * const InventoryClassName;
+
+/**
+ A local copy of one Parse Inventory record (one plant).
+
+ Only the fields the app shows are kept, as typed properties, so items can be stored
+ with UgiJson/JsonPlan and looked up without going back to Parse.
+ */
+@interface InventoryItem : UgiJsonModelBase
+
+@property (nonatomic) NSString *objectId;
+@property (nonatomic) NSDate *updatedAt;
+@property (nonatomic) long long barcode;
+@property (nonatomic) NSString *epc;            //!< EPC of the plant's tag, uppercase hex
+@property (nonatomic) NSString *name;
+@property (nonatomic) NSNumber *age;
+@property (nonatomic) NSString *phase;
+@property (nonatomic) NSDate *clone;
+@property (nonatomic) NSDate *vegetative;
+@property (nonatomic) NSDate *flowering;
+
+/**
+ Copy the fields of an Inventory object
+
+ @param object  Inventory PFObject
+ @return        New item
+ */
++ (InventoryItem *) itemWithObject:(PFObject *)object;
+
+/**
+ A copy of this item with some keys of an Inventory object applied, for objects that
+ only hold the keys just saved (made with objectWithoutDataWithClassName:objectId:)
+
+ @param keys    Keys to take from the object
+ @param object  Inventory PFObject
+ @return        New item
+ */
+- (InventoryItem *) itemByApplyingKeys:(NSArray *)keys ofObject:(PFObject *)object;
+
+/**
+ Keys of an Inventory object that items keep (besides objectId and updatedAt)
+
+ @return  Key names
+ */
++ (NSArray *) keys;
+
+/**
+ Have a query fetch only the keys items keep (objectId, createdAt and updatedAt always
+ come back), so objects are a fraction of their full size
+
+ @param query   Inventory query
+ */
++ (void) selectKeysOfQuery:(PFQuery *)query;
+
+@end
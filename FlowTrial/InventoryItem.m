@@ -0,0 +1,132 @@
+//
+//  InventoryItem.m
+//  FlowTrial
+//
+//  Created by Wade Sellers on 12/29/14.
+//  Copyright (c) 2014 Wade Sellers. All rights reserved.
+//
+
+#import "InventoryItem.h"
+
+NSString * const InventoryClassName = @"Inventory";
+
+//
+// Fields of an Inventory object that items keep, in the order of +keys
+//
+typedef enum {
+    INVENTORY_FIELD_BARCODE,
+    INVENTORY_FIELD_EPC,
+    INVENTORY_FIELD_NAME,
+    INVENTORY_FIELD_AGE,
+    INVENTORY_FIELD_PHASE,
+    INVENTORY_FIELD_CLONE,
+    INVENTORY_FIELD_VEGETATIVE,
+    INVENTORY_FIELD_FLOWERING,
+    INVENTORY_FIELD_COUNT
+} InventoryField;
+
+static NSString * const FieldKeys[INVENTORY_FIELD_COUNT] = {
+    @"barcode", @"epc", @"name", @"age", @"phase", @"clone", @"vegetative", @"flowering"
+};
+
+//
+// Field of each key (NSNumber), built once, for applying keys by name
+//
+static NSDictionary *fieldsByKey(void) {
+    static NSDictionary *fields;
+    static dispatch_once_t onceToken;
+    dispatch_once(&onceToken, ^{
+        NSMutableDictionary *map = [NSMutableDictionary dictionaryWithCapacity:INVENTORY_FIELD_COUNT];
+        for (int field = 0; field < INVENTORY_FIELD_COUNT; field++) {
+            map[FieldKeys[field]] = @(field);
+        }
+        fields = map;
+    });
+    return fields;
+}
+
+//
+// Value if it has the expected class (Parse columns aren't typed on the client)
+//
+static inline id valueOfClass(id value, Class valueClass) {
+    return [value isKindOfClass:valueClass] ? value : nil;
+}
+
+@implementation InventoryItem
+
+//
+// Copy one field of an Inventory object into an item, straight into its ivar
+//
+static void applyField(InventoryItem *item, PFObject *object, InventoryField field) {
+    id value = object[FieldKeys[field]];
+    switch (field) {
+        case INVENTORY_FIELD_BARCODE:
+            item->_barcode = [valueOfClass(value, [NSNumber class]) longLongValue];
+            break;
+        case INVENTORY_FIELD_EPC:
+            item->_epc = [valueOfClass(value, [NSString class]) uppercaseString];
+            break;
+        case INVENTORY_FIELD_NAME:
+            item->_name = valueOfClass(value, [NSString class]);
+            break;
+        case INVENTORY_FIELD_AGE:
+            item->_age = valueOfClass(value, [NSNumber class]);
+            break;
+        case INVENTORY_FIELD_PHASE:
+            item->_phase = valueOfClass(value, [NSString class]);
+            break;
+        case INVENTORY_FIELD_CLONE:
+            item->_clone = valueOfClass(value, [NSDate class]);
+            break;
+        case INVENTORY_FIELD_VEGETATIVE:
+            item->_vegetative = valueOfClass(value, [NSDate class]);
+            break;
+        case INVENTORY_FIELD_FLOWERING:
+            item->_flowering = valueOfClass(value, [NSDate class]);
+            break;
+        default:
+            break;
+    }
+}
+
++ (InventoryItem *) itemWithObject:(PFObject *)object {
+    InventoryItem *item = [[InventoryItem alloc] init];
+    item.objectId = object.objectId;
+    item.updatedAt = object.updatedAt;
+    for (int field = 0; field < INVENTORY_FIELD_COUNT; field++) {
+        applyField(item, object, field);
+    }
+    return item;
+}
+
+- (InventoryItem *) itemByApplyingKeys:(NSArray *)keys ofObject:(PFObject *)object {
+    InventoryItem *item = [[InventoryItem alloc] init];
+    item.objectId = self.objectId;
+    item.updatedAt = object.updatedAt ?: self.updatedAt;
+    item.barcode = self.barcode;
+    item.epc = self.epc;
+    item.name = self.name;
+    item.age = self.age;
+    item.phase = self.phase;
+    item.clone = self.clone;
+    item.vegetative = self.vegetative;
+    item.flowering = self.flowering;
+    NSDictionary *fields = fieldsByKey();
+    for (NSString *key in keys) {
+        NSNumber *field = fields[key];
+        if (field) {
+            applyField(item, object, field.intValue);
+        }
+    }
+    return item;
+}
+
++ (NSArray *) keys {
+    return [NSArray arrayWithObjects:(const id *)FieldKeys count:INVENTORY_FIELD_COUNT];
+}
+
++ (void) selectKeysOfQuery:(PFQuery *)query {
+    [query selectKeys:[self keys]];
+}
+
+@end
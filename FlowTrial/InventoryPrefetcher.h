@@ -0,0 +1,90 @@
+//
+//  InventoryPrefetcher.h
+//  FlowTrial
+//
+//  Created by Wade Sellers on 12/31/14.
+//  Copyright (c) 2014 Wade Sellers. All rights reserved.
+//
+
+#import <Foundation/Foundation.h>
+#import <Bolts/BFTask.h>
+#import "InventoryResolver.h"
+#import "Ugi.h"
+
+/**
+ Fetches the Inventory records of tags as they are found, before anyone asks for them,
+ so tapping a plant shows it without waiting for the network.
+
+ Found tags wait in a fixed-size priority queue ordered by RSSI: the nearest tags, the
+ ones most likely to be tapped, are fetched first, and when a crowded room overflows the
+ queue the farthest tags are dropped. One batch of the nearest EPCs is fetched at a time
+ through the resolver, which adds what it finds to the InventoryStore; that is where
+ prefetched items are read from.
+
+ EPCs fetched recently, found or not, are remembered (approximately least recently
+ used first out, in two generations of recentCapacity / 2), so tags with no Inventory
+ record don't cost a query every time inventory restarts. EPCs whose fetch failed are
+ put back in the queue and tried again after a pause.
+
+ Use from the main thread.
+ */
+@interface InventoryPrefetcher : NSObject
+
+//! Resolver that fetches for this prefetcher
+@property (readonly, nonatomic) InventoryResolver *resolver;
+
+//! Most EPCs fetched together (default 50)
+@property (nonatomic) NSUInteger batchSize;
+
+/**
+ Create a prefetcher with the default sizes (512 queued EPCs, 4096 remembered)
+
+ @param resolver        Resolver to fetch through
+ @return                New prefetcher
+ */
+- (id) initWithResolver:(InventoryResolver *)resolver;
+
+/**
+ Create a prefetcher
+
+ @param resolver        Resolver to fetch through
+ @param queueCapacity   Most EPCs waiting to be fetched
+ @param recentCapacity  About how many fetched EPCs are remembered
+ @return                New prefetcher
+ */
+- (id) initWithResolver:(InventoryResolver *)resolver
+          queueCapacity:(uint32_t)queueCapacity
+         recentCapacity:(uint32_t)recentCapacity;
+
+/**
+ Queue a newly found tag, with the RSSI of its latest read as priority. Call from
+ inventoryTagFound:withDetailedPerReadData:.
+
+ @param tag                  Tag
+ @param detailedPerReadData  Per read data from the delegate call (may be nil)
+ */
+- (void) tagFound:(UgiTag *)tag withDetailedPerReadData:(NSArray *)detailedPerReadData;
+
+/**
+ Queue an EPC
+
+ @param epc   EPC
+ @param rssi  Priority (higher is fetched first)
+ */
+- (void) prefetchEpc:(UgiEpc *)epc rssi:(double)rssi;
+
+/**
+ Get the item of a tag now: from the store if it is there (prefetched or synced),
+ otherwise by fetching it straight away, ahead of the queue
+
+ @param tag  Tag
+ @return     Task whose result is the InventoryItem, nil if the tag has none
+ */
+- (BFTask *) itemForTag:(UgiTag *)tag;
+
+/**
+ Forget the EPCs waiting to be fetched (fetches already started still finish)
+ */
+- (void) removeAllPending;
+
+@end
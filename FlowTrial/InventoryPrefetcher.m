@@ -0,0 +1,190 @@
+//
+//  InventoryPrefetcher.m
+//  FlowTrial
+//
+//  Created by Wade Sellers on 12/31/14.
+//  Copyright (c) 2014 Wade Sellers. All rights reserved.
+//
+
+#import <Bolts/BFExecutor.h>
+#import "InventoryPrefetcher.h"
+#import "EpcTable.h"
+#import "PrefetchQueue.h"
+#import "UgiEpc+EpcKey.h"
+#import "UgiEpc+HexString.h"
+
+#define DEFAULT_QUEUE_CAPACITY 512
+#define DEFAULT_RECENT_CAPACITY 4096
+#define DEFAULT_BATCH_SIZE 50
+
+//! Seconds to wait after a failed fetch before fetching again
+#define RETRY_DELAY_SECONDS 5
+
+@interface InventoryPrefetcher ()
+
+@property (readwrite, nonatomic) InventoryResolver *resolver;
+@property BOOL fetching;
+
+@end
+
+@implementation InventoryPrefetcher {
+    PrefetchQueue _queue;
+    // EPCs fetched recently: the current generation, and the one before it
+    EpcTable _recent[2];
+    int _currentRecent;
+    uint32_t _recentGenerationSize;
+}
+
+- (id) initWithResolver:(InventoryResolver *)resolver {
+    return [self initWithResolver:resolver
+                    queueCapacity:DEFAULT_QUEUE_CAPACITY
+                   recentCapacity:DEFAULT_RECENT_CAPACITY];
+}
+
+- (id) initWithResolver:(InventoryResolver *)resolver
+          queueCapacity:(uint32_t)queueCapacity
+         recentCapacity:(uint32_t)recentCapacity {
+    self = [super init];
+    if (self) {
+        self.resolver = resolver;
+        self.batchSize = DEFAULT_BATCH_SIZE;
+        _recentGenerationSize = MAX(recentCapacity / 2, 1);
+        if (!PrefetchQueueInit(&_queue, queueCapacity) ||
+            !EpcTableInit(&_recent[0], _recentGenerationSize) ||
+            !EpcTableInit(&_recent[1], _recentGenerationSize)) {
+            return nil;
+        }
+    }
+    return self;
+}
+
+- (void) dealloc {
+    PrefetchQueueFree(&_queue);
+    EpcTableFree(&_recent[0]);
+    EpcTableFree(&_recent[1]);
+}
+
+#pragma mark - Recently fetched EPCs
+
+- (BOOL) isRecent:(const EpcKey *)key {
+    return EpcTableFind(&_recent[0], key) != EPC_TABLE_NOT_FOUND ||
+           EpcTableFind(&_recent[1], key) != EPC_TABLE_NOT_FOUND;
+}
+
+//
+// Remember a fetched EPC. When the current generation fills up, the previous one (the
+// least recently fetched EPCs) is forgotten and becomes the current one.
+//
+- (void) markRecent:(const EpcKey *)key {
+    if (_recent[_currentRecent].count >= _recentGenerationSize) {
+        _currentRecent = 1 - _currentRecent;
+        EpcTableRemoveAll(&_recent[_currentRecent]);
+    }
+    EpcTableInsert(&_recent[_currentRecent], key, NULL);
+}
+
+#pragma mark - Queueing
+
+- (void) tagFound:(UgiTag *)tag withDetailedPerReadData:(NSArray *)detailedPerReadData {
+    double rssiI, rssiQ;
+    UgiDetailedPerReadData *lastRead = [detailedPerReadData lastObject];
+    if (lastRead) {
+        rssiI = lastRead.rssiI;
+        rssiQ = lastRead.rssiQ;
+    } else {
+        UgiTagReadState *readState = tag.readState;
+        rssiI = readState.mostRecentRssiI;
+        rssiQ = readState.mostRecentRssiQ;
+    }
+    // The stronger channel is the better estimate of distance
+    [self prefetchEpc:tag.epc rssi:MAX(rssiI, rssiQ)];
+}
+
+- (void) prefetchEpc:(UgiEpc *)epc rssi:(double)rssi {
+    EpcKey key = [epc epcKey];
+    if ([self.resolver.store itemForEpcKey:&key] || [self isRecent:&key]) {
+        return;
+    }
+    PrefetchQueuePush(&_queue, &key, (float)rssi);
+    [self fetchNext];
+}
+
+- (void) removeAllPending {
+    PrefetchQueueRemoveAll(&_queue);
+}
+
+#pragma mark - Fetching
+
+//
+// Fetch the nearest queued EPCs, unless a fetch is already running. EPCs queued while it
+// runs are ranked against each other when it finishes, so a tag found late but close
+// still goes before one found early but far away.
+//
+- (void) fetchNext {
+    if (self.fetching) {
+        return;
+    }
+    InventoryStore *store = self.resolver.store;
+    NSUInteger batchSize = MAX(self.batchSize, 1);
+    NSMutableArray *epcs = [NSMutableArray arrayWithCapacity:MIN(batchSize, _queue.count)];
+    NSMutableData *entries = [NSMutableData dataWithCapacity:MIN(batchSize, _queue.count) * sizeof(PrefetchQueueEntry)];
+    PrefetchQueueEntry entry;
+    while (epcs.count < batchSize && PrefetchQueuePop(&_queue, &entry)) {
+        if ([store itemForEpcKey:&entry.key] || [self isRecent:&entry.key]) {
+            continue;
+        }
+        [epcs addObject:[UgiEpc hexStringForKey:&entry.key]];
+        [entries appendBytes:&entry length:sizeof(entry)];
+    }
+    if (epcs.count == 0) {
+        return;
+    }
+
+    self.fetching = YES;
+    __weak InventoryPrefetcher *weakSelf = self;
+    [[self.resolver resolveEpcs:epcs handler:nil] continueWithExecutor:[BFExecutor mainThreadExecutor]
+                                                             withBlock:^id(BFTask *task) {
+        InventoryPrefetcher *strongSelf = weakSelf;
+        if (!strongSelf) {
+            return nil;
+        }
+        const PrefetchQueueEntry *fetched = entries.bytes;
+        if (task.error || task.exception || task.isCancelled) {
+            // Put the batch back and give the network a rest before trying again
+            NSLog(@"Prefetch of %lu EPCs failed: %@", (unsigned long)epcs.count, task.error ?: task.exception);
+            for (NSUInteger i = 0; i < epcs.count; i++) {
+                [strongSelf requeue:&fetched[i]];
+            }
+            dispatch_after(dispatch_time(DISPATCH_TIME_NOW, (int64_t)(RETRY_DELAY_SECONDS * NSEC_PER_SEC)),
+                           dispatch_get_main_queue(), ^{
+                weakSelf.fetching = NO;
+                [weakSelf fetchNext];
+            });
+            return nil;
+        }
+        for (NSUInteger i = 0; i < epcs.count; i++) {
+            [strongSelf markRecent:&fetched[i].key];
+        }
+        strongSelf.fetching = NO;
+        [strongSelf fetchNext];
+        return nil;
+    }];
+}
+
+- (void) requeue:(const PrefetchQueueEntry *)entry {
+    PrefetchQueuePush(&_queue, &entry->key, entry->priority);
+}
+
+- (BFTask *) itemForTag:(UgiTag *)tag {
+    EpcKey key = [tag.epc epcKey];
+    InventoryItem *item = [self.resolver.store itemForEpcKey:&key];
+    if (item) {
+        return [BFTask taskWithResult:item];
+    }
+    NSString *hex = [UgiEpc hexStringForKey:&key];
+    return [[self.resolver resolveEpcs:@[ hex ] handler:nil] continueWithSuccessBlock:^id(BFTask *task) {
+        return task.result[hex];
+    }];
+}
+
+@end
@@ -0,0 +1,73 @@
+//
+//  InventoryRecorder.h
+//  FlowTrial
+//
+//  Created by Wade Sellers on 12/23/14.
+//  Copyright (c) 2014 Wade Sellers. All rights reserved.
+//
+
+#import <Foundation/Foundation.h>
+#import "InventoryController.h"
+#import "SessionWriter.h"
+
+//! User default (BOOL): record each inventory the home screen runs
+extern NSString * const InventoryRecorderEnabledKey;
+
+/**
+ Records every raw find of an inventory to a session file (see SessionFormat.h),
+ for audits and for replaying a session later.
+
+ Finds are handed over in chunks and encoded and written on the recorder's own queue,
+ so the main thread only copies them.
+ */
+@interface InventoryRecorder : NSObject
+
+//! File being recorded to
+@property (readonly, nonatomic) NSString *path;
+
+//! Counters so far
+@property (readonly) SessionWriterStats stats;
+
+/**
+ Where to record a session starting now: a file named for the time, in a Sessions folder
+ in the documents folder (created if need be)
+
+ @return    Path for a new session file
+ */
++ (NSString *) pathForNewSession;
+
+/**
+ Create a recorder, creating (or replacing) the session file
+
+ @param path    File to record to
+ @param error   Set if the file can't be created
+ @return        New recorder, nil on failure
+ */
+- (id) initWithPath:(NSString *)path
+              error:(NSError **)error;
+
+/**
+ Record the raw finds of an InventoryController, by becoming its rawFindHandler
+
+ @param controller  Controller to record
+ */
+- (void) recordInventoryController:(InventoryController *)controller;
+
+/**
+ Append finds. May be called on any thread; finds are copied before returning.
+
+ @param finds   Finds
+ @param count   Number of finds
+ */
+- (void) appendFinds:(const RawFind *)finds
+               count:(uint32_t)count;
+
+/**
+ Stop recording, write out the last block and close the file
+
+ @param completion  Called on the main thread when the file is closed, with an error if
+                    any write failed
+ */
+- (void) closeWithCompletion:(void(^)(NSError *error))completion;
+
+@end
@@ -0,0 +1,127 @@
+//
+//  InventoryRecorder.m
+//  FlowTrial
+//
+//  Created by Wade Sellers on 12/23/14.
+//  Copyright (c) 2014 Wade Sellers. All rights reserved.
+//
+
+#import "InventoryRecorder.h"
+
+NSString * const InventoryRecorderEnabledKey = @"RecordInventorySessions";
+
+//! Folder (in the documents folder) sessions are recorded to
+#define SESSIONS_DIRECTORY_NAME @"Sessions"
+
+//! Extension of session files
+#define SESSION_FILE_EXTENSION @"session"
+
+@interface InventoryRecorder ()
+
+@property (readwrite, nonatomic) NSString *path;
+@property dispatch_queue_t queue;
+@property (weak) InventoryController *controller;
+@property (copy) RawFindHandler handler;
+@property NSError *writeError;
+
+@end
+
+@implementation InventoryRecorder {
+    SessionWriter _writer;
+    BOOL _open;
+}
+
++ (NSString *) pathForNewSession {
+    NSString *documents = NSSearchPathForDirectoriesInDomains(NSDocumentDirectory, NSUserDomainMask, YES)[0];
+    NSString *directory = [documents stringByAppendingPathComponent:SESSIONS_DIRECTORY_NAME];
+    [[NSFileManager defaultManager] createDirectoryAtPath:directory withIntermediateDirectories:YES attributes:nil error:nil];
+    NSDateFormatter *formatter = [[NSDateFormatter alloc] init];
+    formatter.locale = [NSLocale localeWithLocaleIdentifier:@"en_US_POSIX"];
+    formatter.dateFormat = @"yyyyMMdd-HHmmss";
+    NSString *name = [[formatter stringFromDate:[NSDate date]] stringByAppendingPathExtension:SESSION_FILE_EXTENSION];
+    return [directory stringByAppendingPathComponent:name];
+}
+
+- (id) initWithPath:(NSString *)path
+              error:(NSError **)error {
+    self = [super init];
+    if (self) {
+        self.path = path;
+        if (!SessionWriterOpen(&_writer, path.fileSystemRepresentation)) {
+            if (error) {
+                *error = [NSError errorWithDomain:NSPOSIXErrorDomain code:errno userInfo:@{ NSFilePathErrorKey: path }];
+            }
+            return nil;
+        }
+        _open = YES;
+        self.queue = dispatch_queue_create("InventoryRecorder", DISPATCH_QUEUE_SERIAL);
+    }
+    return self;
+}
+
+- (void) dealloc {
+    if (_open) {
+        SessionWriterClose(&_writer);
+    }
+}
+
+- (SessionWriterStats) stats {
+    __block SessionWriterStats stats;
+    dispatch_sync(self.queue, ^{
+        stats = self->_writer.stats;
+    });
+    return stats;
+}
+
+- (void) recordInventoryController:(InventoryController *)controller {
+    __weak InventoryRecorder *weakSelf = self;
+    self.handler = ^(const RawFind *finds, uint32_t count) {
+        [weakSelf appendFinds:finds count:count];
+    };
+    self.controller = controller;
+    controller.rawFindHandler = self.handler;
+}
+
+- (void) appendFinds:(const RawFind *)finds
+               count:(uint32_t)count {
+    if (count == 0) {
+        return;
+    }
+    NSData *chunk = [NSData dataWithBytes:finds length:count * sizeof(RawFind)];
+    dispatch_async(self.queue, ^{
+        if (!self->_open || self.writeError) {
+            return;
+        }
+        const RawFind *chunkFinds = chunk.bytes;
+        for (uint32_t i = 0; i < count; i++) {
+            if (!SessionWriterAppend(&self->_writer, &chunkFinds[i])) {
+                self.writeError = [NSError errorWithDomain:NSPOSIXErrorDomain code:errno userInfo:@{ NSFilePathErrorKey: self.path }];
+                return;
+            }
+        }
+    });
+}
+
+- (void) closeWithCompletion:(void(^)(NSError *error))completion {
+    InventoryController *controller = self.controller;
+    if (controller && controller.rawFindHandler == self.handler) {
+        controller.rawFindHandler = nil;
+    }
+    self.controller = nil;
+    dispatch_async(self.queue, ^{
+        if (self->_open) {
+            self->_open = NO;
+            if (!SessionWriterClose(&self->_writer) && !self.writeError) {
+                self.writeError = [NSError errorWithDomain:NSPOSIXErrorDomain code:errno userInfo:@{ NSFilePathErrorKey: self.path }];
+            }
+        }
+        NSError *error = self.writeError;
+        if (completion) {
+            dispatch_async(dispatch_get_main_queue(), ^{
+                completion(error);
+            });
+        }
+    });
+}
+
+@end
@@ -0,0 +1,97 @@
+//
+//  InventoryResolver.h
+//  FlowTrial
+//
+//  Created by Wade Sellers on 12/30/14.
+//  Copyright (c) 2014 Wade Sellers. All rights reserved.
+//
+
+#import <Foundation/Foundation.h>
+#import <Bolts/BFTask.h>
+#import "InventoryStore.h"
+#import "UgiInventory.h"
+
+/**
+ Called on the main thread as items are resolved
+
+ @param resolved    Newly resolved items, by EPC (uppercase hex string) or barcode (NSNumber)
+ */
+typedef void (^InventoryResolverHandler)(NSDictionary *resolved);
+
+/**
+ Makes the query that fetches one chunk
+
+ @param key     Column to match ("epc" or "barcode")
+ @param values  Values of the chunk
+ @return        Query for the Inventory objects with those values
+ */
+typedef PFQuery *(^InventoryResolverQueryBlock)(NSString *key, NSArray *values);
+
+/**
+ Resolves many EPCs or barcodes to Inventory items at once.
+
+ Anything already in the InventoryStore is resolved straight away. The rest is split into
+ chunks, each fetched with one whereKey:containedIn: query; up to maxConcurrentQueries
+ queries run at once and the rest wait their turn. Values that are already being fetched
+ (by this request or an earlier one that hasn't finished) are not asked for again; the
+ request waits for the query already in flight. Items are handed to the handler chunk by
+ chunk as queries come back, and added to the store.
+
+ Inventory records are matched on their "epc" column (uppercase hex) or "barcode" column.
+ Use from the main thread.
+ */
+@interface InventoryResolver : NSObject
+
+//! Store to check first and to add fetched items to
+@property (readonly, nonatomic) InventoryStore *store;
+
+//! Values per query (default 200)
+@property (nonatomic) NSUInteger chunkSize;
+
+//! Most queries in flight at once (default 4)
+@property (nonatomic) NSUInteger maxConcurrentQueries;
+
+//! Makes each chunk's query (default: Inventory by key, InventoryItem's keys only); tests replace it
+@property (nonatomic, copy) InventoryResolverQueryBlock queryBlock;
+
+/**
+ Create a resolver
+
+ @param store   Store to check first and to add fetched items to
+ @return        New resolver
+ */
+- (id) initWithStore:(InventoryStore *)store;
+
+/**
+ Resolve EPCs
+
+ @param epcs        UgiEpc objects or hex strings
+ @param handler     Called as items are resolved (may be nil)
+ @return            Task whose result is every item resolved, by EPC (uppercase hex); EPCs
+                    with no Inventory record are left out. Fails if any query failed.
+ */
+- (BFTask *) resolveEpcs:(NSArray *)epcs
+                 handler:(InventoryResolverHandler)handler;
+
+/**
+ Resolve the EPCs of every tag an inventory has found
+
+ @param inventory   Inventory
+ @param handler     Called as items are resolved (may be nil)
+ @return            As for resolveEpcs:handler:
+ */
+- (BFTask *) resolveTagsOfInventory:(UgiInventory *)inventory
+                            handler:(InventoryResolverHandler)handler;
+
+/**
+ Resolve barcodes
+
+ @param barcodes    Barcodes (NSNumber)
+ @param handler     Called as items are resolved (may be nil)
+ @return            Task whose result is every item resolved, by barcode; barcodes with no
+                    Inventory record are left out. Fails if any query failed.
+ */
+- (BFTask *) resolveBarcodes:(NSArray *)barcodes
+                     handler:(InventoryResolverHandler)handler;
+
+@end
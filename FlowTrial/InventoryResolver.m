@@ -0,0 +1,242 @@
+//
+//  InventoryResolver.m
+//  FlowTrial
+//
+//  Created by Wade Sellers on 12/30/14.
+//  Copyright (c) 2014 Wade Sellers. All rights reserved.
+//
+
+#import <Bolts/BFExecutor.h>
+#import <Bolts/BFTaskCompletionSource.h>
+#import "InventoryResolver.h"
+#import "UgiEpc+EpcKey.h"
+#import "UgiEpc+HexString.h"
+#import "UgiTag.h"
+
+#define DEFAULT_CHUNK_SIZE 200
+#define DEFAULT_MAX_CONCURRENT_QUERIES 4
+
+//! Results per query; more than a chunk in case several records share a value
+#define QUERY_LIMIT 1000
+
+static NSString * const EpcKeyName = @"epc";
+static NSString * const BarcodeKeyName = @"barcode";
+
+///////////////////////////////////////////////////////////////////////////////////////
+#pragma mark - ResolverChunk
+///////////////////////////////////////////////////////////////////////////////////////
+
+/**
+ Values to fetch with one query
+ */
+@interface ResolverChunk : NSObject
+
+@property (nonatomic) NSString *key;
+@property (nonatomic) NSArray *values;
+@property (nonatomic) BFTaskCompletionSource *source;   // Result is the items fetched
+
+@end
+
+@implementation ResolverChunk
+@end
+
+///////////////////////////////////////////////////////////////////////////////////////
+#pragma mark - InventoryResolver
+///////////////////////////////////////////////////////////////////////////////////////
+
+@interface InventoryResolver ()
+
+@property (readwrite, nonatomic) InventoryStore *store;
+@property NSMutableDictionary *inFlight;        // Key name -> (value -> task of its chunk)
+@property NSMutableArray *waitingChunks;
+@property NSUInteger runningQueries;
+
+@end
+
+@implementation InventoryResolver
+
+- (id) initWithStore:(InventoryStore *)store {
+    self = [super init];
+    if (self) {
+        self.store = store;
+        self.chunkSize = DEFAULT_CHUNK_SIZE;
+        self.maxConcurrentQueries = DEFAULT_MAX_CONCURRENT_QUERIES;
+        self.queryBlock = ^PFQuery *(NSString *key, NSArray *values) {
+            PFQuery *query = [PFQuery queryWithClassName:InventoryClassName];
+            [query whereKey:key containedIn:values];
+            [InventoryItem selectKeysOfQuery:query];
+            query.limit = QUERY_LIMIT;
+            return query;
+        };
+        self.inFlight = [NSMutableDictionary dictionaryWithObjectsAndKeys:
+                         [NSMutableDictionary dictionary], EpcKeyName,
+                         [NSMutableDictionary dictionary], BarcodeKeyName, nil];
+        self.waitingChunks = [NSMutableArray array];
+    }
+    return self;
+}
+
+#pragma mark - Entry points
+
+- (BFTask *) resolveEpcs:(NSArray *)epcs
+                 handler:(InventoryResolverHandler)handler {
+    InventoryStore *store = self.store;
+    NSMutableDictionary *resolved = [NSMutableDictionary dictionary];
+    NSMutableOrderedSet *missing = [NSMutableOrderedSet orderedSetWithCapacity:epcs.count];
+    for (id epc in epcs) {
+        EpcKey key;
+        if ([epc isKindOfClass:[UgiEpc class]]) {
+            key = [epc epcKey];
+        } else if (![epc isKindOfClass:[NSString class]] || ![UgiEpc parseHexString:epc toKey:&key]) {
+            continue;
+        }
+        NSString *hex = [UgiEpc hexStringForKey:&key];
+        InventoryItem *item = [store itemForEpcKey:&key];
+        if (item) {
+            resolved[hex] = item;
+        } else {
+            [missing addObject:hex];
+        }
+    }
+    return [self resolveMissing:missing.array
+                          inKey:EpcKeyName
+                     valueOfItem:^id(InventoryItem *item) { return item.epc; }
+                        resolved:resolved
+                         handler:handler];
+}
+
+- (BFTask *) resolveTagsOfInventory:(UgiInventory *)inventory
+                            handler:(InventoryResolverHandler)handler {
+    NSMutableArray *epcs = [NSMutableArray arrayWithCapacity:inventory.tags.count];
+    for (UgiTag *tag in inventory.tags) {
+        [epcs addObject:tag.epc];
+    }
+    return [self resolveEpcs:epcs handler:handler];
+}
+
+- (BFTask *) resolveBarcodes:(NSArray *)barcodes
+                     handler:(InventoryResolverHandler)handler {
+    InventoryStore *store = self.store;
+    NSMutableDictionary *resolved = [NSMutableDictionary dictionary];
+    NSMutableOrderedSet *missing = [NSMutableOrderedSet orderedSetWithCapacity:barcodes.count];
+    for (NSNumber *barcode in barcodes) {
+        NSNumber *value = @(barcode.longLongValue);
+        InventoryItem *item = [store itemForBarcode:barcode.longLongValue];
+        if (item) {
+            resolved[value] = item;
+        } else {
+            [missing addObject:value];
+        }
+    }
+    return [self resolveMissing:missing.array
+                          inKey:BarcodeKeyName
+                     valueOfItem:^id(InventoryItem *item) { return @(item.barcode); }
+                        resolved:resolved
+                         handler:handler];
+}
+
+#pragma mark - Fetching
+
+//
+// Fetch the values not in the store, joining queries already in flight, and collect
+// everything into resolved
+//
+- (BFTask *) resolveMissing:(NSArray *)missing
+                      inKey:(NSString *)key
+                valueOfItem:(id (^)(InventoryItem *item))valueOfItem
+                   resolved:(NSMutableDictionary *)resolved
+                    handler:(InventoryResolverHandler)handler {
+    if (resolved.count > 0 && handler) {
+        handler([resolved copy]);
+    }
+
+    // Tasks to wait for: those of chunks already fetching some of the values, and new
+    // chunks for the rest
+    NSMutableDictionary *inFlight = self.inFlight[key];
+    NSMutableSet *tasks = [NSMutableSet set];
+    NSMutableArray *toFetch = [NSMutableArray array];
+    for (id value in missing) {
+        BFTask *task = inFlight[value];
+        if (task) {
+            [tasks addObject:task];
+        } else {
+            [toFetch addObject:value];
+        }
+    }
+    NSUInteger chunkSize = MAX(self.chunkSize, 1);
+    for (NSUInteger start = 0; start < toFetch.count; start += chunkSize) {
+        ResolverChunk *chunk = [[ResolverChunk alloc] init];
+        chunk.key = key;
+        chunk.values = [toFetch subarrayWithRange:NSMakeRange(start, MIN(chunkSize, toFetch.count - start))];
+        chunk.source = [BFTaskCompletionSource taskCompletionSource];
+        for (id value in chunk.values) {
+            inFlight[value] = chunk.source.task;
+        }
+        [tasks addObject:chunk.source.task];
+        [self.waitingChunks addObject:chunk];
+    }
+    [self startQueries];
+
+    // Hand over this request's items from each chunk as it lands
+    NSSet *wanted = [NSSet setWithArray:missing];
+    NSMutableArray *deliveries = [NSMutableArray arrayWithCapacity:tasks.count];
+    for (BFTask *task in tasks) {
+        [deliveries addObject:[task continueWithExecutor:[BFExecutor mainThreadExecutor]
+                                        withSuccessBlock:^id(BFTask *chunkTask) {
+            NSMutableDictionary *found = [NSMutableDictionary dictionary];
+            for (InventoryItem *item in chunkTask.result) {
+                id value = valueOfItem(item);
+                if (value && [wanted containsObject:value]) {
+                    found[value] = item;
+                }
+            }
+            if (found.count > 0) {
+                [resolved addEntriesFromDictionary:found];
+                if (handler) {
+                    handler(found);
+                }
+            }
+            return nil;
+        }]];
+    }
+    return [[BFTask taskForCompletionOfAllTasks:deliveries] continueWithExecutor:[BFExecutor mainThreadExecutor]
+                                                                withSuccessBlock:^id(BFTask *task) {
+        return resolved;
+    }];
+}
+
+//
+// Start waiting chunks while there is room
+//
+- (void) startQueries {
+    while (self.runningQueries < MAX(self.maxConcurrentQueries, 1) && self.waitingChunks.count > 0) {
+        ResolverChunk *chunk = self.waitingChunks[0];
+        [self.waitingChunks removeObjectAtIndex:0];
+        self.runningQueries++;
+
+        PFQuery *query = self.queryBlock(chunk.key, chunk.values);
+        [[query findObjectsInBackground] continueWithExecutor:[BFExecutor mainThreadExecutor]
+                                                    withBlock:^id(BFTask *task) {
+            self.runningQueries--;
+            NSMutableDictionary *inFlight = self.inFlight[chunk.key];
+            for (id value in chunk.values) {
+                if (inFlight[value] == chunk.source.task) {
+                    [inFlight removeObjectForKey:value];
+                }
+            }
+            if (task.error) {
+                [chunk.source setError:task.error];
+            } else if (task.exception) {
+                [chunk.source setException:task.exception];
+            } else if (task.isCancelled) {
+                [chunk.source cancel];
+            } else {
+                [chunk.source setResult:[self.store addObjects:task.result]];
+            }
+            [self startQueries];
+            return nil;
+        }];
+    }
+}
+
+@end
@@ -0,0 +1,135 @@
+//
+//  InventoryStore.h
+//  FlowTrial
+//
+//  Created by Wade Sellers on 12/29/14.
+//  Copyright (c) 2014 Wade Sellers. All rights reserved.
+//
+
+#import <Foundation/Foundation.h>
+#import <Bolts/BFTask.h>
+#import "JournaledJsonRoot.h"
+#import "OfflineWriteQueue.h"
+#import "InventoryItem.h"
+#import "EpcKey.h"
+
+//! Posted on the main thread when items are added or updated
+extern NSString * const InventoryStoreDidChangeNotification;
+
+/**
+ An on-device mirror of the Parse Inventory class, so barcode lookups don't wait for
+ the network.
+
+ Items are indexed by barcode in a sorted BarcodeIndex, so a lookup is a binary search
+ (microseconds for tens of thousands of plants), and by tag EPC in an EpcTable. The
+ mirror is kept up to date by delta syncs that page through the records after the last
+ one seen, in (updatedAt, objectId) order, and is stored as a JournaledJsonRoot so
+ each sync only journals the items that changed (updated items are journaled as new copies and the older copies
+ dropped when loading). Merging changes updates the indexes in place rather than
+ rebuilding them. Records deleted on the server are not noticed by delta syncs.
+
+ Use from the main thread.
+ */
+@interface InventoryStore : JournaledJsonRoot
+
+//! Mirrored items, in the order they were first seen
+@property (nonatomic) NSMutableArray *items;
+UGI_FIELD_TYPE(items, InventoryItem);
+
+//! Newest updatedAt fetched by a sync
+@property (nonatomic) NSDate *lastUpdatedAt;
+
+//! objectId of the last record fetched by a sync (records with the same updatedAt are paged by objectId)
+@property (nonatomic) NSString *lastObjectId;
+
+/**
+ The store, loaded from disk the first time
+
+ @return  Shared store
+ */
++ (InventoryStore *) sharedStore;
+
+/**
+ All items with a barcode
+
+ @param barcode Barcode
+ @return        Items, empty if none are mirrored
+ */
+- (NSArray *) itemsForBarcode:(long long)barcode;
+
+/**
+ The most recently updated item with a barcode
+
+ @param barcode Barcode
+ @return        Item, nil if none is mirrored
+ */
+- (InventoryItem *) itemForBarcode:(long long)barcode;
+
+/**
+ The item whose tag has an EPC
+
+ @param key     EPC
+ @return        Item, nil if none is mirrored
+ */
+- (InventoryItem *) itemForEpcKey:(const EpcKey *)key;
+
+/**
+ Add Inventory objects fetched elsewhere (say, by a query for a barcode that wasn't
+ mirrored yet). Objects older than the mirrored copy are ignored.
+
+ @param objects Inventory PFObjects
+ @return        The mirrored items for the objects, in the same order
+ */
+- (NSArray *) addObjects:(NSArray *)objects;
+
+/**
+ Edit an item: queue a write of just these keys, which works offline, and update the
+ mirror now rather than when the write is sent
+
+ @param values  Keys (of InventoryItem keys) and values to set, as for OfflineWriteQueue
+ @param item    Item to edit
+ @param queue   Queue to write through
+ @return        The mirrored item with the values applied
+ */
+- (InventoryItem *) setValues:(NSDictionary *)values
+                       ofItem:(InventoryItem *)item
+                        queue:(OfflineWriteQueue *)queue;
+
+/**
+ Move items to a new phase: set phase, and the date the phase started, on every item,
+ writing only those two keys through the queue (as setValues:ofItem:queue:)
+
+ @param phase       New phase
+ @param dateKey     Date column for the phase ("clone", "vegetative" or "flowering"; nil for none)
+ @param date        Date the phase started
+ @param items       Items (InventoryItem) to move
+ @param queue       Queue to write through
+ @return            The mirrored items, moved
+ */
+- (NSArray *) setPhase:(NSString *)phase
+               dateKey:(NSString *)dateKey
+                  date:(NSDate *)date
+               ofItems:(NSArray *)items
+                 queue:(OfflineWriteQueue *)queue;
+
+/**
+ Fetch records changed since the last sync. Only one sync runs at a time; calling this
+ during a sync returns the sync in progress.
+
+ @return  Task whose result is the number of items added or updated (NSNumber)
+ */
+- (BFTask *) sync;
+
+/**
+ Sync now and then every interval until stopSyncing
+
+ @param interval    Seconds between syncs
+ */
+- (void) startSyncingWithInterval:(NSTimeInterval)interval;
+
+/**
+ Stop periodic syncing
+ */
+- (void) stopSyncing;
+
+@end
@@ -0,0 +1,391 @@
+//
+//  InventoryStore.m
+//  FlowTrial
+//
+//  Created by Wade Sellers on 12/29/14.
+//  Copyright (c) 2014 Wade Sellers. All rights reserved.
+//
+
+#import <Bolts/BFExecutor.h>
+#import "InventoryStore.h"
+#import "BarcodeIndex.h"
+#import "EpcTable.h"
+#import "UgiEpc+HexString.h"
+
+NSString * const InventoryStoreDidChangeNotification = @"InventoryStoreDidChangeNotification";
+
+//! File (in the documents folder) the store is kept in
+#define INVENTORY_STORE_FILE_NAME @"InventoryStore"
+
+//! Records fetched per query when syncing (Parse's maximum)
+#define SYNC_PAGE_SIZE 1000
+
+@implementation InventoryStore {
+    // Instance variables rather than properties, so they are not serialized
+    BarcodeIndex _index;
+    EpcTable _epcs;
+    uint32_t *_epcPositions;            // Position in items of each EPC in _epcs
+    NSMutableDictionary *_positions;    // objectId -> position in items
+    BFTask *_syncTask;
+    NSTimer *_syncTimer;
+}
+
++ (InventoryStore *) sharedStore {
+    static InventoryStore *store;
+    static dispatch_once_t onceToken;
+    dispatch_once(&onceToken, ^{
+        store = [[InventoryStore alloc] initFromFile:INVENTORY_STORE_FILE_NAME initializationData:nil debug:NO];
+    });
+    return store;
+}
+
+- (void) initNonPersistent:(NSDictionary *)initializationData {
+    // Before the journal is replayed (and changes are watched), so this isn't journaled
+    self.items = self.items ? [self.items mutableCopy] : [NSMutableArray array];
+    [super initNonPersistent:initializationData];
+    [self removeOutdatedItems];
+    [self rebuildIndex];
+}
+
+- (void) dealloc {
+    [_syncTimer invalidate];
+    BarcodeIndexFree(&_index);
+    EpcTableFree(&_epcs);
+    free(_epcPositions);
+}
+
+#pragma mark - Index
+
+//
+// Updated items are journaled as new copies; keep only the newest copy of each
+//
+- (void) removeOutdatedItems {
+    _positions = [NSMutableDictionary dictionaryWithCapacity:self.items.count];
+    NSMutableIndexSet *outdated = [NSMutableIndexSet indexSet];
+    NSMutableArray *items = self.items;
+    for (NSUInteger i = 0; i < items.count; i++) {
+        InventoryItem *item = items[i];
+        NSNumber *position = item.objectId ? _positions[item.objectId] : nil;
+        if (!position) {
+            if (item.objectId) {
+                _positions[item.objectId] = @(i);
+            }
+            continue;
+        }
+        // Later copies win unless they are older; either way this position goes
+        InventoryItem *previous = items[position.unsignedIntegerValue];
+        if ([item.updatedAt compare:previous.updatedAt] != NSOrderedAscending) {
+            items[position.unsignedIntegerValue] = item;
+        }
+        [outdated addIndex:i];
+    }
+    if (outdated.count > 0) {
+        [items removeObjectsAtIndexes:outdated];
+        [_positions removeAllObjects];
+        for (NSUInteger i = 0; i < items.count; i++) {
+            NSString *objectId = [items[i] objectId];
+            if (objectId) {
+                _positions[objectId] = @(i);
+            }
+        }
+    }
+}
+
+- (void) rebuildIndex {
+    uint32_t count = (uint32_t)self.items.count;
+    if (!_index.entries && !BarcodeIndexInit(&_index, count)) {
+        return;
+    }
+    if (!_epcs.keys && !EpcTableInit(&_epcs, count)) {
+        return;
+    }
+    uint32_t *epcPositions = realloc(_epcPositions, MAX(count, 1) * sizeof(uint32_t));
+    if (!epcPositions) {
+        return;
+    }
+    _epcPositions = epcPositions;
+
+    BarcodeIndexRemoveAll(&_index);
+    EpcTableRemoveAll(&_epcs);
+    uint32_t position = 0;
+    for (InventoryItem *item in self.items) {
+        BarcodeIndexAdd(&_index, item.barcode, position);
+        EpcKey key;
+        if (item.epc && [UgiEpc parseHexString:item.epc toKey:&key]) {
+            // With more than one item per EPC, the last one (the newest record) wins
+            uint32_t epcIndex = EpcTableInsert(&_epcs, &key, NULL);
+            if (epcIndex != EPC_TABLE_NOT_FOUND) {
+                _epcPositions[epcIndex] = position;
+            }
+        }
+        position++;
+    }
+    BarcodeIndexSort(&_index);
+}
+
+//
+// Bring the indexes up to date after a merge, without rebuilding them. entries are the
+// barcodes of new items and of items whose barcode changed; epcPositions are the items
+// with an EPC that wasn't indexed for them. An EPC that moved off an item can't be taken
+// out of the EpcTable, so that (rare) case rebuilds everything.
+//
+- (void) updateIndexWithEntries:(NSMutableData *)entries
+                   epcPositions:(NSIndexSet *)epcPositions
+                      epcsMoved:(BOOL)epcsMoved {
+    uint32_t count = (uint32_t)self.items.count;
+    if (epcsMoved || !_index.entries || !_epcs.keys) {
+        [self rebuildIndex];
+        return;
+    }
+    uint32_t *positions = realloc(_epcPositions, MAX(count, 1) * sizeof(uint32_t));
+    if (!positions) {
+        return;
+    }
+    _epcPositions = positions;
+    if (!BarcodeIndexMerge(&_index, entries.mutableBytes, (uint32_t)(entries.length / sizeof(BarcodeIndexEntry)))) {
+        [self rebuildIndex];
+        return;
+    }
+    [epcPositions enumerateIndexesUsingBlock:^(NSUInteger position, BOOL *stop) {
+        EpcKey key;
+        if (![UgiEpc parseHexString:[self.items[position] epc] toKey:&key]) {
+            return;
+        }
+        // As in rebuildIndex, the last item with an EPC wins
+        bool inserted;
+        uint32_t epcIndex = EpcTableInsert(&_epcs, &key, &inserted);
+        if (epcIndex != EPC_TABLE_NOT_FOUND && (inserted || position > _epcPositions[epcIndex])) {
+            _epcPositions[epcIndex] = (uint32_t)position;
+        }
+    }];
+}
+
+- (NSArray *) itemsForBarcode:(long long)barcode {
+    uint32_t first = 0;
+    uint32_t count = _index.entries ? BarcodeIndexFind(&_index, barcode, &first) : 0;
+    if (count == 1) {
+        return @[ self.items[_index.entries[first].item] ];
+    }
+    NSMutableArray *items = [NSMutableArray arrayWithCapacity:count];
+    for (uint32_t i = first; i < first + count; i++) {
+        [items addObject:self.items[_index.entries[i].item]];
+    }
+    return items;
+}
+
+- (InventoryItem *) itemForBarcode:(long long)barcode {
+    InventoryItem *newest = nil;
+    for (InventoryItem *item in [self itemsForBarcode:barcode]) {
+        if (!newest || [item.updatedAt compare:newest.updatedAt] == NSOrderedDescending) {
+            newest = item;
+        }
+    }
+    return newest;
+}
+
+- (InventoryItem *) itemForEpcKey:(const EpcKey *)key {
+    uint32_t epcIndex = _epcs.keys ? EpcTableFind(&_epcs, key) : EPC_TABLE_NOT_FOUND;
+    return epcIndex == EPC_TABLE_NOT_FOUND ? nil : self.items[_epcPositions[epcIndex]];
+}
+
+#pragma mark - Updating
+
+//
+// Merge objects into items; returns the items for them and counts the ones that changed.
+// With keys, only those keys are taken from the objects and applied to mirrored items
+// (objects not mirrored are skipped); without, objects are copied whole.
+//
+- (NSArray *) mergeObjects:(NSArray *)objects
+                      keys:(NSArray *)keys
+                   changed:(NSUInteger *)numChanged {
+    NSMutableArray *result = [NSMutableArray arrayWithCapacity:objects.count];
+    NSMutableArray *changed = [NSMutableArray array];
+    NSMutableData *entries = [NSMutableData data];
+    NSMutableIndexSet *epcPositions = [NSMutableIndexSet indexSet];
+    BOOL epcsMoved = NO;
+    for (PFObject *object in objects) {
+        if (!object.objectId) {
+            continue;
+        }
+        NSNumber *position = _positions[object.objectId];
+        if (position) {
+            InventoryItem *existing = self.items[position.unsignedIntegerValue];
+            // Local edits (keys, no updatedAt) always apply; fetched copies only if newer
+            if (existing.updatedAt && (object.updatedAt || !keys) &&
+                [object.updatedAt compare:existing.updatedAt] != NSOrderedDescending) {
+                [result addObject:existing];
+                continue;
+            }
+        }
+        InventoryItem *item;
+        if (!keys) {
+            item = [InventoryItem itemWithObject:object];
+        } else if (position) {
+            item = [self.items[position.unsignedIntegerValue] itemByApplyingKeys:keys ofObject:object];
+        } else {
+            continue;
+        }
+        BarcodeIndexEntry entry = { item.barcode, (uint32_t)(position ? position.unsignedIntegerValue : self.items.count) };
+        if (position) {
+            InventoryItem *previous = self.items[position.unsignedIntegerValue];
+            if (previous.barcode != item.barcode) {
+                [entries appendBytes:&entry length:sizeof(entry)];
+            }
+            EpcKey key;
+            if (item.epc != previous.epc && ![item.epc isEqualToString:previous.epc]) {
+                if (previous.epc && [UgiEpc parseHexString:previous.epc toKey:&key]) {
+                    epcsMoved = YES;
+                } else {
+                    [epcPositions addIndex:entry.item];
+                }
+            }
+            self.items[position.unsignedIntegerValue] = item;
+        } else {
+            [entries appendBytes:&entry length:sizeof(entry)];
+            [epcPositions addIndex:entry.item];
+            _positions[item.objectId] = @(self.items.count);
+            [self.items addObject:item];
+        }
+        [changed addObject:item];
+        [result addObject:item];
+    }
+
+    if (changed.count > 0) {
+        [self field:@"items" appendedObjects:changed];
+        [self updateIndexWithEntries:entries epcPositions:epcPositions epcsMoved:epcsMoved];
+        [[NSNotificationCenter defaultCenter] postNotificationName:InventoryStoreDidChangeNotification object:self];
+    }
+    if (numChanged) {
+        *numChanged = changed.count;
+    }
+    return result;
+}
+
+- (NSArray *) addObjects:(NSArray *)objects {
+    NSArray *items = [self mergeObjects:objects keys:nil changed:NULL];
+    [self save];
+    return items;
+}
+
+- (InventoryItem *) setValues:(NSDictionary *)values
+                       ofItem:(InventoryItem *)item
+                        queue:(OfflineWriteQueue *)queue {
+    return [[self setValues:values ofItems:@[ item ] queue:queue] firstObject] ?: item;
+}
+
+- (NSArray *) setPhase:(NSString *)phase
+               dateKey:(NSString *)dateKey
+                  date:(NSDate *)date
+               ofItems:(NSArray *)items
+                 queue:(OfflineWriteQueue *)queue {
+    NSMutableDictionary *values = [NSMutableDictionary dictionaryWithObject:phase forKey:@"phase"];
+    if (dateKey) {
+        values[dateKey] = date ?: [NSNull null];
+    }
+    return [self setValues:values ofItems:items queue:queue];
+}
+
+//
+// Queue the same write to every item, then apply it to the mirror in one merge and save
+//
+- (NSArray *) setValues:(NSDictionary *)values
+                ofItems:(NSArray *)items
+                  queue:(OfflineWriteQueue *)queue {
+    NSMutableArray *objects = [NSMutableArray arrayWithCapacity:items.count];
+    for (InventoryItem *item in items) {
+        // Queued first: it raises, before the item changes, if a value can't be queued
+        [queue setValues:values ofObjectWithClassName:InventoryClassName objectId:item.objectId];
+        // No updatedAt, so the item keeps its own and the server's copy replaces it on a later sync
+        PFObject *object = [PFObject objectWithoutDataWithClassName:InventoryClassName objectId:item.objectId];
+        for (NSString *key in values) {
+            object[key] = values[key];
+        }
+        [objects addObject:object];
+    }
+    NSArray *merged = [self mergeObjects:objects keys:[values allKeys] changed:NULL];
+    [self save];
+    return merged;
+}
+
+#pragma mark - Syncing
+
+- (BFTask *) sync {
+    if (!_syncTask || _syncTask.isCompleted) {
+        _syncTask = [self syncAfter:self.lastUpdatedAt objectId:self.lastObjectId changed:0];
+    }
+    return _syncTask;
+}
+
+//
+// Fetch one page of the records after (since, objectId) in (updatedAt, objectId) order,
+// then the next until a page comes back short
+//
+- (BFTask *) syncAfter:(NSDate *)since
+              objectId:(NSString *)objectId
+               changed:(NSUInteger)changed {
+    PFQuery *query;
+    if (since && objectId) {
+        // Later records, or ones sharing the timestamp that sort after the last one seen,
+        // so pages neither overlap nor stall on a run of equal timestamps
+        PFQuery *later = [PFQuery queryWithClassName:InventoryClassName];
+        [later whereKey:@"updatedAt" greaterThan:since];
+        PFQuery *tied = [PFQuery queryWithClassName:InventoryClassName];
+        [tied whereKey:@"updatedAt" equalTo:since];
+        [tied whereKey:@"objectId" greaterThan:objectId];
+        query = [PFQuery orQueryWithSubqueries:@[ later, tied ]];
+    } else {
+        query = [PFQuery queryWithClassName:InventoryClassName];
+        if (since) {
+            // Synced before objectIds were kept: at or after, so nothing is skipped
+            [query whereKey:@"updatedAt" greaterThanOrEqualTo:since];
+        }
+    }
+    [query orderByAscending:@"updatedAt"];
+    [query addAscendingOrder:@"objectId"];
+    [InventoryItem selectKeysOfQuery:query];
+    query.limit = SYNC_PAGE_SIZE;
+
+    return [[query findObjectsInBackground] continueWithExecutor:[BFExecutor mainThreadExecutor]
+                                                withSuccessBlock:^id(BFTask *task) {
+        NSArray *objects = task.result;
+        NSUInteger numChanged;
+        [self mergeObjects:objects keys:nil changed:&numChanged];
+        PFObject *last = objects.lastObject;
+        if (last.updatedAt && last.objectId) {
+            self.lastUpdatedAt = last.updatedAt;
+            self.lastObjectId = last.objectId;
+        }
+        [self save];
+
+        if (objects.count < SYNC_PAGE_SIZE || !last.updatedAt || !last.objectId) {
+            return @(changed + numChanged);
+        }
+        return [self syncAfter:last.updatedAt objectId:last.objectId changed:changed + numChanged];
+    }];
+}
+
+- (void) startSyncingWithInterval:(NSTimeInterval)interval {
+    [self stopSyncing];
+    [self sync];
+    _syncTimer = [NSTimer scheduledTimerWithTimeInterval:interval
+                                                  target:self
+                                                selector:@selector(syncTimerFired:)
+                                                userInfo:nil
+                                                 repeats:YES];
+}
+
+- (void) stopSyncing {
+    [_syncTimer invalidate];
+    _syncTimer = nil;
+}
+
+- (void) syncTimerFired:(NSTimer *)timer {
+    [[self sync] continueWithBlock:^id(BFTask *task) {
+        if (task.error) {
+            NSLog(@"InventoryStore: sync failed: %@", task.error);
+        }
+        return nil;
+    }];
+}
+
+@end
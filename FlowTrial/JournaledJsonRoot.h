@@ -0,0 +1,77 @@
+//
+//  JournaledJsonRoot.h
+//  FlowTrial
+//
+//  Created by Wade Sellers on 12/28/14.
+//  Copyright (c) 2014 Wade Sellers. All rights reserved.
+//
+
+#import <Foundation/Foundation.h>
+#import "UgiJson.h"
+
+/**
+ A UgiPersistentJsonRoot whose save costs the size of the change, not of the object.
+
+ UgiPersistentJsonRoot's save rewrites the whole object graph to _filePath every time.
+ This subclass keeps the file at _filePath as a snapshot and, next to it, an append-only
+ journal (see JsonJournal.h). Saving appends the fields that changed since the last save
+ as one checksummed batch and syncs it. When the journal grows bigger than the snapshot,
+ a new snapshot is serialized and written in the background (temporary file, sync,
+ rename, sync directory), then the journal entries it covers are dropped. Loading reads
+ the snapshot as usual and replays the journal on top; a batch torn by a crash is
+ ignored, so the file is never left half written.
+
+ Changes are found with key-value observing, so assigning a property is enough. Objects
+ changed in place (adding to a mutable array, editing a child object) are not seen:
+ call fieldChanged: for those, or field:appendedObjects: so only the new objects are
+ journaled.
+
+ Subclasses that override initNonPersistent: must call super first; the journal is
+ replayed there. Like its superclass this is not thread safe; use it from one thread.
+ */
+@interface JournaledJsonRoot : UgiPersistentJsonRoot
+
+//! Generation of the last snapshot; journal entries written before it are already in it
+@property (nonatomic) long long journalGeneration;
+
+/**
+ Journal a field on the next save (for in-place changes key-value observing can't see)
+
+ @param field   Property name
+ */
+- (void) fieldChanged:(NSString *)field;
+
+/**
+ Journal objects that were added to the end of an array field, without journaling the
+ rest of the array. Call after adding them.
+
+ @param field   Property name of a mutable array
+ @param objects Objects that were added
+ */
+- (void) field:(NSString *)field
+appendedObjects:(NSArray *)objects;
+
+/**
+ Append the changes since the last save to the journal and sync it
+ */
+- (void) save;
+
+/**
+ Write a snapshot now and empty the journal (normally this happens in the background
+ when the journal outgrows the snapshot). Waits until it is done.
+ */
+- (void) compact;
+
+/**
+ Wait for background snapshot writing to finish
+ */
+- (void) waitForCompaction;
+
+/**
+ Bytes in the journal
+
+ @return  Journal length
+ */
+- (unsigned long long) journalLength;
+
+@end
@@ -0,0 +1,345 @@
+//
+//  JournaledJsonRoot.m
+//  FlowTrial
+//
+//  Created by Wade Sellers on 12/28/14.
+//  Copyright (c) 2014 Wade Sellers. All rights reserved.
+//
+
+#import "JournaledJsonRoot.h"
+#import "JsonJournal.h"
+#import "JsonModelReader.h"
+#import "JsonPlan.h"
+
+//! The journal is _filePath with this added
+#define JOURNAL_SUFFIX @".journal"
+
+//! Don't bother compacting journals smaller than this, however small the snapshot
+#define MIN_COMPACTION_BYTES (64 * 1024)
+
+static int ObservationContext;
+
+@implementation JournaledJsonRoot {
+    // Instance variables rather than properties, so they are not serialized
+    JsonJournal _journal;
+    BOOL _journalOpen;
+    BOOL _hasSnapshot;                      // Main thread only
+    dispatch_queue_t _ioQueue;              // Journal writes, in order
+    dispatch_queue_t _compactionQueue;      // Snapshot writes
+    BOOL _compacting;                       // On _ioQueue
+    unsigned long long _snapshotLength;     // On _ioQueue
+    NSArray *_observedFields;
+    NSMutableOrderedSet *_changedFields;
+    NSMutableDictionary *_appendedObjects;
+}
+
+#pragma mark - Loading
+
+- (void) initNonPersistent:(NSDictionary *)initializationData {
+    // The snapshot has been loaded by now; bring it up to date before anything else sees it
+    [self openJournal];
+    [super initNonPersistent:initializationData];
+}
+
+- (void) dealloc {
+    for (NSString *field in _observedFields) {
+        [self removeObserver:self forKeyPath:field context:&ObservationContext];
+    }
+    if (_journalOpen) {
+        JsonJournalClose(&_journal);
+    }
+}
+
+//
+// Apply one journal entry, reading its value as the one field of an object
+//
+- (void) replayEntry:(const JsonJournalEntry *)entry {
+    NSString *field = [[NSString alloc] initWithBytes:entry->name length:entry->nameLength encoding:NSUTF8StringEncoding];
+    JsonWriter keyWriter;
+    if (!field || !JsonWriterInit(&keyWriter, entry->nameLength + 8, NULL, NULL)) {
+        return;
+    }
+    JsonWriterKey(&keyWriter, entry->name, entry->nameLength);
+    NSMutableData *json = [NSMutableData dataWithCapacity:keyWriter.length + entry->valueLength + 2];
+    [json appendBytes:"{" length:1];
+    [json appendBytes:keyWriter.bytes length:keyWriter.length];
+    [json appendBytes:entry->value length:entry->valueLength];
+    [json appendBytes:"}" length:1];
+    JsonWriterFree(&keyWriter);
+
+    id existing = entry->op == JSON_JOURNAL_APPEND ? [self valueForKey:field] : nil;
+    NSError *error;
+    if (![JsonModelReader readFieldsIntoObject:self fromData:json error:&error]) {
+        NSLog(@"JournaledJsonRoot: can't replay %@: %@", field, error);
+        return;
+    }
+    if (entry->op == JSON_JOURNAL_APPEND && existing) {
+        id added = [self valueForKey:field];
+        if ([added isKindOfClass:[NSSet class]]) {
+            added = [added allObjects];
+        }
+        id all = [existing mutableCopy];
+        [all addObjectsFromArray:added];
+        [self setValue:all forKey:field];
+    }
+}
+
+static void replayBatch(void *context, uint64_t generation, const JsonJournalEntry *entries, int count) {
+    JournaledJsonRoot *root = (__bridge JournaledJsonRoot *)context;
+    if ((long long)generation < root.journalGeneration) {
+        return;  // Written before the snapshot was taken, so already in it
+    }
+    for (int i = 0; i < count; i++) {
+        [root replayEntry:&entries[i]];
+    }
+}
+
+- (void) openJournal {
+    if (_ioQueue) {
+        return;
+    }
+    _ioQueue = dispatch_queue_create("JournaledJsonRoot", DISPATCH_QUEUE_SERIAL);
+    _compactionQueue = dispatch_queue_create("JournaledJsonRoot.compaction", DISPATCH_QUEUE_SERIAL);
+    _changedFields = [NSMutableOrderedSet orderedSet];
+    _appendedObjects = [NSMutableDictionary dictionary];
+
+    NSString *path = self._filePath;
+    if (path) {
+        NSString *journalPath = [path stringByAppendingString:JOURNAL_SUFFIX];
+        NSDictionary *attributes = [[NSFileManager defaultManager] attributesOfItemAtPath:path error:nil];
+        _hasSnapshot = attributes != nil;
+        _snapshotLength = attributes.fileSize;
+        if (!_hasSnapshot) {
+            // The first save writes a snapshot before journaling anything, so a journal
+            // without one is left over from a deleted file
+            [[NSFileManager defaultManager] removeItemAtPath:journalPath error:nil];
+        }
+        _journalOpen = JsonJournalOpen(&_journal, journalPath.fileSystemRepresentation, replayBatch, (__bridge void *)self);
+        if (!_journalOpen) {
+            NSLog(@"JournaledJsonRoot: can't open %@: %s", journalPath, strerror(errno));
+        }
+    }
+
+    NSMutableArray *fields = [[JsonPlan planForClass:[self class]].fieldNames mutableCopy];
+    [fields removeObject:NSStringFromSelector(@selector(journalGeneration))];
+    for (NSString *field in fields) {
+        [self addObserver:self forKeyPath:field options:0 context:&ObservationContext];
+    }
+    _observedFields = fields;
+}
+
+#pragma mark - Changes
+
+- (void) observeValueForKeyPath:(NSString *)keyPath
+                       ofObject:(id)object
+                         change:(NSDictionary *)change
+                        context:(void *)context {
+    if (context != &ObservationContext) {
+        [super observeValueForKeyPath:keyPath ofObject:object change:change context:context];
+        return;
+    }
+    [_changedFields addObject:keyPath];
+}
+
+- (void) fieldChanged:(NSString *)field {
+    [_changedFields addObject:field];
+}
+
+- (void) field:(NSString *)field
+appendedObjects:(NSArray *)objects {
+    if ([_changedFields containsObject:field]) {
+        return;  // The whole field is going out anyway
+    }
+    NSMutableArray *appended = _appendedObjects[field];
+    if (!appended) {
+        appended = [NSMutableArray array];
+        _appendedObjects[field] = appended;
+    }
+    [appended addObjectsFromArray:objects];
+}
+
+- (NSData *) jsonForField:(NSString *)field {
+    JsonWriter writer;
+    if (!JsonWriterInit(&writer, 256, NULL, NULL)) {
+        return nil;
+    }
+    if (![[JsonPlan planForClass:[self class]] writeField:field ofObject:self toWriter:&writer] || writer.failed) {
+        JsonWriterFree(&writer);
+        return nil;
+    }
+    return [NSData dataWithBytesNoCopy:writer.bytes length:writer.length freeWhenDone:YES];
+}
+
+#pragma mark - Saving
+
+- (void) save {
+    if (!_journalOpen) {
+        [super save];
+        return;
+    }
+    if (!_hasSnapshot) {
+        // The journal needs a snapshot to build on
+        [self compact];
+        return;
+    }
+    if (_changedFields.count == 0 && _appendedObjects.count == 0) {
+        return;
+    }
+
+    // Keep the names and values alive until the batch is written
+    NSMutableArray *buffers = [NSMutableArray array];
+    NSUInteger maxEntries = _changedFields.count + _appendedObjects.count;
+    JsonJournalEntry *entries = calloc(maxEntries, sizeof(JsonJournalEntry));
+    int count = 0;
+    for (NSString *field in _changedFields) {
+        NSData *value = [self jsonForField:field];
+        if (!value) {
+            continue;
+        }
+        NSData *name = [field dataUsingEncoding:NSUTF8StringEncoding];
+        [buffers addObject:name];
+        [buffers addObject:value];
+        entries[count++] = (JsonJournalEntry){ JSON_JOURNAL_SET, name.bytes, name.length, value.bytes, value.length };
+    }
+    for (NSString *field in _appendedObjects) {
+        if ([_changedFields containsObject:field]) {
+            continue;
+        }
+        NSData *value = [_appendedObjects[field] toJsonData];
+        if (!value) {
+            continue;
+        }
+        NSData *name = [field dataUsingEncoding:NSUTF8StringEncoding];
+        [buffers addObject:name];
+        [buffers addObject:value];
+        entries[count++] = (JsonJournalEntry){ JSON_JOURNAL_APPEND, name.bytes, name.length, value.bytes, value.length };
+    }
+
+    __block BOOL ok = YES;
+    __block BOOL journalFailed = NO;
+    __block int error = 0;
+    __block BOOL compactNow = NO;
+    __block uint64_t offset = 0;
+    uint64_t generation = (uint64_t)self.journalGeneration;
+    if (count > 0) {
+        dispatch_sync(_ioQueue, ^{
+            ok = JsonJournalAppend(&self->_journal, generation, entries, count, true);
+            error = errno;
+            journalFailed = self->_journal.failedError != 0;
+            if (ok && !self->_compacting &&
+                self->_journal.length > MAX(MIN_COMPACTION_BYTES, self->_snapshotLength)) {
+                self->_compacting = YES;
+                offset = self->_journal.length;
+                compactNow = YES;
+            }
+        });
+    }
+    free(entries);
+    if (journalFailed) {
+        [self abandonJournal];
+        [self save];
+        return;
+    }
+    if (!ok) {
+        // Leave the changes pending so the next save tries again
+        NSLog(@"JournaledJsonRoot: journal write failed: %s", strerror(error));
+        return;
+    }
+    [_changedFields removeAllObjects];
+    [_appendedObjects removeAllObjects];
+    if (compactNow) {
+        [self writeSnapshotCoveringJournal:offset wait:NO];
+    }
+}
+
+//
+// The journal can't be written any more (see JsonJournalDropPrefix): save whole
+// snapshots from now on, newer than anything left in the journal file
+//
+- (void) abandonJournal {
+    dispatch_sync(_ioQueue, ^{
+        NSLog(@"JournaledJsonRoot: journal failed, saving snapshots only: %s", strerror(self->_journal.failedError));
+        JsonJournalClose(&self->_journal);
+        self->_journalOpen = NO;
+    });
+    self.journalGeneration++;
+    [_changedFields removeAllObjects];
+    [_appendedObjects removeAllObjects];
+}
+
+- (void) compact {
+    if (!_journalOpen) {
+        [super save];
+        return;
+    }
+    [self waitForCompaction];
+    __block uint64_t offset;
+    dispatch_sync(_ioQueue, ^{
+        self->_compacting = YES;
+        offset = self->_journal.length;
+    });
+    if ([self writeSnapshotCoveringJournal:offset wait:YES]) {
+        // Only now is anything not yet journaled safe; if the write failed it stays
+        // pending for the next save
+        _hasSnapshot = YES;
+        [_changedFields removeAllObjects];
+        [_appendedObjects removeAllObjects];
+    }
+}
+
+//
+// Serialize a snapshot (on this thread, so it is consistent), then write it and drop
+// the first offset bytes of the journal on the compaction queue. Returns whether the
+// snapshot was written when waiting, YES when not.
+//
+- (BOOL) writeSnapshotCoveringJournal:(uint64_t)offset
+                                 wait:(BOOL)wait {
+    // Entries journaled from here on are newer than the snapshot
+    self.journalGeneration++;
+    NSData *snapshot = [self toJsonData];
+
+    NSString *path = self._filePath;
+    __block BOOL written = NO;
+    dispatch_block_t write = ^{
+        written = snapshot && JsonFileReplace(path.fileSystemRepresentation, snapshot.bytes, snapshot.length);
+        if (!written) {
+            NSLog(@"JournaledJsonRoot: can't write %@: %s", path, strerror(errno));
+        }
+        dispatch_sync(self->_ioQueue, ^{
+            if (written) {
+                self->_snapshotLength = snapshot.length;
+                if (self->_journalOpen && !JsonJournalDropPrefix(&self->_journal, offset)) {
+                    // Harmless: the old entries are skipped by generation when replayed
+                    NSLog(@"JournaledJsonRoot: can't trim journal: %s", strerror(errno));
+                }
+            }
+            self->_compacting = NO;
+        });
+    };
+    if (wait) {
+        dispatch_sync(_compactionQueue, write);
+        return written;
+    }
+    // Only called by save, with nothing pending and a snapshot already on disk
+    dispatch_async(_compactionQueue, write);
+    return YES;
+}
+
+- (void) waitForCompaction {
+    if (_compactionQueue) {
+        dispatch_sync(_compactionQueue, ^{});
+    }
+}
+
+- (unsigned long long) journalLength {
+    if (!_journalOpen) {
+        return 0;
+    }
+    __block unsigned long long length;
+    dispatch_sync(_ioQueue, ^{
+        length = self->_journal.length;
+    });
+    return length;
+}
+
+@end
@@ -0,0 +1,337 @@
+//
+//  JsonJournal.c
+//  FlowTrial
+//
+//  Created by Wade Sellers on 12/28/14.
+//  Copyright (c) 2014 Wade Sellers. All rights reserved.
+//
+
+#include "JsonJournal.h"
+
+#include <errno.h>
+#include <fcntl.h>
+#include <libgen.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+//! Most entries in one batch that replay can hand back
+#define JSON_JOURNAL_MAX_BATCH 4096
+
+static uint32_t checksum(const JsonJournalRecordHeader *header, const uint8_t *payload) {
+    uint32_t hash = 2166136261u;
+    const uint8_t *bytes = (const uint8_t *)&header->generation;
+    size_t headerBytes = sizeof(*header) - offsetof(JsonJournalRecordHeader, generation);
+    for (size_t i = 0; i < headerBytes; i++) {
+        hash ^= bytes[i];
+        hash *= 16777619u;
+    }
+    for (uint32_t i = 0; i < header->length; i++) {
+        hash ^= payload[i];
+        hash *= 16777619u;
+    }
+    return hash;
+}
+
+//
+// Sync a file to storage. On iOS fsync only reaches the drive's cache; F_FULLFSYNC
+// is what makes the ordering guarantees real.
+//
+static bool syncFile(int fd) {
+#ifdef F_FULLFSYNC
+    if (fcntl(fd, F_FULLFSYNC) == 0) {
+        return true;
+    }
+#endif
+    return fsync(fd) == 0;
+}
+
+//
+// Sync the directory holding path, so a rename into it is durable
+//
+static bool syncDirectory(const char *path) {
+    char *copy = strdup(path);
+    if (!copy) {
+        errno = ENOMEM;
+        return false;
+    }
+    int fd = open(dirname(copy), O_RDONLY);
+    free(copy);
+    if (fd < 0) {
+        return false;
+    }
+    bool ok = syncFile(fd);
+    close(fd);
+    return ok;
+}
+
+static bool writeAll(int fd, const uint8_t *bytes, size_t length) {
+    while (length > 0) {
+        ssize_t written = write(fd, bytes, length);
+        if (written < 0) {
+            if (errno == EINTR) {
+                continue;
+            }
+            return false;
+        }
+        bytes += written;
+        length -= (size_t)written;
+    }
+    return true;
+}
+
+static bool readAll(int fd, uint8_t *bytes, size_t length) {
+    while (length > 0) {
+        ssize_t bytesRead = read(fd, bytes, length);
+        if (bytesRead < 0) {
+            if (errno == EINTR) {
+                continue;
+            }
+            return false;
+        }
+        if (bytesRead == 0) {
+            errno = EIO;
+            return false;
+        }
+        bytes += bytesRead;
+        length -= (size_t)bytesRead;
+    }
+    return true;
+}
+
+//
+// Walk the records in a journal's contents, replaying committed batches.
+// Returns the length of the valid prefix.
+//
+static uint64_t replayRecords(const uint8_t *bytes, uint64_t length,
+                              JsonJournalReplayFunction replay, void *context,
+                              JsonJournalEntry *entries) {
+    uint64_t committed = 0;
+    uint64_t offset = 0;
+    int count = 0;
+    while (length - offset >= sizeof(JsonJournalRecordHeader)) {
+        JsonJournalRecordHeader header;
+        memcpy(&header, bytes + offset, sizeof(header));
+        const uint8_t *payload = bytes + offset + sizeof(header);
+        if (header.magic != JSON_JOURNAL_MAGIC ||
+            header.length > length - offset - sizeof(header) ||
+            header.nameLength > header.length ||
+            count == JSON_JOURNAL_MAX_BATCH ||
+            checksum(&header, payload) != header.checksum) {
+            break;
+        }
+        JsonJournalEntry *entry = &entries[count++];
+        entry->op = (JsonJournalOp)header.op;
+        entry->name = (const char *)payload;
+        entry->nameLength = header.nameLength;
+        entry->value = payload + header.nameLength;
+        entry->valueLength = header.length - header.nameLength;
+        offset += sizeof(header) + header.length;
+
+        if (header.flags & JSON_JOURNAL_COMMIT) {
+            if (replay) {
+                replay(context, header.generation, entries, count);
+            }
+            count = 0;
+            committed = offset;
+        }
+    }
+    return committed;
+}
+
+bool JsonJournalOpen(JsonJournal *journal, const char *path,
+                     JsonJournalReplayFunction replay, void *context) {
+    memset(journal, 0, sizeof(*journal));
+    journal->path = strdup(path);
+    journal->fd = open(path, O_RDWR | O_CREAT, 0644);
+    struct stat info;
+    if (!journal->path || journal->fd < 0 || fstat(journal->fd, &info) != 0) {
+        int error = journal->path ? errno : ENOMEM;
+        JsonJournalClose(journal);
+        errno = error;
+        return false;
+    }
+
+    uint64_t fileLength = (uint64_t)info.st_size;
+    if (fileLength > 0) {
+        uint8_t *bytes = malloc((size_t)fileLength);
+        JsonJournalEntry *entries = malloc(JSON_JOURNAL_MAX_BATCH * sizeof(JsonJournalEntry));
+        bool ok = bytes && entries && readAll(journal->fd, bytes, (size_t)fileLength);
+        int error = bytes && entries ? errno : ENOMEM;
+        if (ok) {
+            journal->length = replayRecords(bytes, fileLength, replay, context, entries);
+        }
+        free(bytes);
+        free(entries);
+        if (!ok) {
+            JsonJournalClose(journal);
+            errno = error;
+            return false;
+        }
+    }
+
+    // Cut off a torn tail so new batches follow the last committed one
+    if (journal->length < fileLength &&
+        (ftruncate(journal->fd, (off_t)journal->length) != 0 || !syncFile(journal->fd))) {
+        int error = errno;
+        JsonJournalClose(journal);
+        errno = error;
+        return false;
+    }
+    lseek(journal->fd, (off_t)journal->length, SEEK_SET);
+    return true;
+}
+
+void JsonJournalClose(JsonJournal *journal) {
+    if (journal->fd >= 0) {
+        close(journal->fd);
+    }
+    free(journal->path);
+    journal->fd = -1;
+    journal->path = NULL;
+    journal->length = 0;
+    journal->failedError = 0;
+}
+
+bool JsonJournalAppend(JsonJournal *journal, uint64_t generation,
+                       const JsonJournalEntry *entries, int count, bool sync) {
+    if (journal->failedError) {
+        errno = journal->failedError;
+        return false;
+    }
+    if (count <= 0 || count > JSON_JOURNAL_MAX_BATCH) {
+        errno = EINVAL;
+        return false;
+    }
+    size_t total = 0;
+    for (int i = 0; i < count; i++) {
+        if (entries[i].nameLength > UINT16_MAX ||
+            entries[i].nameLength + entries[i].valueLength > UINT32_MAX) {
+            errno = EINVAL;
+            return false;
+        }
+        total += sizeof(JsonJournalRecordHeader) + entries[i].nameLength + entries[i].valueLength;
+    }
+
+    // The whole batch goes out in one write
+    uint8_t *batch = malloc(total);
+    if (!batch) {
+        errno = ENOMEM;
+        return false;
+    }
+    uint8_t *next = batch;
+    for (int i = 0; i < count; i++) {
+        const JsonJournalEntry *entry = &entries[i];
+        JsonJournalRecordHeader header;
+        memset(&header, 0, sizeof(header));
+        header.magic = JSON_JOURNAL_MAGIC;
+        header.generation = generation;
+        header.length = (uint32_t)(entry->nameLength + entry->valueLength);
+        header.nameLength = (uint16_t)entry->nameLength;
+        header.op = (uint8_t)entry->op;
+        header.flags = i == count - 1 ? JSON_JOURNAL_COMMIT : 0;
+        uint8_t *payload = next + sizeof(header);
+        memcpy(payload, entry->name, entry->nameLength);
+        memcpy(payload + entry->nameLength, entry->value, entry->valueLength);
+        header.checksum = checksum(&header, payload);
+        memcpy(next, &header, sizeof(header));
+        next = payload + header.length;
+    }
+
+    bool ok = writeAll(journal->fd, batch, total) && (!sync || syncFile(journal->fd));
+    int error = errno;
+    free(batch);
+    if (!ok) {
+        // Take back whatever part of the batch made it out
+        ftruncate(journal->fd, (off_t)journal->length);
+        lseek(journal->fd, (off_t)journal->length, SEEK_SET);
+        errno = error;
+        return false;
+    }
+    journal->length += total;
+    return true;
+}
+
+bool JsonJournalDropPrefix(JsonJournal *journal, uint64_t offset) {
+    if (journal->failedError) {
+        errno = journal->failedError;
+        return false;
+    }
+    if (offset == 0) {
+        return true;
+    }
+    if (offset > journal->length) {
+        errno = EINVAL;
+        return false;
+    }
+    size_t tailLength = (size_t)(journal->length - offset);
+    uint8_t *tail = malloc(tailLength ? tailLength : 1);
+    if (!tail) {
+        errno = ENOMEM;
+        return false;
+    }
+    bool ok = lseek(journal->fd, (off_t)offset, SEEK_SET) >= 0 &&
+              readAll(journal->fd, tail, tailLength) &&
+              JsonFileReplace(journal->path, tail, tailLength);
+    int error = errno;
+    free(tail);
+    if (!ok) {
+        lseek(journal->fd, (off_t)journal->length, SEEK_SET);
+        errno = error;
+        return false;
+    }
+
+    // The journal's path now names the new file. The old descriptor is for the unlinked
+    // file, so appends through it would be lost: without a new one the journal is done.
+    int fd = open(journal->path, O_RDWR);
+    if (fd < 0) {
+        error = errno;
+        close(journal->fd);
+        journal->fd = -1;
+        journal->length = tailLength;
+        journal->failedError = error;
+        errno = error;
+        return false;
+    }
+    close(journal->fd);
+    journal->fd = fd;
+    journal->length = tailLength;
+    lseek(journal->fd, (off_t)journal->length, SEEK_SET);
+    return true;
+}
+
+bool JsonFileReplace(const char *path, const uint8_t *bytes, size_t length) {
+    size_t pathLength = strlen(path);
+    char *temporary = malloc(pathLength + sizeof(".tmp"));
+    if (!temporary) {
+        errno = ENOMEM;
+        return false;
+    }
+    memcpy(temporary, path, pathLength);
+    memcpy(temporary + pathLength, ".tmp", sizeof(".tmp"));
+
+    int fd = open(temporary, O_WRONLY | O_CREAT | O_TRUNC, 0644);
+    bool ok = fd >= 0 && writeAll(fd, bytes, length) && syncFile(fd);
+    int error = ok ? 0 : errno;
+    if (fd >= 0 && close(fd) != 0 && ok) {
+        ok = false;
+        error = errno;
+    }
+    // Only rename once the new contents are on storage
+    if (ok && rename(temporary, path) != 0) {
+        ok = false;
+        error = errno;
+    }
+    if (!ok) {
+        unlink(temporary);
+    } else if (!syncDirectory(path)) {
+        // The new file is in place but the rename may not survive a crash yet
+        ok = false;
+        error = errno;
+    }
+    free(temporary);
+    errno = ok ? 0 : error;
+    return ok;
+}
@@ -0,0 +1,160 @@
+//
+//  JsonJournal.h
+//  FlowTrial
+//
+//  Created by Wade Sellers on 12/28/14.
+//  Copyright (c) 2014 Wade Sellers. All rights reserved.
+//
+
+#ifndef FlowTrial_JsonJournal_h
+#define FlowTrial_JsonJournal_h
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+///////////////////////////////////////////////////////////////////////////////////////
+#pragma mark - File format
+///////////////////////////////////////////////////////////////////////////////////////
+
+//! Marks a journal record header ("JRNL")
+#define JSON_JOURNAL_MAGIC 0x4C4E524Au
+
+//! Set on the last record of a batch; a batch only counts once this record is in the file
+#define JSON_JOURNAL_COMMIT 0x01
+
+/**
+ What a journal entry does to its field
+ */
+typedef enum {
+    JSON_JOURNAL_SET = 0,       //!< The value replaces the field
+    JSON_JOURNAL_APPEND = 1     //!< The value is an array of objects to add to the field
+} JsonJournalOp;
+
+/**
+ Record header. The header is followed by the field name and then the JSON value;
+ length covers both.
+ */
+typedef struct {
+    uint32_t magic;             //!< JSON_JOURNAL_MAGIC
+    uint32_t checksum;          //!< FNV-1a over the rest of the header and the payload
+    uint64_t generation;        //!< Snapshot generation the record was written against
+    uint32_t length;            //!< Payload bytes (name + value)
+    uint16_t nameLength;        //!< Bytes of field name at the start of the payload
+    uint8_t op;                 //!< JsonJournalOp
+    uint8_t flags;              //!< JSON_JOURNAL_COMMIT
+} JsonJournalRecordHeader;
+
+///////////////////////////////////////////////////////////////////////////////////////
+#pragma mark - Types
+///////////////////////////////////////////////////////////////////////////////////////
+
+/**
+ One field-level change
+ */
+typedef struct {
+    JsonJournalOp op;
+    const char *name;           //!< Field name (UTF-8, not NUL terminated)
+    size_t nameLength;
+    const uint8_t *value;       //!< JSON value
+    size_t valueLength;
+} JsonJournalEntry;
+
+/**
+ Called for each committed batch when a journal is opened
+
+ @param context     Context passed to JsonJournalOpen
+ @param generation  Generation the batch was written against
+ @param entries     Entries of the batch, in order (valid only during the call)
+ @param count       Number of entries
+ */
+typedef void (*JsonJournalReplayFunction)(void *context, uint64_t generation,
+                                          const JsonJournalEntry *entries, int count);
+
+/**
+ An append-only journal of field-level changes, kept next to a snapshot file.
+
+ Changes are appended in batches (one per save) with a single write, then synced, so a
+ save costs the size of the change rather than the size of the object graph. Each record
+ is checksummed and the last one of a batch carries JSON_JOURNAL_COMMIT, so a crash in
+ the middle of a write leaves a torn tail that is detected and cut off the next time the
+ journal is opened; the batches before it are intact.
+
+ Compaction happens outside the journal: the owner writes a new snapshot with
+ JsonFileReplace, then drops the part of the journal that the snapshot covers with
+ JsonJournalDropPrefix. Records carry the generation they were written against, so a
+ crash between those two steps is harmless: records older than the snapshot's generation
+ are skipped on replay.
+
+ Not thread safe.
+ */
+typedef struct {
+    int fd;
+    char *path;
+    uint64_t length;            //!< Bytes of committed records in the file
+    int failedError;            //!< errno of the failure that left the journal unusable, 0 if none
+} JsonJournal;
+
+///////////////////////////////////////////////////////////////////////////////////////
+#pragma mark - Functions
+///////////////////////////////////////////////////////////////////////////////////////
+
+/**
+ Open a journal (creating it if needed), replay its committed batches and cut off any
+ torn tail
+
+ @param journal     Journal to initialize
+ @param path        Journal file
+ @param replay      Called for each committed batch, may be NULL
+ @param context     Passed to replay
+ @return            false on failure (errno is set)
+ */
+bool JsonJournalOpen(JsonJournal *journal, const char *path,
+                     JsonJournalReplayFunction replay, void *context);
+
+/**
+ Close a journal
+ */
+void JsonJournalClose(JsonJournal *journal);
+
+/**
+ Append a batch of entries as one write
+
+ @param journal     Journal
+ @param generation  Current snapshot generation
+ @param entries     Entries
+ @param count       Number of entries (at least one)
+ @param sync        Sync to storage before returning
+ @return            false on failure (errno is set); the journal is left as it was.
+                    Always false once the journal has failed (see JsonJournalDropPrefix).
+ */
+bool JsonJournalAppend(JsonJournal *journal, uint64_t generation,
+                       const JsonJournalEntry *entries, int count, bool sync);
+
+/**
+ Drop the first bytes of the journal (records now covered by a snapshot). The rest is
+ copied to a new file which replaces the journal atomically.
+
+ @param journal     Journal
+ @param offset      Journal length when the snapshot was taken
+ @return            false on failure (errno is set); the journal is left as it was,
+                    unless the new file replaced it but could not be opened: then the
+                    file on disk is whole but the journal has failed (failedError is set)
+                    and every later append or drop fails until it is closed and opened
+                    again
+ */
+bool JsonJournalDropPrefix(JsonJournal *journal, uint64_t offset);
+
+/**
+ Replace a file atomically and durably: write a temporary file, sync it, rename it over
+ the file and sync the directory. Readers see either the old file or the new one, even
+ after a crash.
+
+ @param path        File to replace
+ @param bytes       New contents
+ @param length      Number of bytes
+ @return            false on failure (errno is set); the file is left as it was
+ */
+bool JsonFileReplace(const char *path, const uint8_t *bytes, size_t length);
+
+#endif
@@ -0,0 +1,83 @@
+//
+//  JsonModelReader.h
+//  FlowTrial
+//
+//  Created by Wade Sellers on 12/27/14.
+//  Copyright (c) 2014 Wade Sellers. All rights reserved.
+//
+
+#import <Foundation/Foundation.h>
+#import "JsonReader.h"
+#import "EpcKey.h"
+
+//! Error domain for JsonModelReader errors; the code is the byte offset of the error
+extern NSString * const JsonModelReaderErrorDomain;
+
+/**
+ Builds model objects from JSON as it is read from a stream, field by field, using
+ JsonReader. Memory used for parsing stays bounded (the stream buffer plus the longest
+ string); only the objects being built grow.
+
+ Objects are filled in through their properties like UgiJson: primitives through their
+ typed setters, NSDate from [UgiJson dateToJson:] numbers, NSData from hex strings,
+ model objects recursively, and arrays with the element class from UGI_FIELD_TYPE.
+ UGI_FIELD_IGNORE, UGI_FIELD_CUSTOM_DESERIALIZATION and handleUnrecognizedField: are
+ honored. Unknown fields are skipped without being built.
+ */
+@interface JsonModelReader : NSObject
+
+/**
+ Read an object from a stream
+
+ @param objectClass     Class of the top level object, or of the elements if it is an
+                        array (nil for Foundation objects)
+ @param stream          Open input stream
+ @param error           Set on failure
+ @return                New object, nil on failure
+ */
++ (id) readObjectOfClass:(Class)objectClass
+              fromStream:(NSInputStream *)stream
+                   error:(NSError **)error;
+
+/**
+ Read an object from data
+
+ @param objectClass     Class of the top level object, or of the elements if it is an
+                        array (nil for Foundation objects)
+ @param data            JSON
+ @param error           Set on failure
+ @return                New object, nil on failure
+ */
++ (id) readObjectOfClass:(Class)objectClass
+                fromData:(NSData *)data
+                   error:(NSError **)error;
+
+/**
+ Read the fields of a JSON object into an existing object. Fields that aren't in the
+ JSON are left as they are.
+
+ @param object  Object to fill in
+ @param data    JSON object
+ @param error   Set on failure (fields read before the error have been set)
+ @return        NO on failure
+ */
++ (BOOL) readFieldsIntoObject:(id)object
+                     fromData:(NSData *)data
+                        error:(NSError **)error;
+
+/**
+ Read a JSON array of EPCs (hex strings, or UgiEpc objects as {"data": hex}) straight
+ into an array of EpcKeys, without creating an object per EPC
+
+ @param stream  Open input stream
+ @param keys    Set to the keys (free with free())
+ @param count   Set to the number of keys
+ @param error   Set on failure
+ @return        NO on failure
+ */
++ (BOOL) readEpcKeysFromStream:(NSInputStream *)stream
+                          keys:(EpcKey **)keys
+                         count:(uint32_t *)count
+                         error:(NSError **)error;
+
+@end
@@ -0,0 +1,597 @@
+//
+//  JsonModelReader.m
+//  FlowTrial
+//
+//  Created by Wade Sellers on 12/27/14.
+//  Copyright (c) 2014 Wade Sellers. All rights reserved.
+//
+
+#import <objc/runtime.h>
+#import "JsonModelReader.h"
+#import "HexCodec.h"
+#import "UgiJson.h"
+
+NSString * const JsonModelReaderErrorDomain = @"JsonModelReader";
+
+#define ANNOTATION_PREFIX "_UgiJson_annotation_"
+#define ANNOTATION_SEPARATOR @"ž"
+
+#define STREAM_BUFFER_SIZE 16384
+#define MAX_TOKEN_LENGTH (1024 * 1024)
+
+typedef enum {
+    FIELD_BOOL,
+    FIELD_SIGNED,
+    FIELD_UNSIGNED,
+    FIELD_FLOAT,
+    FIELD_DOUBLE,
+    FIELD_OBJECT
+} FieldKind;
+
+///////////////////////////////////////////////////////////////////////////////////////
+#pragma mark - JsonReadField / JsonReadPlan
+///////////////////////////////////////////////////////////////////////////////////////
+
+/**
+ How to set one property
+ */
+@interface JsonReadField : NSObject
+
+@property (nonatomic) NSString *name;
+@property (nonatomic) SEL setter;
+@property (nonatomic) IMP imp;
+@property (nonatomic) FieldKind kind;
+@property (nonatomic) char typeChar;
+@property (nonatomic) Class valueClass;
+@property (nonatomic) Class elementClass;
+@property (nonatomic) BOOL customDeserialization;
+
+@end
+
+@implementation JsonReadField
+@end
+
+/**
+ Settable properties of a class by JSON key, worked out once per class
+ */
+@interface JsonReadPlan : NSObject
+
+@property (nonatomic) NSDictionary *fields;
+@property (nonatomic) BOOL handlesUnrecognizedFields;
+
++ (JsonReadPlan *) planForClass:(Class)planClass;
+
+@end
+
+@implementation JsonReadPlan
+
++ (JsonReadPlan *) planForClass:(Class)planClass {
+    static NSMapTable *plans;
+    static dispatch_queue_t plansQueue;
+    static dispatch_once_t onceToken;
+    dispatch_once(&onceToken, ^{
+        plans = [NSMapTable mapTableWithKeyOptions:NSPointerFunctionsOpaqueMemory | NSPointerFunctionsOpaquePersonality
+                                      valueOptions:NSPointerFunctionsStrongMemory];
+        plansQueue = dispatch_queue_create("JsonReadPlan", DISPATCH_QUEUE_SERIAL);
+    });
+    __block JsonReadPlan *plan;
+    dispatch_sync(plansQueue, ^{
+        plan = [plans objectForKey:planClass];
+        if (!plan) {
+            plan = [[JsonReadPlan alloc] initWithClass:planClass];
+            [plans setObject:plan forKey:planClass];
+        }
+    });
+    return plan;
+}
+
+- (id) initWithClass:(Class)planClass {
+    self = [super init];
+    if (self) {
+        self.handlesUnrecognizedFields = [planClass instancesRespondToSelector:@selector(handleUnrecognizedField:value:context:)];
+        NSMutableDictionary *fields = [NSMutableDictionary dictionary];
+        NSMutableSet *ignored = [NSMutableSet set];
+        NSMutableSet *custom = [NSMutableSet set];
+        NSMutableDictionary *elementClasses = [NSMutableDictionary dictionary];
+
+        for (Class c = planClass; c && c != [NSObject class]; c = class_getSuperclass(c)) {
+            unsigned int count;
+            objc_property_t *list = class_copyPropertyList(c, &count);
+            for (unsigned int i = 0; i < count; i++) {
+                const char *cName = property_getName(list[i]);
+                NSString *name = @(cName);
+                if (strncmp(cName, ANNOTATION_PREFIX, strlen(ANNOTATION_PREFIX)) == 0) {
+                    NSArray *parts = [[name substringFromIndex:strlen(ANNOTATION_PREFIX)] componentsSeparatedByString:ANNOTATION_SEPARATOR];
+                    if (parts.count >= 3 && [parts[0] isEqualToString:@"field"]) {
+                        if ([parts[2] isEqualToString:@"ignore"]) {
+                            [ignored addObject:parts[1]];
+                        } else if ([parts[2] isEqualToString:@"customDeserialization"]) {
+                            [custom addObject:parts[1]];
+                        } else if (parts.count == 4 && ([parts[2] isEqualToString:@"type"] || [parts[2] isEqualToString:@"wrappedtype"])) {
+                            Class elementClass = NSClassFromString(parts[3]);
+                            if (elementClass) {
+                                elementClasses[parts[1]] = elementClass;
+                            }
+                        }
+                    }
+                } else if (!fields[name] && ![name hasPrefix:@"_"]) {
+                    JsonReadField *field = [self fieldForProperty:list[i] name:name planClass:planClass];
+                    if (field) {
+                        fields[name] = field;
+                    }
+                }
+            }
+            free(list);
+        }
+        for (NSString *name in ignored) {
+            [fields removeObjectForKey:name];
+        }
+        [fields enumerateKeysAndObjectsUsingBlock:^(NSString *name, JsonReadField *field, BOOL *stop) {
+            field.elementClass = elementClasses[name];
+            field.customDeserialization = [custom containsObject:name];
+        }];
+        self.fields = fields;
+    }
+    return self;
+}
+
+- (JsonReadField *) fieldForProperty:(objc_property_t)property
+                                name:(NSString *)name
+                           planClass:(Class)planClass {
+    char *readonly = property_copyAttributeValue(property, "R");
+    if (readonly) {
+        free(readonly);
+        return nil;
+    }
+    JsonReadField *field = [[JsonReadField alloc] init];
+    field.name = name;
+    char *type = property_copyAttributeValue(property, "T");
+    char *setter = property_copyAttributeValue(property, "S");
+    field.typeChar = type ? type[0] : 0;
+    if (field.typeChar == '@' && strlen(type) > 3) {
+        // T@"ClassName"
+        NSString *className = [[NSString alloc] initWithBytes:type + 2 length:strlen(type) - 3 encoding:NSUTF8StringEncoding];
+        field.valueClass = NSClassFromString(className);
+    }
+    if (setter) {
+        field.setter = sel_registerName(setter);
+    } else {
+        NSString *setterName = [NSString stringWithFormat:@"set%@%@:",
+                                [[name substringToIndex:1] uppercaseString], [name substringFromIndex:1]];
+        field.setter = NSSelectorFromString(setterName);
+    }
+    free(type);
+    free(setter);
+
+    switch (field.typeChar) {
+        case 'B': case 'c':                     field.kind = FIELD_BOOL; break;
+        case 's': case 'i': case 'l': case 'q': field.kind = FIELD_SIGNED; break;
+        case 'C': case 'S': case 'I': case 'L': case 'Q': field.kind = FIELD_UNSIGNED; break;
+        case 'f':                               field.kind = FIELD_FLOAT; break;
+        case 'd':                               field.kind = FIELD_DOUBLE; break;
+        case '@':                               field.kind = FIELD_OBJECT; break;
+        default:                                return nil;
+    }
+    if (![planClass instancesRespondToSelector:field.setter]) {
+        return nil;
+    }
+    field.imp = class_getMethodImplementation(planClass, field.setter);
+    return field;
+}
+
+@end
+
+///////////////////////////////////////////////////////////////////////////////////////
+#pragma mark - JsonModelReader
+///////////////////////////////////////////////////////////////////////////////////////
+
+@interface JsonModelReader ()
+
+@property NSInputStream *stream;
+@property NSData *data;
+@property NSError *error;
+
+@end
+
+@implementation JsonModelReader {
+    JsonReader _reader;
+    uint8_t _buffer[STREAM_BUFFER_SIZE];
+    NSMutableDictionary *_context;
+}
+
+- (id) initWithStream:(NSInputStream *)stream
+                 data:(NSData *)data {
+    self = [super init];
+    if (self) {
+        self.stream = stream;
+        self.data = data;
+        if (!JsonReaderInit(&_reader, MAX_TOKEN_LENGTH)) {
+            return nil;
+        }
+        if (data) {
+            JsonReaderFeed(&_reader, data.bytes, data.length, YES);
+        }
+        _context = [NSMutableDictionary dictionary];
+    }
+    return self;
+}
+
+- (void) dealloc {
+    JsonReaderFree(&_reader);
+}
+
+- (NSError *) errorWithMessage:(NSString *)message {
+    return [NSError errorWithDomain:JsonModelReaderErrorDomain
+                               code:(NSInteger)_reader.offset
+                           userInfo:@{ NSLocalizedDescriptionKey: message }];
+}
+
+//
+// Next token, reading more of the stream as needed
+//
+- (JsonToken) next {
+    for (;;) {
+        JsonToken token = JsonReaderNext(&_reader);
+        if (token != JSON_TOKEN_NEED_INPUT) {
+            if (token == JSON_TOKEN_ERROR && !self.error) {
+                self.error = [self errorWithMessage:@"Malformed JSON"];
+            }
+            return token;
+        }
+        NSInteger length = [self.stream read:_buffer maxLength:sizeof(_buffer)];
+        if (length < 0) {
+            self.error = self.stream.streamError ?: [self errorWithMessage:@"Stream read failed"];
+            return JSON_TOKEN_ERROR;
+        }
+        JsonReaderFeed(&_reader, _buffer, (size_t)length, length == 0);
+    }
+}
+
+- (BOOL) skipValue:(JsonToken)token {
+    if (token != JSON_TOKEN_BEGIN_OBJECT && token != JSON_TOKEN_BEGIN_ARRAY) {
+        return token != JSON_TOKEN_ERROR;
+    }
+    int depth = _reader.depth;
+    for (;;) {
+        token = JsonReaderSkipTo(&_reader, depth);
+        if (token != JSON_TOKEN_NEED_INPUT) {
+            return token != JSON_TOKEN_ERROR && token != JSON_TOKEN_END;
+        }
+        NSInteger length = [self.stream read:_buffer maxLength:sizeof(_buffer)];
+        if (length < 0) {
+            self.error = self.stream.streamError;
+            return NO;
+        }
+        JsonReaderFeed(&_reader, _buffer, (size_t)length, length == 0);
+    }
+}
+
+- (NSString *) currentString {
+    size_t length;
+    const char *utf8 = JsonReaderString(&_reader, &length);
+    return [[NSString alloc] initWithBytes:utf8 length:length encoding:NSUTF8StringEncoding];
+}
+
+- (NSNumber *) currentNumber {
+    int64_t integer;
+    if (JsonReaderInteger(&_reader, &integer)) {
+        return @(integer);
+    }
+    return @(JsonReaderNumber(&_reader));
+}
+
+- (NSData *) currentHexData {
+    size_t length;
+    const char *hex = JsonReaderString(&_reader, &length);
+    NSMutableData *data = [NSMutableData dataWithLength:length / 2];
+    return HexDecode(hex, length, data.mutableBytes) ? data : nil;
+}
+
+#pragma mark - Values
+
+//
+// Read the value starting with token. valueClass is what the caller wants (nil for
+// Foundation objects), elementClass the class of array elements.
+//
+- (id) readValue:(JsonToken)token
+      valueClass:(Class)valueClass
+    elementClass:(Class)elementClass {
+    switch (token) {
+        case JSON_TOKEN_STRING:
+            if (valueClass && [valueClass isSubclassOfClass:[NSData class]]) {
+                return [self currentHexData];
+            }
+            return [self currentString];
+        case JSON_TOKEN_NUMBER:
+            if (valueClass && [valueClass isSubclassOfClass:[NSDate class]]) {
+                int64_t milliseconds;
+                if (!JsonReaderInteger(&_reader, &milliseconds)) {
+                    // Fractional or out of range: the nearest millisecond, if there is one
+                    double number = JsonReaderNumber(&_reader);
+                    if (!(fabs(number) < 9.2e18)) {
+                        return nil;
+                    }
+                    milliseconds = llround(number);
+                }
+                return [UgiJson dateFromJson:milliseconds];
+            }
+            return [self currentNumber];
+        case JSON_TOKEN_TRUE:
+            return @YES;
+        case JSON_TOKEN_FALSE:
+            return @NO;
+        case JSON_TOKEN_NULL:
+            return [NSNull null];
+        case JSON_TOKEN_BEGIN_ARRAY: {
+            NSMutableArray *array = [NSMutableArray array];
+            for (;;) {
+                JsonToken elementToken = [self next];
+                if (elementToken == JSON_TOKEN_END_ARRAY) {
+                    break;
+                }
+                id element = [self readValue:elementToken valueClass:elementClass elementClass:nil];
+                if (!element) {
+                    return nil;
+                }
+                [array addObject:element];
+            }
+            if (valueClass && [valueClass isSubclassOfClass:[NSSet class]]) {
+                return [NSMutableSet setWithArray:array];
+            }
+            return array;
+        }
+        case JSON_TOKEN_BEGIN_OBJECT:
+            if (!valueClass || [valueClass isSubclassOfClass:[NSDictionary class]]) {
+                return [self readDictionary];
+            }
+            return [self readObjectOfClass:valueClass];
+        default:
+            return nil;
+    }
+}
+
+- (NSDictionary *) readDictionary {
+    NSMutableDictionary *dictionary = [NSMutableDictionary dictionary];
+    for (;;) {
+        JsonToken token = [self next];
+        if (token == JSON_TOKEN_END_OBJECT) {
+            return dictionary;
+        }
+        if (token != JSON_TOKEN_KEY) {
+            return nil;
+        }
+        NSString *key = [self currentString];
+        if (!key) {
+            return nil;
+        }
+        id value = [self readValue:[self next] valueClass:nil elementClass:nil];
+        if (!value) {
+            return nil;
+        }
+        dictionary[key] = value;
+    }
+}
+
+- (id) readObjectOfClass:(Class)objectClass {
+    id object = [[objectClass alloc] init];
+    if ([object respondsToSelector:@selector(initForDeserialization:)]) {
+        [object initForDeserialization:_context];
+    }
+    return [self readFieldsOfObject:object] ? object : nil;
+}
+
+//
+// Read the fields of an object whose opening brace was just read, up to its end
+//
+- (BOOL) readFieldsOfObject:(id)object {
+    JsonReadPlan *plan = [JsonReadPlan planForClass:[object class]];
+    for (;;) {
+        JsonToken token = [self next];
+        if (token == JSON_TOKEN_END_OBJECT) {
+            return YES;
+        }
+        if (token != JSON_TOKEN_KEY) {
+            return NO;
+        }
+        size_t keyLength;
+        const char *key = JsonReaderString(&_reader, &keyLength);
+        NSString *name = [[NSString alloc] initWithBytes:key length:keyLength encoding:NSUTF8StringEncoding];
+        if (!name) {
+            return NO;
+        }
+        JsonReadField *field = plan.fields[name];
+        token = [self next];
+
+        if (!field) {
+            if (plan.handlesUnrecognizedFields) {
+                id value = [self readValue:token valueClass:nil elementClass:nil];
+                if (!value) {
+                    return NO;
+                }
+                [object handleUnrecognizedField:name value:value context:_context];
+            } else if (![self skipValue:token]) {
+                return NO;
+            }
+            continue;
+        }
+        if (![self setField:field ofObject:object token:token]) {
+            return NO;
+        }
+    }
+}
+
+- (BOOL) setField:(JsonReadField *)field
+         ofObject:(id)object
+            token:(JsonToken)token {
+    if (field.kind != FIELD_OBJECT) {
+        // Primitives take numbers and booleans; anything else is left at its default
+        double number;
+        int64_t integer;
+        if (token == JSON_TOKEN_NUMBER) {
+            number = JsonReaderNumber(&_reader);
+            if (!JsonReaderInteger(&_reader, &integer)) {
+                integer = (int64_t)number;
+            }
+        } else if (token == JSON_TOKEN_TRUE || token == JSON_TOKEN_FALSE) {
+            integer = token == JSON_TOKEN_TRUE;
+            number = (double)integer;
+        } else {
+            return [self skipValue:token];
+        }
+        SEL setter = field.setter;
+        IMP imp = field.imp;
+        switch (field.typeChar) {
+            case 'B': ((void (*)(id, SEL, bool))imp)(object, setter, integer != 0); break;
+            case 'c': ((void (*)(id, SEL, signed char))imp)(object, setter, (signed char)integer); break;
+            case 's': ((void (*)(id, SEL, short))imp)(object, setter, (short)integer); break;
+            case 'i': ((void (*)(id, SEL, int))imp)(object, setter, (int)integer); break;
+            case 'l': ((void (*)(id, SEL, long))imp)(object, setter, (long)integer); break;
+            case 'q': ((void (*)(id, SEL, long long))imp)(object, setter, (long long)integer); break;
+            case 'C': ((void (*)(id, SEL, unsigned char))imp)(object, setter, (unsigned char)integer); break;
+            case 'S': ((void (*)(id, SEL, unsigned short))imp)(object, setter, (unsigned short)integer); break;
+            case 'I': ((void (*)(id, SEL, unsigned int))imp)(object, setter, (unsigned int)integer); break;
+            case 'L': ((void (*)(id, SEL, unsigned long))imp)(object, setter, (unsigned long)integer); break;
+            case 'Q': ((void (*)(id, SEL, unsigned long long))imp)(object, setter, (unsigned long long)integer); break;
+            case 'f': ((void (*)(id, SEL, float))imp)(object, setter, (float)number); break;
+            case 'd': ((void (*)(id, SEL, double))imp)(object, setter, number); break;
+        }
+        return YES;
+    }
+
+    id value = [self readValue:token
+                    valueClass:field.customDeserialization ? nil : field.valueClass
+                  elementClass:field.customDeserialization ? nil : field.elementClass];
+    if (!value) {
+        return NO;
+    }
+    if (field.customDeserialization) {
+        value = [object customDeserialize:field.name value:value context:_context];
+    }
+    if (value == [NSNull null]) {
+        value = nil;
+    } else if (field.valueClass && ![value isKindOfClass:field.valueClass]) {
+        return YES;  // Wrong type for the property: leave it alone rather than store the wrong kind of object
+    }
+    ((void (*)(id, SEL, id))field.imp)(object, field.setter, value);
+    return YES;
+}
+
+#pragma mark - Entry points
+
+- (id) readTopLevelObjectOfClass:(Class)objectClass
+                           error:(NSError **)error {
+    JsonToken token = [self next];
+    id object;
+    if (token == JSON_TOKEN_BEGIN_ARRAY && objectClass &&
+        ![objectClass isSubclassOfClass:[NSArray class]] && ![objectClass isSubclassOfClass:[NSSet class]]) {
+        // A top level array is an array of objectClass
+        object = [self readValue:token valueClass:nil elementClass:objectClass];
+    } else {
+        object = [self readValue:token valueClass:objectClass elementClass:nil];
+    }
+    if (object && [self next] != JSON_TOKEN_END) {
+        object = nil;
+    }
+    if (!object && error) {
+        *error = self.error ?: [self errorWithMessage:@"Unexpected JSON"];
+    }
+    return object;
+}
+
++ (id) readObjectOfClass:(Class)objectClass
+              fromStream:(NSInputStream *)stream
+                   error:(NSError **)error {
+    JsonModelReader *reader = [[JsonModelReader alloc] initWithStream:stream data:nil];
+    return [reader readTopLevelObjectOfClass:objectClass error:error];
+}
+
++ (id) readObjectOfClass:(Class)objectClass
+                fromData:(NSData *)data
+                   error:(NSError **)error {
+    JsonModelReader *reader = [[JsonModelReader alloc] initWithStream:nil data:data];
+    return [reader readTopLevelObjectOfClass:objectClass error:error];
+}
+
++ (BOOL) readFieldsIntoObject:(id)object
+                    fromData:(NSData *)data
+                       error:(NSError **)error {
+    JsonModelReader *reader = [[JsonModelReader alloc] initWithStream:nil data:data];
+    BOOL ok = [reader next] == JSON_TOKEN_BEGIN_OBJECT &&
+              [reader readFieldsOfObject:object] &&
+              [reader next] == JSON_TOKEN_END;
+    if (!ok && error) {
+        *error = reader.error ?: [reader errorWithMessage:@"Expected an object"];
+    }
+    return ok;
+}
+
+//
+// One EPC: a hex string, or an object with the hex in "data"
+//
+- (BOOL) readEpcKey:(JsonToken)token
+                key:(EpcKey *)key {
+    if (token == JSON_TOKEN_BEGIN_OBJECT) {
+        BOOL found = NO;
+        while ((token = [self next]) == JSON_TOKEN_KEY) {
+            BOOL isData = strcmp(JsonReaderString(&_reader, NULL), "data") == 0;
+            token = [self next];
+            if (isData && token == JSON_TOKEN_STRING) {
+                found = [self readEpcKey:token key:key];
+            } else if (![self skipValue:token]) {
+                return NO;
+            }
+        }
+        return found && token == JSON_TOKEN_END_OBJECT;
+    }
+    if (token != JSON_TOKEN_STRING) {
+        return NO;
+    }
+    size_t length;
+    const char *hex = JsonReaderString(&_reader, &length);
+    uint8_t bytes[EPC_KEY_MAX_LENGTH];
+    if (length == 0 || length > EPC_KEY_MAX_LENGTH * 2 || !HexDecode(hex, length, bytes)) {
+        return NO;
+    }
+    *key = EpcKeyMake(bytes, (int)(length / 2));
+    return YES;
+}
+
++ (BOOL) readEpcKeysFromStream:(NSInputStream *)stream
+                          keys:(EpcKey **)keys
+                         count:(uint32_t *)count
+                         error:(NSError **)error {
+    JsonModelReader *reader = [[JsonModelReader alloc] initWithStream:stream data:nil];
+    EpcKey *result = NULL;
+    uint32_t numKeys = 0, capacity = 0;
+    BOOL ok = [reader next] == JSON_TOKEN_BEGIN_ARRAY;
+    while (ok) {
+        JsonToken token = [reader next];
+        if (token == JSON_TOKEN_END_ARRAY) {
+            ok = [reader next] == JSON_TOKEN_END;
+            break;
+        }
+        if (numKeys == capacity) {
+            capacity = capacity ? capacity * 2 : 1024;
+            EpcKey *grown = realloc(result, capacity * sizeof(EpcKey));
+            if (!grown) {
+                ok = NO;
+                break;
+            }
+            result = grown;
+        }
+        ok = [reader readEpcKey:token key:&result[numKeys]];
+        numKeys += ok;
+    }
+    if (!ok) {
+        free(result);
+        if (error) {
+            *error = reader.error ?: [reader errorWithMessage:@"Expected an array of EPCs"];
+        }
+        return NO;
+    }
+    *keys = result;
+    *count = numKeys;
+    return YES;
+}
+
+@end
@@ -0,0 +1,159 @@
+//
+//  JsonPlan.h
+//  FlowTrial
+//
+//  Created by Wade Sellers on 12/26/14.
+//  Copyright (c) 2014 Wade Sellers. All rights reserved.
+//
+
+#import <Foundation/Foundation.h>
+#import "JsonWriter.h"
+
+/**
+ Classes can write themselves instead of going through a plan
+ */
+@protocol JsonPlanCustomWriting <NSObject>
+
+- (void) writeJson:(JsonWriter *)writer;
+
+@end
+
+/**
+ A compiled serialization plan for one class.
+
+ The first time a class is serialized its properties (including those of superclasses),
+ getters, types and UgiJson annotations (ignore, wrapped, custom serialization) are
+ worked out once with the runtime and kept. After that, serializing an object is a
+ walk over the plan: getters are called through cached IMPs, keys are pre-escaped bytes,
+ and values go straight into a JsonWriter with no intermediate dictionaries or boxing
+ of primitives.
+
+ Values are written as: NSString as strings, NSNumber as numbers or booleans, NSDate as
+ [UgiJson dateToJson:], NSData as uppercase hex, NSArray/NSSet as arrays, NSDictionary
+ as objects, NSNull/nil as null, and any other object with its own plan.
+
+ Model hooks see the same serialization context as with UgiJson: one context per
+ serialization, holding the root object and the stack of objects being written, which
+ the root may add to in prepareSerializationContext:. Primitive fields are only boxed
+ when the class overrides shouldSerializeField:value:context: or the field has custom
+ serialization.
+ */
+@interface JsonPlan : NSObject
+
+//! Class the plan is for
+@property (readonly, nonatomic) Class planClass;
+
+//! Names of the fields the plan writes, in the order they are written
+@property (readonly, nonatomic) NSArray *fieldNames;
+
+/**
+ Get the plan for a class (thread safe; plans are built once and kept)
+
+ @param planClass   Class
+ @return            The class's plan
+ */
++ (JsonPlan *) planForClass:(Class)planClass;
+
+/**
+ Make the context to serialize a root object with
+
+ @param root    Object being serialized
+ @param context Context to start from (nil for UGI_SERIALIZATION_CONTEXT_DEFAULT)
+ @return        A copy of context with UGI_CONTEXT_ROOT_OBJECT and an empty
+                UGI_CONTEXT_OBJECT_STACK, passed through the root's prepareSerializationContext:
+ */
++ (NSMutableDictionary *) serializationContextForRoot:(id)root
+                                           context:(NSDictionary *)context;
+
+/**
+ Write an object of the plan's class
+
+ @param object  Object
+ @param writer  Writer
+ */
+- (void) writeObject:(id)object
+            toWriter:(JsonWriter *)writer;
+
+/**
+ Write an object of the plan's class as part of a larger serialization
+
+ @param object  Object
+ @param context Context from serializationContextForRoot:context:
+ @param writer  Writer
+ */
+- (void) writeObject:(id)object
+             context:(NSMutableDictionary *)context
+            toWriter:(JsonWriter *)writer;
+
+/**
+ Write just the value of one field of an object (null if it is nil), the same way
+ writeObject:toWriter: would
+
+ @param name    Field name
+ @param object  Object of the plan's class
+ @param writer  Writer
+ @return        NO if the plan has no such field
+ */
+- (BOOL) writeField:(NSString *)name
+           ofObject:(id)object
+           toWriter:(JsonWriter *)writer;
+
+/**
+ Write any value (picking the plan from its class when it is a model object)
+
+ @param value   Value, or nil for null
+ @param writer  Writer
+ */
++ (void) writeValue:(id)value
+           toWriter:(JsonWriter *)writer;
+
+/**
+ Write any value as part of a larger serialization
+
+ @param value   Value, or nil for null
+ @param context Context from serializationContextForRoot:context:
+ @param writer  Writer
+ */
++ (void) writeValue:(id)value
+            context:(NSMutableDictionary *)context
+           toWriter:(JsonWriter *)writer;
+
+@end
+
+@interface NSObject (JsonPlan)
+
+/**
+ Serialize to JSON with the class's plan
+
+ @return  JSON data, nil if out of memory
+ */
+- (NSData *) toJsonData;
+
+/**
+ Serialize to JSON with the class's plan, as toJson: would with this context
+
+ @param context Serialization context (nil for UGI_SERIALIZATION_CONTEXT_DEFAULT)
+ @return        JSON data, nil if out of memory
+ */
+- (NSData *) toJsonDataWithContext:(NSDictionary *)context;
+
+/**
+ Serialize to JSON with the class's plan, writing to a stream as the buffer fills
+
+ @param stream  Open output stream
+ @return        NO if writing to the stream failed
+ */
+- (BOOL) writeJsonToStream:(NSOutputStream *)stream;
+
+/**
+ Serialize to JSON with the class's plan and a serialization context, writing to a
+ stream as the buffer fills
+
+ @param stream  Open output stream
+ @param context Serialization context (nil for UGI_SERIALIZATION_CONTEXT_DEFAULT)
+ @return        NO if writing to the stream failed
+ */
+- (BOOL) writeJsonToStream:(NSOutputStream *)stream
+                   context:(NSDictionary *)context;
+
+@end
@@ -0,0 +1,567 @@
+//
+//  JsonPlan.m
+//  FlowTrial
+//
+//  Created by Wade Sellers on 12/26/14.
+//  Copyright (c) 2014 Wade Sellers. All rights reserved.
+//
+
+#import <objc/message.h>
+#import <objc/runtime.h>
+#import "JsonPlan.h"
+#import "HexCodec.h"
+#import "UgiJson.h"
+
+//! Prefix and separator UgiJson uses to encode annotations in property names
+#define ANNOTATION_PREFIX "_UgiJson_annotation_"
+#define ANNOTATION_SEPARATOR @"ž"
+
+#define JSON_STREAM_BUFFER_SIZE 65536
+
+typedef enum {
+    FIELD_BOOL,
+    FIELD_SIGNED,
+    FIELD_UNSIGNED,
+    FIELD_FLOAT,
+    FIELD_DOUBLE,
+    FIELD_OBJECT
+} FieldKind;
+
+/**
+ One property to write
+ */
+typedef struct {
+    SEL getter;
+    IMP imp;
+    FieldKind kind;
+    char typeChar;                  //!< Objective-C type encoding
+    BOOL customSerialization;
+    char *quotedKey;                //!< "name":
+    size_t quotedKeyLength;
+    __unsafe_unretained NSString *name;
+} JsonField;
+
+@interface JsonPlan ()
+
+@property (readwrite, nonatomic) Class planClass;
+@property NSMutableArray *names;    // Keeps the field names alive
+@property SEL wrappedGetter;
+@property BOOL callsShouldSerializeObject;
+@property BOOL callsShouldSerializeField;
+
+@end
+
+@implementation JsonPlan {
+    JsonField *_fields;
+    NSUInteger _numFields;
+}
+
+#pragma mark - Building plans
+
++ (JsonPlan *) planForClass:(Class)planClass {
+    static NSMapTable *plans;
+    static dispatch_queue_t plansQueue;
+    static dispatch_once_t onceToken;
+    dispatch_once(&onceToken, ^{
+        plans = [NSMapTable mapTableWithKeyOptions:NSPointerFunctionsOpaqueMemory | NSPointerFunctionsOpaquePersonality
+                                      valueOptions:NSPointerFunctionsStrongMemory];
+        plansQueue = dispatch_queue_create("JsonPlan", DISPATCH_QUEUE_SERIAL);
+    });
+    __block JsonPlan *plan;
+    dispatch_sync(plansQueue, ^{
+        plan = [plans objectForKey:planClass];
+        if (!plan) {
+            plan = [[JsonPlan alloc] initWithClass:planClass];
+            [plans setObject:plan forKey:planClass];
+        }
+    });
+    return plan;
+}
+
+//
+// Does the class override a UgiJsonModel hook, rather than inheriting
+// UgiJsonModelBase's default?
+//
++ (BOOL) class:(Class)planClass overrides:(SEL)selector {
+    if (![planClass instancesRespondToSelector:selector]) {
+        return NO;
+    }
+    Class base = [UgiJsonModelBase class];
+    return ![planClass isSubclassOfClass:base] ||
+           class_getMethodImplementation(planClass, selector) != class_getMethodImplementation(base, selector);
+}
+
+- (id) initWithClass:(Class)planClass {
+    self = [super init];
+    if (self) {
+        self.planClass = planClass;
+        self.names = [NSMutableArray array];
+        self.callsShouldSerializeObject = [JsonPlan class:planClass overrides:@selector(shouldSerializeObject:)];
+        self.callsShouldSerializeField = [JsonPlan class:planClass overrides:@selector(shouldSerializeField:value:context:)];
+
+        NSMutableSet *ignored = [NSMutableSet set];
+        NSMutableSet *custom = [NSMutableSet set];
+        NSMutableArray *properties = [NSMutableArray array];
+        NSMutableSet *seen = [NSMutableSet set];
+        [self collectProperties:properties seen:seen ignored:ignored custom:custom];
+
+        _fields = calloc(MAX(properties.count, 1), sizeof(JsonField));
+        for (NSValue *value in properties) {
+            objc_property_t property = [value pointerValue];
+            NSString *name = @(property_getName(property));
+            if ([ignored containsObject:name]) {
+                continue;
+            }
+            JsonField field;
+            if ([self makeField:&field property:property name:name custom:[custom containsObject:name]]) {
+                _fields[_numFields++] = field;
+            }
+        }
+    }
+    return self;
+}
+
+- (void) dealloc {
+    for (NSUInteger i = 0; i < _numFields; i++) {
+        free(_fields[i].quotedKey);
+    }
+    free(_fields);
+}
+
+//
+// Properties from NSObject down to the class, skipping UgiJson annotations (which are
+// read here instead)
+//
+- (void) collectProperties:(NSMutableArray *)properties
+                      seen:(NSMutableSet *)seen
+                   ignored:(NSMutableSet *)ignored
+                    custom:(NSMutableSet *)custom {
+    NSMutableArray *classes = [NSMutableArray array];
+    for (Class c = self.planClass; c && c != [NSObject class]; c = class_getSuperclass(c)) {
+        [classes insertObject:c atIndex:0];
+    }
+    for (Class c in classes) {
+        unsigned int count;
+        objc_property_t *list = class_copyPropertyList(c, &count);
+        for (unsigned int i = 0; i < count; i++) {
+            const char *cName = property_getName(list[i]);
+            NSString *name = @(cName);
+            if (strncmp(cName, ANNOTATION_PREFIX, strlen(ANNOTATION_PREFIX)) == 0) {
+                [self readAnnotation:[name substringFromIndex:strlen(ANNOTATION_PREFIX)] ignored:ignored custom:custom];
+            } else if (![seen containsObject:name] && ![name hasPrefix:@"_"] &&
+                       ![name isEqualToString:@"hash"] && ![name isEqualToString:@"superclass"] &&
+                       ![name isEqualToString:@"description"] && ![name isEqualToString:@"debugDescription"]) {
+                [seen addObject:name];
+                [properties addObject:[NSValue valueWithPointer:list[i]]];
+            }
+        }
+        free(list);
+    }
+}
+
+- (void) readAnnotation:(NSString *)annotation
+                ignored:(NSMutableSet *)ignored
+                 custom:(NSMutableSet *)custom {
+    NSArray *parts = [annotation componentsSeparatedByString:ANNOTATION_SEPARATOR];
+    if (parts.count == 3 && [parts[0] isEqualToString:@"class"] && [parts[1] isEqualToString:@"wrapped"]) {
+        self.wrappedGetter = NSSelectorFromString(parts[2]);
+    } else if (parts.count >= 3 && [parts[0] isEqualToString:@"field"]) {
+        if ([parts[2] isEqualToString:@"ignore"]) {
+            [ignored addObject:parts[1]];
+        } else if ([parts[2] isEqualToString:@"customSerialization"]) {
+            [custom addObject:parts[1]];
+        }
+    }
+}
+
+- (BOOL) makeField:(JsonField *)field
+          property:(objc_property_t)property
+              name:(NSString *)name
+            custom:(BOOL)custom {
+    memset(field, 0, sizeof(*field));
+    char *type = property_copyAttributeValue(property, "T");
+    char *getter = property_copyAttributeValue(property, "G");
+    field->typeChar = type ? type[0] : 0;
+    field->getter = getter ? sel_registerName(getter) : sel_registerName(property_getName(property));
+    free(type);
+    free(getter);
+
+    switch (field->typeChar) {
+        case 'B': case 'c':                     field->kind = FIELD_BOOL; break;
+        case 's': case 'i': case 'l': case 'q': field->kind = FIELD_SIGNED; break;
+        case 'C': case 'S': case 'I': case 'L': case 'Q': field->kind = FIELD_UNSIGNED; break;
+        case 'f':                               field->kind = FIELD_FLOAT; break;
+        case 'd':                               field->kind = FIELD_DOUBLE; break;
+        case '@':                               field->kind = FIELD_OBJECT; break;
+        default:
+            return NO;  // Structs, pointers, selectors etc. have no JSON form
+    }
+    if (![self.planClass instancesRespondToSelector:field->getter]) {
+        return NO;
+    }
+    field->imp = class_getMethodImplementation(self.planClass, field->getter);
+    field->customSerialization = custom;
+
+    // "name": with the name escaped, ready to copy
+    JsonWriter keyWriter;
+    if (!JsonWriterInit(&keyWriter, 64, NULL, NULL)) {
+        return NO;
+    }
+    const char *utf8 = name.UTF8String;
+    JsonWriterKey(&keyWriter, utf8, strlen(utf8));
+    field->quotedKey = (char *)keyWriter.bytes;
+    field->quotedKeyLength = keyWriter.length;
+    [self.names addObject:name];
+    field->name = name;
+    return YES;
+}
+
+#pragma mark - Writing
+
+static void writeString(NSString *string, JsonWriter *writer) {
+    CFStringRef cfString = (__bridge CFStringRef)string;
+    const char *utf8 = CFStringGetCStringPtr(cfString, kCFStringEncodingUTF8);
+    if (utf8) {
+        JsonWriterString(writer, utf8, strlen(utf8));
+        return;
+    }
+    // Not stored as UTF-8: convert a piece at a time on the stack
+    JsonWriterStringBegin(writer);
+    CFIndex length = CFStringGetLength(cfString);
+    CFIndex position = 0;
+    uint8_t buffer[512];
+    while (position < length) {
+        CFIndex used = 0;
+        CFIndex converted = CFStringGetBytes(cfString, CFRangeMake(position, length - position),
+                                             kCFStringEncodingUTF8, '?', false, buffer, sizeof(buffer), &used);
+        if (converted == 0) {
+            break;
+        }
+        JsonWriterStringAppend(writer, (const char *)buffer, (size_t)used);
+        position += converted;
+    }
+    JsonWriterStringEnd(writer);
+}
+
+static void writeNumber(NSNumber *number, JsonWriter *writer) {
+    CFNumberRef cfNumber = (__bridge CFNumberRef)number;
+    if (CFGetTypeID(cfNumber) == CFBooleanGetTypeID()) {
+        JsonWriterBool(writer, CFBooleanGetValue((CFBooleanRef)cfNumber));
+    } else if (CFNumberIsFloatType(cfNumber)) {
+        JsonWriterDouble(writer, number.doubleValue);
+    } else if (CFNumberGetType(cfNumber) == kCFNumberSInt64Type && number.longLongValue < 0) {
+        JsonWriterInt64(writer, number.longLongValue);
+    } else if (CFNumberGetType(cfNumber) == kCFNumberSInt64Type) {
+        // Could be an unsigned value too big for a signed one
+        JsonWriterUInt64(writer, number.unsignedLongLongValue);
+    } else {
+        JsonWriterInt64(writer, number.longLongValue);
+    }
+}
+
+static void writeData(NSData *data, JsonWriter *writer) {
+    JsonWriterStringBegin(writer);
+    uint8_t *p = JsonWriterReserve(writer, HEX_ENCODED_LENGTH(data.length));
+    if (p) {
+        HexEncode(data.bytes, data.length, (char *)p);
+        writer->length += HEX_ENCODED_LENGTH(data.length);
+    }
+    JsonWriterStringEnd(writer);
+}
+
++ (NSMutableDictionary *) serializationContextForRoot:(id)root
+                                           context:(NSDictionary *)context {
+    NSMutableDictionary *prepared = [(context ?: UGI_SERIALIZATION_CONTEXT_DEFAULT) mutableCopy] ?: [NSMutableDictionary dictionary];
+    if (root) {
+        prepared[(id)UGI_CONTEXT_ROOT_OBJECT] = root;
+    }
+    prepared[(id)UGI_CONTEXT_OBJECT_STACK] = [NSMutableArray array];
+    if ([root respondsToSelector:@selector(prepareSerializationContext:)]) {
+        [root prepareSerializationContext:prepared];
+    }
+    return prepared;
+}
+
++ (void) writeValue:(id)value
+           toWriter:(JsonWriter *)writer {
+    [self writeValue:value context:[self serializationContextForRoot:value context:nil] toWriter:writer];
+}
+
++ (void) writeValue:(id)value
+            context:(NSMutableDictionary *)context
+           toWriter:(JsonWriter *)writer {
+    // The common leaf types first, then containers, then model objects
+    if (!value || value == (id)kCFNull) {
+        JsonWriterNull(writer);
+    } else if ([value isKindOfClass:[NSString class]]) {
+        writeString(value, writer);
+    } else if ([value isKindOfClass:[NSNumber class]]) {
+        writeNumber(value, writer);
+    } else if ([value isKindOfClass:[NSDate class]]) {
+        JsonWriterInt64(writer, [UgiJson dateToJson:value]);
+    } else if ([value isKindOfClass:[NSData class]]) {
+        writeData(value, writer);
+    } else if ([value isKindOfClass:[NSArray class]] || [value isKindOfClass:[NSSet class]]) {
+        JsonWriterBeginArray(writer);
+        // Collections are nearly always of one class, so remember the last plan
+        Class lastClass = Nil;
+        JsonPlan *lastPlan = nil;
+        for (id element in value) {
+            if ([element class] == lastClass) {
+                [lastPlan writeObject:element context:context toWriter:writer];
+            } else if ([self isLeafValue:element]) {
+                [self writeValue:element context:context toWriter:writer];
+            } else {
+                lastClass = [element class];
+                lastPlan = [self planForClass:lastClass];
+                [lastPlan writeObject:element context:context toWriter:writer];
+            }
+        }
+        JsonWriterEndArray(writer);
+    } else if ([value isKindOfClass:[NSDictionary class]]) {
+        JsonWriterBeginObject(writer);
+        [(NSDictionary *)value enumerateKeysAndObjectsUsingBlock:^(id key, id object, BOOL *stop) {
+            NSString *keyString = [key isKindOfClass:[NSString class]] ? key : [key description];
+            const char *utf8 = keyString.UTF8String;
+            JsonWriterKey(writer, utf8, strlen(utf8));
+            [self writeValue:object context:context toWriter:writer];
+        }];
+        JsonWriterEndObject(writer);
+    } else if ([value respondsToSelector:@selector(writeJson:)]) {
+        [(id<JsonPlanCustomWriting>)value writeJson:writer];
+    } else {
+        [[self planForClass:[value class]] writeObject:value context:context toWriter:writer];
+    }
+}
+
++ (BOOL) isLeafValue:(id)value {
+    return value == (id)kCFNull ||
+           [value isKindOfClass:[NSString class]] ||
+           [value isKindOfClass:[NSNumber class]] ||
+           [value isKindOfClass:[NSDate class]] ||
+           [value isKindOfClass:[NSData class]] ||
+           [value isKindOfClass:[NSArray class]] ||
+           [value isKindOfClass:[NSSet class]] ||
+           [value isKindOfClass:[NSDictionary class]] ||
+           [value respondsToSelector:@selector(writeJson:)];
+}
+
+//
+// Write a field that isn't an object, calling its getter through the cached IMP
+//
+static void writePrimitive(const JsonField *field, id object, JsonWriter *writer) {
+    switch (field->kind) {
+        case FIELD_BOOL:
+            if (field->typeChar == 'B') {
+                JsonWriterBool(writer, ((bool (*)(id, SEL))field->imp)(object, field->getter));
+            } else {
+                JsonWriterBool(writer, ((signed char (*)(id, SEL))field->imp)(object, field->getter) != 0);
+            }
+            break;
+        case FIELD_SIGNED: {
+            int64_t value;
+            switch (field->typeChar) {
+                case 's': value = ((short (*)(id, SEL))field->imp)(object, field->getter); break;
+                case 'i': value = ((int (*)(id, SEL))field->imp)(object, field->getter); break;
+                case 'l': value = ((long (*)(id, SEL))field->imp)(object, field->getter); break;
+                default:  value = ((long long (*)(id, SEL))field->imp)(object, field->getter); break;
+            }
+            JsonWriterInt64(writer, value);
+            break;
+        }
+        case FIELD_UNSIGNED: {
+            uint64_t value;
+            switch (field->typeChar) {
+                case 'C': value = ((unsigned char (*)(id, SEL))field->imp)(object, field->getter); break;
+                case 'S': value = ((unsigned short (*)(id, SEL))field->imp)(object, field->getter); break;
+                case 'I': value = ((unsigned int (*)(id, SEL))field->imp)(object, field->getter); break;
+                case 'L': value = ((unsigned long (*)(id, SEL))field->imp)(object, field->getter); break;
+                default:  value = ((unsigned long long (*)(id, SEL))field->imp)(object, field->getter); break;
+            }
+            JsonWriterUInt64(writer, value);
+            break;
+        }
+        case FIELD_FLOAT:
+            JsonWriterDouble(writer, ((float (*)(id, SEL))field->imp)(object, field->getter));
+            break;
+        case FIELD_DOUBLE:
+            JsonWriterDouble(writer, ((double (*)(id, SEL))field->imp)(object, field->getter));
+            break;
+        case FIELD_OBJECT:
+            break;
+    }
+}
+
+//
+// The value of a field boxed the way UgiJson hands it to the model's hooks
+//
+static id boxedValue(const JsonField *field, id object) {
+    switch (field->kind) {
+        case FIELD_BOOL:
+            if (field->typeChar == 'B') {
+                return @(((bool (*)(id, SEL))field->imp)(object, field->getter));
+            }
+            return @((BOOL)(((signed char (*)(id, SEL))field->imp)(object, field->getter) != 0));
+        case FIELD_SIGNED:
+            switch (field->typeChar) {
+                case 's': return @(((short (*)(id, SEL))field->imp)(object, field->getter));
+                case 'i': return @(((int (*)(id, SEL))field->imp)(object, field->getter));
+                case 'l': return @(((long (*)(id, SEL))field->imp)(object, field->getter));
+                default:  return @(((long long (*)(id, SEL))field->imp)(object, field->getter));
+            }
+        case FIELD_UNSIGNED:
+            switch (field->typeChar) {
+                case 'C': return @(((unsigned char (*)(id, SEL))field->imp)(object, field->getter));
+                case 'S': return @(((unsigned short (*)(id, SEL))field->imp)(object, field->getter));
+                case 'I': return @(((unsigned int (*)(id, SEL))field->imp)(object, field->getter));
+                case 'L': return @(((unsigned long (*)(id, SEL))field->imp)(object, field->getter));
+                default:  return @(((unsigned long long (*)(id, SEL))field->imp)(object, field->getter));
+            }
+        case FIELD_FLOAT:
+            return @(((float (*)(id, SEL))field->imp)(object, field->getter));
+        case FIELD_DOUBLE:
+            return @(((double (*)(id, SEL))field->imp)(object, field->getter));
+        case FIELD_OBJECT:
+            return ((id (*)(id, SEL))field->imp)(object, field->getter);
+    }
+    return nil;
+}
+
+- (void) writeObject:(id)object
+            toWriter:(JsonWriter *)writer {
+    [self writeObject:object context:[JsonPlan serializationContextForRoot:object context:nil] toWriter:writer];
+}
+
+- (void) writeObject:(id)object
+             context:(NSMutableDictionary *)context
+            toWriter:(JsonWriter *)writer {
+    if ([object class] != self.planClass) {
+        [JsonPlan writeValue:object context:context toWriter:writer];
+        return;
+    }
+    if (self.wrappedGetter) {
+        id (*getWrapped)(id, SEL) = (id (*)(id, SEL))objc_msgSend;
+        [JsonPlan writeValue:getWrapped(object, self.wrappedGetter) context:context toWriter:writer];
+        return;
+    }
+    if (self.callsShouldSerializeObject && ![object shouldSerializeObject:context]) {
+        JsonWriterNull(writer);
+        return;
+    }
+
+    // Hooks of nested objects see what they are inside, as with UgiJson
+    NSMutableArray *stack = context[(id)UGI_CONTEXT_OBJECT_STACK];
+    [stack addObject:object];
+    JsonWriterBeginObject(writer);
+    for (NSUInteger i = 0; i < _numFields; i++) {
+        const JsonField *field = &_fields[i];
+        if (field->kind != FIELD_OBJECT && !self.callsShouldSerializeField && !field->customSerialization) {
+            // Nothing to ask the object, so skip boxing the value
+            JsonWriterRawKey(writer, field->quotedKey, field->quotedKeyLength);
+            writePrimitive(field, object, writer);
+            continue;
+        }
+        id value = boxedValue(field, object);
+        if (self.callsShouldSerializeField &&
+            ![object shouldSerializeField:field->name value:value context:context]) {
+            continue;
+        }
+        if (field->customSerialization) {
+            value = [object customSerialize:field->name value:value context:context];
+        }
+        if (!value) {
+            continue;  // Like UgiJson, nil properties are left out
+        }
+        JsonWriterRawKey(writer, field->quotedKey, field->quotedKeyLength);
+        [JsonPlan writeValue:value context:context toWriter:writer];
+    }
+    JsonWriterEndObject(writer);
+    [stack removeLastObject];
+}
+
+- (NSArray *) fieldNames {
+    return [self.names copy];
+}
+
+- (BOOL) writeField:(NSString *)name
+           ofObject:(id)object
+           toWriter:(JsonWriter *)writer {
+    for (NSUInteger i = 0; i < _numFields; i++) {
+        const JsonField *field = &_fields[i];
+        if (![field->name isEqualToString:name]) {
+            continue;
+        }
+        if (field->kind != FIELD_OBJECT && !field->customSerialization) {
+            writePrimitive(field, object, writer);
+            return YES;
+        }
+        // Serialized as if the object were, so hooks get the same context
+        NSMutableDictionary *context = [JsonPlan serializationContextForRoot:object context:nil];
+        id value = boxedValue(field, object);
+        if (field->customSerialization) {
+            value = [object customSerialize:field->name value:value context:context];
+        }
+        NSMutableArray *stack = context[(id)UGI_CONTEXT_OBJECT_STACK];
+        [stack addObject:object];
+        [JsonPlan writeValue:value context:context toWriter:writer];
+        [stack removeLastObject];
+        return YES;
+    }
+    return NO;
+}
+
+@end
+
+#pragma mark - NSObject (JsonPlan)
+
+static bool writeToStream(void *context, const uint8_t *bytes, size_t length) {
+    NSOutputStream *stream = (__bridge NSOutputStream *)context;
+    while (length > 0) {
+        NSInteger written = [stream write:bytes maxLength:length];
+        if (written <= 0) {
+            return false;
+        }
+        bytes += written;
+        length -= (size_t)written;
+    }
+    return true;
+}
+
+@implementation NSObject (JsonPlan)
+
+- (NSData *) toJsonData {
+    return [self toJsonDataWithContext:nil];
+}
+
+- (NSData *) toJsonDataWithContext:(NSDictionary *)context {
+    JsonWriter writer;
+    if (!JsonWriterInit(&writer, 4096, NULL, NULL)) {
+        return nil;
+    }
+    [JsonPlan writeValue:self context:[JsonPlan serializationContextForRoot:self context:context] toWriter:&writer];
+    if (writer.failed) {
+        JsonWriterFree(&writer);
+        return nil;
+    }
+    // Hand the buffer over rather than copying it
+    NSData *data = [NSData dataWithBytesNoCopy:writer.bytes length:writer.length freeWhenDone:YES];
+    return data;
+}
+
+- (BOOL) writeJsonToStream:(NSOutputStream *)stream {
+    return [self writeJsonToStream:stream context:nil];
+}
+
+- (BOOL) writeJsonToStream:(NSOutputStream *)stream
+                   context:(NSDictionary *)context {
+    JsonWriter writer;
+    if (!JsonWriterInit(&writer, JSON_STREAM_BUFFER_SIZE, writeToStream, (__bridge void *)stream)) {
+        return NO;
+    }
+    [JsonPlan writeValue:self context:[JsonPlan serializationContextForRoot:self context:context] toWriter:&writer];
+    BOOL ok = JsonWriterFlush(&writer);
+    JsonWriterFree(&writer);
+    return ok;
+}
+
+@end
@@ -0,0 +1,477 @@
+//
+//  JsonReader.c
+//  FlowTrial
+//
+//  Created by Wade Sellers on 12/27/14.
+//  Copyright (c) 2014 Wade Sellers. All rights reserved.
+//
+
+#include "JsonReader.h"
+
+#include <errno.h>
+#include <stdlib.h>
+#include <string.h>
+
+//! What the structure allows next
+enum {
+    EXPECT_VALUE,               // Top level, after ':' or after ',' in an array
+    EXPECT_VALUE_OR_END,        // Just after '['
+    EXPECT_KEY,                 // After ',' in an object
+    EXPECT_KEY_OR_END,          // Just after '{'
+    EXPECT_COLON,
+    EXPECT_COMMA_OR_END,
+    EXPECT_NOTHING              // The top level value is complete
+};
+
+//! Token in progress
+enum {
+    LEX_NONE,
+    LEX_STRING,
+    LEX_NUMBER,
+    LEX_LITERAL
+};
+
+//! Inside a string
+enum {
+    STRING_PLAIN,
+    STRING_ESCAPE,
+    STRING_UNICODE              // lexState counts the hex digits read, from STRING_UNICODE
+};
+
+static inline bool isNumberByte(uint8_t c) {
+    return (c >= '0' && c <= '9') || c == '-' || c == '+' || c == '.' || c == 'e' || c == 'E';
+}
+
+static JsonToken fail(JsonReader *reader) {
+    reader->errorOffset = reader->offset;
+    reader->lex = LEX_NONE;
+    reader->expect = EXPECT_NOTHING;
+    reader->depth = -1;         // Sticks: every later call fails too
+    return JSON_TOKEN_ERROR;
+}
+
+static inline void consume(JsonReader *reader, size_t count) {
+    reader->position += count;
+    reader->offset += count;
+}
+
+//! Starting size of the token buffer; it doubles as needed, up to maxTokenLength
+#define INITIAL_TOKEN_CAPACITY 256
+
+static bool appendToken(JsonReader *reader, const void *bytes, size_t length) {
+    size_t needed = reader->tokenLength + length;
+    if (needed > reader->maxTokenLength) {
+        return false;
+    }
+    if (needed > reader->tokenCapacity) {
+        size_t capacity = reader->tokenCapacity;
+        while (capacity < needed) {
+            capacity *= 2;
+        }
+        if (capacity > reader->maxTokenLength) {
+            capacity = reader->maxTokenLength;
+        }
+        // One more for the terminating zero
+        char *token = realloc(reader->token, capacity + 1);
+        if (!token) {
+            return false;
+        }
+        reader->token = token;
+        reader->tokenCapacity = capacity;
+    }
+    memcpy(reader->token + reader->tokenLength, bytes, length);
+    reader->tokenLength += length;
+    return true;
+}
+
+static bool appendCodePoint(JsonReader *reader, uint32_t c) {
+    uint8_t utf8[4];
+    size_t length;
+    if (c < 0x80) {
+        utf8[0] = (uint8_t)c;
+        length = 1;
+    } else if (c < 0x800) {
+        utf8[0] = (uint8_t)(0xC0 | (c >> 6));
+        utf8[1] = (uint8_t)(0x80 | (c & 0x3F));
+        length = 2;
+    } else if (c < 0x10000) {
+        utf8[0] = (uint8_t)(0xE0 | (c >> 12));
+        utf8[1] = (uint8_t)(0x80 | ((c >> 6) & 0x3F));
+        utf8[2] = (uint8_t)(0x80 | (c & 0x3F));
+        length = 3;
+    } else {
+        utf8[0] = (uint8_t)(0xF0 | (c >> 18));
+        utf8[1] = (uint8_t)(0x80 | ((c >> 12) & 0x3F));
+        utf8[2] = (uint8_t)(0x80 | ((c >> 6) & 0x3F));
+        utf8[3] = (uint8_t)(0x80 | (c & 0x3F));
+        length = 4;
+    }
+    return appendToken(reader, utf8, length);
+}
+
+//
+// Is a string well-formed UTF-8: no stray continuation bytes, truncated or overlong
+// sequences, surrogates or code points past U+10FFFF
+//
+static bool isValidUtf8(const uint8_t *p, size_t length) {
+    const uint8_t *end = p + length;
+    while (p < end) {
+        uint8_t c = *p;
+        if (c < 0x80) {
+            p++;
+            continue;
+        }
+        size_t extra;
+        uint32_t codePoint, min;
+        if ((c & 0xE0) == 0xC0) {
+            extra = 1; codePoint = c & 0x1F; min = 0x80;
+        } else if ((c & 0xF0) == 0xE0) {
+            extra = 2; codePoint = c & 0x0F; min = 0x800;
+        } else if ((c & 0xF8) == 0xF0) {
+            extra = 3; codePoint = c & 0x07; min = 0x10000;
+        } else {
+            return false;
+        }
+        if ((size_t)(end - p) <= extra) {
+            return false;
+        }
+        for (size_t i = 1; i <= extra; i++) {
+            if ((p[i] & 0xC0) != 0x80) {
+                return false;
+            }
+            codePoint = (codePoint << 6) | (p[i] & 0x3F);
+        }
+        if (codePoint < min || codePoint > 0x10FFFF || (codePoint >= 0xD800 && codePoint <= 0xDFFF)) {
+            return false;
+        }
+        p += extra + 1;
+    }
+    return true;
+}
+
+//
+// The structure after a complete value
+//
+static void valueDone(JsonReader *reader) {
+    reader->expect = reader->depth == 0 ? EXPECT_NOTHING : EXPECT_COMMA_OR_END;
+}
+
+static bool finishNumber(JsonReader *reader) {
+    reader->token[reader->tokenLength] = 0;
+    const char *text = reader->token;
+    // Validate against the JSON grammar; strtod alone would accept hex, "inf" etc.
+    const char *p = text;
+    if (*p == '-') p++;
+    if (*p == '0') {
+        p++;
+    } else if (*p >= '1' && *p <= '9') {
+        while (*p >= '0' && *p <= '9') p++;
+    } else {
+        return false;
+    }
+    bool integer = true;
+    if (*p == '.') {
+        integer = false;
+        p++;
+        if (!(*p >= '0' && *p <= '9')) return false;
+        while (*p >= '0' && *p <= '9') p++;
+    }
+    if (*p == 'e' || *p == 'E') {
+        integer = false;
+        p++;
+        if (*p == '+' || *p == '-') p++;
+        if (!(*p >= '0' && *p <= '9')) return false;
+        while (*p >= '0' && *p <= '9') p++;
+    }
+    if (*p != 0) {
+        return false;
+    }
+    reader->number = strtod(text, NULL);
+    reader->integer = false;
+    if (integer) {
+        errno = 0;
+        reader->integerValue = strtoll(text, NULL, 10);
+        reader->integer = errno != ERANGE;
+    }
+    valueDone(reader);
+    return true;
+}
+
+//
+// Continue a string; returns the token, or NEED_INPUT if the chunk ran out
+//
+static JsonToken continueString(JsonReader *reader) {
+    while (reader->position < reader->end) {
+        if (reader->lexState == STRING_PLAIN) {
+            // Copy the run up to the next quote, backslash or control character
+            const uint8_t *run = reader->position;
+            const uint8_t *p = run;
+            while (p < reader->end && *p != '"' && *p != '\\' && *p >= 0x20) {
+                p++;
+            }
+            if (!appendToken(reader, run, (size_t)(p - run))) {
+                return fail(reader);
+            }
+            consume(reader, (size_t)(p - run));
+            if (p == reader->end) {
+                break;
+            }
+            uint8_t c = *p;
+            consume(reader, 1);
+            if (c == '"') {
+                // Escapes always append valid UTF-8; raw bytes are checked here, once the string is whole
+                if (reader->highSurrogate || !isValidUtf8((const uint8_t *)reader->token, reader->tokenLength)) {
+                    return fail(reader);
+                }
+                reader->token[reader->tokenLength] = 0;
+                reader->lex = LEX_NONE;
+                if (reader->expect == EXPECT_KEY || reader->expect == EXPECT_KEY_OR_END) {
+                    reader->expect = EXPECT_COLON;
+                    return JSON_TOKEN_KEY;
+                }
+                valueDone(reader);
+                return JSON_TOKEN_STRING;
+            } else if (c == '\\') {
+                reader->lexState = STRING_ESCAPE;
+            } else {
+                return fail(reader);  // Raw control character
+            }
+        } else if (reader->lexState == STRING_ESCAPE) {
+            uint8_t c = *reader->position;
+            consume(reader, 1);
+            char unescaped;
+            switch (c) {
+                case '"':  unescaped = '"'; break;
+                case '\\': unescaped = '\\'; break;
+                case '/':  unescaped = '/'; break;
+                case 'b':  unescaped = '\b'; break;
+                case 'f':  unescaped = '\f'; break;
+                case 'n':  unescaped = '\n'; break;
+                case 'r':  unescaped = '\r'; break;
+                case 't':  unescaped = '\t'; break;
+                case 'u':
+                    reader->lexState = STRING_UNICODE;
+                    reader->codePoint = 0;
+                    continue;
+                default:
+                    return fail(reader);
+            }
+            if (reader->highSurrogate || !appendToken(reader, &unescaped, 1)) {
+                return fail(reader);
+            }
+            reader->lexState = STRING_PLAIN;
+        } else {
+            uint8_t c = *reader->position;
+            consume(reader, 1);
+            uint32_t digit;
+            if (c >= '0' && c <= '9') digit = c - '0';
+            else if (c >= 'a' && c <= 'f') digit = c - 'a' + 10;
+            else if (c >= 'A' && c <= 'F') digit = c - 'A' + 10;
+            else return fail(reader);
+            reader->codePoint = (reader->codePoint << 4) | digit;
+            if (++reader->lexState < STRING_UNICODE + 4) {
+                continue;
+            }
+            uint32_t codePoint = reader->codePoint;
+            reader->lexState = STRING_PLAIN;
+            if (codePoint >= 0xD800 && codePoint <= 0xDBFF) {
+                if (reader->highSurrogate) {
+                    return fail(reader);
+                }
+                reader->highSurrogate = codePoint;
+                // The low surrogate must follow as another \u escape
+                continue;
+            }
+            if (codePoint >= 0xDC00 && codePoint <= 0xDFFF) {
+                if (!reader->highSurrogate) {
+                    return fail(reader);
+                }
+                codePoint = 0x10000 + ((reader->highSurrogate - 0xD800) << 10) + (codePoint - 0xDC00);
+                reader->highSurrogate = 0;
+            } else if (reader->highSurrogate) {
+                return fail(reader);
+            }
+            if (!appendCodePoint(reader, codePoint)) {
+                return fail(reader);
+            }
+        }
+    }
+    return reader->final ? fail(reader) : JSON_TOKEN_NEED_INPUT;
+}
+
+static JsonToken continueNumber(JsonReader *reader) {
+    const uint8_t *run = reader->position;
+    const uint8_t *p = run;
+    while (p < reader->end && isNumberByte(*p)) {
+        p++;
+    }
+    if (!appendToken(reader, run, (size_t)(p - run))) {
+        return fail(reader);
+    }
+    consume(reader, (size_t)(p - run));
+    if (p == reader->end && !reader->final) {
+        return JSON_TOKEN_NEED_INPUT;
+    }
+    reader->lex = LEX_NONE;
+    return finishNumber(reader) ? JSON_TOKEN_NUMBER : fail(reader);
+}
+
+static JsonToken continueLiteral(JsonReader *reader) {
+    while (reader->literal[reader->lexState]) {
+        if (reader->position == reader->end) {
+            return reader->final ? fail(reader) : JSON_TOKEN_NEED_INPUT;
+        }
+        if (*reader->position != (uint8_t)reader->literal[reader->lexState]) {
+            return fail(reader);
+        }
+        consume(reader, 1);
+        reader->lexState++;
+    }
+    reader->lex = LEX_NONE;
+    valueDone(reader);
+    switch (reader->literal[0]) {
+        case 't': return JSON_TOKEN_TRUE;
+        case 'f': return JSON_TOKEN_FALSE;
+        default:  return JSON_TOKEN_NULL;
+    }
+}
+
+bool JsonReaderInit(JsonReader *reader, size_t maxTokenLength) {
+    memset(reader, 0, sizeof(*reader));
+    reader->maxTokenLength = maxTokenLength;
+    reader->tokenCapacity = maxTokenLength < INITIAL_TOKEN_CAPACITY ? maxTokenLength : INITIAL_TOKEN_CAPACITY;
+    reader->token = malloc(reader->tokenCapacity + 1);
+    reader->expect = EXPECT_VALUE;
+    if (reader->token) {
+        reader->token[0] = 0;
+    }
+    return reader->token != NULL;
+}
+
+void JsonReaderFree(JsonReader *reader) {
+    free(reader->token);
+    memset(reader, 0, sizeof(*reader));
+}
+
+void JsonReaderFeed(JsonReader *reader, const uint8_t *bytes, size_t length, bool final) {
+    reader->position = bytes;
+    reader->end = bytes + length;
+    reader->final = final;
+}
+
+const char *JsonReaderString(const JsonReader *reader, size_t *length) {
+    if (length) {
+        *length = reader->tokenLength;
+    }
+    return reader->token;
+}
+
+JsonToken JsonReaderNext(JsonReader *reader) {
+    if (reader->depth < 0) {
+        return JSON_TOKEN_ERROR;
+    }
+    switch (reader->lex) {
+        case LEX_STRING:  return continueString(reader);
+        case LEX_NUMBER:  return continueNumber(reader);
+        case LEX_LITERAL: return continueLiteral(reader);
+    }
+
+    for (;;) {
+        if (reader->position == reader->end) {
+            if (!reader->final) {
+                return JSON_TOKEN_NEED_INPUT;
+            }
+            return reader->expect == EXPECT_NOTHING ? JSON_TOKEN_END : fail(reader);
+        }
+        uint8_t c = *reader->position;
+        if (c == ' ' || c == '\n' || c == '\r' || c == '\t') {
+            consume(reader, 1);
+            continue;
+        }
+        int expect = reader->expect;
+        bool wantsValue = expect == EXPECT_VALUE || expect == EXPECT_VALUE_OR_END;
+
+        if (c == ':' ) {
+            if (expect != EXPECT_COLON) {
+                return fail(reader);
+            }
+            consume(reader, 1);
+            reader->expect = EXPECT_VALUE;
+            continue;
+        }
+        if (c == ',') {
+            if (expect != EXPECT_COMMA_OR_END) {
+                return fail(reader);
+            }
+            consume(reader, 1);
+            reader->expect = (reader->inObject >> reader->depth) & 1 ? EXPECT_KEY : EXPECT_VALUE;
+            continue;
+        }
+        if (c == '}' || c == ']') {
+            bool object = (reader->inObject >> reader->depth) & 1;
+            bool canEnd = expect == EXPECT_COMMA_OR_END ||
+                          (object ? expect == EXPECT_KEY_OR_END : expect == EXPECT_VALUE_OR_END);
+            if (reader->depth == 0 || !canEnd || object != (c == '}')) {
+                return fail(reader);
+            }
+            consume(reader, 1);
+            reader->depth--;
+            valueDone(reader);
+            return object ? JSON_TOKEN_END_OBJECT : JSON_TOKEN_END_ARRAY;
+        }
+        if (c == '"') {
+            if (!wantsValue && expect != EXPECT_KEY && expect != EXPECT_KEY_OR_END) {
+                return fail(reader);
+            }
+            consume(reader, 1);
+            reader->lex = LEX_STRING;
+            reader->lexState = STRING_PLAIN;
+            reader->tokenLength = 0;
+            reader->highSurrogate = 0;
+            return continueString(reader);
+        }
+        if (!wantsValue) {
+            return fail(reader);
+        }
+        if (c == '{' || c == '[') {
+            if (reader->depth + 1 >= JSON_READER_MAX_DEPTH) {
+                return fail(reader);
+            }
+            consume(reader, 1);
+            reader->depth++;
+            uint64_t bit = (uint64_t)1 << reader->depth;
+            if (c == '{') {
+                reader->inObject |= bit;
+                reader->expect = EXPECT_KEY_OR_END;
+                return JSON_TOKEN_BEGIN_OBJECT;
+            }
+            reader->inObject &= ~bit;
+            reader->expect = EXPECT_VALUE_OR_END;
+            return JSON_TOKEN_BEGIN_ARRAY;
+        }
+        if (c == '-' || (c >= '0' && c <= '9')) {
+            reader->lex = LEX_NUMBER;
+            reader->tokenLength = 0;
+            return continueNumber(reader);
+        }
+        if (c == 't' || c == 'f' || c == 'n') {
+            reader->lex = LEX_LITERAL;
+            reader->lexState = 0;
+            reader->literal = c == 't' ? "true" : c == 'f' ? "false" : "null";
+            return continueLiteral(reader);
+        }
+        return fail(reader);
+    }
+}
+
+JsonToken JsonReaderSkipTo(JsonReader *reader, int depth) {
+    for (;;) {
+        JsonToken token = JsonReaderNext(reader);
+        if (token == JSON_TOKEN_NEED_INPUT || token == JSON_TOKEN_ERROR || token == JSON_TOKEN_END) {
+            return token;
+        }
+        if (reader->depth < depth) {
+            return token;
+        }
+    }
+}
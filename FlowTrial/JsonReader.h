@@ -0,0 +1,134 @@
+//
+//  JsonReader.h
+//  FlowTrial
+//
+//  Created by Wade Sellers on 12/27/14.
+//  Copyright (c) 2014 Wade Sellers. All rights reserved.
+//
+
+#ifndef FlowTrial_JsonReader_h
+#define FlowTrial_JsonReader_h
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+typedef enum {
+    JSON_TOKEN_NEED_INPUT = 0,  //!< Feed more bytes (or the end of input) and call again
+    JSON_TOKEN_BEGIN_OBJECT,
+    JSON_TOKEN_END_OBJECT,
+    JSON_TOKEN_BEGIN_ARRAY,
+    JSON_TOKEN_END_ARRAY,
+    JSON_TOKEN_KEY,             //!< An object key; the text is in JsonReaderString
+    JSON_TOKEN_STRING,          //!< The text is in JsonReaderString
+    JSON_TOKEN_NUMBER,          //!< The value is in JsonReaderNumber / JsonReaderInteger
+    JSON_TOKEN_TRUE,
+    JSON_TOKEN_FALSE,
+    JSON_TOKEN_NULL,
+    JSON_TOKEN_END,             //!< The document is complete
+    JSON_TOKEN_ERROR            //!< Malformed input or a limit was exceeded; see errorOffset
+} JsonToken;
+
+#define JSON_READER_MAX_DEPTH 64
+
+/**
+ Incremental pull parser.
+
+ Input is fed in chunks of any size as it arrives (JsonReaderFeed); JsonReaderNext
+ returns one token at a time, or JSON_TOKEN_NEED_INPUT when the chunk runs out in the
+ middle of one. Nothing is buffered except the token in progress (up to
+ maxTokenLength bytes, allocated as tokens need it) and one bit per nesting level, so
+ memory stays bounded however large the document is. Strings are checked to be valid
+ UTF-8; invalid ones are an error. Chunks are not copied and must stay valid until the reader
+ asks for more. Not thread safe.
+ */
+typedef struct {
+    // Input
+    const uint8_t *position;
+    const uint8_t *end;
+    bool final;
+    uint64_t offset;            //!< Bytes consumed so far
+    // Structure
+    uint64_t inObject;          //!< Per depth, is the container an object (else an array)
+    int depth;
+    int expect;
+    // Token in progress
+    int lex;
+    int lexState;
+    uint32_t codePoint;
+    uint32_t highSurrogate;
+    const char *literal;
+    char *token;
+    size_t tokenLength;
+    size_t tokenCapacity;       //!< Size of token, which grows as needed up to maxTokenLength
+    size_t maxTokenLength;
+    bool integer;
+    // Results
+    double number;
+    int64_t integerValue;
+    uint64_t errorOffset;       //!< Where the error was found
+} JsonReader;
+
+/**
+ Initialize a reader
+
+ @param reader          Reader
+ @param maxTokenLength  Longest string or number accepted, in bytes
+ @return                false if out of memory
+ */
+bool JsonReaderInit(JsonReader *reader, size_t maxTokenLength);
+
+void JsonReaderFree(JsonReader *reader);
+
+/**
+ Give the reader the next chunk of input. Only call this after JSON_TOKEN_NEED_INPUT
+ (or before the first JsonReaderNext).
+
+ @param reader  Reader
+ @param bytes   Input
+ @param length  Number of bytes
+ @param final   true if this is the end of the input
+ */
+void JsonReaderFeed(JsonReader *reader, const uint8_t *bytes, size_t length, bool final);
+
+/**
+ Read the next token
+ */
+JsonToken JsonReaderNext(JsonReader *reader);
+
+/**
+ Text of the last KEY or STRING token, unescaped, UTF-8 and NUL terminated
+
+ @param reader  Reader
+ @param length  Set to the length in bytes (may be NULL)
+ @return        The text; valid until the next call to JsonReaderNext
+ */
+const char *JsonReaderString(const JsonReader *reader, size_t *length);
+
+//! Value of the last NUMBER token
+static inline double JsonReaderNumber(const JsonReader *reader) {
+    return reader->number;
+}
+
+/**
+ Integer value of the last NUMBER token
+
+ @return  false if the number has a fraction or exponent, or doesn't fit
+ */
+static inline bool JsonReaderInteger(const JsonReader *reader, int64_t *value) {
+    *value = reader->integerValue;
+    return reader->integer;
+}
+
+/**
+ Skip the rest of a value whose first token was just read (for an object or array,
+ everything up to its end). Returns JSON_TOKEN_NEED_INPUT if the input ran out first;
+ call it again with the same depth after feeding more.
+
+ @param reader  Reader
+ @param depth   The reader's depth right after the first token of the value
+ @return        The last token of the value, NEED_INPUT, or ERROR
+ */
+JsonToken JsonReaderSkipTo(JsonReader *reader, int depth);
+
+#endif
@@ -0,0 +1,275 @@
+//
+//  JsonWriter.c
+//  FlowTrial
+//
+//  Created by Wade Sellers on 12/26/14.
+//  Copyright (c) 2014 Wade Sellers. All rights reserved.
+//
+
+#include "JsonWriter.h"
+
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#define JSON_WRITER_MIN_CAPACITY 256
+
+//! Which bytes need escaping inside a string: control characters, '"' and '\'
+static inline bool needsEscape(uint8_t c) {
+    return c < 0x20 || c == '"' || c == '\\';
+}
+
+static inline void put(JsonWriter *writer, const void *bytes, size_t length) {
+    uint8_t *p = JsonWriterReserve(writer, length);
+    if (p) {
+        memcpy(p, bytes, length);
+        writer->length += length;
+    }
+}
+
+static inline void putByte(JsonWriter *writer, uint8_t byte) {
+    uint8_t *p = JsonWriterReserve(writer, 1);
+    if (p) {
+        *p = byte;
+        writer->length++;
+    }
+}
+
+static inline void beforeValue(JsonWriter *writer) {
+    if (writer->afterKey) {
+        writer->afterKey = false;
+        return;
+    }
+    uint64_t bit = (uint64_t)1 << (writer->depth & 63);
+    if (writer->hasValue & bit) {
+        putByte(writer, ',');
+    }
+    writer->hasValue |= bit;
+}
+
+bool JsonWriterInit(JsonWriter *writer, size_t capacity, JsonWriterFlushFunction flush, void *flushContext) {
+    memset(writer, 0, sizeof(*writer));
+    writer->capacity = capacity < JSON_WRITER_MIN_CAPACITY ? JSON_WRITER_MIN_CAPACITY : capacity;
+    writer->bytes = malloc(writer->capacity);
+    writer->flush = flush;
+    writer->flushContext = flushContext;
+    return writer->bytes != NULL;
+}
+
+void JsonWriterFree(JsonWriter *writer) {
+    free(writer->bytes);
+    memset(writer, 0, sizeof(*writer));
+}
+
+void JsonWriterReset(JsonWriter *writer) {
+    writer->length = 0;
+    writer->hasValue = 0;
+    writer->depth = 0;
+    writer->afterKey = false;
+    writer->failed = false;
+}
+
+bool JsonWriterFlush(JsonWriter *writer) {
+    if (writer->failed) {
+        return false;
+    }
+    if (writer->flush && writer->length > 0) {
+        if (!writer->flush(writer->flushContext, writer->bytes, writer->length)) {
+            writer->failed = true;
+            return false;
+        }
+        writer->length = 0;
+    }
+    return true;
+}
+
+uint8_t *JsonWriterReserve(JsonWriter *writer, size_t length) {
+    if (writer->failed) {
+        return NULL;
+    }
+    if (writer->length + length <= writer->capacity) {
+        return writer->bytes + writer->length;
+    }
+    if (writer->flush && length <= writer->capacity) {
+        return JsonWriterFlush(writer) ? writer->bytes : NULL;
+    }
+    size_t capacity = writer->capacity * 2;
+    while (capacity < writer->length + length) {
+        capacity *= 2;
+    }
+    uint8_t *bytes = realloc(writer->bytes, capacity);
+    if (!bytes) {
+        writer->failed = true;
+        return NULL;
+    }
+    writer->bytes = bytes;
+    writer->capacity = capacity;
+    return writer->bytes + writer->length;
+}
+
+#pragma mark - Containers
+
+static void beginContainer(JsonWriter *writer, uint8_t open) {
+    beforeValue(writer);
+    if (writer->depth + 1 >= JSON_WRITER_MAX_DEPTH) {
+        writer->failed = true;
+        return;
+    }
+    putByte(writer, open);
+    writer->depth++;
+    writer->hasValue &= ~((uint64_t)1 << writer->depth);
+}
+
+static void endContainer(JsonWriter *writer, uint8_t close) {
+    if (writer->depth > 0) {
+        writer->depth--;
+    }
+    writer->afterKey = false;
+    putByte(writer, close);
+}
+
+void JsonWriterBeginObject(JsonWriter *writer) {
+    beginContainer(writer, '{');
+}
+
+void JsonWriterEndObject(JsonWriter *writer) {
+    endContainer(writer, '}');
+}
+
+void JsonWriterBeginArray(JsonWriter *writer) {
+    beginContainer(writer, '[');
+}
+
+void JsonWriterEndArray(JsonWriter *writer) {
+    endContainer(writer, ']');
+}
+
+#pragma mark - Strings
+
+void JsonWriterStringBegin(JsonWriter *writer) {
+    beforeValue(writer);
+    putByte(writer, '"');
+}
+
+void JsonWriterStringAppend(JsonWriter *writer, const char *utf8, size_t length) {
+    static const char hexDigits[] = "0123456789abcdef";
+    const uint8_t *p = (const uint8_t *)utf8;
+    const uint8_t *end = p + length;
+    while (p < end) {
+        // Copy the run of bytes that need no escaping in one go
+        const uint8_t *run = p;
+        while (p < end && !needsEscape(*p)) {
+            p++;
+        }
+        if (p > run) {
+            put(writer, run, (size_t)(p - run));
+        }
+        if (p == end) {
+            break;
+        }
+        char escape[6] = { '\\', 0, 0, 0, 0, 0 };
+        size_t escapeLength = 2;
+        switch (*p) {
+            case '"':  escape[1] = '"'; break;
+            case '\\': escape[1] = '\\'; break;
+            case '\n': escape[1] = 'n'; break;
+            case '\r': escape[1] = 'r'; break;
+            case '\t': escape[1] = 't'; break;
+            case '\b': escape[1] = 'b'; break;
+            case '\f': escape[1] = 'f'; break;
+            default:
+                escape[1] = 'u';
+                escape[2] = '0';
+                escape[3] = '0';
+                escape[4] = hexDigits[*p >> 4];
+                escape[5] = hexDigits[*p & 0x0F];
+                escapeLength = 6;
+                break;
+        }
+        put(writer, escape, escapeLength);
+        p++;
+    }
+}
+
+void JsonWriterStringEnd(JsonWriter *writer) {
+    putByte(writer, '"');
+}
+
+void JsonWriterString(JsonWriter *writer, const char *utf8, size_t length) {
+    JsonWriterStringBegin(writer);
+    JsonWriterStringAppend(writer, utf8, length);
+    JsonWriterStringEnd(writer);
+}
+
+void JsonWriterKey(JsonWriter *writer, const char *utf8, size_t length) {
+    JsonWriterString(writer, utf8, length);
+    putByte(writer, ':');
+    writer->afterKey = true;
+}
+
+void JsonWriterRawKey(JsonWriter *writer, const char *quotedKey, size_t length) {
+    beforeValue(writer);
+    put(writer, quotedKey, length);
+    writer->afterKey = true;
+}
+
+#pragma mark - Scalars
+
+void JsonWriterUInt64(JsonWriter *writer, uint64_t value) {
+    char digits[20];
+    int count = 0;
+    do {
+        digits[sizeof(digits) - ++count] = (char)('0' + value % 10);
+        value /= 10;
+    } while (value);
+    beforeValue(writer);
+    put(writer, digits + sizeof(digits) - count, (size_t)count);
+}
+
+void JsonWriterInt64(JsonWriter *writer, int64_t value) {
+    if (value >= 0) {
+        JsonWriterUInt64(writer, (uint64_t)value);
+        return;
+    }
+    char digits[21];
+    uint64_t magnitude = (uint64_t)0 - (uint64_t)value;
+    int count = 0;
+    do {
+        digits[sizeof(digits) - ++count] = (char)('0' + magnitude % 10);
+        magnitude /= 10;
+    } while (magnitude);
+    digits[sizeof(digits) - ++count] = '-';
+    beforeValue(writer);
+    put(writer, digits + sizeof(digits) - count, (size_t)count);
+}
+
+void JsonWriterDouble(JsonWriter *writer, double value) {
+    if (!isfinite(value)) {
+        JsonWriterNull(writer);
+        return;
+    }
+    // Whole numbers are common (counts, timestamps in ms) and much cheaper as integers
+    if (value == floor(value) && fabs(value) < 1e15) {
+        JsonWriterInt64(writer, (int64_t)value);
+        return;
+    }
+    char buffer[32];
+    int length = snprintf(buffer, sizeof(buffer), "%.17g", value);
+    beforeValue(writer);
+    put(writer, buffer, (size_t)length);
+}
+
+void JsonWriterBool(JsonWriter *writer, bool value) {
+    beforeValue(writer);
+    if (value) {
+        put(writer, "true", 4);
+    } else {
+        put(writer, "false", 5);
+    }
+}
+
+void JsonWriterNull(JsonWriter *writer) {
+    beforeValue(writer);
+    put(writer, "null", 4);
+}
@@ -0,0 +1,114 @@
+//
+//  JsonWriter.h
+//  FlowTrial
+//
+//  Created by Wade Sellers on 12/26/14.
+//  Copyright (c) 2014 Wade Sellers. All rights reserved.
+//
+
+#ifndef FlowTrial_JsonWriter_h
+#define FlowTrial_JsonWriter_h
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+/**
+ Called with the bytes written so far when the buffer fills up, and by JsonWriterFlush
+
+ @return  false if the bytes could not be written (the writer then fails)
+ */
+typedef bool (*JsonWriterFlushFunction)(void *context, const uint8_t *bytes, size_t length);
+
+/**
+ Writes compact JSON into a growable byte buffer, optionally handing full buffers to a
+ flush function (to stream to a file or socket). Commas and colons are placed
+ automatically; the caller just opens and closes containers and writes keys and values.
+ Nesting is limited to JSON_WRITER_MAX_DEPTH. Not thread safe.
+ */
+#define JSON_WRITER_MAX_DEPTH 64
+
+typedef struct {
+    uint8_t *bytes;                 //!< Output so far (since the last flush)
+    size_t length;                  //!< Bytes in bytes
+    size_t capacity;                //!< Size of bytes
+    JsonWriterFlushFunction flush;  //!< NULL to keep everything in bytes
+    void *flushContext;
+    uint64_t hasValue;              //!< Per depth, does the container already have a value (so needs a comma)
+    int depth;
+    bool afterKey;                  //!< A key was just written, so no comma before the value
+    bool failed;                    //!< Out of memory, too deep or a flush failed; everything after is dropped
+} JsonWriter;
+
+/**
+ Initialize a writer
+
+ @param writer          Writer
+ @param capacity        Initial buffer size (the buffer size, when flushing)
+ @param flush           Flush function, NULL to grow the buffer instead
+ @param flushContext    Passed to flush
+ @return                false if out of memory
+ */
+bool JsonWriterInit(JsonWriter *writer, size_t capacity, JsonWriterFlushFunction flush, void *flushContext);
+
+/**
+ Free the writer's buffer (without flushing)
+ */
+void JsonWriterFree(JsonWriter *writer);
+
+/**
+ Clear the output and start again
+ */
+void JsonWriterReset(JsonWriter *writer);
+
+/**
+ Hand everything written so far to the flush function
+
+ @return  false if the writer has failed
+ */
+bool JsonWriterFlush(JsonWriter *writer);
+
+/**
+ Make room for length more bytes (flushing or growing)
+
+ @return  Where to write them, NULL if the writer has failed
+ */
+uint8_t *JsonWriterReserve(JsonWriter *writer, size_t length);
+
+void JsonWriterBeginObject(JsonWriter *writer);
+void JsonWriterEndObject(JsonWriter *writer);
+void JsonWriterBeginArray(JsonWriter *writer);
+void JsonWriterEndArray(JsonWriter *writer);
+
+/**
+ Write an object key
+
+ @param writer  Writer
+ @param utf8    Key, UTF-8
+ @param length  Length in bytes
+ */
+void JsonWriterKey(JsonWriter *writer, const char *utf8, size_t length);
+
+/**
+ Write an object key that is already quoted, escaped and followed by ':' (for keys
+ prepared ahead of time)
+ */
+void JsonWriterRawKey(JsonWriter *writer, const char *quotedKey, size_t length);
+
+void JsonWriterString(JsonWriter *writer, const char *utf8, size_t length);
+void JsonWriterInt64(JsonWriter *writer, int64_t value);
+void JsonWriterUInt64(JsonWriter *writer, uint64_t value);
+//! NaN and infinities are written as null, since JSON has no way to express them
+void JsonWriterDouble(JsonWriter *writer, double value);
+void JsonWriterBool(JsonWriter *writer, bool value);
+void JsonWriterNull(JsonWriter *writer);
+
+/**
+ Write a string in pieces: JsonWriterStringBegin, any number of JsonWriterStringAppend,
+ then JsonWriterStringEnd. Pieces must not split a UTF-8 sequence.
+ */
+void JsonWriterStringBegin(JsonWriter *writer);
+void JsonWriterStringAppend(JsonWriter *writer, const char *utf8, size_t length);
+void JsonWriterStringEnd(JsonWriter *writer);
+
+#endif
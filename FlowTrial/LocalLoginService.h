@@ -0,0 +1,34 @@
+//
+//  LocalLoginService.h
+//  FlowTrial
+//
+//  Created by Wade Sellers on 12/31/14.
+//  Copyright (c) 2014 Wade Sellers. All rights reserved.
+//
+
+#import <Foundation/Foundation.h>
+#import "LoginService.h"
+
+/**
+ LoginService backed by a table of users in memory, keyed by username, for tests and for
+ running without Parse. Answers like CloudLoginService: a new session token and only
+ the projected keys of the user, never the password.
+ */
+@interface LocalLoginService : NSObject <LoginService>
+
+//! Number of logins answered (successful or not)
+@property (readonly, nonatomic) NSUInteger loginCount;
+
+/**
+ Add a user, replacing any user with the same username
+
+ @param username    Username
+ @param password    Password
+ @param fields      Other keys of the user (may be nil)
+ @return            The user's objectId
+ */
+- (NSString *) addUserWithUsername:(NSString *)username
+                          password:(NSString *)password
+                            fields:(NSDictionary *)fields;
+
+@end
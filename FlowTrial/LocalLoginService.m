@@ -0,0 +1,76 @@
+//
+//  LocalLoginService.m
+//  FlowTrial
+//
+//  Created by Wade Sellers on 12/31/14.
+//  Copyright (c) 2014 Wade Sellers. All rights reserved.
+//
+
+#import "LocalLoginService.h"
+
+@interface LocalLoginService ()
+
+//! User records by username
+@property NSMutableDictionary *users;
+@property (readwrite, nonatomic) NSUInteger loginCount;
+
+@end
+
+@implementation LocalLoginService
+
+- (id) init {
+    self = [super init];
+    if (self) {
+        self.users = [NSMutableDictionary dictionary];
+    }
+    return self;
+}
+
+- (NSString *) addUserWithUsername:(NSString *)username
+                          password:(NSString *)password
+                            fields:(NSDictionary *)fields {
+    NSMutableDictionary *record = [NSMutableDictionary dictionaryWithDictionary:fields ?: @{}];
+    NSString *objectId = [[NSUUID UUID] UUIDString];
+    record[@"objectId"] = objectId;
+    record[@"username"] = username;
+    record[@"password"] = password;
+    self.users[username] = record;
+    return objectId;
+}
+
+- (BFTask *) signUpWithUsername:(NSString *)username password:(NSString *)password {
+    if (username && self.users[username]) {
+        return [BFTask taskWithError:[NSError errorWithDomain:LoginServiceErrorDomain
+                                                         code:LOGIN_SERVICE_ERROR_USERNAME_TAKEN
+                                                     userInfo:nil]];
+    }
+    if (username.length == 0 || password.length == 0) {
+        return [BFTask taskWithError:[NSError errorWithDomain:LoginServiceErrorDomain
+                                                         code:LOGIN_SERVICE_ERROR_BAD_LOGIN
+                                                     userInfo:nil]];
+    }
+    [self addUserWithUsername:username password:password fields:nil];
+    return [self logInWithUsername:username password:password];
+}
+
+- (BFTask *) logInWithUsername:(NSString *)username password:(NSString *)password {
+    self.loginCount++;
+    NSDictionary *record = username ? self.users[username] : nil;
+    if (!record || !password || ![record[@"password"] isEqualToString:password]) {
+        return [BFTask taskWithError:[NSError errorWithDomain:LoginServiceErrorDomain
+                                                         code:LOGIN_SERVICE_ERROR_BAD_LOGIN
+                                                     userInfo:nil]];
+    }
+    // Same shape as the Cloud Code response
+    NSMutableDictionary *user = [NSMutableDictionary dictionary];
+    user[@"objectId"] = record[@"objectId"];
+    for (NSString *key in LoginServiceUserKeys()) {
+        if (record[key]) {
+            user[key] = record[key];
+        }
+    }
+    NSDictionary *response = @{ @"sessionToken": [[NSUUID UUID] UUIDString], @"user": user };
+    return [BFTask taskWithResult:[LoginSession sessionWithResponse:response]];
+}
+
+@end
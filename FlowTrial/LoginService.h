@@ -0,0 +1,106 @@
+//
+//  LoginService.h
+//  FlowTrial
+//
+//  Created by Wade Sellers on 12/31/14.
+//  Copyright (c) 2014 Wade Sellers. All rights reserved.
+//
+
+#import <Foundation/Foundation.h>
+#import <Bolts/BFTask.h>
+#import <Parse/Parse.h>
+#import "OfflineWriteQueue.h"
+
+//! Error domain for logins the service turned down
+extern NSString * const LoginServiceErrorDomain;
+
+//! Error code: no user has that username and password
+#define LOGIN_SERVICE_ERROR_BAD_LOGIN 1
+
+//! Error code: the service's response could not be understood
+#define LOGIN_SERVICE_ERROR_BAD_RESPONSE 2
+
+//! Error code: sign up with a username another user has
+#define LOGIN_SERVICE_ERROR_USERNAME_TAKEN 3
+
+/**
+ Keys of the User projection returned by a login (objectId is always included).
+ Never includes password.
+
+ @return  Keys
+ */
+NSArray *LoginServiceUserKeys(void);
+
+/**
+ A logged in user
+ */
+@interface LoginSession : NSObject
+
+//! Token identifying this login
+@property (readonly, nonatomic) NSString *sessionToken;
+
+//! The User, with only objectId and LoginServiceUserKeys() filled in
+@property (readonly, nonatomic) PFObject *user;
+
+/**
+ Create a session
+
+ @param sessionToken    Token identifying the login
+ @param user            User projection
+ @return                New session
+ */
+- (id) initWithSessionToken:(NSString *)sessionToken user:(PFObject *)user;
+
+/**
+ Create a session from a login response: a dictionary with "sessionToken" and "user",
+ the latter a dictionary with "objectId" and the projected keys
+
+ @param response    Response
+ @return            New session, or nil if the response is not one
+ */
++ (LoginSession *) sessionWithResponse:(id)response;
+
+/**
+ Change the user's profile: set the values on user now, and queue a write of just those
+ keys, which works offline. Credentials never go through the queue: a password raises
+ NSInvalidArgumentException, changing nothing.
+
+ @param values  Keys and values to set, as for OfflineWriteQueue
+ @param queue   Queue to write through
+ */
+- (void) setProfileValues:(NSDictionary *)values
+                    queue:(OfflineWriteQueue *)queue;
+
+@end
+
+/**
+ Where LoginViewController checks a username and password, and signs up new users: Cloud
+ Code functions (CloudLoginService), or a table in memory (LocalLoginService) for tests
+ and the simulator.
+
+ Either way the password is checked by the service, never on the device, usernames are
+ unique, and only a session token and a small projection of the User come back.
+ */
+@protocol LoginService <NSObject>
+
+/**
+ Log in
+
+ @param username    Username
+ @param password    Password
+ @return            Task whose result is a LoginSession; fails with
+                    LOGIN_SERVICE_ERROR_BAD_LOGIN if the username and password don't match
+ */
+- (BFTask *) logInWithUsername:(NSString *)username password:(NSString *)password;
+
+/**
+ Create a user and log in as it
+
+ @param username    Username, which no other user may have
+ @param password    Password
+ @return            Task whose result is a LoginSession for the new user; fails with
+                    LOGIN_SERVICE_ERROR_USERNAME_TAKEN if the username is in use
+ */
+- (BFTask *) signUpWithUsername:(NSString *)username password:(NSString *)password;
+
+@end
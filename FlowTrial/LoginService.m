@@ -0,0 +1,65 @@
+//
+//  LoginService.m
+//  FlowTrial
+//
+//  Created by Wade Sellers on 12/31/14.
+//  Copyright (c) 2014 Wade Sellers. All rights reserved.
+//
+
+#import "LoginService.h"
+
+NSString * const LoginServiceErrorDomain = @"LoginServiceErrorDomain";
+
+NSArray *LoginServiceUserKeys(void) {
+    return @[ @"username" ];
+}
+
+@implementation LoginSession
+
+- (id) initWithSessionToken:(NSString *)sessionToken user:(PFObject *)user {
+    self = [super init];
+    if (self) {
+        _sessionToken = sessionToken;
+        _user = user;
+    }
+    return self;
+}
+
++ (LoginSession *) sessionWithResponse:(id)response {
+    if (![response isKindOfClass:[NSDictionary class]]) {
+        return nil;
+    }
+    NSString *sessionToken = response[@"sessionToken"];
+    NSDictionary *fields = response[@"user"];
+    if (![sessionToken isKindOfClass:[NSString class]] ||
+        ![fields isKindOfClass:[NSDictionary class]] ||
+        ![fields[@"objectId"] isKindOfClass:[NSString class]]) {
+        return nil;
+    }
+    PFObject *user = [PFObject objectWithoutDataWithClassName:@"User" objectId:fields[@"objectId"]];
+    for (NSString *key in LoginServiceUserKeys()) {
+        id value = fields[key];
+        if (value && value != [NSNull null]) {
+            user[key] = value;
+        }
+    }
+    return [[LoginSession alloc] initWithSessionToken:sessionToken user:user];
+}
+
+- (void) setProfileValues:(NSDictionary *)values
+                    queue:(OfflineWriteQueue *)queue {
+    if (values[@"password"]) {
+        // The queue keeps writes on disk until they are sent
+        [NSException raise:NSInvalidArgumentException format:@"LoginSession: passwords can't be queued"];
+    }
+    [queue setValues:values ofObjectWithClassName:self.user.parseClassName objectId:self.user.objectId];
+    for (NSString *key in values) {
+        if (values[key] == [NSNull null]) {
+            [self.user removeObjectForKey:key];
+        } else {
+            self.user[key] = values[key];
+        }
+    }
+}
+
+@end
@@ -9,9 +9,12 @@
 #import <UIKit/UIKit.h>
 #import <Parse/Parse.h>
 #import "Ugi.h"
+#import "LoginService.h"
 
 @interface LoginViewController : UIViewController
 
+//! Service that checks logins (a CloudLoginService unless set before the view loads)
+@property id<LoginService> loginService;
 
 @end
 
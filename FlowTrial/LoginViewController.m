@@ -6,7 +6,9 @@
 //  Copyright (c) 2014 Wade Sellers. All rights reserved.
 //
 
+#import <Bolts/BFExecutor.h>
 #import "LoginViewController.h"
+#import "CloudLoginService.h"
 #import "User.h"
 #import "UserHomeScreenVC.h"
 
@@ -24,7 +26,7 @@
 @property (weak, nonatomic) IBOutlet UIButton *signUpButton;
 @property (weak, nonatomic) IBOutlet UIButton *finishButton;
 
-@property NSArray *userArray;
+@property LoginSession *session;
 @property User *user;
 
 @end
@@ -34,6 +36,9 @@
 - (void)viewDidLoad {
     [super viewDidLoad];
     self.user = [[User alloc] init];
+    if (!self.loginService) {
+        self.loginService = [[CloudLoginService alloc] init];
+    }
 
 }
 
@@ -47,28 +52,25 @@
     self.user.username = self.usernameTextField.text;
     self.user.password = self.passwordTextField.text;
 
-    PFQuery *userQuery = [PFQuery queryWithClassName:@"User"];
-    [userQuery whereKey:@"username" equalTo:self.user.username];
-    [userQuery findObjectsInBackgroundWithBlock:^(NSArray *objects, NSError *error) {
-        if (error)
+    // The password is checked by the service; only a session and the user's public keys come back
+    [[self.loginService logInWithUsername:self.user.username password:self.user.password]
+     continueWithExecutor:[BFExecutor mainThreadExecutor] withBlock:^id(BFTask *task) {
+        if (task.result)
+        {
+            self.session = task.result;
+            [self performSegueWithIdentifier:@"intoHomeScreenSegue" sender:sender];
+        }
+        else if ([task.error.domain isEqualToString:LoginServiceErrorDomain] && task.error.code == LOGIN_SERVICE_ERROR_BAD_LOGIN)
         {
-            NSLog(@"Error: %@", error.userInfo);
-            self.userArray = [NSArray array];
+            UIAlertView *badLoginAlert = [[UIAlertView alloc] initWithTitle:@"Incorrect Login" message:@"Password doesn't match for Username, try again." delegate:self cancelButtonTitle:@"Okay" otherButtonTitles: nil];
+            [badLoginAlert show];
         }
         else
         {
-            self.userArray = [[NSArray alloc] initWithArray: objects];
-
-            if ([[[self.userArray objectAtIndex:0] valueForKey:@"password"] isEqualToString:self.user.password])
-            {
-                [self performSegueWithIdentifier:@"intoHomeScreenSegue" sender:sender];
-            }
-            else
-            {
-                UIAlertView *badLoginAlert = [[UIAlertView alloc] initWithTitle:@"Incorrect Login" message:@"Password doesn't match for Username, try again." delegate:self cancelButtonTitle:@"Okay" otherButtonTitles: nil];
-                [badLoginAlert show];
-            }
+            NSLog(@"Error: %@", task.error.userInfo);
+            [self showAlertForError:task.error title:@"Login Failed"];
         }
+        return nil;
     }];
 }
 
@@ -86,21 +88,47 @@
     if (![self.passwordTextField.text isEqualToString:self.confirmPasswordTextField.text]) {
         UIAlertView *badConfirmPasswordAlert = [[UIAlertView alloc] initWithTitle:@"Password Mismatch" message:@"Please Try Again" delegate:self cancelButtonTitle:@"Okay" otherButtonTitles: nil];
         [badConfirmPasswordAlert show];
+        return;
     }
     User *newUser = [[User alloc] init];
     newUser.username = self.usernameTextField.text;
     newUser.password = self.passwordTextField.text;
 
-    PFObject *newUserObject = [PFObject objectWithClassName:@"User"];
-    newUserObject[@"username"] = newUser.username;
-    newUserObject[@"password"] = newUser.password;
-    [newUserObject saveInBackground];
+    // Sent straight to the service, never queued: the password must not sit on the device
+    [[self.loginService signUpWithUsername:newUser.username password:newUser.password]
+     continueWithExecutor:[BFExecutor mainThreadExecutor] withBlock:^id(BFTask *task) {
+        if (task.result)
+        {
+            self.session = task.result;
+            [self performSegueWithIdentifier:@"intoHomeScreenSegue" sender:sender];
+        }
+        else if ([task.error.domain isEqualToString:LoginServiceErrorDomain] && task.error.code == LOGIN_SERVICE_ERROR_USERNAME_TAKEN)
+        {
+            UIAlertView *usernameTakenAlert = [[UIAlertView alloc] initWithTitle:@"Username Taken" message:@"Someone already has that username, try another." delegate:self cancelButtonTitle:@"Okay" otherButtonTitles: nil];
+            [usernameTakenAlert show];
+        }
+        else
+        {
+            NSLog(@"Error: %@", task.error.userInfo);
+            [self showAlertForError:task.error title:@"Sign Up Failed"];
+        }
+        return nil;
+    }];
+}
 
+//
+// Tell the user about a failure that isn't their username or password
+//
+- (void)showAlertForError:(NSError *)error title:(NSString *)title {
+    NSString *message = error ? [NSString stringWithFormat:@"%@ Please try again.", error.localizedDescription]
+                              : @"Something went wrong. Please try again.";
+    UIAlertView *errorAlert = [[UIAlertView alloc] initWithTitle:title message:message delegate:self cancelButtonTitle:@"Okay" otherButtonTitles: nil];
+    [errorAlert show];
 }
 
 - (void)prepareForSegue:(UIStoryboardSegue *)segue sender:(id)sender {
     UserHomeScreenVC *userHomeScreenVC = [segue destinationViewController];
-    userHomeScreenVC.user = [self.userArray objectAtIndex:0];
+    userHomeScreenVC.user = self.session.user;
 }
 
 
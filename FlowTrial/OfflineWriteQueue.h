@@ -0,0 +1,110 @@
+//
+//  OfflineWriteQueue.h
+//  FlowTrial
+//
+//  Created by Wade Sellers on 12/31/14.
+//  Copyright (c) 2014 Wade Sellers. All rights reserved.
+//
+
+#import <Foundation/Foundation.h>
+#import <Bolts/BFTask.h>
+#import "BulkSaver.h"
+
+//! Posted on the main thread after a flush, whether or not everything was saved
+extern NSString * const OfflineWriteQueueDidFlushNotification;
+
+//! Flush notification userInfo key: local id -> objectId of the objects the flush created (NSDictionary)
+extern NSString * const OfflineWriteQueueCreatedObjectIdsKey;
+
+/**
+ A durable queue of writes to Parse objects (Inventory records, Users), for devices that
+ are often offline.
+
+ Queuing a write updates a table of pending writes in memory, where several writes to
+ one object coalesce into a single write of the latest value of each key, and appends
+ the write to a JsonJournal on a background queue, so it costs one append and never
+ waits for the network. Pending writes survive the app being killed: the table is
+ rebuilt on launch from a snapshot file and the journal records written after it.
+
+ Pending writes are sent by flush, in batches through a BulkSaver. Flushes start a
+ moment after each write (so a burst of edits goes out together) and whenever the
+ network becomes reachable, while startFlushing is in effect. Writes that fail stay
+ pending, beneath any newer writes to the same keys, and are retried after a delay that
+ doubles with each failed flush. After each flush the table is written as a new
+ snapshot and the journal emptied.
+
+ Values can be NSString, NSNumber, NSDate, or NSNull to remove a key. Objects that
+ don't exist yet get a local id, which later writes can use until the object is
+ created. Writes queued by local id in the meantime go to the new object; after that,
+ use the objectId, which the flush notification gives under
+ OfflineWriteQueueCreatedObjectIdsKey (the queue forgets the mapping once it is applied).
+
+ Writes sit on disk until they are sent, so never queue credentials or other secrets.
+ The shared queue is kept in Application Support, excluded from backups and protected
+ while the device is locked.
+
+ Use from the main thread.
+ */
+@interface OfflineWriteQueue : NSObject
+
+//! Saver that flushes go through
+@property (readonly, nonatomic) BulkSaver *saver;
+
+//! Number of objects with writes pending
+@property (readonly, nonatomic) NSUInteger pendingCount;
+
+/**
+ The app's queue, loaded from Application Support the first time
+
+ @return  Shared queue
+ */
++ (OfflineWriteQueue *) sharedQueue;
+
+/**
+ Open a queue
+
+ @param path    File for the snapshot; the journal is next to it (path + ".journal")
+ @return        Queue with the writes left pending from last time
+ */
+- (id) initWithPath:(NSString *)path;
+
+/**
+ Queue a write
+
+ @param values      Keys and values to set; raises NSInvalidArgumentException, queuing
+                    nothing, if a value isn't one of the types above
+ @param className   Parse class
+ @param objectId    Object to write, a local id returned by an earlier call, or nil to create an object;
+                    raises NSInvalidArgumentException for a local id whose object has been created
+ @return            The object's id: its objectId, or a local id until it is created
+ */
+- (NSString *) setValues:(NSDictionary *)values
+  ofObjectWithClassName:(NSString *)className
+               objectId:(NSString *)objectId;
+
+/**
+ Wait until every write queued so far is in the journal or a snapshot
+ */
+- (void) waitUntilWritten;
+
+/**
+ Send the pending writes now. Only one flush runs at a time; calling this during a
+ flush returns the flush in progress.
+
+ @return    Task whose result is the number of objects saved (NSNumber), or the
+            BulkSaver error if some couldn't be
+ */
+- (BFTask *) flush;
+
+/**
+ Flush after writes, whenever the network becomes reachable, and again a while after a
+ flush fails, until stopFlushing
+ */
+- (void) startFlushing;
+
+/**
+ Stop flushing by itself (writes are still queued and saved to disk)
+ */
+- (void) stopFlushing;
+
+@end
@@ -0,0 +1,602 @@
+//
+//  OfflineWriteQueue.m
+//  FlowTrial
+//
+//  Created by Wade Sellers on 12/31/14.
+//  Copyright (c) 2014 Wade Sellers. All rights reserved.
+//
+
+#import <SystemConfiguration/SystemConfiguration.h>
+#import <Bolts/BFExecutor.h>
+#import <Parse/Parse.h>
+#import "OfflineWriteQueue.h"
+#import "JsonJournal.h"
+
+NSString * const OfflineWriteQueueDidFlushNotification = @"OfflineWriteQueueDidFlushNotification";
+NSString * const OfflineWriteQueueCreatedObjectIdsKey = @"createdObjectIds";
+
+//! Folder (in Application Support) the shared queue is kept in
+#define WRITE_QUEUE_DIRECTORY_NAME @"OfflineWriteQueue"
+
+//! File (in that folder) the shared queue is kept in
+#define WRITE_QUEUE_FILE_NAME @"OfflineWriteQueue"
+
+//! The journal is the snapshot path with this added
+#define JOURNAL_SUFFIX @".journal"
+
+//! Local ids of objects not created yet start with this
+#define LOCAL_ID_PREFIX @"local-"
+
+//! Seconds after a write before flushing, so a burst of edits goes out together
+#define FLUSH_DELAY_SECONDS 2
+
+//! Seconds after a failed flush before trying again, doubling with each failure
+#define FLUSH_RETRY_DELAY_SECONDS 5
+
+//! Longest wait between retries
+#define MAX_FLUSH_RETRY_DELAY_SECONDS (5 * 60)
+
+//! Host whose reachability starts a flush
+#define PARSE_HOST "api.parse.com"
+
+//! Write a snapshot once this much has been journaled, even if nothing could be flushed
+#define MAX_JOURNAL_BYTES (256 * 1024)
+
+// Snapshot and journal record keys
+static NSString * const GenerationKey = @"generation";
+static NSString * const WritesKey = @"writes";
+static NSString * const CreatedKey = @"created";
+static NSString * const ClassNameKey = @"c";
+static NSString * const ObjectIdKey = @"o";
+static NSString * const LocalIdKey = @"l";
+static NSString * const FieldsKey = @"f";
+
+//! Dates are stored as { "__date": seconds since 1970 }
+static NSString * const DateKey = @"__date";
+
+//! Journal entry names for created objects are this and the local id
+static NSString * const CreatedEntryPrefix = @"created/";
+
+///////////////////////////////////////////////////////////////////////////////////////
+#pragma mark - QueuedWrite
+///////////////////////////////////////////////////////////////////////////////////////
+
+/**
+ Everything pending for one object
+ */
+@interface QueuedWrite : NSObject
+
+@property (nonatomic) NSString *className;
+@property (nonatomic) NSString *objectId;               // nil until the object is created
+@property (nonatomic) NSString *localId;                // nil for objects that exist
+@property (nonatomic) NSMutableDictionary *fields;      // Key -> stored value, latest write wins
+
+//! Key in the pending table (and journal entry name): class and id
+- (NSString *) key;
+
+//! As stored in the snapshot and journal
+- (NSDictionary *) record;
+
++ (QueuedWrite *) writeWithRecord:(NSDictionary *)record;
+
+@end
+
+@implementation QueuedWrite
+
+- (NSString *) key {
+    return [NSString stringWithFormat:@"%@/%@", self.className, self.objectId ?: self.localId];
+}
+
+- (NSDictionary *) record {
+    NSMutableDictionary *record = [NSMutableDictionary dictionaryWithCapacity:4];
+    record[ClassNameKey] = self.className;
+    record[FieldsKey] = self.fields;
+    if (self.objectId) {
+        record[ObjectIdKey] = self.objectId;
+    }
+    if (self.localId) {
+        record[LocalIdKey] = self.localId;
+    }
+    return record;
+}
+
++ (QueuedWrite *) writeWithRecord:(NSDictionary *)record {
+    if (![record isKindOfClass:[NSDictionary class]] ||
+        ![record[ClassNameKey] isKindOfClass:[NSString class]] ||
+        ![record[FieldsKey] isKindOfClass:[NSDictionary class]]) {
+        return nil;
+    }
+    QueuedWrite *write = [[QueuedWrite alloc] init];
+    write.className = record[ClassNameKey];
+    write.objectId = record[ObjectIdKey];
+    write.localId = record[LocalIdKey];
+    write.fields = [record[FieldsKey] mutableCopy];
+    return (write.objectId || write.localId) ? write : nil;
+}
+
+@end
+
+//
+// A value as it is stored (JSON), nil if it can't be queued
+//
+static id storedValue(id value) {
+    if ([value isKindOfClass:[NSDate class]]) {
+        return @{ DateKey: @([value timeIntervalSince1970]) };
+    }
+    if ([value isKindOfClass:[NSString class]] || [value isKindOfClass:[NSNumber class]] ||
+        value == [NSNull null]) {
+        return value;
+    }
+    return nil;
+}
+
+static id valueFromStored(id stored) {
+    if ([stored isKindOfClass:[NSDictionary class]]) {
+        return [NSDate dateWithTimeIntervalSince1970:[stored[DateKey] doubleValue]];
+    }
+    return stored;
+}
+
+///////////////////////////////////////////////////////////////////////////////////////
+#pragma mark - OfflineWriteQueue
+///////////////////////////////////////////////////////////////////////////////////////
+
+@interface OfflineWriteQueue ()
+
+@property (readwrite, nonatomic) BulkSaver *saver;
+@property NSString *path;
+@property NSMutableDictionary *pending;             // Key -> QueuedWrite
+@property NSArray *flushingWrites;                  // Being saved by the running flush
+@property NSMutableDictionary *createdObjectIds;    // Local id -> objectId, until applied to the writes
+@property BFTask *flushTask;
+@property BOOL autoFlush;
+@property BOOL flushScheduled;
+@property NSTimeInterval retryDelay;                // Before the next retry; 0 until a flush fails
+
+- (void) mergeWrite:(QueuedWrite *)write;
+- (void) mergeCreatedObjectIds:(NSDictionary *)createdObjectIds;
+
+@end
+
+//
+// Create the folder the queue is kept in: not backed up, and files in it (which
+// inherit its protection) unreadable while the device is locked
+//
+static void createProtectedDirectory(NSString *directory) {
+    NSError *error;
+    if (![[NSFileManager defaultManager] createDirectoryAtPath:directory
+                                   withIntermediateDirectories:YES
+                                                    attributes:@{ NSFileProtectionKey: NSFileProtectionComplete }
+                                                         error:&error] ||
+        ![[NSFileManager defaultManager] setAttributes:@{ NSFileProtectionKey: NSFileProtectionComplete }
+                                          ofItemAtPath:directory
+                                                 error:&error] ||
+        ![[NSURL fileURLWithPath:directory isDirectory:YES] setResourceValue:@YES
+                                                                      forKey:NSURLIsExcludedFromBackupKey
+                                                                       error:&error]) {
+        NSLog(@"OfflineWriteQueue: can't set up %@: %@", directory, error);
+    }
+}
+
+@implementation OfflineWriteQueue {
+    JsonJournal _journal;
+    BOOL _journalOpen;
+    uint64_t _generation;
+    uint64_t _journaledBytes;           // Since the last snapshot
+    dispatch_queue_t _ioQueue;
+    SCNetworkReachabilityRef _reachability;
+}
+
++ (OfflineWriteQueue *) sharedQueue {
+    static OfflineWriteQueue *queue;
+    static dispatch_once_t onceToken;
+    dispatch_once(&onceToken, ^{
+        NSString *support = NSSearchPathForDirectoriesInDomains(NSApplicationSupportDirectory, NSUserDomainMask, YES)[0];
+        NSString *directory = [support stringByAppendingPathComponent:WRITE_QUEUE_DIRECTORY_NAME];
+        createProtectedDirectory(directory);
+        queue = [[OfflineWriteQueue alloc] initWithPath:[directory stringByAppendingPathComponent:WRITE_QUEUE_FILE_NAME]];
+    });
+    return queue;
+}
+
+- (id) initWithPath:(NSString *)path {
+    self = [super init];
+    if (self) {
+        self.path = path;
+        self.saver = [[BulkSaver alloc] init];
+        self.pending = [NSMutableDictionary dictionary];
+        self.createdObjectIds = [NSMutableDictionary dictionary];
+        _ioQueue = dispatch_queue_create("OfflineWriteQueue", DISPATCH_QUEUE_SERIAL);
+        [self load];
+    }
+    return self;
+}
+
+- (void) dealloc {
+    // Journal blocks hold on to the queue, so none are left by now
+    [self stopFlushing];
+    if (_journalOpen) {
+        JsonJournalClose(&_journal);
+    }
+}
+
+- (NSUInteger) pendingCount {
+    return self.pending.count;
+}
+
+#pragma mark - Loading
+
+static void replayBatch(void *context, uint64_t generation, const JsonJournalEntry *entries, int count) {
+    OfflineWriteQueue *queue = (__bridge OfflineWriteQueue *)context;
+    if (generation < queue->_generation) {
+        return;  // Written before the snapshot was taken, so already in it
+    }
+    for (int i = 0; i < count; i++) {
+        NSData *value = [NSData dataWithBytesNoCopy:(void *)entries[i].value length:entries[i].valueLength freeWhenDone:NO];
+        NSDictionary *record = [NSJSONSerialization JSONObjectWithData:value options:0 error:nil];
+        QueuedWrite *write = [QueuedWrite writeWithRecord:record];
+        if (write) {
+            [queue mergeWrite:write];
+        } else if ([record isKindOfClass:[NSDictionary class]] &&
+                   [record[LocalIdKey] isKindOfClass:[NSString class]] &&
+                   [record[ObjectIdKey] isKindOfClass:[NSString class]]) {
+            [queue mergeCreatedObjectIds:@{ record[LocalIdKey]: record[ObjectIdKey] }];
+        }
+    }
+}
+
+- (void) load {
+    NSData *snapshot = [NSData dataWithContentsOfFile:self.path];
+    NSDictionary *contents = snapshot ? [NSJSONSerialization JSONObjectWithData:snapshot options:0 error:nil] : nil;
+    if ([contents isKindOfClass:[NSDictionary class]]) {
+        _generation = [contents[GenerationKey] unsignedLongLongValue];
+        for (NSDictionary *record in contents[WritesKey]) {
+            QueuedWrite *write = [QueuedWrite writeWithRecord:record];
+            if (write) {
+                [self mergeWrite:write];
+            }
+        }
+        if ([contents[CreatedKey] isKindOfClass:[NSDictionary class]]) {
+            [self mergeCreatedObjectIds:contents[CreatedKey]];
+        }
+    }
+    NSString *journalPath = [self.path stringByAppendingString:JOURNAL_SUFFIX];
+    _journalOpen = JsonJournalOpen(&_journal, journalPath.fileSystemRepresentation, replayBatch, (__bridge void *)self);
+    if (!_journalOpen) {
+        NSLog(@"OfflineWriteQueue: can't open %@: %s", journalPath, strerror(errno));
+    }
+    _journaledBytes = _journalOpen ? _journal.length : 0;
+    // Writes queued by local id before the app quit go to objects created since
+    [self adoptCreatedObjectIds];
+    [self.createdObjectIds removeAllObjects];
+}
+
+#pragma mark - Queuing
+
+//
+// Add a write to the pending table; its fields win over those already pending
+//
+- (void) mergeWrite:(QueuedWrite *)write {
+    NSString *key = [write key];
+    QueuedWrite *existing = self.pending[key];
+    if (existing) {
+        [existing.fields addEntriesFromDictionary:write.fields];
+    } else {
+        self.pending[key] = write;
+    }
+}
+
+//
+// Add objects created by earlier flushes, as loaded from the snapshot or journal
+//
+- (void) mergeCreatedObjectIds:(NSDictionary *)createdObjectIds {
+    for (NSString *localId in createdObjectIds) {
+        if ([localId isKindOfClass:[NSString class]] && [createdObjectIds[localId] isKindOfClass:[NSString class]]) {
+            self.createdObjectIds[localId] = createdObjectIds[localId];
+        }
+    }
+}
+
+- (NSString *) setValues:(NSDictionary *)values
+  ofObjectWithClassName:(NSString *)className
+               objectId:(NSString *)objectId {
+    QueuedWrite *write = [[QueuedWrite alloc] init];
+    write.className = className;
+    write.fields = [NSMutableDictionary dictionaryWithCapacity:values.count];
+    for (NSString *key in values) {
+        id value = storedValue(values[key]);
+        if (!value) {
+            // Nothing has been queued yet, so the caller can catch this and carry on
+            [NSException raise:NSInvalidArgumentException
+                        format:@"OfflineWriteQueue: can't queue a %@ for %@", [values[key] class], key];
+        }
+        write.fields[key] = value;
+    }
+    if (!objectId) {
+        write.localId = [LOCAL_ID_PREFIX stringByAppendingString:[[NSUUID UUID] UUIDString]];
+    } else if ([objectId hasPrefix:LOCAL_ID_PREFIX]) {
+        // Created since the caller got its local id?
+        write.objectId = self.createdObjectIds[objectId];
+        write.localId = write.objectId ? nil : objectId;
+        if (write.localId && ![self isWaitingForLocalId:objectId className:className]) {
+            // Created and forgotten: writing by local id now would create it again
+            [NSException raise:NSInvalidArgumentException
+                        format:@"OfflineWriteQueue: %@ has been created, use its objectId", objectId];
+        }
+    } else {
+        write.objectId = objectId;
+    }
+
+    [self mergeWrite:write];
+    [self journalWrite:write];
+    [self scheduleFlush];
+    return write.objectId ?: write.localId;
+}
+
+//
+// Is an object with this local id still to be created (queued, or being flushed)?
+//
+- (BOOL) isWaitingForLocalId:(NSString *)localId className:(NSString *)className {
+    if (self.pending[[NSString stringWithFormat:@"%@/%@", className, localId]]) {
+        return YES;
+    }
+    for (QueuedWrite *write in self.flushingWrites) {
+        if ([write.localId isEqualToString:localId]) {
+            return YES;
+        }
+    }
+    return NO;
+}
+
+//
+// Append one write to the journal, off the main thread
+//
+- (void) journalWrite:(QueuedWrite *)write {
+    if (!_journalOpen) {
+        return;
+    }
+    NSData *name = [[write key] dataUsingEncoding:NSUTF8StringEncoding];
+    NSData *value = [NSJSONSerialization dataWithJSONObject:[write record] options:0 error:nil];
+    if (!value) {
+        return;
+    }
+    uint64_t generation = _generation;
+    dispatch_async(_ioQueue, ^{
+        JsonJournalEntry entry = { JSON_JOURNAL_SET, name.bytes, name.length, value.bytes, value.length };
+        if (!JsonJournalAppend(&self->_journal, generation, &entry, 1, true)) {
+            NSLog(@"OfflineWriteQueue: journal write failed: %s", strerror(errno));
+        }
+    });
+    _journaledBytes += sizeof(JsonJournalRecordHeader) + name.length + value.length;
+    if (_journaledBytes > MAX_JOURNAL_BYTES) {
+        [self compact];
+    }
+}
+
+//
+// Append an object created by a flush to the journal, so writes to its local id still
+// find it after a restart
+//
+- (void) journalCreatedObjectId:(NSString *)objectId forLocalId:(NSString *)localId {
+    if (!_journalOpen) {
+        return;
+    }
+    NSData *name = [[CreatedEntryPrefix stringByAppendingString:localId] dataUsingEncoding:NSUTF8StringEncoding];
+    NSData *value = [NSJSONSerialization dataWithJSONObject:@{ LocalIdKey: localId, ObjectIdKey: objectId } options:0 error:nil];
+    uint64_t generation = _generation;
+    dispatch_async(_ioQueue, ^{
+        JsonJournalEntry entry = { JSON_JOURNAL_SET, name.bytes, name.length, value.bytes, value.length };
+        if (!JsonJournalAppend(&self->_journal, generation, &entry, 1, true)) {
+            NSLog(@"OfflineWriteQueue: journal write failed: %s", strerror(errno));
+        }
+    });
+    _journaledBytes += sizeof(JsonJournalRecordHeader) + name.length + value.length;
+}
+
+//
+// Write the pending table as a new snapshot and empty the journal
+//
+- (void) compact {
+    if (!_journalOpen) {
+        return;
+    }
+    // Writes journaled from here on are newer than the snapshot
+    _generation++;
+    _journaledBytes = 0;
+    NSMutableArray *records = [NSMutableArray arrayWithCapacity:self.pending.count];
+    // Writes being flushed go first, so pending writes to the same keys win when loaded
+    for (QueuedWrite *write in self.flushingWrites) {
+        [records addObject:[write record]];
+    }
+    for (QueuedWrite *write in [self.pending objectEnumerator]) {
+        [records addObject:[write record]];
+    }
+    NSDictionary *contents = @{ GenerationKey: @(_generation),
+                                WritesKey: records,
+                                CreatedKey: [self.createdObjectIds copy] };
+    NSData *snapshot = [NSJSONSerialization dataWithJSONObject:contents options:0 error:nil];
+    NSString *path = self.path;
+    dispatch_async(_ioQueue, ^{
+        // Every write journaled before this point is in the snapshot
+        if (!snapshot || !JsonFileReplace(path.fileSystemRepresentation, snapshot.bytes, snapshot.length)) {
+            NSLog(@"OfflineWriteQueue: can't write %@: %s", path, strerror(errno));
+        } else if (!JsonJournalDropPrefix(&self->_journal, self->_journal.length)) {
+            // Harmless: the old records are skipped by generation when replayed
+            NSLog(@"OfflineWriteQueue: can't trim journal: %s", strerror(errno));
+        }
+    });
+}
+
+- (void) waitUntilWritten {
+    dispatch_sync(_ioQueue, ^{});
+}
+
+#pragma mark - Flushing
+
+- (BFTask *) flush {
+    if (self.flushTask && !self.flushTask.isCompleted) {
+        return self.flushTask;
+    }
+    if (self.pending.count == 0) {
+        return [BFTask taskWithResult:@0];
+    }
+
+    // Writes queued from here on wait for the next flush
+    NSArray *writes = [self.pending allValues];
+    [self.pending removeAllObjects];
+    self.flushingWrites = writes;
+    NSMutableArray *objects = [NSMutableArray arrayWithCapacity:writes.count];
+    for (QueuedWrite *write in writes) {
+        PFObject *object = write.objectId
+            ? [PFObject objectWithoutDataWithClassName:write.className objectId:write.objectId]
+            : [PFObject objectWithClassName:write.className];
+        for (NSString *key in write.fields) {
+            id value = valueFromStored(write.fields[key]);
+            if (value == [NSNull null]) {
+                [object removeObjectForKey:key];
+            } else {
+                object[key] = value;
+            }
+        }
+        [objects addObject:object];
+    }
+
+    self.flushTask = [[self.saver saveObjects:objects progress:nil] continueWithExecutor:[BFExecutor mainThreadExecutor]
+                                                                               withBlock:^id(BFTask *task) {
+        self.flushingWrites = nil;
+        NSArray *saved = task.error ? task.error.userInfo[BulkSaverSavedObjectsKey] : task.result;
+        NSHashTable *savedObjects = [NSHashTable hashTableWithOptions:NSPointerFunctionsObjectPointerPersonality];
+        for (PFObject *object in saved) {
+            [savedObjects addObject:object];
+        }
+        for (NSUInteger i = 0; i < writes.count; i++) {
+            QueuedWrite *write = writes[i];
+            PFObject *object = objects[i];
+            if (write.localId && object.objectId) {
+                // Created, even if a later write in its batch failed
+                self.createdObjectIds[write.localId] = object.objectId;
+                [self journalCreatedObjectId:object.objectId forLocalId:write.localId];
+                if (![savedObjects containsObject:object]) {
+                    write.objectId = object.objectId;
+                    write.localId = nil;
+                }
+            }
+            if (![savedObjects containsObject:object]) {
+                [self requeueWrite:write];
+            }
+        }
+        // Once applied the mappings are only needed by callers holding local ids, who get them below
+        [self adoptCreatedObjectIds];
+        NSDictionary *created = [self.createdObjectIds copy];
+        [self.createdObjectIds removeAllObjects];
+        [self compact];
+        [[NSNotificationCenter defaultCenter] postNotificationName:OfflineWriteQueueDidFlushNotification
+                                                            object:self
+                                                          userInfo:@{ OfflineWriteQueueCreatedObjectIdsKey: created }];
+
+        if (task.error) {
+            NSLog(@"OfflineWriteQueue: %lu objects not saved: %@", (unsigned long)self.pending.count, task.error);
+            [self scheduleRetry];
+            return task;
+        }
+        self.retryDelay = 0;
+        // Writes queued during the flush go out next
+        if (self.pending.count > 0) {
+            [self scheduleFlush];
+        }
+        return @(saved.count);
+    }];
+    return self.flushTask;
+}
+
+//
+// Put back a write that wasn't saved, beneath anything written since
+//
+- (void) requeueWrite:(QueuedWrite *)write {
+    NSString *key = [write key];
+    QueuedWrite *newer = self.pending[key];
+    if (newer) {
+        [write.fields addEntriesFromDictionary:newer.fields];
+    }
+    self.pending[key] = write;
+}
+
+//
+// Writes queued for objects by local id, before they were created, go to the new objects
+//
+- (void) adoptCreatedObjectIds {
+    for (QueuedWrite *write in [self.pending allValues]) {
+        NSString *objectId = write.localId ? self.createdObjectIds[write.localId] : nil;
+        if (!objectId) {
+            continue;
+        }
+        [self.pending removeObjectForKey:[write key]];
+        write.objectId = objectId;
+        write.localId = nil;
+        // Queued by local id since the object's last save went out, so it wins
+        [self mergeWrite:write];
+    }
+}
+
+- (void) scheduleFlush {
+    [self scheduleFlushAfter:FLUSH_DELAY_SECONDS];
+}
+
+//
+// Try a failed flush again later, backing off while it keeps failing
+//
+- (void) scheduleRetry {
+    self.retryDelay = self.retryDelay > 0 ? MIN(self.retryDelay * 2, MAX_FLUSH_RETRY_DELAY_SECONDS)
+                                          : FLUSH_RETRY_DELAY_SECONDS;
+    [self scheduleFlushAfter:self.retryDelay];
+}
+
+- (void) scheduleFlushAfter:(NSTimeInterval)delay {
+    if (!self.autoFlush || self.flushScheduled) {
+        return;
+    }
+    self.flushScheduled = YES;
+    __weak OfflineWriteQueue *weakSelf = self;
+    dispatch_after(dispatch_time(DISPATCH_TIME_NOW, (int64_t)(delay * NSEC_PER_SEC)),
+                   dispatch_get_main_queue(), ^{
+        OfflineWriteQueue *strongSelf = weakSelf;
+        strongSelf.flushScheduled = NO;
+        if (strongSelf.autoFlush) {
+            [strongSelf flush];
+        }
+    });
+}
+
+#pragma mark - Reachability
+
+static void reachabilityChanged(SCNetworkReachabilityRef target, SCNetworkReachabilityFlags flags, void *info) {
+    OfflineWriteQueue *queue = (__bridge OfflineWriteQueue *)info;
+    if ((flags & kSCNetworkReachabilityFlagsReachable) && !(flags & kSCNetworkReachabilityFlagsConnectionRequired)) {
+        [queue flush];
+    }
+}
+
+- (void) startFlushing {
+    if (self.autoFlush) {
+        return;
+    }
+    self.autoFlush = YES;
+    _reachability = SCNetworkReachabilityCreateWithName(NULL, PARSE_HOST);
+    if (_reachability) {
+        SCNetworkReachabilityContext context = { 0, (__bridge void *)self, NULL, NULL, NULL };
+        SCNetworkReachabilitySetCallback(_reachability, reachabilityChanged, &context);
+        SCNetworkReachabilityScheduleWithRunLoop(_reachability, CFRunLoopGetMain(), kCFRunLoopCommonModes);
+    }
+    [self scheduleFlush];
+}
+
+- (void) stopFlushing {
+    self.autoFlush = NO;
+    if (_reachability) {
+        SCNetworkReachabilityUnscheduleFromRunLoop(_reachability, CFRunLoopGetMain(), kCFRunLoopCommonModes);
+        CFRelease(_reachability);
+        _reachability = NULL;
+    }
+}
+
+@end
@@ -0,0 +1,101 @@
+//
+//  PrefetchQueue.c
+//  FlowTrial
+//
+//  Created by Wade Sellers on 12/31/14.
+//  Copyright (c) 2014 Wade Sellers. All rights reserved.
+//
+
+#include "PrefetchQueue.h"
+
+#include <stdlib.h>
+#include <string.h>
+
+bool PrefetchQueueInit(PrefetchQueue *queue, uint32_t capacity) {
+    memset(queue, 0, sizeof(*queue));
+    queue->capacity = capacity > 0 ? capacity : 1;
+    queue->entries = malloc(queue->capacity * sizeof(PrefetchQueueEntry));
+    return queue->entries != NULL;
+}
+
+void PrefetchQueueFree(PrefetchQueue *queue) {
+    free(queue->entries);
+    memset(queue, 0, sizeof(*queue));
+}
+
+void PrefetchQueueRemoveAll(PrefetchQueue *queue) {
+    queue->count = 0;
+}
+
+//
+// Move the entry at position up until its parent is at least as high
+//
+static void siftUp(PrefetchQueue *queue, uint32_t position) {
+    PrefetchQueueEntry entry = queue->entries[position];
+    while (position > 0) {
+        uint32_t parent = (position - 1) / 2;
+        if (queue->entries[parent].priority >= entry.priority) {
+            break;
+        }
+        queue->entries[position] = queue->entries[parent];
+        position = parent;
+    }
+    queue->entries[position] = entry;
+}
+
+//
+// Move the entry at position down until both children are no higher
+//
+static void siftDown(PrefetchQueue *queue, uint32_t position) {
+    PrefetchQueueEntry entry = queue->entries[position];
+    for (;;) {
+        uint32_t child = position * 2 + 1;
+        if (child >= queue->count) {
+            break;
+        }
+        if (child + 1 < queue->count && queue->entries[child + 1].priority > queue->entries[child].priority) {
+            child++;
+        }
+        if (queue->entries[child].priority <= entry.priority) {
+            break;
+        }
+        queue->entries[position] = queue->entries[child];
+        position = child;
+    }
+    queue->entries[position] = entry;
+}
+
+bool PrefetchQueuePush(PrefetchQueue *queue, const EpcKey *key, float priority) {
+    uint32_t position;
+    if (queue->count < queue->capacity) {
+        position = queue->count++;
+    } else {
+        // Replace the lowest entry, which is one of the leaves
+        position = queue->count / 2;
+        for (uint32_t i = position + 1; i < queue->count; i++) {
+            if (queue->entries[i].priority < queue->entries[position].priority) {
+                position = i;
+            }
+        }
+        if (queue->entries[position].priority >= priority) {
+            return false;
+        }
+    }
+    queue->entries[position].key = *key;
+    queue->entries[position].priority = priority;
+    siftUp(queue, position);
+    return true;
+}
+
+bool PrefetchQueuePop(PrefetchQueue *queue, PrefetchQueueEntry *entry) {
+    if (queue->count == 0) {
+        return false;
+    }
+    *entry = queue->entries[0];
+    queue->count--;
+    if (queue->count > 0) {
+        queue->entries[0] = queue->entries[queue->count];
+        siftDown(queue, 0);
+    }
+    return true;
+}
@@ -0,0 +1,76 @@
+//
+//  PrefetchQueue.h
+//  FlowTrial
+//
+//  Created by Wade Sellers on 12/31/14.
+//  Copyright (c) 2014 Wade Sellers. All rights reserved.
+//
+
+#ifndef FlowTrial_PrefetchQueue_h
+#define FlowTrial_PrefetchQueue_h
+
+#include <stdbool.h>
+#include <stdint.h>
+#include "EpcKey.h"
+
+/**
+ One EPC waiting to be fetched
+ */
+typedef struct {
+    EpcKey key;
+    float priority;           //!< Higher is fetched first (RSSI: the closer the tag, the higher)
+} PrefetchQueueEntry;
+
+/**
+ PrefetchQueue is a fixed-size priority queue of EPCs: a binary max-heap on priority.
+
+ Pops return the highest priority EPC. When the queue is full, a push replaces the
+ lowest priority entry if the new one beats it and is dropped otherwise, so the queue
+ always holds the best capacity entries seen. The lowest entry is always a leaf, so
+ finding it only looks at the second half of the heap.
+ */
+typedef struct {
+    PrefetchQueueEntry *entries;
+    uint32_t count;
+    uint32_t capacity;
+} PrefetchQueue;
+
+/**
+ Initialize a queue
+
+ @param queue     Queue to initialize
+ @param capacity  Most entries held (at least 1)
+ @return          false if out of memory
+ */
+bool PrefetchQueueInit(PrefetchQueue *queue, uint32_t capacity);
+
+/**
+ Free a queue's memory
+ */
+void PrefetchQueueFree(PrefetchQueue *queue);
+
+/**
+ Remove all entries
+ */
+void PrefetchQueueRemoveAll(PrefetchQueue *queue);
+
+/**
+ Add an EPC
+
+ @param queue     Queue
+ @param key       EPC
+ @param priority  Priority
+ @return          false if the queue is full of higher priority entries and the EPC was dropped
+ */
+bool PrefetchQueuePush(PrefetchQueue *queue, const EpcKey *key, float priority);
+
+/**
+ Remove the highest priority EPC
+
+ @param queue     Queue
+ @param entry     Set to the entry removed
+ @return          false if the queue is empty
+ */
+bool PrefetchQueuePop(PrefetchQueue *queue, PrefetchQueueEntry *entry);
+
+#endif
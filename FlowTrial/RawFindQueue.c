@@ -0,0 +1,78 @@
+//
+//  RawFindQueue.c
+//  FlowTrial
+//
+//  Created by Wade Sellers on 12/19/14.
+//  Copyright (c) 2014 Wade Sellers. All rights reserved.
+//
+
+#include "RawFindQueue.h"
+
+#include <stdlib.h>
+#include <string.h>
+
+bool RawFindQueueInit(RawFindQueue *queue, uint32_t capacity) {
+    memset(queue, 0, sizeof(*queue));
+    uint32_t size = 16;
+    while (size < capacity) {
+        size <<= 1;
+    }
+    queue->finds = malloc(size * sizeof(RawFind));
+    if (!queue->finds) {
+        return false;
+    }
+    queue->mask = size - 1;
+    return true;
+}
+
+void RawFindQueueFree(RawFindQueue *queue) {
+    free(queue->finds);
+    memset(queue, 0, sizeof(*queue));
+}
+
+bool RawFindQueuePush(RawFindQueue *queue, const RawFind *find) {
+    uint64_t tail = queue->tail;
+    uint64_t capacity = (uint64_t)queue->mask + 1;
+    if (tail - queue->cachedHead >= capacity) {
+        queue->cachedHead = __atomic_load_n(&queue->head, __ATOMIC_ACQUIRE);
+        if (tail - queue->cachedHead >= capacity) {
+            __atomic_store_n(&queue->dropped, queue->dropped + 1, __ATOMIC_RELAXED);
+            return false;
+        }
+    }
+    queue->finds[tail & queue->mask] = *find;
+    // The cached head may be old, so this is at least the depth; only when it is a new
+    // high is it worth re-reading the head for the true depth
+    uint32_t depth = (uint32_t)(tail + 1 - queue->cachedHead);
+    if (depth > queue->highWater) {
+        queue->cachedHead = __atomic_load_n(&queue->head, __ATOMIC_ACQUIRE);
+        depth = (uint32_t)(tail + 1 - queue->cachedHead);
+        if (depth > queue->highWater) {
+            __atomic_store_n(&queue->highWater, depth, __ATOMIC_RELAXED);
+        }
+    }
+    __atomic_store_n(&queue->tail, tail + 1, __ATOMIC_RELEASE);
+    return true;
+}
+
+uint32_t RawFindQueuePop(RawFindQueue *queue, RawFind *finds, uint32_t maxFinds) {
+    uint64_t head = queue->head;
+    if (queue->cachedTail == head) {
+        queue->cachedTail = __atomic_load_n(&queue->tail, __ATOMIC_ACQUIRE);
+    }
+    uint64_t available = queue->cachedTail - head;
+    uint32_t count = available < maxFinds ? (uint32_t)available : maxFinds;
+    for (uint32_t i = 0; i < count; i++) {
+        finds[i] = queue->finds[(head + i) & queue->mask];
+    }
+    __atomic_store_n(&queue->head, head + count, __ATOMIC_RELEASE);
+    return count;
+}
+
+void RawFindQueueGetStats(const RawFindQueue *queue, RawFindQueueStats *stats) {
+    stats->popped = __atomic_load_n(&queue->head, __ATOMIC_ACQUIRE);
+    stats->pushed = __atomic_load_n(&queue->tail, __ATOMIC_ACQUIRE);
+    stats->dropped = __atomic_load_n(&queue->dropped, __ATOMIC_RELAXED);
+    stats->highWater = __atomic_load_n(&queue->highWater, __ATOMIC_RELAXED);
+    stats->capacity = queue->mask + 1;
+}
@@ -0,0 +1,112 @@
+//
+//  RawFindQueue.h
+//  FlowTrial
+//
+//  Created by Wade Sellers on 12/19/14.
+//  Copyright (c) 2014 Wade Sellers. All rights reserved.
+//
+
+#ifndef FlowTrial_RawFindQueue_h
+#define FlowTrial_RawFindQueue_h
+
+#include <stdbool.h>
+#include <stdint.h>
+
+#include "EpcKey.h"
+
+/**
+ One raw tag find, as seen by the reader protocol before any inventory bookkeeping
+ */
+typedef struct {
+    EpcKey epc;             //!< EPC found
+    double timestamp;       //!< When, as CFAbsoluteTime (seconds since 1/1/2001)
+    int32_t frequency;      //!< Frequency in kHz (0 if unknown)
+    float rssiI;            //!< RSSI, I channel (0 if unknown)
+    float rssiQ;            //!< RSSI, Q channel (0 if unknown)
+    uint16_t readData1;     //!< First detailed per-read word (if any)
+    uint16_t readData2;     //!< Second detailed per-read word (if any)
+} RawFind;
+
+/**
+ Counters for a RawFindQueue. All counts are since the queue was initialized.
+ */
+typedef struct {
+    uint64_t pushed;        //!< Finds accepted by the queue
+    uint64_t dropped;       //!< Finds dropped because the queue was full
+    uint64_t popped;        //!< Finds taken off by the consumer
+    uint32_t highWater;     //!< Most finds ever waiting at once
+    uint32_t capacity;      //!< Size of the queue
+} RawFindQueueStats;
+
+#define RAW_FIND_QUEUE_CACHE_LINE 64
+
+/**
+ Bounded lock-free single-producer single-consumer queue of RawFinds.
+
+ The producer is the thread the SDK calls inventoryFilterLowLevel: on, the consumer is
+ the main thread. Push never blocks: if the consumer has fallen behind and the queue is
+ full the find is dropped and counted, so a burst can't stall decoding. Each side
+ caches the other side's index and only re-reads it when the cached value says the
+ queue is full (or empty), or, for the producer, when a push may set a new high water
+ mark. The two indexes sit on separate cache lines.
+
+ Contract: at most one thread pushes and at most one (other) thread pops at any time;
+ handing either role to another thread needs a happens-before edge (a lock, a dispatch
+ to a serial queue) between the old thread's last call and the new thread's first.
+ Init and Free must not overlap any other call. GetStats may be called from any thread.
+ */
+typedef struct {
+    RawFind *finds;
+    uint32_t mask;
+    char padding0[RAW_FIND_QUEUE_CACHE_LINE];
+    // Producer side
+    uint64_t tail;
+    uint64_t cachedHead;
+    uint64_t dropped;
+    uint32_t highWater;
+    char padding1[RAW_FIND_QUEUE_CACHE_LINE];
+    // Consumer side
+    uint64_t head;
+    uint64_t cachedTail;
+    char padding2[RAW_FIND_QUEUE_CACHE_LINE];
+} RawFindQueue;
+
+/**
+ Initialize a queue
+
+ @param queue     Queue to initialize
+ @param capacity  Number of finds it can hold (rounded up to a power of 2)
+ @return          false if out of memory
+ */
+bool RawFindQueueInit(RawFindQueue *queue, uint32_t capacity);
+
+/**
+ Free a queue's memory. Neither side may be using it.
+ */
+void RawFindQueueFree(RawFindQueue *queue);
+
+/**
+ Add a find (producer thread only)
+
+ @param queue  Queue
+ @param find   Find to add
+ @return       false if the queue was full and the find was dropped
+ */
+bool RawFindQueuePush(RawFindQueue *queue, const RawFind *find);
+
+/**
+ Take finds off the queue (consumer thread only)
+
+ @param queue     Queue
+ @param finds     Buffer to copy finds into
+ @param maxFinds  Size of the buffer
+ @return          Number of finds copied
+ */
+uint32_t RawFindQueuePop(RawFindQueue *queue, RawFind *finds, uint32_t maxFinds);
+
+/**
+ Get the queue's counters (any thread; the values may be slightly out of date)
+ */
+void RawFindQueueGetStats(const RawFindQueue *queue, RawFindQueueStats *stats);
+
+#endif
@@ -0,0 +1,107 @@
+//
+//  ReadHistorySlab.c
+//  FlowTrial
+//
+//  Created by Wade Sellers on 12/18/14.
+//  Copyright (c) 2014 Wade Sellers. All rights reserved.
+//
+
+#include "ReadHistorySlab.h"
+
+#include <stdlib.h>
+#include <string.h>
+
+#define READ_HISTORY_MIN_CAPACITY 64
+
+static bool growTags(ReadHistorySlab *slab, uint32_t tagIndex) {
+    uint32_t capacity = slab->tagCapacity ? slab->tagCapacity : READ_HISTORY_MIN_CAPACITY;
+    while (capacity <= tagIndex) {
+        capacity *= 2;
+    }
+    uint32_t *counts = calloc((size_t)slab->depth * capacity, sizeof(uint32_t));
+    uint32_t *windowTotals = calloc(capacity, sizeof(uint32_t));
+    uint32_t *totalReads = calloc(capacity, sizeof(uint32_t));
+    if (!counts || !windowTotals || !totalReads) {
+        free(counts);
+        free(windowTotals);
+        free(totalReads);
+        return false;
+    }
+    if (slab->tagCapacity) {
+        for (uint32_t row = 0; row < slab->depth; row++) {
+            memcpy(counts + (size_t)row * capacity,
+                   slab->counts + (size_t)row * slab->tagCapacity,
+                   slab->tagCount * sizeof(uint32_t));
+        }
+        memcpy(windowTotals, slab->windowTotals, slab->tagCount * sizeof(uint32_t));
+        memcpy(totalReads, slab->totalReads, slab->tagCount * sizeof(uint32_t));
+    }
+    free(slab->counts);
+    free(slab->windowTotals);
+    free(slab->totalReads);
+    slab->counts = counts;
+    slab->windowTotals = windowTotals;
+    slab->totalReads = totalReads;
+    slab->tagCapacity = capacity;
+    return true;
+}
+
+bool ReadHistorySlabInit(ReadHistorySlab *slab, uint32_t depth, uint32_t capacity) {
+    memset(slab, 0, sizeof(*slab));
+    slab->depth = depth ? depth : 1;
+    if (!growTags(slab, capacity ? capacity - 1 : 0)) {
+        return false;
+    }
+    return true;
+}
+
+void ReadHistorySlabFree(ReadHistorySlab *slab) {
+    free(slab->counts);
+    free(slab->windowTotals);
+    free(slab->totalReads);
+    memset(slab, 0, sizeof(*slab));
+}
+
+void ReadHistorySlabReset(ReadHistorySlab *slab) {
+    memset(slab->counts, 0, (size_t)slab->depth * slab->tagCapacity * sizeof(uint32_t));
+    memset(slab->windowTotals, 0, slab->tagCapacity * sizeof(uint32_t));
+    memset(slab->totalReads, 0, slab->tagCapacity * sizeof(uint32_t));
+    slab->tagCount = 0;
+    slab->interval = 0;
+}
+
+bool ReadHistorySlabRecord(ReadHistorySlab *slab, uint32_t tagIndex, uint32_t numFinds) {
+    if (slab->depth == 0) {
+        return false;  // Freed, or its Init failed
+    }
+    if (tagIndex >= slab->tagCapacity && !growTags(slab, tagIndex)) {
+        return false;
+    }
+    if (tagIndex >= slab->tagCount) {
+        slab->tagCount = tagIndex + 1;
+    }
+    uint32_t *count = &slab->counts[(size_t)(slab->interval % slab->depth) * slab->tagCapacity + tagIndex];
+    // The window total is at least the interval's count, so keeping it from wrapping keeps
+    // the count from wrapping too, and what is stored stays consistent with the totals
+    uint32_t room = UINT32_MAX - slab->windowTotals[tagIndex];
+    if (numFinds > room) {
+        numFinds = room;
+    }
+    *count += numFinds;
+    slab->windowTotals[tagIndex] += numFinds;
+    uint32_t *totalReads = &slab->totalReads[tagIndex];
+    *totalReads = numFinds > UINT32_MAX - *totalReads ? UINT32_MAX : *totalReads + numFinds;
+    return true;
+}
+
+void ReadHistorySlabAdvance(ReadHistorySlab *slab) {
+    slab->interval++;
+    // The row for the new interval holds the oldest interval, which now drops out of the window
+    uint32_t *restrict oldest = slab->counts + (size_t)(slab->interval % slab->depth) * slab->tagCapacity;
+    uint32_t *restrict windowTotals = slab->windowTotals;
+    uint32_t tagCount = slab->tagCount;
+    for (uint32_t i = 0; i < tagCount; i++) {
+        windowTotals[i] -= oldest[i];
+    }
+    memset(oldest, 0, tagCount * sizeof(uint32_t));
+}
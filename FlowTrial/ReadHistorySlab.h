@@ -0,0 +1,118 @@
+//
+//  ReadHistorySlab.h
+//  FlowTrial
+//
+//  Created by Wade Sellers on 12/18/14.
+//  Copyright (c) 2014 Wade Sellers. All rights reserved.
+//
+
+#ifndef FlowTrial_ReadHistorySlab_h
+#define FlowTrial_ReadHistorySlab_h
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+/**
+ Read history for every tag in an inventory, in one block of memory.
+
+ The history is a ring of historyDepth intervals shared by all tags. Each interval is a
+ row of per-tag find counts, so advancing to the next interval is one pass over two
+ contiguous arrays (retire the oldest row from the running totals, then clear it)
+ no matter how many tags there are. Tags are identified by their index in
+ InventoryController.tags.
+ */
+typedef struct {
+    uint32_t *counts;         //!< depth rows of tagCapacity counts, row (interval % depth)
+    uint32_t *windowTotals;   //!< Finds per tag over the whole ring
+    uint32_t *totalReads;     //!< Finds per tag since inventory started
+    uint32_t depth;           //!< Number of intervals kept
+    uint32_t tagCount;        //!< Number of tags (highest tag index + 1)
+    uint32_t tagCapacity;     //!< Allocated columns
+    uint64_t interval;        //!< Number of the current interval (counts up from 0)
+} ReadHistorySlab;
+
+/**
+ A tag's read history as of one interval, without copying it.
+
+ Reading through a view returns the counts the slab holds for intervals up to the one
+ the view was taken in. Intervals that have since rolled off the ring read as 0.
+ */
+typedef struct {
+    const ReadHistorySlab *slab;
+    uint32_t tagIndex;
+    uint64_t interval;
+} ReadHistoryView;
+
+/**
+ Initialize a slab
+
+ @param slab      Slab to initialize
+ @param depth     Number of history intervals (historyDepth)
+ @param capacity  Number of tags to size for (the slab grows past this as needed)
+ @return          false if out of memory
+ */
+bool ReadHistorySlabInit(ReadHistorySlab *slab, uint32_t depth, uint32_t capacity);
+
+/**
+ Free a slab's memory
+ */
+void ReadHistorySlabFree(ReadHistorySlab *slab);
+
+/**
+ Forget all tags and history, keeping the memory
+ */
+void ReadHistorySlabReset(ReadHistorySlab *slab);
+
+/**
+ Add finds for a tag in the current interval
+
+ @param slab      Slab
+ @param tagIndex  Index of the tag (the slab grows to include it)
+ @param numFinds  Number of finds
+ @return          false if out of memory, or the slab is freed (finds are dropped)
+ */
+bool ReadHistorySlabRecord(ReadHistorySlab *slab, uint32_t tagIndex, uint32_t numFinds);
+
+/**
+ Move every tag's history on by one interval
+
+ @param slab  Slab
+ */
+void ReadHistorySlabAdvance(ReadHistorySlab *slab);
+
+/**
+ Has the tag been found at any time in the history window?
+ */
+static inline bool ReadHistorySlabIsVisible(const ReadHistorySlab *slab, uint32_t tagIndex) {
+    return tagIndex < slab->tagCount && slab->windowTotals[tagIndex] != 0;
+}
+
+/**
+ Get a view of a tag's history as of the current interval
+ */
+static inline ReadHistoryView ReadHistorySlabView(const ReadHistorySlab *slab, uint32_t tagIndex) {
+    ReadHistoryView view = { slab, tagIndex, slab->interval };
+    return view;
+}
+
+/**
+ Number of finds in an interval
+
+ @param view  View
+ @param age   0 for the view's interval, 1 for the one before, and so on
+ @return      Number of finds
+ */
+static inline uint32_t ReadHistoryViewCount(ReadHistoryView view, uint32_t age) {
+    const ReadHistorySlab *slab = view.slab;
+    if (age > view.interval || view.tagIndex >= slab->tagCount) {
+        return 0;
+    }
+    uint64_t interval = view.interval - age;
+    if (slab->interval - interval >= slab->depth) {
+        return 0;
+    }
+    return slab->counts[(size_t)(interval % slab->depth) * slab->tagCapacity + view.tagIndex];
+}
+
+#endif
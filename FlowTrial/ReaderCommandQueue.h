@@ -0,0 +1,45 @@
+//
+//  ReaderCommandQueue.h
+//  FlowTrial
+//
+//  Created by Wade Sellers on 12/31/14.
+//  Copyright (c) 2014 Wade Sellers. All rights reserved.
+//
+
+#import <Foundation/Foundation.h>
+#import <Bolts/BFTask.h>
+
+/**
+ Starts one reader command: calls the SDK and returns a task that completes in the SDK's
+ callback
+
+ @return  Task for the command
+ */
+typedef BFTask * (^ReaderCommand)(void);
+
+/**
+ Runs reader commands one at a time, in the order they were enqueued.
+
+ The reader works on one command at a time, and SDK calls finish in a later callback, so
+ a BFExecutor alone (which only decides where a block runs) can't keep them apart. Each
+ command is chained on the task of the command before it instead, and started on the main
+ thread as soon as that one finishes, from its callback: a pipeline that enqueues its
+ commands up front keeps the reader busy without a round trip through the app between
+ commands. A command that fails doesn't stop the ones after it.
+
+ Use from the main thread.
+ */
+@interface ReaderCommandQueue : NSObject
+
+//! Commands enqueued that haven't finished (including the one running)
+@property (readonly, nonatomic) NSUInteger pendingCount;
+
+/**
+ Enqueue a command
+
+ @param command     Command, started once every command enqueued before it has finished
+ @return            Task that completes as the command's task does
+ */
+- (BFTask *) enqueue:(ReaderCommand)command;
+
+@end
@@ -0,0 +1,45 @@
+//
+//  ReaderCommandQueue.m
+//  FlowTrial
+//
+//  Created by Wade Sellers on 12/31/14.
+//  Copyright (c) 2014 Wade Sellers. All rights reserved.
+//
+
+#import <Bolts/BFExecutor.h>
+#import "ReaderCommandQueue.h"
+
+@interface ReaderCommandQueue ()
+
+@property (readwrite, nonatomic) NSUInteger pendingCount;
+
+//! Completes when the last command enqueued has finished (never fails)
+@property BFTask *tail;
+
+@end
+
+@implementation ReaderCommandQueue
+
+- (id) init {
+    self = [super init];
+    if (self) {
+        self.tail = [BFTask taskWithResult:nil];
+    }
+    return self;
+}
+
+- (BFTask *) enqueue:(ReaderCommand)command {
+    self.pendingCount++;
+    // The main thread executor runs inline when the previous command finishes on the main thread
+    BFTask *task = [self.tail continueWithExecutor:[BFExecutor mainThreadExecutor] withBlock:^id(BFTask *previous) {
+        BFTask *started = command();
+        return started ?: [BFTask taskWithResult:nil];
+    }];
+    self.tail = [task continueWithExecutor:[BFExecutor mainThreadExecutor] withBlock:^id(BFTask *finished) {
+        self.pendingCount--;
+        return nil;
+    }];
+    return task;
+}
+
+@end
@@ -0,0 +1,165 @@
+//
+//  ReaderSimulator.c
+//  FlowTrial
+//
+//  Created by Wade Sellers on 12/20/14.
+//  Copyright (c) 2014 Wade Sellers. All rights reserved.
+//
+
+#include "ReaderSimulator.h"
+
+#include <math.h>
+#include <stdlib.h>
+#include <string.h>
+
+#pragma mark - Random numbers
+
+//
+// xorshift64*: small, fast and the same on every platform
+//
+static uint64_t nextRandom(uint64_t *state) {
+    uint64_t x = *state;
+    x ^= x >> 12;
+    x ^= x << 25;
+    x ^= x >> 27;
+    *state = x;
+    return x * 0x2545F4914F6CDD1Dull;
+}
+
+//! Uniform in (0, 1]
+static double nextUniform(uint64_t *state) {
+    return ((nextRandom(state) >> 11) + 1) * (1.0 / 9007199254740992.0);
+}
+
+static double nextGaussian(uint64_t *state) {
+    return sqrt(-2.0 * log(nextUniform(state))) * cos(2.0 * M_PI * nextUniform(state));
+}
+
+#pragma mark - Configuration
+
+void ReaderSimulatorDefaultConfig(ReaderSimulatorConfig *config) {
+    memset(config, 0, sizeof(*config));
+    config->seed = 1;
+    config->numTags = 1000;
+    config->epcLength = 12;
+    config->epcPrefix[0] = 0xE2;
+    config->epcPrefix[1] = 0x00;
+    config->readsPerSecond = 500;
+    config->tagsInView = 1000;
+    config->rssiMean = -55;
+    config->rssiStdDev = 2;
+    config->tagRssiSpread = 6;
+    config->firstChannelKHz = 902750;
+    config->channelSpacingKHz = 500;
+    config->numChannels = 50;
+    config->dwellSeconds = 0.4;
+    config->roundSeconds = 0.05;
+}
+
+EpcKey ReaderSimulatorTagEpc(const ReaderSimulatorConfig *config, uint32_t tagNumber) {
+    uint8_t bytes[EPC_KEY_MAX_LENGTH];
+    int length = (int)config->epcLength;
+    if (length < 4) {
+        length = 4;
+    } else if (length > EPC_KEY_MAX_LENGTH) {
+        length = EPC_KEY_MAX_LENGTH;
+    }
+    memset(bytes, 0, sizeof(bytes));
+    memcpy(bytes, config->epcPrefix, length - 4 < 4 ? (size_t)(length - 4) : 4);
+    bytes[length - 4] = (uint8_t)(tagNumber >> 24);
+    bytes[length - 3] = (uint8_t)(tagNumber >> 16);
+    bytes[length - 2] = (uint8_t)(tagNumber >> 8);
+    bytes[length - 1] = (uint8_t)tagNumber;
+    return EpcKeyMake(bytes, length);
+}
+
+#pragma mark - Lifecycle
+
+bool ReaderSimulatorInit(ReaderSimulator *simulator, const ReaderSimulatorConfig *config, double startTimestamp) {
+    memset(simulator, 0, sizeof(*simulator));
+    simulator->config = *config;
+    if (simulator->config.numTags == 0) {
+        simulator->config.numTags = 1;
+    }
+    if (simulator->config.tagsInView == 0 || simulator->config.tagsInView > simulator->config.numTags) {
+        simulator->config.tagsInView = simulator->config.numTags;
+    }
+    if (simulator->config.numChannels == 0) {
+        simulator->config.numChannels = 1;
+    }
+    simulator->startTimestamp = startTimestamp;
+    simulator->rng = config->seed ? config->seed : 1;
+
+    simulator->tagRssiOffsets = malloc(simulator->config.numTags * sizeof(float));
+    if (!simulator->tagRssiOffsets) {
+        return false;
+    }
+    for (uint32_t i = 0; i < simulator->config.numTags; i++) {
+        simulator->tagRssiOffsets[i] = (float)(nextGaussian(&simulator->rng) * config->tagRssiSpread);
+    }
+    simulator->nextReadTime = config->readsPerSecond > 0 ?
+        -log(nextUniform(&simulator->rng)) / config->readsPerSecond : INFINITY;
+    return true;
+}
+
+void ReaderSimulatorFree(ReaderSimulator *simulator) {
+    free(simulator->tagRssiOffsets);
+    memset(simulator, 0, sizeof(*simulator));
+}
+
+#pragma mark - Running
+
+static uint32_t pickTag(ReaderSimulator *simulator, double time) {
+    const ReaderSimulatorConfig *config = &simulator->config;
+    uint32_t firstInView = 0;
+    if (config->sweepSeconds > 0 && config->tagsInView < config->numTags) {
+        double progress = fmod(time, config->sweepSeconds) / config->sweepSeconds;
+        firstInView = (uint32_t)(progress * (config->numTags - config->tagsInView + 1));
+    }
+    return firstInView + (uint32_t)(nextRandom(&simulator->rng) % config->tagsInView);
+}
+
+uint32_t ReaderSimulatorRun(ReaderSimulator *simulator, double seconds, RawFind *finds, uint32_t maxFinds) {
+    const ReaderSimulatorConfig *config = &simulator->config;
+    double endTime = simulator->time + seconds;
+    uint32_t count = 0;
+
+    while (simulator->nextReadTime <= endTime && count < maxFinds) {
+        double time = simulator->nextReadTime;
+        simulator->nextReadTime += -log(nextUniform(&simulator->rng)) / config->readsPerSecond;
+
+        uint32_t tagNumber = pickTag(simulator, time);
+        simulator->stats.packetsSent++;
+        if (nextUniform(&simulator->rng) <= config->packetLossRate) {
+            simulator->stats.packetsLost++;
+            continue;
+        }
+        if (nextUniform(&simulator->rng) <= config->crcErrorRate) {
+            simulator->stats.crcMismatches++;
+            continue;
+        }
+        simulator->stats.packetsReceived++;
+        simulator->stats.rawTagFinds++;
+
+        RawFind *find = &finds[count++];
+        memset(find, 0, sizeof(*find));
+        find->epc = ReaderSimulatorTagEpc(config, tagNumber);
+        find->timestamp = simulator->startTimestamp + time;
+        uint32_t channel = (uint32_t)(time / (config->dwellSeconds > 0 ? config->dwellSeconds : 1)) % config->numChannels;
+        find->frequency = config->firstChannelKHz + (int32_t)channel * config->channelSpacingKHz;
+        double rssi = config->rssiMean + simulator->tagRssiOffsets[tagNumber] +
+                      nextGaussian(&simulator->rng) * config->rssiStdDev;
+        find->rssiI = (float)rssi;
+        find->rssiQ = (float)(rssi - 3);
+        find->readData1 = (uint16_t)tagNumber;
+        find->readData2 = (uint16_t)(tagNumber >> 16);
+        simulator->time = time;
+    }
+    if (count < maxFinds || simulator->nextReadTime > endTime) {
+        simulator->time = endTime;
+    }
+    if (config->roundSeconds > 0) {
+        simulator->stats.inventoryRounds = (uint64_t)(simulator->time / config->roundSeconds);
+    }
+    return count;
+}
@@ -0,0 +1,114 @@
+//
+//  ReaderSimulator.h
+//  FlowTrial
+//
+//  Created by Wade Sellers on 12/20/14.
+//  Copyright (c) 2014 Wade Sellers. All rights reserved.
+//
+
+#ifndef FlowTrial_ReaderSimulator_h
+#define FlowTrial_ReaderSimulator_h
+
+#include <stdbool.h>
+#include <stdint.h>
+
+#include "RawFindQueue.h"
+
+/**
+ What the simulated reader sees
+ */
+typedef struct {
+    uint64_t seed;              //!< Random seed; the same seed and config always give the same finds
+    uint32_t numTags;           //!< Size of the tag population
+    uint32_t epcLength;         //!< EPC length in bytes (4...27)
+    uint8_t epcPrefix[4];       //!< First bytes of every EPC; the tag number fills the last 4 bytes
+    double readsPerSecond;      //!< Raw reads per second over all visible tags
+    double sweepSeconds;        //!< 0 for every tag always in view, otherwise seconds to sweep past the whole population
+    uint32_t tagsInView;        //!< Tags in view at once while sweeping
+    double rssiMean;            //!< Mean RSSI (dBm)
+    double rssiStdDev;          //!< RSSI standard deviation, per read
+    double tagRssiSpread;       //!< RSSI standard deviation between tags (distance differences)
+    double packetLossRate;      //!< Fraction of find packets lost on the way to the host
+    double crcErrorRate;        //!< Fraction of find packets received with a bad CRC
+    int32_t firstChannelKHz;    //!< Lowest hop frequency
+    int32_t channelSpacingKHz;  //!< Distance between channels
+    uint32_t numChannels;       //!< Number of channels hopped over
+    double dwellSeconds;        //!< Time on each channel before hopping
+    double roundSeconds;        //!< Length of an inventory round
+} ReaderSimulatorConfig;
+
+/**
+ Counters, named after their UgiDiagnosticData counterparts
+ */
+typedef struct {
+    uint64_t packetsSent;       //!< Find packets sent by the reader
+    uint64_t packetsReceived;   //!< Find packets that arrived intact
+    uint64_t packetsLost;       //!< Find packets that never arrived
+    uint64_t crcMismatches;     //!< Find packets that arrived with a bad CRC
+    uint64_t rawTagFinds;       //!< Finds delivered
+    uint64_t inventoryRounds;   //!< Inventory rounds run
+} ReaderSimulatorStats;
+
+/**
+ A deterministic software stand-in for a Grokker. It produces the stream of raw finds
+ a reader would deliver for a configured tag population, including the ones lost or
+ corrupted on the way. Pure C, so it runs anywhere, headless.
+ */
+typedef struct {
+    ReaderSimulatorConfig config;
+    ReaderSimulatorStats stats;
+    double time;                //!< Simulated seconds since the start
+    double startTimestamp;      //!< Timestamp of time 0 (CFAbsoluteTime)
+    // private
+    uint64_t rng;
+    double nextReadTime;
+    float *tagRssiOffsets;
+} ReaderSimulator;
+
+/**
+ Get the default configuration: 1,000 standard-length tags all in view, 500 reads/sec,
+ no errors, the US frequency band
+
+ @param config  Configuration to fill
+ */
+void ReaderSimulatorDefaultConfig(ReaderSimulatorConfig *config);
+
+/**
+ Initialize a simulator
+
+ @param simulator       Simulator to initialize
+ @param config          Configuration
+ @param startTimestamp  Timestamp for simulated time 0
+ @return                false if out of memory
+ */
+bool ReaderSimulatorInit(ReaderSimulator *simulator, const ReaderSimulatorConfig *config, double startTimestamp);
+
+/**
+ Free a simulator's memory
+ */
+void ReaderSimulatorFree(ReaderSimulator *simulator);
+
+/**
+ Run the simulation forward
+
+ Stops after the given simulated time, or earlier if the buffer fills (call again to
+ carry on from there).
+
+ @param simulator  Simulator
+ @param seconds    Simulated time to run for
+ @param finds      Buffer for the finds that reach the host
+ @param maxFinds   Size of the buffer
+ @return           Number of finds put in the buffer
+ */
+uint32_t ReaderSimulatorRun(ReaderSimulator *simulator, double seconds, RawFind *finds, uint32_t maxFinds);
+
+/**
+ Get the EPC of a tag in the population
+
+ @param config     Configuration
+ @param tagNumber  Tag number (0...numTags-1)
+ @return           EPC
+ */
+EpcKey ReaderSimulatorTagEpc(const ReaderSimulatorConfig *config, uint32_t tagNumber);
+
+#endif
@@ -0,0 +1,96 @@
+//
+//  ReaderTransport.h
+//  FlowTrial
+//
+//  Created by Wade Sellers on 12/20/14.
+//  Copyright (c) 2014 Wade Sellers. All rights reserved.
+//
+
+#import <Foundation/Foundation.h>
+#import "Ugi.h"
+#import "RawFindQueue.h"
+
+/**
+ For inventory delegates that want everything a transport knows about each raw find, not
+ just the EPC that inventoryFilterLowLevel: carries. The SDK only has the EPC, but a
+ transport that knows more (SimulatedReaderTransport has frequency and RSSI) calls this,
+ on the same thread and with the same meaning, instead of inventoryFilterLowLevel: when
+ the delegate implements it.
+ */
+@protocol RawFindFilter <NSObject>
+
+/**
+ Filter a raw find
+
+ @param find    Find; only valid for the duration of the call
+ @return        YES to ignore the find, as for inventoryFilterLowLevel:
+ */
+- (BOOL) inventoryFilterRawFind:(const RawFind *)find;
+
+@end
+
+/**
+ Where InventoryController gets its finds from: the Grokker through the Ugi singleton
+ (UgiReaderTransport), or a simulated reader (SimulatedReaderTransport).
+
+ Implementations report to the delegate the same way the SDK does, on the same threads:
+ inventoryFilterLowLevel: (or inventoryFilterRawFind:, see RawFindFilter) on a background
+ thread, everything else on the main thread.
+ */
+@protocol ReaderTransport <NSObject>
+
+//! Is a reader connected
+@property (readonly, nonatomic) BOOL isConnected;
+
+/**
+ Connect to the reader (returns immediately)
+ */
+- (void) openConnection;
+
+/**
+ Disconnect from the reader
+ */
+- (void) closeConnection;
+
+/**
+ Start running inventory
+
+ @param delegate       Delegate object to report back to
+ @param configuration  Configuration to use
+ @param epcs           EPCs to find, all other EPCs are ignored (or nil to find all EPCs)
+ @return               UgiInventory object, if the transport has one
+ */
+- (UgiInventory *) startInventory:(id<UgiInventoryDelegate>)delegate
+                withConfiguration:(UgiRfidConfiguration *)configuration
+                         withEpcs:(NSArray *)epcs;
+
+/**
+ Start running inventory, ignoring some EPCs
+
+ @param delegate       Delegate object to report back to
+ @param configuration  Configuration to use
+ @param epcsToIgnore   EPCs to ignore
+ @return               UgiInventory object, if the transport has one
+ */
+- (UgiInventory *) startInventoryIgnoringEpcs:(id<UgiInventoryDelegate>)delegate
+                            withConfiguration:(UgiRfidConfiguration *)configuration
+                             withEpcsToIgnore:(NSArray *)epcsToIgnore;
+
+/**
+ Stop running inventory
+
+ @param completion  Block to run when inventory is completely finished
+ */
+- (void) stopInventoryWithCompletion:(StopInventoryCompletion)completion;
+
+/**
+ Get diagnostic data
+
+ @param data   Buffer to fill
+ @param reset  YES to reset counters
+ @return       YES if successful, NO if a reader has never been connected
+ */
+- (BOOL) getDiagnosticData:(UgiDiagnosticData *)data
+             resetCounters:(BOOL)reset;
+
+@end
@@ -0,0 +1,59 @@
+//
+//  RecordedSession.h
+//  FlowTrial
+//
+//  Created by Wade Sellers on 12/24/14.
+//  Copyright (c) 2014 Wade Sellers. All rights reserved.
+//
+
+#import <Foundation/Foundation.h>
+#import "UgiEpc.h"
+#import "SessionReader.h"
+
+/**
+ A session recorded by InventoryRecorder, opened for queries (see SessionReader.h).
+ Not thread safe.
+ */
+@interface RecordedSession : NSObject
+
+//! File the session is read from
+@property (readonly, nonatomic) NSString *path;
+
+//! The underlying reader, for block-level access
+@property (readonly, nonatomic) const SessionReader *reader;
+
+//! Total finds recorded
+@property (readonly, nonatomic) uint64_t numFinds;
+
+//! Number of distinct EPCs recorded
+@property (readonly, nonatomic) NSUInteger numEpcs;
+
+/**
+ Open a session file
+
+ @param path    Session file
+ @param error   Set if the file can't be opened
+ @return        New session, nil on failure
+ */
+- (id) initWithPath:(NSString *)path
+              error:(NSError **)error;
+
+/**
+ When was an EPC last seen?
+
+ @param epc   EPC
+ @return      Time of the last find, nil if the EPC is not in the session
+ */
+- (NSDate *) lastSeen:(UgiEpc *)epc;
+
+/**
+ Which EPCs were seen in a time range (inclusive)?
+
+ @param start   Start of the range
+ @param end     End of the range
+ @return        Array of UgiEpc, in no particular order
+ */
+- (NSArray *) epcsSeenFrom:(NSDate *)start
+                        to:(NSDate *)end;
+
+@end
@@ -0,0 +1,79 @@
+//
+//  RecordedSession.m
+//  FlowTrial
+//
+//  Created by Wade Sellers on 12/24/14.
+//  Copyright (c) 2014 Wade Sellers. All rights reserved.
+//
+
+#import "RecordedSession.h"
+#import "UgiEpc+EpcKey.h"
+
+@interface RecordedSession ()
+
+@property (readwrite, nonatomic) NSString *path;
+
+@end
+
+@implementation RecordedSession {
+    SessionReader _reader;
+}
+
+- (id) initWithPath:(NSString *)path
+              error:(NSError **)error {
+    self = [super init];
+    if (self) {
+        self.path = path;
+        if (!SessionReaderOpen(&_reader, path.fileSystemRepresentation)) {
+            if (error) {
+                *error = [NSError errorWithDomain:NSPOSIXErrorDomain code:errno userInfo:@{ NSFilePathErrorKey: path }];
+            }
+            return nil;
+        }
+    }
+    return self;
+}
+
+- (void) dealloc {
+    SessionReaderClose(&_reader);
+}
+
+- (const SessionReader *) reader {
+    return &_reader;
+}
+
+- (uint64_t) numFinds {
+    return _reader.numFinds;
+}
+
+- (NSUInteger) numEpcs {
+    return _reader.epcs.count;
+}
+
+- (NSDate *) lastSeen:(UgiEpc *)epc {
+    EpcKey key = [epc epcKey];
+    double timestamp;
+    if (!SessionReaderLastSeen(&_reader, &key, &timestamp)) {
+        return nil;
+    }
+    return [NSDate dateWithTimeIntervalSinceReferenceDate:timestamp];
+}
+
+- (NSArray *) epcsSeenFrom:(NSDate *)start
+                        to:(NSDate *)end {
+    EpcTable seen;
+    if (!EpcTableInit(&seen, 256)) {
+        return nil;
+    }
+    NSMutableArray *epcs = nil;
+    if (SessionReaderEpcsSeenBetween(&_reader, start.timeIntervalSinceReferenceDate, end.timeIntervalSinceReferenceDate, &seen)) {
+        epcs = [NSMutableArray arrayWithCapacity:seen.count];
+        for (uint32_t i = 0; i < seen.count; i++) {
+            [epcs addObject:[UgiEpc epcFromKey:&seen.keys[i]]];
+        }
+    }
+    EpcTableFree(&seen);
+    return epcs;
+}
+
+@end
@@ -0,0 +1,127 @@
+//
+//  SessionFormat.h
+//  FlowTrial
+//
+//  Created by Wade Sellers on 12/23/14.
+//  Copyright (c) 2014 Wade Sellers. All rights reserved.
+//
+
+#ifndef FlowTrial_SessionFormat_h
+#define FlowTrial_SessionFormat_h
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+/**
+ On-disk format of a recorded inventory session.
+
+ A session file is a sequence of SESSION_BLOCK_SIZE blocks, so it can be memory-mapped
+ and any block found by offset. Each block stands alone: a SessionBlockHeader, then the
+ block's finds stored column by column, then zero padding.
+
+   EPC dictionary   Each distinct EPC in the block once: length byte, then the bytes
+   EPC              Per find, varint index into the dictionary
+   Timestamp        Per find, zigzag varint microseconds since the previous find
+                    (the first find is at the header's firstTimestamp)
+   Frequency        Per find, zigzag varint kHz change from the previous find
+   RSSI             Per find, zigzag varint change in I then Q, in tenths of a dB
+   Read data        Per find, varint readData1 then readData2
+
+ Everything is little-endian. Repeated EPCs, steady frequencies and closely spaced
+ reads all come down to a byte or two per column.
+ */
+
+#define SESSION_BLOCK_SIZE 16384
+#define SESSION_BLOCK_MAGIC 0x42535446u     // "FTSB"
+#define SESSION_FORMAT_VERSION 1
+
+//! Microseconds per second, the timestamp column's unit
+#define SESSION_TIMESTAMP_TICKS 1000000.0
+//! RSSI column units per dB
+#define SESSION_RSSI_SCALE 10.0f
+
+typedef enum {
+    SESSION_COLUMN_EPC_DICTIONARY = 0,
+    SESSION_COLUMN_EPC,
+    SESSION_COLUMN_TIMESTAMP,
+    SESSION_COLUMN_FREQUENCY,
+    SESSION_COLUMN_RSSI,
+    SESSION_COLUMN_READ_DATA,
+    SESSION_COLUMN_COUNT
+} SessionColumn;
+
+/**
+ Start of every block
+ */
+typedef struct {
+    uint32_t magic;                                     //!< SESSION_BLOCK_MAGIC
+    uint16_t version;                                   //!< SESSION_FORMAT_VERSION
+    uint16_t headerSize;                                //!< sizeof(SessionBlockHeader)
+    uint32_t blockNumber;                               //!< Position in the file, from 0
+    uint32_t numFinds;                                  //!< Finds in this block
+    uint32_t numEpcs;                                   //!< Entries in the EPC dictionary
+    uint32_t checksum;                                  //!< FNV-1a of bytes headerSize...usedSize
+    double firstTimestamp;                              //!< First find (CFAbsoluteTime)
+    double lastTimestamp;                               //!< Last find (CFAbsoluteTime)
+    uint32_t columnOffsets[SESSION_COLUMN_COUNT + 1];   //!< Column starts from the block start; the last is the used size
+} SessionBlockHeader;
+
+///////////////////////////////////////////////////////////////////////////////////////
+#pragma mark - Encoding helpers
+///////////////////////////////////////////////////////////////////////////////////////
+
+//! Most bytes a varint of a 64-bit value takes
+#define SESSION_MAX_VARINT_LENGTH 10
+
+static inline uint64_t SessionZigzag(int64_t value) {
+    return ((uint64_t)value << 1) ^ (uint64_t)(value >> 63);
+}
+
+static inline int64_t SessionUnzigzag(uint64_t value) {
+    return (int64_t)(value >> 1) ^ -(int64_t)(value & 1);
+}
+
+/**
+ Write a varint
+
+ @return  Position after the varint
+ */
+static inline uint8_t *SessionPutVarint(uint8_t *p, uint64_t value) {
+    while (value >= 0x80) {
+        *p++ = (uint8_t)(value | 0x80);
+        value >>= 7;
+    }
+    *p++ = (uint8_t)value;
+    return p;
+}
+
+/**
+ Read a varint
+
+ @return  Position after the varint, NULL if it runs past end
+ */
+static inline const uint8_t *SessionGetVarint(const uint8_t *p, const uint8_t *end, uint64_t *value) {
+    uint64_t result = 0;
+    for (int shift = 0; shift < 64 && p < end; shift += 7) {
+        uint8_t byte = *p++;
+        result |= (uint64_t)(byte & 0x7F) << shift;
+        if (!(byte & 0x80)) {
+            *value = result;
+            return p;
+        }
+    }
+    return NULL;
+}
+
+//! Checksum of a block's columns
+static inline uint32_t SessionChecksum(const uint8_t *bytes, size_t length) {
+    uint32_t hash = 2166136261u;
+    for (size_t i = 0; i < length; i++) {
+        hash ^= bytes[i];
+        hash *= 16777619u;
+    }
+    return hash;
+}
+
+#endif
@@ -0,0 +1,449 @@
+//
+//  SessionReader.c
+//  FlowTrial
+//
+//  Created by Wade Sellers on 12/24/14.
+//  Copyright (c) 2014 Wade Sellers. All rights reserved.
+//
+
+#include "SessionReader.h"
+
+#include <errno.h>
+#include <fcntl.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+/**
+ Reads a block's columns in step; each column is consumed independently
+ */
+typedef struct {
+    const uint8_t *position[SESSION_COLUMN_COUNT];
+    const uint8_t *end[SESSION_COLUMN_COUNT];
+    double firstTimestamp;
+    int64_t ticks;
+    int64_t frequency;
+    int64_t rssiI;
+    int64_t rssiQ;
+} BlockCursor;
+
+static const SessionBlockHeader *headerForBlock(const SessionReader *reader, uint32_t block) {
+    return (const SessionBlockHeader *)(reader->map + (size_t)block * SESSION_BLOCK_SIZE);
+}
+
+static uint32_t epcPrefix(const EpcKey *key) {
+    // Bytes past the length are zero, so short EPCs need no special case
+    return ((uint32_t)key->bytes[0] << 24) | ((uint32_t)key->bytes[1] << 16) |
+           ((uint32_t)key->bytes[2] << 8) | key->bytes[3];
+}
+
+/**
+ Read the next entry of an EPC dictionary
+
+ @return  Position after the entry, NULL if it runs past end
+ */
+static const uint8_t *nextDictionaryEntry(const uint8_t *p, const uint8_t *end, EpcKey *key) {
+    if (p >= end || *p > EPC_KEY_MAX_LENGTH || p + 1 + *p > end) {
+        return NULL;
+    }
+    *key = EpcKeyMake(p + 1, *p);
+    return p + 1 + *p;
+}
+
+static bool validBlock(const SessionBlockHeader *header, uint32_t block) {
+    if (header->magic != SESSION_BLOCK_MAGIC ||
+        header->version != SESSION_FORMAT_VERSION ||
+        header->headerSize != sizeof(SessionBlockHeader) ||
+        header->blockNumber != block ||
+        header->numFinds == 0 ||
+        header->columnOffsets[0] != sizeof(SessionBlockHeader) ||
+        header->columnOffsets[SESSION_COLUMN_COUNT] > SESSION_BLOCK_SIZE) {
+        return false;
+    }
+    for (int column = 0; column < SESSION_COLUMN_COUNT; column++) {
+        if (header->columnOffsets[column] > header->columnOffsets[column + 1]) {
+            return false;
+        }
+    }
+    const uint8_t *base = (const uint8_t *)header;
+    const uint8_t *p = base + header->columnOffsets[SESSION_COLUMN_EPC_DICTIONARY];
+    const uint8_t *end = base + header->columnOffsets[SESSION_COLUMN_EPC];
+    EpcKey key;
+    for (uint32_t i = 0; i < header->numEpcs; i++) {
+        if (!(p = nextDictionaryEntry(p, end, &key))) {
+            return false;
+        }
+    }
+    return true;
+}
+
+static void cursorInit(BlockCursor *cursor, const SessionBlockHeader *header) {
+    const uint8_t *base = (const uint8_t *)header;
+    memset(cursor, 0, sizeof(*cursor));
+    for (int column = 0; column < SESSION_COLUMN_COUNT; column++) {
+        cursor->position[column] = base + header->columnOffsets[column];
+        cursor->end[column] = base + header->columnOffsets[column + 1];
+    }
+    cursor->firstTimestamp = header->firstTimestamp;
+}
+
+static bool cursorNextValue(BlockCursor *cursor, SessionColumn column, uint64_t *value) {
+    cursor->position[column] = SessionGetVarint(cursor->position[column], cursor->end[column], value);
+    return cursor->position[column] != NULL;
+}
+
+static bool cursorNextEpcAndTimestamp(BlockCursor *cursor, uint64_t *epcIndex, double *timestamp) {
+    uint64_t delta;
+    if (!cursorNextValue(cursor, SESSION_COLUMN_EPC, epcIndex) ||
+        !cursorNextValue(cursor, SESSION_COLUMN_TIMESTAMP, &delta)) {
+        return false;
+    }
+    cursor->ticks += SessionUnzigzag(delta);
+    *timestamp = cursor->firstTimestamp + cursor->ticks / SESSION_TIMESTAMP_TICKS;
+    return true;
+}
+
+static bool cursorNextDetails(BlockCursor *cursor, RawFind *find) {
+    uint64_t frequency, rssiI, rssiQ, readData1, readData2;
+    if (!cursorNextValue(cursor, SESSION_COLUMN_FREQUENCY, &frequency) ||
+        !cursorNextValue(cursor, SESSION_COLUMN_RSSI, &rssiI) ||
+        !cursorNextValue(cursor, SESSION_COLUMN_RSSI, &rssiQ) ||
+        !cursorNextValue(cursor, SESSION_COLUMN_READ_DATA, &readData1) ||
+        !cursorNextValue(cursor, SESSION_COLUMN_READ_DATA, &readData2)) {
+        return false;
+    }
+    cursor->frequency += SessionUnzigzag(frequency);
+    cursor->rssiI += SessionUnzigzag(rssiI);
+    cursor->rssiQ += SessionUnzigzag(rssiQ);
+    find->frequency = (int32_t)cursor->frequency;
+    find->rssiI = cursor->rssiI / SESSION_RSSI_SCALE;
+    find->rssiQ = cursor->rssiQ / SESSION_RSSI_SCALE;
+    find->readData1 = (uint16_t)readData1;
+    find->readData2 = (uint16_t)readData2;
+    return true;
+}
+
+/**
+ Decode a block's dictionary
+
+ @return  Number of entries (header->numEpcs, already validated on open)
+ */
+static uint32_t readDictionary(const SessionBlockHeader *header, EpcKey *keys) {
+    const uint8_t *base = (const uint8_t *)header;
+    const uint8_t *p = base + header->columnOffsets[SESSION_COLUMN_EPC_DICTIONARY];
+    const uint8_t *end = base + header->columnOffsets[SESSION_COLUMN_EPC];
+    for (uint32_t i = 0; i < header->numEpcs; i++) {
+        p = nextDictionaryEntry(p, end, &keys[i]);
+    }
+    return header->numEpcs;
+}
+
+#pragma mark - Open / close
+
+static bool buildIndex(SessionReader *reader) {
+    reader->blocks = malloc(((size_t)reader->numBlocks + 1) * sizeof(SessionBlockInfo));
+    if (!reader->blocks || !EpcTableInit(&reader->epcs, 1024)) {
+        return false;
+    }
+
+    reader->minEpcPrefix = UINT32_MAX;
+    reader->maxEpcPrefix = 0;
+
+    // Count the blocks each EPC is in, building the EPC table as we go
+    uint32_t *counts = NULL;
+    uint32_t countCapacity = 0;
+    uint64_t numPostings = 0;
+    for (uint32_t block = 0; block < reader->numBlocks; block++) {
+        const SessionBlockHeader *header = headerForBlock(reader, block);
+        SessionBlockInfo *info = &reader->blocks[block];
+        info->firstTimestamp = header->firstTimestamp;
+        info->lastTimestamp = header->lastTimestamp;
+        info->numFinds = header->numFinds;
+        info->numEpcs = header->numEpcs;
+        info->minEpcPrefix = UINT32_MAX;
+        info->maxEpcPrefix = 0;
+        reader->numFinds += header->numFinds;
+        if (block == 0 || info->firstTimestamp < reader->firstTimestamp) {
+            reader->firstTimestamp = info->firstTimestamp;
+        }
+        if (block == 0 || info->lastTimestamp > reader->lastTimestamp) {
+            reader->lastTimestamp = info->lastTimestamp;
+        }
+
+        const uint8_t *p = (const uint8_t *)header + header->columnOffsets[SESSION_COLUMN_EPC_DICTIONARY];
+        const uint8_t *end = (const uint8_t *)header + header->columnOffsets[SESSION_COLUMN_EPC];
+        EpcKey key;
+        for (uint32_t i = 0; i < header->numEpcs; i++) {
+            p = nextDictionaryEntry(p, end, &key);
+            uint32_t prefix = epcPrefix(&key);
+            info->minEpcPrefix = prefix < info->minEpcPrefix ? prefix : info->minEpcPrefix;
+            info->maxEpcPrefix = prefix > info->maxEpcPrefix ? prefix : info->maxEpcPrefix;
+
+            bool inserted;
+            uint32_t index = EpcTableInsert(&reader->epcs, &key, &inserted);
+            if (index == EPC_TABLE_NOT_FOUND) {
+                free(counts);
+                return false;
+            }
+            if (index >= countCapacity) {
+                uint32_t capacity = countCapacity ? countCapacity * 2 : 1024;
+                uint32_t *grown = realloc(counts, capacity * sizeof(uint32_t));
+                if (!grown) {
+                    free(counts);
+                    return false;
+                }
+                memset(grown + countCapacity, 0, (capacity - countCapacity) * sizeof(uint32_t));
+                counts = grown;
+                countCapacity = capacity;
+            }
+            counts[index]++;
+            numPostings++;
+        }
+        reader->minEpcPrefix = info->minEpcPrefix < reader->minEpcPrefix ? info->minEpcPrefix : reader->minEpcPrefix;
+        reader->maxEpcPrefix = info->maxEpcPrefix > reader->maxEpcPrefix ? info->maxEpcPrefix : reader->maxEpcPrefix;
+    }
+
+    // Lay the posting lists out back to back, then fill them in block order
+    uint32_t numEpcs = reader->epcs.count;
+    reader->postingStarts = malloc(((size_t)numEpcs + 1) * sizeof(uint32_t));
+    reader->postings = malloc((size_t)(numPostings ? numPostings : 1) * sizeof(uint32_t));
+    if (!reader->postingStarts || !reader->postings) {
+        free(counts);
+        return false;
+    }
+    uint32_t start = 0;
+    for (uint32_t i = 0; i < numEpcs; i++) {
+        reader->postingStarts[i] = start;
+        start += counts[i];
+        counts[i] = reader->postingStarts[i];
+    }
+    reader->postingStarts[numEpcs] = start;
+
+    for (uint32_t block = 0; block < reader->numBlocks; block++) {
+        const SessionBlockHeader *header = headerForBlock(reader, block);
+        const uint8_t *p = (const uint8_t *)header + header->columnOffsets[SESSION_COLUMN_EPC_DICTIONARY];
+        const uint8_t *end = (const uint8_t *)header + header->columnOffsets[SESSION_COLUMN_EPC];
+        EpcKey key;
+        for (uint32_t i = 0; i < header->numEpcs; i++) {
+            p = nextDictionaryEntry(p, end, &key);
+            reader->postings[counts[EpcTableFind(&reader->epcs, &key)]++] = block;
+        }
+    }
+    free(counts);
+    return true;
+}
+
+bool SessionReaderOpen(SessionReader *reader, const char *path) {
+    memset(reader, 0, sizeof(*reader));
+    int fd = open(path, O_RDONLY);
+    if (fd < 0) {
+        return false;
+    }
+    struct stat st;
+    if (fstat(fd, &st) != 0) {
+        int error = errno;
+        close(fd);
+        errno = error;
+        return false;
+    }
+    size_t blocksInFile = (size_t)st.st_size / SESSION_BLOCK_SIZE;
+    if (blocksInFile > 0) {
+        void *map = mmap(NULL, blocksInFile * SESSION_BLOCK_SIZE, PROT_READ, MAP_PRIVATE, fd, 0);
+        if (map == MAP_FAILED) {
+            int error = errno;
+            close(fd);
+            errno = error;
+            return false;
+        }
+        reader->map = map;
+        reader->mapLength = blocksInFile * SESSION_BLOCK_SIZE;
+        madvise(map, reader->mapLength, MADV_RANDOM);
+    }
+    close(fd);
+
+    while (reader->numBlocks < blocksInFile && validBlock(headerForBlock(reader, reader->numBlocks), reader->numBlocks)) {
+        reader->numBlocks++;
+    }
+    if (!buildIndex(reader)) {
+        SessionReaderClose(reader);
+        errno = ENOMEM;
+        return false;
+    }
+    return true;
+}
+
+void SessionReaderClose(SessionReader *reader) {
+    if (reader->map) {
+        munmap((void *)reader->map, reader->mapLength);
+    }
+    free(reader->blocks);
+    free(reader->postingStarts);
+    free(reader->postings);
+    EpcTableFree(&reader->epcs);
+    memset(reader, 0, sizeof(*reader));
+}
+
+#pragma mark - Queries
+
+bool SessionReaderMayMatch(const SessionReader *reader, double start, double end, uint32_t minPrefix, uint32_t maxPrefix) {
+    return reader->numBlocks > 0 &&
+           reader->lastTimestamp >= start && reader->firstTimestamp <= end &&
+           reader->maxEpcPrefix >= minPrefix && reader->minEpcPrefix <= maxPrefix;
+}
+
+const uint32_t *SessionReaderBlocksForEpc(const SessionReader *reader, const EpcKey *epc, uint32_t *count) {
+    uint32_t index = EpcTableFind(&reader->epcs, epc);
+    if (index == EPC_TABLE_NOT_FOUND) {
+        *count = 0;
+        return NULL;
+    }
+    *count = reader->postingStarts[index + 1] - reader->postingStarts[index];
+    return reader->postings + reader->postingStarts[index];
+}
+
+bool SessionReaderLastSeen(const SessionReader *reader, const EpcKey *epc, double *timestamp) {
+    uint32_t numBlocks;
+    const uint32_t *blocks = SessionReaderBlocksForEpc(reader, epc, &numBlocks);
+    // Later blocks are usually later in time, but a block's own lastTimestamp decides
+    double best = 0;
+    bool found = false;
+    for (uint32_t i = numBlocks; i-- > 0; ) {
+        const SessionBlockInfo *info = &reader->blocks[blocks[i]];
+        if (found && info->lastTimestamp <= best) {
+            continue;
+        }
+        const SessionBlockHeader *header = headerForBlock(reader, blocks[i]);
+        const uint8_t *p = (const uint8_t *)header + header->columnOffsets[SESSION_COLUMN_EPC_DICTIONARY];
+        const uint8_t *end = (const uint8_t *)header + header->columnOffsets[SESSION_COLUMN_EPC];
+        uint64_t dictionaryIndex = UINT64_MAX;
+        EpcKey key;
+        for (uint32_t j = 0; j < header->numEpcs; j++) {
+            p = nextDictionaryEntry(p, end, &key);
+            if (EpcKeyEqual(&key, epc)) {
+                dictionaryIndex = j;
+                break;
+            }
+        }
+
+        BlockCursor cursor;
+        cursorInit(&cursor, header);
+        for (uint32_t j = 0; j < header->numFinds; j++) {
+            uint64_t epcIndex;
+            double findTimestamp;
+            if (!cursorNextEpcAndTimestamp(&cursor, &epcIndex, &findTimestamp)) {
+                break;
+            }
+            if (epcIndex == dictionaryIndex && (!found || findTimestamp > best)) {
+                best = findTimestamp;
+                found = true;
+            }
+        }
+    }
+    if (found) {
+        *timestamp = best;
+    }
+    return found;
+}
+
+bool SessionReaderEpcsSeenBetween(const SessionReader *reader, double start, double end, EpcTable *result) {
+    return SessionReaderEpcsWithPrefixesSeenBetween(reader, start, end, 0, UINT32_MAX, result);
+}
+
+bool SessionReaderEpcsWithPrefixesSeenBetween(const SessionReader *reader, double start, double end,
+                                              uint32_t minPrefix, uint32_t maxPrefix, EpcTable *result) {
+    EpcKey *keys = NULL;
+    bool *wanted = NULL;            // Per dictionary entry: is its prefix in range?
+    uint32_t keyCapacity = 0;
+    bool ok = true;
+    for (uint32_t block = 0; ok && block < reader->numBlocks; block++) {
+        const SessionBlockInfo *info = &reader->blocks[block];
+        if (info->lastTimestamp < start || info->firstTimestamp > end ||
+            info->maxEpcPrefix < minPrefix || info->minEpcPrefix > maxPrefix) {
+            continue;
+        }
+        const SessionBlockHeader *header = headerForBlock(reader, block);
+        if (header->numEpcs > keyCapacity) {
+            EpcKey *grownKeys = realloc(keys, header->numEpcs * sizeof(EpcKey));
+            keys = grownKeys ? grownKeys : keys;
+            bool *grownWanted = realloc(wanted, header->numEpcs * sizeof(bool));
+            wanted = grownWanted ? grownWanted : wanted;
+            if (!grownKeys || !grownWanted) {
+                free(keys);
+                free(wanted);
+                return false;
+            }
+            keyCapacity = header->numEpcs;
+        }
+        uint32_t numEpcs = readDictionary(header, keys);
+        bool allWanted = info->minEpcPrefix >= minPrefix && info->maxEpcPrefix <= maxPrefix;
+        for (uint32_t i = 0; i < numEpcs; i++) {
+            uint32_t prefix = epcPrefix(&keys[i]);
+            wanted[i] = allWanted || (prefix >= minPrefix && prefix <= maxPrefix);
+        }
+        bool inserted;
+
+        if (info->firstTimestamp >= start && info->lastTimestamp <= end) {
+            for (uint32_t i = 0; ok && i < numEpcs; i++) {
+                if (wanted[i]) {
+                    ok = EpcTableInsert(result, &keys[i], &inserted) != EPC_TABLE_NOT_FOUND;
+                }
+            }
+            continue;
+        }
+        BlockCursor cursor;
+        cursorInit(&cursor, header);
+        for (uint32_t i = 0; ok && i < header->numFinds; i++) {
+            uint64_t epcIndex;
+            double timestamp;
+            if (!cursorNextEpcAndTimestamp(&cursor, &epcIndex, &timestamp) || epcIndex >= numEpcs) {
+                ok = false;
+            } else if (timestamp >= start && timestamp <= end && wanted[epcIndex]) {
+                ok = EpcTableInsert(result, &keys[epcIndex], &inserted) != EPC_TABLE_NOT_FOUND;
+            }
+        }
+    }
+    free(keys);
+    free(wanted);
+    return ok;
+}
+
+uint32_t SessionReaderDecodeBlock(const SessionReader *reader, uint32_t block, RawFind *finds, uint32_t maxFinds) {
+    if (block >= reader->numBlocks) {
+        return 0;
+    }
+    const SessionBlockHeader *header = headerForBlock(reader, block);
+    EpcKey *keys = malloc((header->numEpcs ? header->numEpcs : 1) * sizeof(EpcKey));
+    if (!keys) {
+        return 0;
+    }
+    uint32_t numEpcs = readDictionary(header, keys);
+    BlockCursor cursor;
+    cursorInit(&cursor, header);
+    uint32_t count = 0;
+    while (count < header->numFinds && count < maxFinds) {
+        RawFind *find = &finds[count];
+        uint64_t epcIndex;
+        if (!cursorNextEpcAndTimestamp(&cursor, &epcIndex, &find->timestamp) ||
+            epcIndex >= numEpcs ||
+            !cursorNextDetails(&cursor, find)) {
+            count = 0;
+            break;
+        }
+        find->epc = keys[epcIndex];
+        count++;
+    }
+    free(keys);
+    return count;
+}
+
+bool SessionReaderVerifyBlock(const SessionReader *reader, uint32_t block) {
+    if (block >= reader->numBlocks) {
+        return false;
+    }
+    const SessionBlockHeader *header = headerForBlock(reader, block);
+    const uint8_t *base = (const uint8_t *)header;
+    return SessionChecksum(base + header->headerSize,
+                           header->columnOffsets[SESSION_COLUMN_COUNT] - header->headerSize) == header->checksum;
+}
@@ -0,0 +1,156 @@
+//
+//  SessionReader.h
+//  FlowTrial
+//
+//  Created by Wade Sellers on 12/24/14.
+//  Copyright (c) 2014 Wade Sellers. All rights reserved.
+//
+
+#ifndef FlowTrial_SessionReader_h
+#define FlowTrial_SessionReader_h
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+#include "EpcTable.h"
+#include "RawFindQueue.h"
+#include "SessionFormat.h"
+
+/**
+ Sparse index entry for one block
+ */
+typedef struct {
+    double firstTimestamp;      //!< First find in the block
+    double lastTimestamp;       //!< Last find in the block
+    uint32_t minEpcPrefix;      //!< Smallest first 4 EPC bytes (big-endian) in the block
+    uint32_t maxEpcPrefix;      //!< Largest first 4 EPC bytes (big-endian) in the block
+    uint32_t numFinds;          //!< Finds in the block
+    uint32_t numEpcs;           //!< Distinct EPCs in the block
+} SessionBlockInfo;
+
+/**
+ Read-only access to a session file written by SessionWriter.
+
+ The file is memory-mapped. Opening it reads only the block headers and EPC
+ dictionaries, to build a sparse per-block index and a posting list of the blocks each
+ EPC appears in; find columns are decoded only for the blocks a query has to look at.
+ EPCs are compared as EpcKeys, so two EPCs are the same exactly when their bytes and
+ lengths are, as with UgiEpc.
+
+ A torn last block (from a crash while recording) ends the file. Not thread safe.
+
+ A reader covers one session file, and InventoryRecorder writes one file per session, so
+ a query over many recorded sessions opens a reader for each. The file-wide summary
+ (time span and EPC prefix range) lets SessionReaderMayMatch rule a session out
+ without touching its blocks; the same ranges per block let prefix queries skip blocks.
+ */
+typedef struct {
+    const uint8_t *map;
+    size_t mapLength;
+    uint32_t numBlocks;         //!< Valid blocks
+    uint64_t numFinds;          //!< Finds in all valid blocks
+    double firstTimestamp;      //!< Earliest first find of any block (0 if there are none)
+    double lastTimestamp;       //!< Latest last find of any block (0 if there are none)
+    uint32_t minEpcPrefix;      //!< Smallest first 4 EPC bytes (big-endian) in the file
+    uint32_t maxEpcPrefix;      //!< Largest first 4 EPC bytes (big-endian) in the file
+    SessionBlockInfo *blocks;   //!< Index, one per block
+    EpcTable epcs;              //!< Every distinct EPC in the file
+    uint32_t *postingStarts;    //!< Per EPC, start in postings (epcs.count + 1 entries)
+    uint32_t *postings;         //!< Block numbers, ascending, per EPC
+} SessionReader;
+
+/**
+ Open a session file
+
+ @param reader  Reader to initialize
+ @param path    Session file
+ @return        false on failure (errno is set)
+ */
+bool SessionReaderOpen(SessionReader *reader, const char *path);
+
+/**
+ Unmap the file and free the index
+ */
+void SessionReaderClose(SessionReader *reader);
+
+/**
+ Could the session have finds in a time range with EPCs in a prefix range? Only the
+ summary is checked, so this is cheap enough to run over every recorded session first.
+
+ @param reader      Reader
+ @param start       Start time (CFAbsoluteTime)
+ @param end         End time (CFAbsoluteTime)
+ @param minPrefix   Smallest first 4 EPC bytes (big-endian) wanted
+ @param maxPrefix   Largest first 4 EPC bytes (big-endian) wanted
+ @return            false if no find in the file can match
+ */
+bool SessionReaderMayMatch(const SessionReader *reader, double start, double end, uint32_t minPrefix, uint32_t maxPrefix);
+
+/**
+ Find the blocks an EPC appears in
+
+ @param reader  Reader
+ @param epc     EPC
+ @param count   Set to the number of blocks
+ @return        Block numbers, ascending (NULL if the EPC never appears)
+ */
+const uint32_t *SessionReaderBlocksForEpc(const SessionReader *reader, const EpcKey *epc, uint32_t *count);
+
+/**
+ When was an EPC last seen?
+
+ @param reader      Reader
+ @param epc         EPC
+ @param timestamp   Set to the time of the last find (CFAbsoluteTime)
+ @return            false if the EPC is not in the session
+ */
+bool SessionReaderLastSeen(const SessionReader *reader, const EpcKey *epc, double *timestamp);
+
+/**
+ Which EPCs were seen between two times (inclusive)? Blocks entirely inside the range
+ are answered from their dictionaries alone.
+
+ @param reader  Reader
+ @param start   Start time (CFAbsoluteTime)
+ @param end     End time (CFAbsoluteTime)
+ @param result  Initialized table the EPCs are added to
+ @return        false if out of memory or a block is corrupt
+ */
+bool SessionReaderEpcsSeenBetween(const SessionReader *reader, double start, double end, EpcTable *result);
+
+/**
+ Which EPCs whose first 4 bytes (big-endian) are in a range were seen between two times
+ (inclusive)? Blocks whose EPC prefixes are all outside the range are skipped, so asking
+ for one company prefix or tag filter value reads only the blocks that have it.
+
+ @param reader      Reader
+ @param start       Start time (CFAbsoluteTime)
+ @param end         End time (CFAbsoluteTime)
+ @param minPrefix   Smallest prefix wanted
+ @param maxPrefix   Largest prefix wanted
+ @param result      Initialized table the EPCs are added to
+ @return            false if out of memory or a block is corrupt
+ */
+bool SessionReaderEpcsWithPrefixesSeenBetween(const SessionReader *reader, double start, double end,
+                                              uint32_t minPrefix, uint32_t maxPrefix, EpcTable *result);
+
+/**
+ Decode all the finds in a block
+
+ @param reader      Reader
+ @param block       Block number
+ @param finds       Buffer for the finds
+ @param maxFinds    Size of the buffer (SessionBlockInfo.numFinds is enough)
+ @return            Number of finds decoded, 0 if the block is corrupt
+ */
+uint32_t SessionReaderDecodeBlock(const SessionReader *reader, uint32_t block, RawFind *finds, uint32_t maxFinds);
+
+/**
+ Check a block's checksum (not done on open, since it means reading the whole block)
+
+ @return  true if the block's columns are intact
+ */
+bool SessionReaderVerifyBlock(const SessionReader *reader, uint32_t block);
+
+#endif
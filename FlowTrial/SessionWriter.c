@@ -0,0 +1,194 @@
+//
+//  SessionWriter.c
+//  FlowTrial
+//
+//  Created by Wade Sellers on 12/23/14.
+//  Copyright (c) 2014 Wade Sellers. All rights reserved.
+//
+
+#include "SessionWriter.h"
+
+#include <errno.h>
+#include <fcntl.h>
+#include <math.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+//! Most distinct EPCs that fit in a block (each costs at least its dictionary entry and one find)
+#define SESSION_MAX_EPCS_PER_BLOCK (SESSION_BLOCK_SIZE / 8)
+
+//! Most bytes one find can add to a block, including a new dictionary entry
+#define SESSION_MAX_FIND_SIZE (1 + EPC_KEY_MAX_LENGTH + 5 + SESSION_MAX_VARINT_LENGTH + 5 + 5 + 5 + 3 + 3)
+
+static void freeBuffers(SessionWriter *writer) {
+    free(writer->block);
+    for (int column = 0; column < SESSION_COLUMN_COUNT; column++) {
+        free(writer->columns[column]);
+    }
+    EpcTableFree(&writer->dictionary);
+}
+
+static void startBlock(SessionWriter *writer) {
+    memset(writer->columnLengths, 0, sizeof(writer->columnLengths));
+    EpcTableRemoveAll(&writer->dictionary);
+    writer->numFinds = 0;
+    writer->previousTicks = 0;
+    writer->previousFrequency = 0;
+    writer->previousRssiI = 0;
+    writer->previousRssiQ = 0;
+}
+
+static uint32_t usedSize(const SessionWriter *writer) {
+    uint32_t size = sizeof(SessionBlockHeader);
+    for (int column = 0; column < SESSION_COLUMN_COUNT; column++) {
+        size += writer->columnLengths[column];
+    }
+    return size;
+}
+
+static bool writeAll(int fd, const uint8_t *bytes, size_t length) {
+    while (length > 0) {
+        ssize_t written = write(fd, bytes, length);
+        if (written < 0) {
+            if (errno == EINTR) {
+                continue;
+            }
+            return false;
+        }
+        bytes += written;
+        length -= (size_t)written;
+    }
+    return true;
+}
+
+bool SessionWriterOpen(SessionWriter *writer, const char *path) {
+    memset(writer, 0, sizeof(*writer));
+    writer->fd = -1;
+    writer->block = malloc(SESSION_BLOCK_SIZE);
+    bool ok = writer->block != NULL && EpcTableInit(&writer->dictionary, SESSION_MAX_EPCS_PER_BLOCK);
+    for (int column = 0; ok && column < SESSION_COLUMN_COUNT; column++) {
+        writer->columns[column] = malloc(SESSION_BLOCK_SIZE);
+        ok = writer->columns[column] != NULL;
+    }
+    if (!ok) {
+        freeBuffers(writer);
+        errno = ENOMEM;
+        return false;
+    }
+    writer->fd = open(path, O_WRONLY | O_CREAT | O_TRUNC, 0644);
+    if (writer->fd < 0) {
+        int error = errno;
+        freeBuffers(writer);
+        errno = error;
+        return false;
+    }
+    startBlock(writer);
+    return true;
+}
+
+bool SessionWriterFlush(SessionWriter *writer) {
+    if (writer->numFinds == 0) {
+        return true;
+    }
+    SessionBlockHeader header;
+    memset(&header, 0, sizeof(header));
+    header.magic = SESSION_BLOCK_MAGIC;
+    header.version = SESSION_FORMAT_VERSION;
+    header.headerSize = sizeof(SessionBlockHeader);
+    header.blockNumber = writer->blockNumber;
+    header.numFinds = writer->numFinds;
+    header.numEpcs = writer->dictionary.count;
+    header.firstTimestamp = writer->firstTimestamp;
+    header.lastTimestamp = writer->lastTimestamp;
+
+    uint32_t offset = sizeof(SessionBlockHeader);
+    for (int column = 0; column < SESSION_COLUMN_COUNT; column++) {
+        header.columnOffsets[column] = offset;
+        memcpy(writer->block + offset, writer->columns[column], writer->columnLengths[column]);
+        offset += writer->columnLengths[column];
+    }
+    header.columnOffsets[SESSION_COLUMN_COUNT] = offset;
+    memset(writer->block + offset, 0, SESSION_BLOCK_SIZE - offset);
+    header.checksum = SessionChecksum(writer->block + sizeof(SessionBlockHeader), offset - sizeof(SessionBlockHeader));
+    memcpy(writer->block, &header, sizeof(header));
+
+    if (!writeAll(writer->fd, writer->block, SESSION_BLOCK_SIZE)) {
+        return false;
+    }
+    writer->blockNumber++;
+    writer->stats.blocks++;
+    writer->stats.bytes += SESSION_BLOCK_SIZE;
+    startBlock(writer);
+    return true;
+}
+
+bool SessionWriterAppend(SessionWriter *writer, const RawFind *find) {
+    if (writer->numFinds > 0 &&
+        (usedSize(writer) + SESSION_MAX_FIND_SIZE > SESSION_BLOCK_SIZE ||
+         writer->dictionary.count >= SESSION_MAX_EPCS_PER_BLOCK)) {
+        if (!SessionWriterFlush(writer)) {
+            return false;
+        }
+    }
+    if (writer->numFinds == 0) {
+        writer->firstTimestamp = find->timestamp;
+    }
+
+    bool inserted;
+    uint32_t epcIndex = EpcTableInsert(&writer->dictionary, &find->epc, &inserted);
+    if (inserted) {
+        uint8_t *p = writer->columns[SESSION_COLUMN_EPC_DICTIONARY] + writer->columnLengths[SESSION_COLUMN_EPC_DICTIONARY];
+        *p++ = find->epc.length;
+        memcpy(p, find->epc.bytes, find->epc.length);
+        writer->columnLengths[SESSION_COLUMN_EPC_DICTIONARY] += 1 + find->epc.length;
+    }
+
+    uint8_t *start = writer->columns[SESSION_COLUMN_EPC] + writer->columnLengths[SESSION_COLUMN_EPC];
+    writer->columnLengths[SESSION_COLUMN_EPC] += (uint32_t)(SessionPutVarint(start, epcIndex) - start);
+
+    int64_t ticks = llround((find->timestamp - writer->firstTimestamp) * SESSION_TIMESTAMP_TICKS);
+    start = writer->columns[SESSION_COLUMN_TIMESTAMP] + writer->columnLengths[SESSION_COLUMN_TIMESTAMP];
+    writer->columnLengths[SESSION_COLUMN_TIMESTAMP] +=
+        (uint32_t)(SessionPutVarint(start, SessionZigzag(ticks - writer->previousTicks)) - start);
+    writer->previousTicks = ticks;
+
+    start = writer->columns[SESSION_COLUMN_FREQUENCY] + writer->columnLengths[SESSION_COLUMN_FREQUENCY];
+    writer->columnLengths[SESSION_COLUMN_FREQUENCY] +=
+        (uint32_t)(SessionPutVarint(start, SessionZigzag((int64_t)find->frequency - writer->previousFrequency)) - start);
+    writer->previousFrequency = find->frequency;
+
+    int32_t rssiI = (int32_t)lroundf(find->rssiI * SESSION_RSSI_SCALE);
+    int32_t rssiQ = (int32_t)lroundf(find->rssiQ * SESSION_RSSI_SCALE);
+    start = writer->columns[SESSION_COLUMN_RSSI] + writer->columnLengths[SESSION_COLUMN_RSSI];
+    uint8_t *p = SessionPutVarint(start, SessionZigzag((int64_t)rssiI - writer->previousRssiI));
+    p = SessionPutVarint(p, SessionZigzag((int64_t)rssiQ - writer->previousRssiQ));
+    writer->columnLengths[SESSION_COLUMN_RSSI] += (uint32_t)(p - start);
+    writer->previousRssiI = rssiI;
+    writer->previousRssiQ = rssiQ;
+
+    start = writer->columns[SESSION_COLUMN_READ_DATA] + writer->columnLengths[SESSION_COLUMN_READ_DATA];
+    p = SessionPutVarint(start, find->readData1);
+    p = SessionPutVarint(p, find->readData2);
+    writer->columnLengths[SESSION_COLUMN_READ_DATA] += (uint32_t)(p - start);
+
+    writer->lastTimestamp = find->timestamp;
+    writer->numFinds++;
+    writer->stats.finds++;
+    return true;
+}
+
+bool SessionWriterClose(SessionWriter *writer) {
+    bool ok = SessionWriterFlush(writer) && fsync(writer->fd) == 0;
+    int error = errno;
+    if (close(writer->fd) != 0 && ok) {
+        ok = false;
+        error = errno;
+    }
+    writer->fd = -1;
+    freeBuffers(writer);
+    memset(writer->columns, 0, sizeof(writer->columns));
+    writer->block = NULL;
+    errno = error;
+    return ok;
+}
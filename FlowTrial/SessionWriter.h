@@ -0,0 +1,89 @@
+//
+//  SessionWriter.h
+//  FlowTrial
+//
+//  Created by Wade Sellers on 12/23/14.
+//  Copyright (c) 2014 Wade Sellers. All rights reserved.
+//
+
+#ifndef FlowTrial_SessionWriter_h
+#define FlowTrial_SessionWriter_h
+
+#include <stdbool.h>
+#include <stdint.h>
+
+#include "EpcTable.h"
+#include "RawFindQueue.h"
+#include "SessionFormat.h"
+
+/**
+ Counters for a SessionWriter
+ */
+typedef struct {
+    uint64_t finds;             //!< Finds appended
+    uint64_t blocks;            //!< Blocks written
+    uint64_t bytes;             //!< Bytes written
+} SessionWriterStats;
+
+/**
+ Streams finds into a session file (see SessionFormat.h).
+
+ Finds are encoded straight into per-column buffers as they are appended; when the next
+ find might not fit, the columns are laid out into one block and written. All buffers
+ are allocated when the writer is opened, so appending never allocates.
+ Not thread safe.
+ */
+typedef struct {
+    int fd;
+    uint8_t *block;
+    uint8_t *columns[SESSION_COLUMN_COUNT];
+    uint32_t columnLengths[SESSION_COLUMN_COUNT];
+    EpcTable dictionary;
+    uint32_t blockNumber;
+    uint32_t numFinds;
+    double firstTimestamp;
+    double lastTimestamp;
+    int64_t previousTicks;
+    int32_t previousFrequency;
+    int32_t previousRssiI;
+    int32_t previousRssiQ;
+    SessionWriterStats stats;
+} SessionWriter;
+
+/**
+ Create a session file (replacing any file already there)
+
+ @param writer  Writer to initialize
+ @param path    File to write
+ @return        false on failure (errno is set)
+ */
+bool SessionWriterOpen(SessionWriter *writer, const char *path);
+
+/**
+ Append a find
+
+ @param writer  Writer
+ @param find    Find to append
+ @return        false if writing a block failed (errno is set)
+ */
+bool SessionWriterAppend(SessionWriter *writer, const RawFind *find);
+
+/**
+ Write out the block in progress, so everything appended so far is in the file.
+ Appending carries on in a new block.
+
+ @param writer  Writer
+ @return        false on failure (errno is set)
+ */
+bool SessionWriterFlush(SessionWriter *writer);
+
+/**
+ Flush, sync and close the file, and free the writer's buffers. The writer is freed
+ even if this fails.
+
+ @param writer  Writer
+ @return        false if the last block could not be written or synced (errno is set)
+ */
+bool SessionWriterClose(SessionWriter *writer);
+
+#endif
@@ -0,0 +1,44 @@
+//
+//  SimulatedReaderTransport.h
+//  FlowTrial
+//
+//  Created by Wade Sellers on 12/20/14.
+//  Copyright (c) 2014 Wade Sellers. All rights reserved.
+//
+
+#import <Foundation/Foundation.h>
+#import "ReaderTransport.h"
+#import "ReaderSimulator.h"
+
+/**
+ ReaderTransport backed by a ReaderSimulator, for running inventory without a Grokker
+ (in the simulator, in tests, in benchmarks).
+
+ The simulation runs on its own serial queue and reports to the delegate like the SDK:
+ inventoryFilterLowLevel: on that queue for every find that arrives intact, then
+ inventoryTagFound/inventoryTagChanged/inventoryTagSubsequentFinds on the main thread.
+ Tags are reported as UgiTag objects whose epc and firstRead are filled in.
+ */
+@interface SimulatedReaderTransport : NSObject <ReaderTransport>
+
+//! Simulation configuration, used from the next startInventory
+@property (nonatomic) ReaderSimulatorConfig config;
+
+//! Simulated seconds per real second, 0 to run as fast as the delegate keeps up (default is 1)
+@property (nonatomic) double speed;
+
+//! Stop inventory by itself after this many simulated seconds (0 = run until stopped, the default)
+@property (nonatomic) double durationSeconds;
+
+//! Counters for the current (or last) inventory
+@property (readonly) ReaderSimulatorStats stats;
+
+/**
+ Create a transport
+
+ @param config  Simulation configuration
+ @return        New transport
+ */
+- (id) initWithConfig:(const ReaderSimulatorConfig *)config;
+
+@end
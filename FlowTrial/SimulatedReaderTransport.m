@@ -0,0 +1,428 @@
+//
+//  SimulatedReaderTransport.m
+//  FlowTrial
+//
+//  Created by Wade Sellers on 12/20/14.
+//  Copyright (c) 2014 Wade Sellers. All rights reserved.
+//
+
+#import "SimulatedReaderTransport.h"
+#import "EpcFilter.h"
+#import "EpcTable.h"
+#import "TagFindBatch.h"
+#import "UgiEpc+EpcKey.h"
+
+//! Simulated time run per step on the simulation queue
+#define SIMULATION_STEP_SECONDS 0.01
+#define SIMULATION_STEP_MAX_FINDS 4096
+//! Steps handed to the main thread but not yet delivered, before the simulation waits
+#define MAX_STEPS_IN_FLIGHT 2
+//! History depth when the configuration doesn't set one, as for the SDK
+#define DEFAULT_HISTORY_DEPTH 20
+
+#pragma mark - SimulatedTag
+
+/**
+ A UgiTag for a simulated find. UgiTag's properties are readonly, so the subclass
+ supplies its own values.
+ */
+@interface SimulatedTag : UgiTag
+
+//! Found within the last historyDepth intervals
+@property (nonatomic) BOOL simulatedVisible;
+
+//! Timestamp of the latest find
+@property (nonatomic) double lastFindTimestamp;
+
+- (id) initWithEpc:(UgiEpc *)epc firstRead:(NSDate *)firstRead;
+
+@end
+
+@implementation SimulatedTag {
+    UgiEpc *_simulatedEpc;
+    NSDate *_simulatedFirstRead;
+}
+
+- (id) initWithEpc:(UgiEpc *)epc firstRead:(NSDate *)firstRead {
+    self = [super init];
+    if (self) {
+        _simulatedEpc = epc;
+        _simulatedFirstRead = firstRead;
+        _simulatedVisible = YES;
+        _lastFindTimestamp = firstRead.timeIntervalSinceReferenceDate;
+    }
+    return self;
+}
+
+- (UgiEpc *) epc {
+    return _simulatedEpc;
+}
+
+- (NSDate *) firstRead {
+    return _simulatedFirstRead;
+}
+
+- (BOOL) isVisible {
+    return _simulatedVisible;
+}
+
+- (UgiTagReadState *) readState {
+    return nil;
+}
+
+@end
+
+#pragma mark - SimulatedReaderTransport
+
+@interface SimulatedReaderTransport ()
+
+@property (readwrite, nonatomic) BOOL isConnected;
+@property (weak) id<UgiInventoryDelegate> delegate;
+@property dispatch_queue_t queue;
+@property dispatch_semaphore_t stepsInFlight;
+//! Tags by index in _found; NSNull for tags the delegate's inventoryFilter: rejected
+@property NSMutableArray *tags;
+@property int generation;
+@property double historyIntervalSeconds;
+//! A tag not found for this long is no longer visible
+@property double visibleSeconds;
+
+@end
+
+@implementation SimulatedReaderTransport {
+    ReaderSimulator _simulator;
+    BOOL _simulatorRunning;
+    EpcFilter *_readerFilter;
+    ReaderSimulatorStats _statsAtReset;
+    RawFind *_stepFinds;
+    // Main thread only
+    EpcTable _found;
+    TagFindBatch _subsequentFinds;
+    // _found.count, kept for getDiagnosticData, which can be called from any thread
+    uint32_t _foundCount;
+}
+
+- (id) init {
+    ReaderSimulatorConfig config;
+    ReaderSimulatorDefaultConfig(&config);
+    return [self initWithConfig:&config];
+}
+
+- (id) initWithConfig:(const ReaderSimulatorConfig *)config {
+    self = [super init];
+    if (self) {
+        self.config = *config;
+        self.speed = 1;
+        self.queue = dispatch_queue_create("SimulatedReaderTransport", DISPATCH_QUEUE_SERIAL);
+        // One semaphore for the transport's life: every step that takes it gives it back,
+        // whatever inventory it belonged to, so restarting never unbalances it
+        self.stepsInFlight = dispatch_semaphore_create(MAX_STEPS_IN_FLIGHT);
+        self.tags = [NSMutableArray array];
+        _stepFinds = malloc(SIMULATION_STEP_MAX_FINDS * sizeof(RawFind));
+        if (!_stepFinds || !EpcTableInit(&_found, 1024) || !TagFindBatchInit(&_subsequentFinds)) {
+            return nil;
+        }
+    }
+    return self;
+}
+
+- (void) dealloc {
+    if (_simulatorRunning) {
+        ReaderSimulatorFree(&_simulator);
+    }
+    EpcFilterFree(_readerFilter);
+    free(_stepFinds);
+    EpcTableFree(&_found);
+    TagFindBatchFree(&_subsequentFinds);
+}
+
+- (ReaderSimulatorStats) stats {
+    __block ReaderSimulatorStats stats;
+    dispatch_sync(self.queue, ^{
+        stats = self->_simulator.stats;
+    });
+    return stats;
+}
+
+#pragma mark - Connection
+
+- (void) openConnection {
+    self.isConnected = YES;
+}
+
+- (void) closeConnection {
+    [self stopInventoryWithCompletion:nil];
+    self.isConnected = NO;
+}
+
+#pragma mark - Inventory
+
+- (UgiInventory *) startInventory:(id<UgiInventoryDelegate>)delegate
+                withConfiguration:(UgiRfidConfiguration *)configuration
+                         withEpcs:(NSArray *)epcs {
+    [self startWithDelegate:delegate configuration:configuration epcs:epcs ignore:NO];
+    return nil;
+}
+
+- (UgiInventory *) startInventoryIgnoringEpcs:(id<UgiInventoryDelegate>)delegate
+                            withConfiguration:(UgiRfidConfiguration *)configuration
+                             withEpcsToIgnore:(NSArray *)epcsToIgnore {
+    [self startWithDelegate:delegate configuration:configuration epcs:epcsToIgnore ignore:YES];
+    return nil;
+}
+
+- (void) startWithDelegate:(id<UgiInventoryDelegate>)delegate
+             configuration:(UgiRfidConfiguration *)configuration
+                      epcs:(NSArray *)epcs
+                    ignore:(BOOL)ignore {
+    // Like the reader, an EPC list filters before anything reaches the host
+    EpcFilter *readerFilter = NULL;
+    if (epcs.count > 0) {
+        EpcKey *keys = malloc(epcs.count * sizeof(EpcKey));
+        if (keys) {
+            uint32_t count = 0;
+            for (UgiEpc *epc in epcs) {
+                keys[count++] = [epc epcKey];
+            }
+            readerFilter = EpcFilterCreate(keys, count, ignore);
+            free(keys);
+        }
+        if (!readerFilter) {
+            [self failStartWithDelegate:delegate];
+            return;
+        }
+    }
+
+    self.generation++;
+    int generation = self.generation;
+    self.delegate = delegate;
+    self.historyIntervalSeconds = (configuration.historyIntervalMSec > 0 ? configuration.historyIntervalMSec : 500) / 1000.0;
+    self.visibleSeconds = self.historyIntervalSeconds *
+                          (configuration.historyDepth > 0 ? configuration.historyDepth : DEFAULT_HISTORY_DEPTH);
+    EpcTableRemoveAll(&_found);
+    __atomic_store_n(&_foundCount, 0, __ATOMIC_RELAXED);
+    TagFindBatchReset(&_subsequentFinds);
+    [self.tags removeAllObjects];
+
+    ReaderSimulatorConfig config = self.config;
+    double startTimestamp = CFAbsoluteTimeGetCurrent();
+    dispatch_async(self.queue, ^{
+        if (self->_simulatorRunning) {
+            ReaderSimulatorFree(&self->_simulator);
+        }
+        self->_simulatorRunning = ReaderSimulatorInit(&self->_simulator, &config, startTimestamp);
+        memset(&self->_statsAtReset, 0, sizeof(self->_statsAtReset));
+        EpcFilterFree(self->_readerFilter);
+        self->_readerFilter = readerFilter;
+    });
+    if ([delegate respondsToSelector:@selector(inventoryDidStart)]) {
+        [delegate inventoryDidStart];
+    }
+    [self scheduleStep:generation];
+}
+
+//
+// Without its EPC list the inventory would report every tag, so it doesn't start:
+// whatever was running stops and the delegate hears the start failed, as it does when
+// the SDK can't send the inventory command
+//
+- (void) failStartWithDelegate:(id<UgiInventoryDelegate>)delegate {
+    self.generation++;
+    self.delegate = nil;
+    // Through the simulation queue, so it comes after any stop already on its way
+    dispatch_async(self.queue, ^{
+        dispatch_async(dispatch_get_main_queue(), ^{
+            if ([delegate respondsToSelector:@selector(inventoryDidStopWithResult:)]) {
+                [delegate inventoryDidStopWithResult:UGI_INVENTORY_COMPLETED_ERROR_SENDING];
+            }
+        });
+    });
+}
+
+- (void) stopInventoryWithCompletion:(StopInventoryCompletion)completion {
+    self.generation++;
+    id<UgiInventoryDelegate> delegate = self.delegate;
+    self.delegate = nil;
+    // Anything already queued on the simulation queue runs first
+    dispatch_async(self.queue, ^{
+        dispatch_async(dispatch_get_main_queue(), ^{
+            if ([delegate respondsToSelector:@selector(inventoryDidStopWithResult:)]) {
+                [delegate inventoryDidStopWithResult:UGI_INVENTORY_COMPLETED_OK];
+            }
+            if (completion) {
+                completion();
+            }
+        });
+    });
+}
+
+- (void) scheduleStep:(int)generation {
+    double delay = self.speed > 0 ? SIMULATION_STEP_SECONDS / self.speed : 0;
+    dispatch_after(dispatch_time(DISPATCH_TIME_NOW, (int64_t)(delay * NSEC_PER_SEC)), self.queue, ^{
+        [self runStep:generation];
+    });
+}
+
+//
+// On the simulation queue
+//
+- (void) runStep:(int)generation {
+    if (generation != self.generation || !_simulatorRunning) {
+        return;
+    }
+    // Let the main thread catch up, without blocking this queue (getDiagnosticData syncs onto it)
+    if (dispatch_semaphore_wait(self.stepsInFlight, DISPATCH_TIME_NOW) != 0) {
+        dispatch_after(dispatch_time(DISPATCH_TIME_NOW, NSEC_PER_MSEC), self.queue, ^{
+            [self runStep:generation];
+        });
+        return;
+    }
+
+    id<UgiInventoryDelegate> delegate = self.delegate;
+    // Delegates that take the whole find get frequency and RSSI too
+    BOOL rawFindFilter = [delegate respondsToSelector:@selector(inventoryFilterRawFind:)];
+    BOOL lowLevelFilter = !rawFindFilter && [delegate respondsToSelector:@selector(inventoryFilterLowLevel:)];
+    double previousTime = _simulator.time;
+    RawFind *finds = _stepFinds;
+    uint32_t count = ReaderSimulatorRun(&_simulator, SIMULATION_STEP_SECONDS, finds, SIMULATION_STEP_MAX_FINDS);
+
+    uint32_t kept = 0;
+    for (uint32_t i = 0; i < count; i++) {
+        if (_readerFilter && !EpcFilterAccepts(_readerFilter, &finds[i].epc)) {
+            continue;
+        }
+        if (rawFindFilter && [(id<RawFindFilter>)delegate inventoryFilterRawFind:&finds[i]]) {
+            continue;
+        }
+        if (lowLevelFilter && [delegate inventoryFilterLowLevel:[UgiEpc epcFromKey:&finds[i].epc]]) {
+            continue;
+        }
+        finds[kept++] = finds[i];
+    }
+    NSData *findsData = [NSData dataWithBytes:finds length:kept * sizeof(RawFind)];
+    double now = _simulator.startTimestamp + _simulator.time;
+    BOOL historyInterval = floor(_simulator.time / self.historyIntervalSeconds) >
+                           floor(previousTime / self.historyIntervalSeconds);
+    BOOL finished = self.durationSeconds > 0 && _simulator.time >= self.durationSeconds;
+
+    dispatch_async(dispatch_get_main_queue(), ^{
+        if (generation == self.generation) {
+            [self deliverFinds:findsData historyInterval:historyInterval now:now];
+            if (finished) {
+                [self stopInventoryWithCompletion:nil];
+            }
+        }
+        dispatch_semaphore_signal(self.stepsInFlight);
+    });
+    if (!finished) {
+        [self scheduleStep:generation];
+    }
+}
+
+//
+// On the main thread: the bookkeeping the SDK does before calling the delegate
+//
+- (void) deliverFinds:(NSData *)findsData
+      historyInterval:(BOOL)historyInterval
+                  now:(double)now {
+    id<UgiInventoryDelegate> delegate = self.delegate;
+    const RawFind *finds = findsData.bytes;
+    uint32_t count = (uint32_t)(findsData.length / sizeof(RawFind));
+
+    for (uint32_t i = 0; i < count; i++) {
+        bool inserted;
+        uint32_t index = EpcTableInsert(&_found, &finds[i].epc, &inserted);
+        if (index == EPC_TABLE_NOT_FOUND) {
+            continue;
+        }
+        if (inserted) {
+            SimulatedTag *tag = [[SimulatedTag alloc] initWithEpc:[UgiEpc epcFromKey:&finds[i].epc]
+                                                        firstRead:[NSDate dateWithTimeIntervalSinceReferenceDate:finds[i].timestamp]];
+            // A rejected tag keeps its slot, so indexes still match _found, but is never reported again
+            if ([delegate respondsToSelector:@selector(inventoryFilter:)] && [delegate inventoryFilter:tag.epc]) {
+                [self.tags addObject:[NSNull null]];
+                continue;
+            }
+            [self.tags addObject:tag];
+            if ([delegate respondsToSelector:@selector(inventoryTagFound:withDetailedPerReadData:)]) {
+                [delegate inventoryTagFound:tag withDetailedPerReadData:nil];
+            }
+            if ([delegate respondsToSelector:@selector(inventoryTagChanged:isFirstFind:)]) {
+                [delegate inventoryTagChanged:tag isFirstFind:YES];
+            }
+        } else {
+            SimulatedTag *tag = self.tags[index];
+            if ((id)tag == [NSNull null]) {
+                continue;
+            }
+            tag.lastFindTimestamp = finds[i].timestamp;
+            if (!tag.simulatedVisible) {
+                tag.simulatedVisible = YES;
+                if ([delegate respondsToSelector:@selector(inventoryTagChanged:isFirstFind:)]) {
+                    [delegate inventoryTagChanged:tag isFirstFind:NO];
+                }
+            }
+            TagFindBatchAdd(&_subsequentFinds, index, 1, finds[i].rssiI, finds[i].rssiQ);
+        }
+    }
+
+    if ([delegate respondsToSelector:@selector(inventoryTagSubsequentFinds:numFinds:withDetailedPerReadData:)]) {
+        for (uint32_t i = 0; i < _subsequentFinds.count; i++) {
+            [delegate inventoryTagSubsequentFinds:self.tags[_subsequentFinds.tagIndexes[i]]
+                                         numFinds:_subsequentFinds.numFinds[i]
+                          withDetailedPerReadData:nil];
+        }
+    }
+    TagFindBatchReset(&_subsequentFinds);
+    __atomic_store_n(&_foundCount, _found.count, __ATOMIC_RELAXED);
+
+    if (historyInterval) {
+        [self updateVisibility:now];
+        if ([delegate respondsToSelector:@selector(inventoryHistoryInterval)]) {
+            [delegate inventoryHistoryInterval];
+        }
+    }
+}
+
+//
+// On the main thread, each history interval: tags not found lately are no longer visible
+//
+- (void) updateVisibility:(double)now {
+    id<UgiInventoryDelegate> delegate = self.delegate;
+    BOOL reportChanges = [delegate respondsToSelector:@selector(inventoryTagChanged:isFirstFind:)];
+    for (SimulatedTag *tag in self.tags) {
+        if ((id)tag == [NSNull null] || !tag.simulatedVisible || now - tag.lastFindTimestamp <= self.visibleSeconds) {
+            continue;
+        }
+        tag.simulatedVisible = NO;
+        if (reportChanges) {
+            [delegate inventoryTagChanged:tag isFirstFind:NO];
+        }
+    }
+}
+
+#pragma mark - Diagnostic data
+
+- (BOOL) getDiagnosticData:(UgiDiagnosticData *)data
+             resetCounters:(BOOL)reset {
+    __block ReaderSimulatorStats stats, atReset;
+    dispatch_sync(self.queue, ^{
+        stats = self->_simulator.stats;
+        atReset = self->_statsAtReset;
+        if (reset) {
+            self->_statsAtReset = stats;
+        }
+    });
+    memset(data, 0, sizeof(*data));
+    data->byteProtocolSkewFactor = 1;
+    data->packetProtocolPacketsSent = (int)(stats.packetsSent - atReset.packetsSent);
+    data->packetProtocolPacketsReceived = (int)(stats.packetsReceived - atReset.packetsReceived);
+    data->packetProtocolCrcMismatches = (int)(stats.crcMismatches - atReset.crcMismatches);
+    data->packetProtocolSendFailures = (int)(stats.packetsLost - atReset.packetsLost);
+    data->rawInventoryRounds = (int)(stats.inventoryRounds - atReset.inventoryRounds);
+    data->rawTagFinds = (int)(stats.rawTagFinds - atReset.rawTagFinds);
+    data->inventoryUnique = (int)__atomic_load_n(&_foundCount, __ATOMIC_RELAXED);
+    return self.isConnected;
+}
+
+@end
@@ -0,0 +1,94 @@
+//
+//  TagFindBatch.c
+//  FlowTrial
+//
+//  Created by Wade Sellers on 12/18/14.
+//  Copyright (c) 2014 Wade Sellers. All rights reserved.
+//
+
+#include "TagFindBatch.h"
+
+#include <stdlib.h>
+#include <string.h>
+
+#define TAG_FIND_BATCH_INITIAL_CAPACITY 256
+
+static bool growEntries(TagFindBatch *batch) {
+    uint32_t capacity = batch->capacity ? batch->capacity * 2 : TAG_FIND_BATCH_INITIAL_CAPACITY;
+    uint32_t *tagIndexes = realloc(batch->tagIndexes, capacity * sizeof(uint32_t));
+    if (tagIndexes) batch->tagIndexes = tagIndexes;
+    int32_t *numFinds = realloc(batch->numFinds, capacity * sizeof(int32_t));
+    if (numFinds) batch->numFinds = numFinds;
+    double *rssiI = realloc(batch->rssiI, capacity * sizeof(double));
+    if (rssiI) batch->rssiI = rssiI;
+    double *rssiQ = realloc(batch->rssiQ, capacity * sizeof(double));
+    if (rssiQ) batch->rssiQ = rssiQ;
+    if (!tagIndexes || !numFinds || !rssiI || !rssiQ) {
+        return false;
+    }
+    batch->capacity = capacity;
+    return true;
+}
+
+static bool growTags(TagFindBatch *batch, uint32_t tagIndex) {
+    uint32_t tagCapacity = batch->tagCapacity ? batch->tagCapacity : TAG_FIND_BATCH_INITIAL_CAPACITY;
+    while (tagCapacity <= tagIndex) {
+        tagCapacity *= 2;
+    }
+    uint32_t *entryForTag = realloc(batch->entryForTag, tagCapacity * sizeof(uint32_t));
+    if (!entryForTag) {
+        return false;
+    }
+    memset(entryForTag + batch->tagCapacity, 0, (tagCapacity - batch->tagCapacity) * sizeof(uint32_t));
+    batch->entryForTag = entryForTag;
+    batch->tagCapacity = tagCapacity;
+    return true;
+}
+
+bool TagFindBatchInit(TagFindBatch *batch) {
+    memset(batch, 0, sizeof(*batch));
+    if (!growEntries(batch) || !growTags(batch, 0)) {
+        TagFindBatchFree(batch);
+        return false;
+    }
+    return true;
+}
+
+void TagFindBatchFree(TagFindBatch *batch) {
+    free(batch->tagIndexes);
+    free(batch->numFinds);
+    free(batch->rssiI);
+    free(batch->rssiQ);
+    free(batch->entryForTag);
+    memset(batch, 0, sizeof(*batch));
+}
+
+bool TagFindBatchAdd(TagFindBatch *batch, uint32_t tagIndex, int32_t numFinds, double rssiI, double rssiQ) {
+    if (tagIndex >= batch->tagCapacity && !growTags(batch, tagIndex)) {
+        return false;
+    }
+    uint32_t entry = batch->entryForTag[tagIndex];
+    if (entry == 0) {
+        if (batch->count == batch->capacity && !growEntries(batch)) {
+            return false;
+        }
+        entry = ++batch->count;
+        batch->entryForTag[tagIndex] = entry;
+        batch->tagIndexes[entry - 1] = tagIndex;
+        batch->numFinds[entry - 1] = 0;
+    }
+    batch->numFinds[entry - 1] += numFinds;
+    batch->rssiI[entry - 1] = rssiI;
+    batch->rssiQ[entry - 1] = rssiQ;
+    batch->totalFinds += (uint32_t)numFinds;
+    return true;
+}
+
+void TagFindBatchReset(TagFindBatch *batch) {
+    // Clear only the entries that were used rather than the whole per-tag array
+    for (uint32_t i = 0; i < batch->count; i++) {
+        batch->entryForTag[batch->tagIndexes[i]] = 0;
+    }
+    batch->count = 0;
+    batch->totalFinds = 0;
+}
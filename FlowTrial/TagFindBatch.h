@@ -0,0 +1,64 @@
+//
+//  TagFindBatch.h
+//  FlowTrial
+//
+//  Created by Wade Sellers on 12/18/14.
+//  Copyright (c) 2014 Wade Sellers. All rights reserved.
+//
+
+#ifndef FlowTrial_TagFindBatch_h
+#define FlowTrial_TagFindBatch_h
+
+#include <stdbool.h>
+#include <stdint.h>
+
+/**
+ Subsequent finds collected over one flush window, as parallel arrays.
+
+ Each tag appears at most once per batch: repeat finds within the window are added
+ to its entry and the RSSI is the most recent one. Tags are identified by their index
+ in InventoryController.tags.
+ */
+typedef struct {
+    uint32_t count;           //!< Number of entries
+    uint32_t *tagIndexes;     //!< Index of each tag in InventoryController.tags
+    int32_t *numFinds;        //!< Finds for each tag during the window
+    double *rssiI;            //!< Most recent RSSI, I channel
+    double *rssiQ;            //!< Most recent RSSI, Q channel
+    uint32_t totalFinds;      //!< Sum of numFinds
+    // private
+    uint32_t capacity;
+    uint32_t *entryForTag;    //!< Entry + 1 for each tag index, 0 if the tag is not in the batch
+    uint32_t tagCapacity;
+} TagFindBatch;
+
+/**
+ Initialize a batch
+
+ @return  false if out of memory
+ */
+bool TagFindBatchInit(TagFindBatch *batch);
+
+/**
+ Free a batch's memory
+ */
+void TagFindBatchFree(TagFindBatch *batch);
+
+/**
+ Add finds for a tag
+
+ @param batch     Batch to add to
+ @param tagIndex  Index of the tag
+ @param numFinds  Number of finds
+ @param rssiI     RSSI, I channel
+ @param rssiQ     RSSI, Q channel
+ @return          false if out of memory (the finds are dropped)
+ */
+bool TagFindBatchAdd(TagFindBatch *batch, uint32_t tagIndex, int32_t numFinds, double rssiI, double rssiQ);
+
+/**
+ Empty the batch for the next window, keeping the memory
+ */
+void TagFindBatchReset(TagFindBatch *batch);
+
+#endif
@@ -0,0 +1,76 @@
+//
+//  TagIndex.h
+//  FlowTrial
+//
+//  Created by Wade Sellers on 12/17/14.
+//  Copyright (c) 2014 Wade Sellers. All rights reserved.
+//
+
+#import <Foundation/Foundation.h>
+#import "Ugi.h"
+#import "EpcKey.h"
+
+/**
+ TagIndex holds the tags found during an inventory, keyed by EPC.
+
+ Lookups go through an EpcTable (open addressing on EpcKey), and tags are kept in
+ find order in one array, so the array can be handed out without copying. Each tag
+ also gets a stable small-integer index (its position in that array) that other
+ per-tag storage can be keyed by.
+
+ Not thread safe: use it from the main thread, where the inventory delegate runs.
+ */
+@interface TagIndex : NSObject
+
+//! Tags in the order they were found. This is the live array, copy it to keep a snapshot
+@property (readonly, nonatomic) NSArray *tags;
+
+//! Number of tags
+@property (readonly, nonatomic) NSUInteger count;
+
+/**
+ Add a tag
+
+ @param tag  Tag to add
+ @return     Index of the tag, or NSNotFound if the tag's EPC is already present
+ */
+- (NSUInteger) addTag:(UgiTag *)tag;
+
+/**
+ Get the tag for an EPC
+
+ @param epc  EPC to find
+ @return     Tag, or nil if not present
+ */
+- (UgiTag *) tagForEpc:(UgiEpc *)epc;
+
+/**
+ Get the tag for an EPC key
+
+ @param key  EPC to find
+ @return     Tag, or nil if not present
+ */
+- (UgiTag *) tagForKey:(const EpcKey *)key;
+
+/**
+ Get the index of an EPC key
+
+ @param key  EPC to find
+ @return     Index (position in tags), or NSNotFound if not present
+ */
+- (NSUInteger) indexOfKey:(const EpcKey *)key;
+
+/**
+ Get the EPC key of the tag at an index
+
+ @param index  Index of the tag
+ @return       Pointer to the key, valid until the next addTag:
+ */
+- (const EpcKey *) keyAtIndex:(NSUInteger)index;
+
+/**
+ Remove all tags
+ */
+- (void) removeAllTags;
+
+@end
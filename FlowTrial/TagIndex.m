@@ -0,0 +1,82 @@
+//
+//  TagIndex.m
+//  FlowTrial
+//
+//  Created by Wade Sellers on 12/17/14.
+//  Copyright (c) 2014 Wade Sellers. All rights reserved.
+//
+
+#import "TagIndex.h"
+#import "EpcTable.h"
+#import "UgiEpc+EpcKey.h"
+
+@interface TagIndex ()
+
+@property NSMutableArray *mutableTags;
+
+@end
+
+@implementation TagIndex {
+    EpcTable _table;
+}
+
+- (id) init {
+    self = [super init];
+    if (self) {
+        if (!EpcTableInit(&_table, 256)) {
+            return nil;
+        }
+        self.mutableTags = [NSMutableArray arrayWithCapacity:256];
+    }
+    return self;
+}
+
+- (void) dealloc {
+    EpcTableFree(&_table);
+}
+
+- (NSArray *) tags {
+    return self.mutableTags;
+}
+
+- (NSUInteger) count {
+    return _table.count;
+}
+
+- (NSUInteger) addTag:(UgiTag *)tag {
+    EpcKey key = [tag.epc epcKey];
+    bool inserted;
+    uint32_t index = EpcTableInsert(&_table, &key, &inserted);
+    if (!inserted) {
+        return NSNotFound;
+    }
+    [self.mutableTags addObject:tag];
+    return index;
+}
+
+- (UgiTag *) tagForEpc:(UgiEpc *)epc {
+    EpcKey key = [epc epcKey];
+    return [self tagForKey:&key];
+}
+
+- (UgiTag *) tagForKey:(const EpcKey *)key {
+    uint32_t index = EpcTableFind(&_table, key);
+    return index == EPC_TABLE_NOT_FOUND ? nil : self.mutableTags[index];
+}
+
+- (NSUInteger) indexOfKey:(const EpcKey *)key {
+    uint32_t index = EpcTableFind(&_table, key);
+    return index == EPC_TABLE_NOT_FOUND ? NSNotFound : index;
+}
+
+- (const EpcKey *) keyAtIndex:(NSUInteger)index {
+    NSParameterAssert(index < _table.count);
+    return &_table.keys[index];
+}
+
+- (void) removeAllTags {
+    EpcTableRemoveAll(&_table);
+    [self.mutableTags removeAllObjects];
+}
+
+@end
@@ -0,0 +1,34 @@
+//
+//  UgiEpc+EpcKey.h
+//  FlowTrial
+//
+//  Created by Wade Sellers on 12/16/14.
+//  Copyright (c) 2014 Wade Sellers. All rights reserved.
+//
+
+#import <Foundation/Foundation.h>
+#import "UgiEpc.h"
+#import "EpcKey.h"
+
+/**
+ Bridge between the SDK's UgiEpc and the app's EpcKey value type. Code on the
+ inventory path converts once at the edge and works with EpcKey from then on.
+ */
+@interface UgiEpc (EpcKey)
+
+/**
+ Get the EPC as an EpcKey
+
+ @return  EpcKey with the same bytes
+ */
+- (EpcKey) epcKey;
+
+/**
+ Create a UgiEpc from an EpcKey (allocates, so keep this off hot paths)
+
+ @param key   Key to convert
+ @return      New UgiEpc object
+ */
++ (UgiEpc *) epcFromKey:(const EpcKey *)key;
+
+@end
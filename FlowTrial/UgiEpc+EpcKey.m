@@ -0,0 +1,24 @@
+//
+//  UgiEpc+EpcKey.m
+//  FlowTrial
+//
+//  Created by Wade Sellers on 12/16/14.
+//  Copyright (c) 2014 Wade Sellers. All rights reserved.
+//
+
+#import "UgiEpc+EpcKey.h"
+
+_Static_assert(EPC_KEY_MAX_LENGTH == UGI_MAX_EPC_LENGTH, "EpcKey must hold the longest UgiEpc");
+_Static_assert(sizeof(EpcKey) == 32, "EpcKey should stay 32 bytes");
+
+@implementation UgiEpc (EpcKey)
+
+- (EpcKey) epcKey {
+    return EpcKeyMake([self bytes], [self length]);
+}
+
++ (UgiEpc *) epcFromKey:(const EpcKey *)key {
+    return [UgiEpc epcFromBytes:[NSData dataWithBytes:key->bytes length:key->length]];
+}
+
+@end
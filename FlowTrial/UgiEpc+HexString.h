@@ -0,0 +1,88 @@
+//
+//  UgiEpc+HexString.h
+//  FlowTrial
+//
+//  Created by Wade Sellers on 12/22/14.
+//  Copyright (c) 2014 Wade Sellers. All rights reserved.
+//
+
+#import <Foundation/Foundation.h>
+#import "UgiEpc.h"
+#import "UgiTag.h"
+#import "UgiUtil.h"
+#import "EpcKey.h"
+
+/**
+ Hex string conversion through HexCodec. Same strings as toString / epcFromString:,
+ without building them a character at a time.
+ */
+@interface UgiEpc (HexString)
+
+/**
+ Convert to a string of hex digits (uppercase), like toString
+
+ @return  String of hex digits
+ */
+- (NSString *) hexString;
+
+/**
+ Create a UgiEpc from a string of hex digits (uppercase or lowercase), like epcFromString:
+
+ @param s   String to convert
+ @return    New UgiEpc object, nil if s is not an EPC in hex
+ */
++ (UgiEpc *) epcFromHexString:(NSString *)s;
+
+/**
+ Convert an EpcKey to a string of hex digits (uppercase)
+
+ @param key   EPC
+ @return      String of hex digits
+ */
++ (NSString *) hexStringForKey:(const EpcKey *)key;
+
+/**
+ Parse a string of hex digits into an EpcKey, without creating any objects
+
+ @param s     String to convert
+ @param key   Set to the EPC
+ @return      NO if s is not an EPC in hex
+ */
++ (BOOL) parseHexString:(NSString *)s
+                  toKey:(EpcKey *)key;
+
+@end
+
+/**
+ HexCodec versions of UgiUtil's dataToString: and stringToData:, with the same strings
+ */
+@interface UgiUtil (HexString)
+
+/**
+ Convert NSData to a string of hex digits (uppercase)
+
+ @param data    Data to convert
+ @return        String of hex digits
+ */
++ (NSString *) hexStringForData:(NSData *)data;
+
+/**
+ Convert a string of hex digits (uppercase or lowercase) to NSData
+
+ @param s   String to convert
+ @return    Data, nil if s is not hex
+ */
++ (NSData *) dataFromHexString:(NSString *)s;
+
+@end
+
+/**
+ The tag's EPC as a hex string, made once per tag and kept with it, for code that
+ logs, displays or uploads the same tags over and over. Main thread only.
+ */
+@interface UgiTag (EpcString)
+
+//! The EPC as a string of hex digits (uppercase)
+- (NSString *) epcString;
+
+@end
@@ -0,0 +1,141 @@
+//
+//  UgiEpc+HexString.m
+//  FlowTrial
+//
+//  Created by Wade Sellers on 12/22/14.
+//  Copyright (c) 2014 Wade Sellers. All rights reserved.
+//
+
+#import <objc/runtime.h>
+#import "UgiEpc+HexString.h"
+#import "HexCodec.h"
+
+static NSString *hexStringForBytes(const uint8_t *bytes, size_t length) {
+    char buffer[HEX_EPC_BUFFER_SIZE];
+    if (length > EPC_KEY_MAX_LENGTH) {
+        length = EPC_KEY_MAX_LENGTH;
+    }
+    HexEncode(bytes, length, buffer);
+    return [[NSString alloc] initWithBytes:buffer length:HEX_ENCODED_LENGTH(length) encoding:NSASCIIStringEncoding];
+}
+
+//
+// The string's characters as ASCII, read in place when the string is stored that way;
+// otherwise copied into buffer, or if that is too small, into *copy (the caller frees it)
+//
+static const char *asciiCharacters(NSString *s, char *buffer, size_t bufferSize, char **copy) {
+    CFStringRef string = (__bridge CFStringRef)s;
+    *copy = NULL;
+    const char *chars = CFStringGetCStringPtr(string, kCFStringEncodingASCII);
+    if (chars) {
+        return chars;
+    }
+    size_t size = (size_t)CFStringGetLength(string) + 1;
+    if (size > bufferSize) {
+        buffer = *copy = malloc(size);
+        if (!buffer) {
+            return NULL;
+        }
+    }
+    if (!CFStringGetCString(string, buffer, (CFIndex)size, kCFStringEncodingASCII)) {
+        free(*copy);
+        *copy = NULL;
+        return NULL;
+    }
+    return buffer;
+}
+
+@implementation UgiEpc (HexString)
+
+- (NSString *) hexString {
+    return hexStringForBytes([self bytes], (size_t)[self length]);
+}
+
++ (NSString *) hexStringForKey:(const EpcKey *)key {
+    return hexStringForBytes(key->bytes, key->length);
+}
+
++ (BOOL) parseHexString:(NSString *)s
+                  toKey:(EpcKey *)key {
+    CFStringRef string = (__bridge CFStringRef)s;
+    CFIndex hexLength = s ? CFStringGetLength(string) : 0;
+    if (hexLength == 0 || hexLength > EPC_KEY_MAX_LENGTH * 2) {
+        return NO;
+    }
+    // The length is checked above, so buffer always fits and nothing is copied to the heap
+    char buffer[HEX_EPC_BUFFER_SIZE];
+    char *copy;
+    const char *hex = asciiCharacters(s, buffer, sizeof(buffer), &copy);
+    if (!hex) {
+        return NO;
+    }
+    uint8_t bytes[EPC_KEY_MAX_LENGTH];
+    if (!HexDecode(hex, (size_t)hexLength, bytes)) {
+        return NO;
+    }
+    *key = EpcKeyMake(bytes, (int)(hexLength / 2));
+    return YES;
+}
+
++ (UgiEpc *) epcFromHexString:(NSString *)s {
+    EpcKey key;
+    if (![self parseHexString:s toKey:&key]) {
+        return nil;
+    }
+    return [UgiEpc epcFromBytes:[NSData dataWithBytes:key.bytes length:key.length]];
+}
+
+@end
+
+@implementation UgiUtil (HexString)
+
++ (NSString *) hexStringForData:(NSData *)data {
+    size_t length = HEX_ENCODED_LENGTH(data.length);
+    char *buffer = malloc(length ? length : 1);
+    if (!buffer) {
+        return nil;
+    }
+    HexEncode(data.bytes, data.length, buffer);
+    return [[NSString alloc] initWithBytesNoCopy:buffer length:length encoding:NSASCIIStringEncoding freeWhenDone:YES];
+}
+
++ (NSData *) dataFromHexString:(NSString *)s {
+    if (!s) {
+        return nil;
+    }
+    char buffer[HEX_EPC_BUFFER_SIZE];
+    char *copy;
+    const char *hex = asciiCharacters(s, buffer, sizeof(buffer), &copy);
+    if (!hex) {
+        return nil;
+    }
+    size_t hexLength = (size_t)CFStringGetLength((__bridge CFStringRef)s);
+    NSMutableData *data = [NSMutableData dataWithLength:hexLength / 2];
+    BOOL valid = HexDecode(hex, hexLength, data.mutableBytes);
+    free(copy);
+    return valid ? data : nil;
+}
+
+@end
+
+@implementation UgiTag (EpcString)
+
+static char epcStringKey;
+
+//
+// The string is kept with the EPC's data, not the tag: a tag whose EPC is rewritten
+// (programTag) gets a new UgiEpc, and a UgiEpc whose data is set gets a new NSData,
+// so either way the cache is missed rather than stale
+//
+- (NSString *) epcString {
+    UgiEpc *epc = self.epc;
+    NSData *data = epc.data;
+    NSString *string = objc_getAssociatedObject(data, &epcStringKey);
+    if (!string && data) {
+        string = [epc hexString];
+        objc_setAssociatedObject(data, &epcStringKey, string, OBJC_ASSOCIATION_RETAIN_NONATOMIC);
+    }
+    return string;
+}
+
+@end
@@ -0,0 +1,17 @@
+//
+//  UgiReaderTransport.h
+//  FlowTrial
+//
+//  Created by Wade Sellers on 12/20/14.
+//  Copyright (c) 2014 Wade Sellers. All rights reserved.
+//
+
+#import <Foundation/Foundation.h>
+#import "ReaderTransport.h"
+
+/**
+ ReaderTransport for a real Grokker, through the Ugi singleton
+ */
+@interface UgiReaderTransport : NSObject <ReaderTransport>
+
+@end
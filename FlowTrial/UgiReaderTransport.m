@@ -0,0 +1,56 @@
+//
+//  UgiReaderTransport.m
+//  FlowTrial
+//
+//  Created by Wade Sellers on 12/20/14.
+//  Copyright (c) 2014 Wade Sellers. All rights reserved.
+//
+
+#import "UgiReaderTransport.h"
+
+@implementation UgiReaderTransport
+
+- (BOOL) isConnected {
+    return [Ugi singleton].isConnected;
+}
+
+- (void) openConnection {
+    [[Ugi singleton] openConnection];
+}
+
+- (void) closeConnection {
+    [[Ugi singleton] closeConnection];
+}
+
+- (UgiInventory *) startInventory:(id<UgiInventoryDelegate>)delegate
+                withConfiguration:(UgiRfidConfiguration *)configuration
+                         withEpcs:(NSArray *)epcs {
+    if (epcs.count == 0) {
+        return [[Ugi singleton] startInventory:delegate withConfiguration:configuration];
+    }
+    return [[Ugi singleton] startInventory:delegate withConfiguration:configuration withEpcs:epcs];
+}
+
+- (UgiInventory *) startInventoryIgnoringEpcs:(id<UgiInventoryDelegate>)delegate
+                            withConfiguration:(UgiRfidConfiguration *)configuration
+                             withEpcsToIgnore:(NSArray *)epcsToIgnore {
+    return [[Ugi singleton] startInventoryIgnoringEpcs:delegate
+                                     withConfiguration:configuration
+                                      withEpcsToIgnore:epcsToIgnore];
+}
+
+- (void) stopInventoryWithCompletion:(StopInventoryCompletion)completion {
+    UgiInventory *inventory = [Ugi singleton].activeInventory;
+    if (inventory) {
+        [inventory stopInventoryWithCompletion:completion];
+    } else if (completion) {
+        completion();
+    }
+}
+
+- (BOOL) getDiagnosticData:(UgiDiagnosticData *)data
+             resetCounters:(BOOL)reset {
+    return [[Ugi singleton] getDiagnosticData:data resetCounters:reset];
+}
+
+@end
@@ -6,9 +6,30 @@
 //  Copyright (c) 2014 Wade Sellers. All rights reserved.
 //
 
+#import <QuartzCore/QuartzCore.h>
+#import <Bolts/BFExecutor.h>
 #import "UserHomeScreenVC.h"
+#import "BarcodeSearchController.h"
+#import "Formatters.h"
+#import "InventoryController.h"
+#import "InventoryPrefetcher.h"
+#import "InventoryRecorder.h"
+#import "InventoryStore.h"
+#import "OfflineWriteQueue.h"
+#import "UgiEpc+EpcKey.h"
+#import "UgiEpc+HexString.h"
+#import "VisibleTagList.h"
 
-@interface UserHomeScreenVC () <UISearchBarDelegate>                                                                                                                                                                                                                                                            
+//! Reuse identifier of the visible plant cells
+static NSString * const PlantCellIdentifier = @"PlantCell";
+
+//
+// A frame's changes touching more rows than this are shown with reloadData rather than
+// row animations (animating thousands of rows at once costs more than redrawing the screen)
+//
+#define MAX_ANIMATED_ROW_CHANGES 100
+
+@interface UserHomeScreenVC () <UISearchBarDelegate, UITableViewDataSource, UITableViewDelegate, UITextFieldDelegate, InventoryControllerDelegate, BarcodeSearchControllerDelegate>                                                                                                                                                                                                                                                            
 @property (weak, nonatomic) IBOutlet UISearchBar *searchBar;
 
 @property (weak, nonatomic) IBOutlet UITextField *nameTextField;
@@ -19,7 +40,14 @@
 @property (weak, nonatomic) IBOutlet UITextField *floweringTextField;
 
 @property NSArray *parsedItems;
-@property PFObject *displayedItem;
+@property InventoryItem *displayedItem;
+
+@property UITableView *plantTableView;
+@property VisibleTagList *visibleTags;
+@property CADisplayLink *displayLink;
+@property InventoryPrefetcher *prefetcher;
+@property BarcodeSearchController *barcodeSearch;
+@property InventoryRecorder *recorder;
 
 @end
 
@@ -28,50 +56,228 @@
 - (void)viewDidLoad {
     [super viewDidLoad];
     NSLog(@"%@", self.user);
+
+    // Every plant tag in range, below the selected item's details
+    self.visibleTags = [[VisibleTagList alloc] init];
+    self.prefetcher = [[InventoryPrefetcher alloc] initWithResolver:
+                       [[InventoryResolver alloc] initWithStore:[InventoryStore sharedStore]]];
+    self.barcodeSearch = [[BarcodeSearchController alloc] initWithStore:[InventoryStore sharedStore]];
+    self.barcodeSearch.delegate = self;
+    self.phaseTextField.delegate = self;
+    self.plantTableView = [[UITableView alloc] initWithFrame:CGRectZero style:UITableViewStylePlain];
+    self.plantTableView.translatesAutoresizingMaskIntoConstraints = NO;
+    self.plantTableView.dataSource = self;
+    self.plantTableView.delegate = self;
+    [self.view addSubview:self.plantTableView];
+    NSDictionary *views = @{ @"above": self.floweringTextField,
+                             @"table": self.plantTableView,
+                             @"bottom": self.bottomLayoutGuide };
+    [self.view addConstraints:[NSLayoutConstraint constraintsWithVisualFormat:@"H:|[table]|"
+                                                                      options:0 metrics:nil views:views]];
+    [self.view addConstraints:[NSLayoutConstraint constraintsWithVisualFormat:@"V:[above]-8-[table][bottom]"
+                                                                      options:0 metrics:nil views:views]];
 }
 
-- (void)searchBarSearchButtonClicked:(UISearchBar *)searchBar {
-    [self parseForResults];
+- (void)viewWillAppear:(BOOL)animated {
+    [super viewWillAppear:animated];
+    [[NSNotificationCenter defaultCenter] addObserver:self
+                                             selector:@selector(inventoryStoreDidChange:)
+                                                 name:InventoryStoreDidChangeNotification
+                                               object:nil];
+
+    // Paused until there are visibility changes to show
+    self.displayLink = [CADisplayLink displayLinkWithTarget:self selector:@selector(showVisibilityChanges:)];
+    self.displayLink.paused = YES;
+    [self.displayLink addToRunLoop:[NSRunLoop mainRunLoop] forMode:NSRunLoopCommonModes];
 
+    InventoryController *inventoryController = [InventoryController singleton];
+    inventoryController.delegate = self;
+    // Recording every find is for audits; it is off unless turned on
+    if ([[NSUserDefaults standardUserDefaults] boolForKey:InventoryRecorderEnabledKey]) {
+        NSError *error;
+        self.recorder = [[InventoryRecorder alloc] initWithPath:[InventoryRecorder pathForNewSession] error:&error];
+        if (self.recorder) {
+            [self.recorder recordInventoryController:inventoryController];
+        } else {
+            NSLog(@"Can't record inventory: %@", error);
+        }
+    }
+    [inventoryController startInventoryWithConfiguration:
+     [UgiRfidConfiguration configWithInventoryType:UGI_INVENTORY_TYPE_INVENTORY_DISTANCE]];
 }
 
-- (void)parseForResults {
-    NSNumberFormatter *formatter = [[NSNumberFormatter alloc] init];
-    [formatter setNumberStyle:NSNumberFormatterDecimalStyle];
-    NSNumber *barcode = [formatter numberFromString:self.searchBar.text];
+- (void)viewWillDisappear:(BOOL)animated {
+    [super viewWillDisappear:animated];
+    [[NSNotificationCenter defaultCenter] removeObserver:self name:InventoryStoreDidChangeNotification object:nil];
 
-    PFQuery *query = [PFQuery queryWithClassName:@"Inventory"];
-    [query whereKey:@"barcode" equalTo:barcode];
-    [query findObjectsInBackgroundWithBlock:^(NSArray *objects, NSError *error) {
+    [self.barcodeSearch cancel];
+    InventoryController *inventoryController = [InventoryController singleton];
+    [inventoryController stopInventory];
+    if (inventoryController.delegate == self) {
+        inventoryController.delegate = nil;
+    }
+    // After stopping, which hands the recorder the last finds
+    [self.recorder closeWithCompletion:^(NSError *error) {
         if (error) {
-            NSLog(@"Error: %@", error.userInfo);
-        }
-        else {
-            self.parsedItems =  [[NSArray alloc] initWithArray:objects];
-            NSLog(@"list of items: %@", self.parsedItems);
-            self.displayedItem = [[PFObject alloc] initWithClassName:@"Inventory"];
-            self.displayedItem = [objects firstObject];
-
-            [self displayItemInformation];
+            NSLog(@"Inventory recording failed: %@", error);
         }
     }];
+    self.recorder = nil;
+    // The display link retains its target
+    [self.displayLink invalidate];
+    self.displayLink = nil;
+}
+
+- (void)searchBar:(UISearchBar *)searchBar textDidChange:(NSString *)searchText {
+    [self.barcodeSearch searchText:searchText];
+}
+
+- (void)searchBarSearchButtonClicked:(UISearchBar *)searchBar {
+    [self.barcodeSearch searchTextNow:searchBar.text];
+
+}
+
+- (void)barcodeSearch:(BarcodeSearchController *)controller
+           foundItems:(NSArray *)items
+           forBarcode:(NSNumber *)barcode
+            fromCache:(BOOL)fromCache {
+    [self showItems:items];
+}
+
+- (void)showItems:(NSArray *)items {
+    self.parsedItems = items;
+    NSLog(@"list of items: %@", self.parsedItems);
+    self.displayedItem = [items firstObject];
+
+    [self displayItemInformation];
 }
 
 - (void)displayItemInformation {
-    NSDateFormatter *dateFormatter = [[NSDateFormatter alloc] init];
-    [dateFormatter setDateFormat:@"MM/dd/yyyy"];
-    NSString *cloneDate = [dateFormatter stringFromDate:self.displayedItem[@"clone"]];
-    NSString *vegetativeDate = [dateFormatter stringFromDate:self.displayedItem[@"vegetative"]];
-    NSString *floweringDate = [dateFormatter stringFromDate:self.displayedItem[@"flowering"]];
-
-    self.nameTextField.text = self.displayedItem[@"name"];
-    self.ageTextField.text = [self.displayedItem[@"age"] stringValue];
-    self.phaseTextField.text = self.displayedItem[@"phase"];
+    NSString *cloneDate = [Formatters shortDateString:self.displayedItem.clone];
+    NSString *vegetativeDate = [Formatters shortDateString:self.displayedItem.vegetative];
+    NSString *floweringDate = [Formatters shortDateString:self.displayedItem.flowering];
+
+    self.nameTextField.text = self.displayedItem.name;
+    self.ageTextField.text = [self.displayedItem.age stringValue];
+    self.phaseTextField.text = self.displayedItem.phase;
     self.cloneTextField.text = cloneDate;
     self.vegetativeTextField.text = vegetativeDate;
     self.floweringTextField.text = floweringDate;
 }
 
+#pragma mark - Editing
+
+- (BOOL)textFieldShouldReturn:(UITextField *)textField {
+    [textField resignFirstResponder];
+    return YES;
+}
+
+//
+// A phase typed in for the shown plant is written through the offline queue; clone,
+// vegetative and flowering also date that phase today
+//
+- (void)textFieldDidEndEditing:(UITextField *)textField {
+    InventoryItem *item = self.displayedItem;
+    NSString *phase = [textField.text stringByTrimmingCharactersInSet:[NSCharacterSet whitespaceCharacterSet]];
+    if (textField != self.phaseTextField || !item.objectId || phase.length == 0 || [phase isEqualToString:item.phase]) {
+        return;
+    }
+    NSString *dateKey = [@[ @"clone", @"vegetative", @"flowering" ] containsObject:phase.lowercaseString] ? phase.lowercaseString : nil;
+    NSArray *moved = [[InventoryStore sharedStore] setPhase:phase
+                                                    dateKey:dateKey
+                                                       date:[NSDate date]
+                                                    ofItems:@[ item ]
+                                                      queue:[OfflineWriteQueue sharedQueue]];
+    self.displayedItem = [moved firstObject] ?: item;
+    [self displayItemInformation];
+}
+
+#pragma mark - Visible plants
+
+//
+// Once per frame while changes are coming in: apply them as one batch of row updates
+//
+- (void)showVisibilityChanges:(CADisplayLink *)displayLink {
+    VisibleTagListChanges *changes = [self.visibleTags applyPendingChanges];
+    if (!changes) {
+        displayLink.paused = YES;
+        return;
+    }
+    if (changes.deletedRows.count + changes.insertedRows.count > MAX_ANIMATED_ROW_CHANGES) {
+        [self.plantTableView reloadData];
+        return;
+    }
+    [self.plantTableView beginUpdates];
+    [self.plantTableView deleteRowsAtIndexPaths:[self indexPathsForRows:changes.deletedRows]
+                               withRowAnimation:UITableViewRowAnimationFade];
+    [self.plantTableView insertRowsAtIndexPaths:[self indexPathsForRows:changes.insertedRows]
+                               withRowAnimation:UITableViewRowAnimationFade];
+    [self.plantTableView endUpdates];
+}
+
+- (NSArray *)indexPathsForRows:(NSIndexSet *)rows {
+    NSMutableArray *indexPaths = [NSMutableArray arrayWithCapacity:rows.count];
+    [rows enumerateIndexesUsingBlock:^(NSUInteger row, BOOL *stop) {
+        [indexPaths addObject:[NSIndexPath indexPathForRow:row inSection:0]];
+    }];
+    return indexPaths;
+}
+
+//
+// Items may have arrived for rows on screen; only those cells are redrawn
+//
+- (void)inventoryStoreDidChange:(NSNotification *)notification {
+    NSArray *visibleRows = [self.plantTableView indexPathsForVisibleRows];
+    if (visibleRows.count > 0) {
+        [self.plantTableView reloadRowsAtIndexPaths:visibleRows withRowAnimation:UITableViewRowAnimationNone];
+    }
+}
+
+- (InventoryItem *)itemForTag:(UgiTag *)tag {
+    EpcKey key = [tag.epc epcKey];
+    return [[InventoryStore sharedStore] itemForEpcKey:&key];
+}
+
+#pragma mark - UITableViewDataSource
+
+- (NSInteger)tableView:(UITableView *)tableView numberOfRowsInSection:(NSInteger)section {
+    return self.visibleTags.rows.count;
+}
+
+- (UITableViewCell *)tableView:(UITableView *)tableView cellForRowAtIndexPath:(NSIndexPath *)indexPath {
+    UITableViewCell *cell = [tableView dequeueReusableCellWithIdentifier:PlantCellIdentifier];
+    if (!cell) {
+        cell = [[UITableViewCell alloc] initWithStyle:UITableViewCellStyleSubtitle reuseIdentifier:PlantCellIdentifier];
+    }
+    UgiTag *tag = self.visibleTags.rows[indexPath.row];
+    InventoryItem *item = [self itemForTag:tag];
+    if (item) {
+        cell.textLabel.text = item.name;
+        cell.detailTextLabel.text = item.phase;
+    } else {
+        cell.textLabel.text = tag.epcString;
+        cell.detailTextLabel.text = nil;
+    }
+    return cell;
+}
+
+#pragma mark - UITableViewDelegate
+
+- (void)tableView:(UITableView *)tableView didSelectRowAtIndexPath:(NSIndexPath *)indexPath {
+    [tableView deselectRowAtIndexPath:indexPath animated:YES];
+    // Usually prefetched already; if not, fetched ahead of everything else
+    UgiTag *tag = self.visibleTags.rows[indexPath.row];
+    [[self.prefetcher itemForTag:tag] continueWithExecutor:[BFExecutor mainThreadExecutor]
+                                                 withBlock:^id(BFTask *task) {
+        if (task.error) {
+            NSLog(@"Error: %@", task.error.userInfo);
+        } else if (task.result) {
+            self.displayedItem = task.result;
+            [self displayItemInformation];
+        }
+        return nil;
+    }];
+}
 
 #pragma mark - UGrokIt delegate methods
 - (id) init {
@@ -80,9 +286,21 @@
     return self;
 }
 
+- (void) inventoryDidStart {
+    [self.prefetcher removeAllPending];
+    [self.visibleTags removeAllTags];
+    [self.plantTableView reloadData];
+}
 
+- (void) inventoryTagFound:(UgiTag *)tag
+   withDetailedPerReadData:(NSArray *)detailedPerReadData {
+    [self.prefetcher tagFound:tag withDetailedPerReadData:detailedPerReadData];
+}
 
-
-
+- (void) inventoryTagChanged:(UgiTag *)tag
+                 isFirstFind:(BOOL)firstFind {
+    [self.visibleTags setTag:tag visible:tag.isVisible];
+    self.displayLink.paused = NO;
+}
 
 @end
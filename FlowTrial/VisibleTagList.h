@@ -0,0 +1,65 @@
+//
+//  VisibleTagList.h
+//  FlowTrial
+//
+//  Created by Wade Sellers on 12/31/14.
+//  Copyright (c) 2014 Wade Sellers. All rights reserved.
+//
+
+#import <Foundation/Foundation.h>
+#import "Ugi.h"
+
+/**
+ Rows to delete and insert to bring a list view up to date, in the form
+ UITableView's beginUpdates/endUpdates expects
+ */
+@interface VisibleTagListChanges : NSObject
+
+//! Rows deleted, as positions before the changes
+@property (readonly, nonatomic) NSIndexSet *deletedRows;
+
+//! Rows inserted, as positions after the changes
+@property (readonly, nonatomic) NSIndexSet *insertedRows;
+
+@end
+
+/**
+ The tags currently visible, as rows for a list view.
+
+ Visibility changes are only recorded as they come in (one per inventoryTagChanged:),
+ then applied together, typically once per display frame: a tag that appears and
+ disappears between two frames never reaches the list view, and each frame's changes
+ become one batch of row deletions and insertions. Rows keep their order; tags that
+ become visible are added at the end, so no row ever moves.
+
+ Tags are identified by EPC. Not thread safe: use it from the main thread.
+ */
+@interface VisibleTagList : NSObject
+
+//! Visible tags (UgiTag), as of the last applyPendingChanges. This is the live array
+@property (readonly, nonatomic) NSArray *rows;
+
+//! Are there changes not applied yet?
+@property (readonly, nonatomic) BOOL hasPendingChanges;
+
+/**
+ Record that a tag became visible or stopped being visible
+
+ @param tag      Tag
+ @param visible  Is the tag visible now?
+ */
+- (void) setTag:(UgiTag *)tag visible:(BOOL)visible;
+
+/**
+ Apply the changes recorded since the last call to rows
+
+ @return  Rows deleted and inserted, nil if rows did not change
+ */
+- (VisibleTagListChanges *) applyPendingChanges;
+
+/**
+ Remove every tag, for a new inventory
+ */
+- (void) removeAllTags;
+
+@end
@@ -0,0 +1,212 @@
+//
+//  VisibleTagList.m
+//  FlowTrial
+//
+//  Created by Wade Sellers on 12/31/14.
+//  Copyright (c) 2014 Wade Sellers. All rights reserved.
+//
+
+#import "VisibleTagList.h"
+#import "EpcTable.h"
+#import "UgiEpc+EpcKey.h"
+
+#define INITIAL_CAPACITY 256
+
+//! Row of a tag that is not in rows
+#define NOT_A_ROW UINT32_MAX
+
+/**
+ What the list knows about one EPC. Slots are positions in the EpcTable, so they stay
+ put for the whole inventory while rows come and go.
+ */
+typedef struct {
+    uint32_t row;           //!< Position in rows, NOT_A_ROW if not there
+    uint8_t visible;        //!< Latest visibility reported
+    uint8_t pending;        //!< In pendingSlots
+} VisibleTagSlot;
+
+@interface VisibleTagListChanges ()
+
+@property (readwrite, nonatomic) NSIndexSet *deletedRows;
+@property (readwrite, nonatomic) NSIndexSet *insertedRows;
+
+@end
+
+@implementation VisibleTagListChanges
+@end
+
+@interface VisibleTagList ()
+
+@property NSMutableArray *mutableRows;
+@property NSMutableArray *tagsBySlot;
+
+@end
+
+@implementation VisibleTagList {
+    EpcTable _table;
+    VisibleTagSlot *_slots;
+    uint32_t _slotCapacity;
+    uint32_t *_rowSlots;            // Slot of each row
+    uint32_t _rowCapacity;
+    uint32_t *_pendingSlots;        // Slots changed since the last apply, in the order they changed
+    uint32_t _pendingCount;
+}
+
+- (id) init {
+    self = [super init];
+    if (self) {
+        if (!EpcTableInit(&_table, INITIAL_CAPACITY)) {
+            return nil;
+        }
+        self.mutableRows = [NSMutableArray arrayWithCapacity:INITIAL_CAPACITY];
+        self.tagsBySlot = [NSMutableArray arrayWithCapacity:INITIAL_CAPACITY];
+    }
+    return self;
+}
+
+- (void) dealloc {
+    EpcTableFree(&_table);
+    free(_slots);
+    free(_rowSlots);
+    free(_pendingSlots);
+}
+
+- (NSArray *) rows {
+    return self.mutableRows;
+}
+
+- (BOOL) hasPendingChanges {
+    return _pendingCount > 0;
+}
+
+//
+// Make room for count slots (pendingSlots can hold every slot, since each is in it at most once)
+//
+- (BOOL) reserveSlots:(uint32_t)count {
+    if (count <= _slotCapacity) {
+        return YES;
+    }
+    uint32_t capacity = MAX(_slotCapacity * 2, INITIAL_CAPACITY);
+    while (capacity < count) {
+        capacity *= 2;
+    }
+    VisibleTagSlot *slots = realloc(_slots, capacity * sizeof(VisibleTagSlot));
+    if (slots) {
+        _slots = slots;
+    }
+    uint32_t *pendingSlots = realloc(_pendingSlots, capacity * sizeof(uint32_t));
+    if (pendingSlots) {
+        _pendingSlots = pendingSlots;
+    }
+    if (!slots || !pendingSlots) {
+        return NO;
+    }
+    _slotCapacity = capacity;
+    return YES;
+}
+
+- (BOOL) reserveRows:(uint32_t)count {
+    if (count <= _rowCapacity) {
+        return YES;
+    }
+    uint32_t capacity = MAX(_rowCapacity * 2, INITIAL_CAPACITY);
+    while (capacity < count) {
+        capacity *= 2;
+    }
+    uint32_t *rowSlots = realloc(_rowSlots, capacity * sizeof(uint32_t));
+    if (!rowSlots) {
+        return NO;
+    }
+    _rowSlots = rowSlots;
+    _rowCapacity = capacity;
+    return YES;
+}
+
+- (void) setTag:(UgiTag *)tag visible:(BOOL)visible {
+    EpcKey key = [tag.epc epcKey];
+    // Room for a new slot first: a key in the table must always have one
+    if (![self reserveSlots:_table.count + 1]) {
+        return;
+    }
+    bool inserted;
+    uint32_t slot = EpcTableInsert(&_table, &key, &inserted);
+    if (slot == EPC_TABLE_NOT_FOUND) {
+        return;
+    }
+    if (inserted) {
+        _slots[slot].row = NOT_A_ROW;
+        _slots[slot].pending = 0;
+        [self.tagsBySlot addObject:tag];
+    } else {
+        self.tagsBySlot[slot] = tag;
+    }
+    _slots[slot].visible = visible ? 1 : 0;
+    if (!_slots[slot].pending) {
+        _slots[slot].pending = 1;
+        _pendingSlots[_pendingCount++] = slot;
+    }
+}
+
+- (VisibleTagListChanges *) applyPendingChanges {
+    NSMutableIndexSet *deletedRows = [NSMutableIndexSet indexSet];
+    NSMutableIndexSet *insertedRows = [NSMutableIndexSet indexSet];
+
+    // Deletions first, in old positions; compact rows and their slots in one pass
+    uint32_t insertCount = 0;
+    for (uint32_t i = 0; i < _pendingCount; i++) {
+        VisibleTagSlot *slot = &_slots[_pendingSlots[i]];
+        if (!slot->visible && slot->row != NOT_A_ROW) {
+            [deletedRows addIndex:slot->row];
+            slot->row = NOT_A_ROW;
+        } else if (slot->visible && slot->row == NOT_A_ROW) {
+            insertCount++;
+        }
+    }
+    if (deletedRows.count > 0) {
+        uint32_t rowCount = (uint32_t)self.mutableRows.count;
+        uint32_t kept = 0;
+        for (uint32_t row = 0; row < rowCount; row++) {
+            uint32_t slot = _rowSlots[row];
+            if (_slots[slot].row != NOT_A_ROW) {
+                _rowSlots[kept] = slot;
+                _slots[slot].row = kept++;
+            }
+        }
+        [self.mutableRows removeObjectsAtIndexes:deletedRows];
+    }
+
+    // Then insertions at the end, in new positions
+    uint32_t rowCount = (uint32_t)self.mutableRows.count;
+    if (insertCount > 0 && [self reserveRows:rowCount + insertCount]) {
+        for (uint32_t i = 0; i < _pendingCount; i++) {
+            uint32_t slot = _pendingSlots[i];
+            if (_slots[slot].visible && _slots[slot].row == NOT_A_ROW) {
+                _rowSlots[rowCount] = slot;
+                _slots[slot].row = rowCount;
+                [self.mutableRows addObject:self.tagsBySlot[slot]];
+                [insertedRows addIndex:rowCount++];
+            }
+        }
+    }
+    for (uint32_t i = 0; i < _pendingCount; i++) {
+        _slots[_pendingSlots[i]].pending = 0;
+    }
+    _pendingCount = 0;
+
+    if (deletedRows.count == 0 && insertedRows.count == 0) {
+        return nil;
+    }
+    VisibleTagListChanges *changes = [[VisibleTagListChanges alloc] init];
+    changes.deletedRows = deletedRows;
+    changes.insertedRows = insertedRows;
+    return changes;
+}
+
+- (void) removeAllTags {
+    EpcTableRemoveAll(&_table);
+    [self.tagsBySlot removeAllObjects];
+    [self.mutableRows removeAllObjects];
+    _pendingCount = 0;
+}
+
+@end
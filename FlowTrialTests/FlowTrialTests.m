@@ -8,6 +8,189 @@
 
 #import <UIKit/UIKit.h>
 #import <XCTest/XCTest.h>
+#import "EpcKey.h"
+#import "UgiEpc+EpcKey.h"
+#import "EpcTable.h"
+#import "TagFindBatch.h"
+#import "ReadHistorySlab.h"
+#import "RawFindQueue.h"
+#import "EpcFilter.h"
+#import "ReaderSimulator.h"
+#import "InventoryController.h"
+#import "SimulatedReaderTransport.h"
+#import "UgiReaderTransport.h"
+#import "HexCodec.h"
+#import "UgiEpc+HexString.h"
+#import "UgiUtil.h"
+#import "SessionWriter.h"
+#import "SessionReader.h"
+#import "JsonPlan.h"
+#import "JsonReader.h"
+#import "JsonModelReader.h"
+#import "JournaledJsonRoot.h"
+#import "BarcodeIndex.h"
+#import "Formatters.h"
+#import "VisibleTagList.h"
+#import "PrefetchQueue.h"
+#import "OfflineWriteQueue.h"
+#import "BarcodeSearchController.h"
+#import "BulkSaver.h"
+#import "LocalLoginService.h"
+#import "CloudLoginService.h"
+#import "InventoryItem.h"
+#import "InventoryResolver.h"
+#import "ReaderCommandQueue.h"
+#import <Bolts/BFTaskCompletionSource.h>
+#import "UgiJson.h"
+
+//! A store-like root for the journal tests
+@interface JournalTestRoot : JournaledJsonRoot
+
+@property (nonatomic) NSString *storeName;
+@property (nonatomic) int visits;
+@property (nonatomic) NSMutableArray *barcodes;
+
+@end
+
+@implementation JournalTestRoot
+@end
+
+//! A nested model whose hooks look at the context, for the JsonPlan parity test
+@interface PlanTestPart : UgiJsonModelBase
+
+@property (nonatomic) NSString *label;
+@property (nonatomic) int count;
+@property (weak, nonatomic) id seenRoot;
+UGI_FIELD_IGNORE(seenRoot);
+
+@end
+
+@implementation PlanTestPart
+
+- (BOOL) shouldSerializeField:(NSString *)fieldName value:(id)value context:(NSMutableDictionary *)context {
+    self.seenRoot = context[(id)UGI_CONTEXT_ROOT_OBJECT];
+    return !([fieldName isEqualToString:@"count"] && [value intValue] == 0);
+}
+
+@end
+
+//! A root model that sets up the context for its parts
+@interface PlanTestModel : UgiJsonModelBase
+
+@property (nonatomic) NSString *name;
+@property (nonatomic) int age;
+@property (nonatomic) BOOL secret;
+@property (nonatomic) long long barcode;
+@property (nonatomic) NSArray *parts;
+
+@end
+
+@implementation PlanTestModel
+
+- (void) prepareSerializationContext:(NSMutableDictionary *)context {
+    context[@"hideAge"] = @YES;
+}
+
+- (BOOL) shouldSerializeField:(NSString *)fieldName value:(id)value context:(NSMutableDictionary *)context {
+    if ([fieldName isEqualToString:@"age"]) {
+        return ![context[@"hideAge"] boolValue];
+    }
+    return ![fieldName isEqualToString:@"secret"];
+}
+
+@end
+
+//! A tag with just an EPC, for the visible tag list tests
+@interface ListTestTag : UgiTag
+
+- (id) initWithEpc:(UgiEpc *)epc;
+
+@end
+
+@implementation ListTestTag {
+    UgiEpc *_testEpc;
+}
+
+- (id) initWithEpc:(UgiEpc *)epc {
+    self = [super init];
+    if (self) {
+        _testEpc = epc;
+    }
+    return self;
+}
+
+- (UgiEpc *) epc {
+    return _testEpc;
+}
+
+@end
+
+//! Tags with EPCs 3000...0000 to 3000...n-1
+static NSArray *listTestTags(int count) {
+    NSMutableArray *tags = [NSMutableArray arrayWithCapacity:count];
+    for (int i = 0; i < count; i++) {
+        uint8_t bytes[12] = { 0x30, 0, 0, 0, 0, 0, 0, 0, 0, 0, (uint8_t)(i >> 8), (uint8_t)i };
+        EpcKey key = EpcKeyMake(bytes, sizeof(bytes));
+        [tags addObject:[[ListTestTag alloc] initWithEpc:[UgiEpc epcFromKey:&key]]];
+    }
+    return tags;
+}
+
+//! Waits for inventory to stop, for the InventoryController tests
+@interface StopTestDelegate : NSObject <InventoryControllerDelegate>
+
+@property (nonatomic) XCTestExpectation *stopped;
+
+@end
+
+@implementation StopTestDelegate
+
+- (void) inventoryDidStopWithResult:(UgiInventoryCompletedReturnValues)result {
+    [self.stopped fulfill];
+}
+
+@end
+
+//! A query that answers when the test says, for the barcode search and resolver tests
+@interface SearchTestQuery : PFQuery
+
+@property (nonatomic) NSNumber *barcode;
+@property (nonatomic) NSArray *values;
+@property (nonatomic) BFTaskCompletionSource *source;
+@property (nonatomic) BOOL cancelled;
+
+@end
+
+@implementation SearchTestQuery
+
+- (BFTask *) findObjectsInBackground {
+    self.source = [BFTaskCompletionSource taskCompletionSource];
+    return self.source.task;
+}
+
+- (void) cancel {
+    self.cancelled = YES;
+}
+
+@end
+
+//! Records what a barcode search reports
+@interface SearchTestDelegate : NSObject <BarcodeSearchControllerDelegate>
+
+@property (nonatomic) NSMutableArray *barcodes;
+
+@end
+
+@implementation SearchTestDelegate
+
+- (void) barcodeSearch:(BarcodeSearchController *)controller
+            foundItems:(NSArray *)items
+            forBarcode:(NSNumber *)barcode
+             fromCache:(BOOL)fromCache {
+    [self.barcodes addObject:barcode];
+}
+
+@end
 
 @interface FlowTrialTests : XCTestCase
 
@@ -37,4 +220,1712 @@
     }];
 }
 
+#pragma mark - EpcKey
+
+static void fillEpcBytes(uint8_t *bytes, int i) {
+    memset(bytes, 0, UGI_STANDARD_EPC_LENGTH);
+    bytes[0] = 0xE2;
+    bytes[8] = (uint8_t)(i >> 24);
+    bytes[9] = (uint8_t)(i >> 16);
+    bytes[10] = (uint8_t)(i >> 8);
+    bytes[11] = (uint8_t)i;
+}
+
+- (void)testEpcKeyMatchesUgiEpc {
+    uint8_t bytes[UGI_STANDARD_EPC_LENGTH];
+    fillEpcBytes(bytes, 1234);
+    UgiEpc *epc = [UgiEpc epcFromBytes:[NSData dataWithBytes:bytes length:sizeof(bytes)]];
+    EpcKey key = [epc epcKey];
+    EpcKey same = EpcKeyMake(bytes, sizeof(bytes));
+    XCTAssertEqual(key.length, UGI_STANDARD_EPC_LENGTH);
+    XCTAssertTrue(EpcKeyEqual(&key, &same));
+    XCTAssertEqualObjects([[UgiEpc epcFromKey:&key] hexString], [epc hexString]);
+
+    EpcKey shorter = EpcKeyMake(bytes, sizeof(bytes) - 1);
+    XCTAssertFalse(EpcKeyEqual(&key, &shorter));
+    XCTAssertTrue(EpcKeyCompare(&shorter, &key) < 0);
+}
+
+// Baseline for testEpcKeyPerformance: what each find costs when it goes through UgiEpc
+- (void)testUgiEpcPerformance {
+    [self measureBlock:^{
+        uint8_t bytes[UGI_STANDARD_EPC_LENGTH];
+        fillEpcBytes(bytes, 0);
+        UgiEpc *previous = [UgiEpc epcFromBytes:[NSData dataWithBytes:bytes length:sizeof(bytes)]];
+        int matches = 0;
+        for (int i = 0; i < 100000; i++) {
+            fillEpcBytes(bytes, i % 1000);
+            UgiEpc *epc = [UgiEpc epcFromBytes:[NSData dataWithBytes:bytes length:sizeof(bytes)]];
+            if ([epc.data isEqualToData:previous.data]) matches++;
+            previous = epc;
+        }
+        XCTAssertEqual(matches, 0);
+    }];
+}
+
+- (void)testEpcKeyPerformance {
+    [self measureBlock:^{
+        uint8_t bytes[UGI_STANDARD_EPC_LENGTH];
+        fillEpcBytes(bytes, 0);
+        EpcKey previous = EpcKeyMake(bytes, sizeof(bytes));
+        int matches = 0;
+        for (int i = 0; i < 100000; i++) {
+            fillEpcBytes(bytes, i % 1000);
+            EpcKey key = EpcKeyMake(bytes, sizeof(bytes));
+            if (EpcKeyEqual(&key, &previous)) matches++;
+            previous = key;
+        }
+        XCTAssertEqual(matches, 0);
+    }];
+}
+
+#pragma mark - EpcTable
+
+- (void)testEpcTableLookup {
+    EpcTable table;
+    XCTAssertTrue(EpcTableInit(&table, 0));
+    uint8_t bytes[UGI_STANDARD_EPC_LENGTH];
+    for (int i = 0; i < 10000; i++) {
+        fillEpcBytes(bytes, i);
+        EpcKey key = EpcKeyMake(bytes, sizeof(bytes));
+        bool inserted;
+        XCTAssertEqual(EpcTableInsert(&table, &key, &inserted), (uint32_t)i);
+        XCTAssertTrue(inserted);
+    }
+    for (int i = 0; i < 10000; i++) {
+        fillEpcBytes(bytes, i);
+        EpcKey key = EpcKeyMake(bytes, sizeof(bytes));
+        XCTAssertEqual(EpcTableFind(&table, &key), (uint32_t)i);
+    }
+    fillEpcBytes(bytes, 10000);
+    EpcKey missing = EpcKeyMake(bytes, sizeof(bytes));
+    XCTAssertEqual(EpcTableFind(&table, &missing), EPC_TABLE_NOT_FOUND);
+    EpcTableFree(&table);
+}
+
+//
+// Lookup and iteration at 1k/10k/100k tags, EpcTable against an NSDictionary keyed
+// by NSData (what UgiEpc-keyed lookups cost). Timings are logged for comparison.
+//
+- (void)testEpcTableScaling {
+    uint8_t bytes[UGI_STANDARD_EPC_LENGTH];
+    for (int numTags = 1000; numTags <= 100000; numTags *= 10) {
+        EpcKey *keys = malloc(numTags * sizeof(EpcKey));
+        NSMutableArray *datas = [NSMutableArray arrayWithCapacity:numTags];
+        for (int i = 0; i < numTags; i++) {
+            fillEpcBytes(bytes, i * 7919);
+            keys[i] = EpcKeyMake(bytes, sizeof(bytes));
+            [datas addObject:[NSData dataWithBytes:bytes length:sizeof(bytes)]];
+        }
+
+        EpcTable table;
+        EpcTableInit(&table, 0);
+        NSMutableDictionary *dictionary = [NSMutableDictionary dictionaryWithCapacity:numTags];
+        for (int i = 0; i < numTags; i++) {
+            EpcTableInsert(&table, &keys[i], NULL);
+            dictionary[datas[i]] = @(i);
+        }
+
+        CFAbsoluteTime start = CFAbsoluteTimeGetCurrent();
+        uint32_t found = 0;
+        for (int i = 0; i < numTags; i++) {
+            found += EpcTableFind(&table, &keys[i]) != EPC_TABLE_NOT_FOUND;
+        }
+        CFAbsoluteTime tableLookup = CFAbsoluteTimeGetCurrent() - start;
+
+        start = CFAbsoluteTimeGetCurrent();
+        uint32_t checksum = 0;
+        for (uint32_t i = 0; i < table.count; i++) {
+            checksum += table.keys[i].hash;
+        }
+        CFAbsoluteTime tableIterate = CFAbsoluteTimeGetCurrent() - start;
+
+        start = CFAbsoluteTimeGetCurrent();
+        NSUInteger dictionaryFound = 0;
+        for (int i = 0; i < numTags; i++) {
+            dictionaryFound += dictionary[datas[i]] != nil;
+        }
+        CFAbsoluteTime dictionaryLookup = CFAbsoluteTimeGetCurrent() - start;
+
+        start = CFAbsoluteTimeGetCurrent();
+        NSUInteger dictionaryChecksum = 0;
+        for (NSData *data in dictionary) {
+            dictionaryChecksum += data.length;
+        }
+        CFAbsoluteTime dictionaryIterate = CFAbsoluteTimeGetCurrent() - start;
+
+        XCTAssertEqual(found, (uint32_t)numTags);
+        XCTAssertEqual(dictionaryFound, (NSUInteger)numTags);
+        NSLog(@"%6d tags: lookup %.1f ns (NSDictionary %.1f ns), iterate %.1f ns (NSDictionary %.1f ns), checksum %u/%lu",
+              numTags,
+              tableLookup * 1e9 / numTags, dictionaryLookup * 1e9 / numTags,
+              tableIterate * 1e9 / numTags, dictionaryIterate * 1e9 / numTags,
+              checksum, (unsigned long)dictionaryChecksum);
+
+        EpcTableFree(&table);
+        free(keys);
+    }
+}
+
+#pragma mark - TagFindBatch
+
+- (void)testTagFindBatchCoalescesRepeatFinds {
+    TagFindBatch batch;
+    XCTAssertTrue(TagFindBatchInit(&batch));
+    for (uint32_t tagIndex = 0; tagIndex < 2000; tagIndex++) {
+        TagFindBatchAdd(&batch, tagIndex, 1, -60, -61);
+        TagFindBatchAdd(&batch, tagIndex, 2, -50, -51);
+    }
+    XCTAssertEqual(batch.count, 2000u);
+    XCTAssertEqual(batch.totalFinds, 6000u);
+    XCTAssertEqual(batch.tagIndexes[1999], 1999u);
+    XCTAssertEqual(batch.numFinds[1999], 3);
+    XCTAssertEqual(batch.rssiI[1999], -50.0);
+
+    TagFindBatchReset(&batch);
+    XCTAssertEqual(batch.count, 0u);
+    TagFindBatchAdd(&batch, 7, 1, -70, -71);
+    XCTAssertEqual(batch.count, 1u);
+    XCTAssertEqual(batch.numFinds[0], 1);
+    TagFindBatchFree(&batch);
+}
+
+#pragma mark - ReadHistorySlab
+
+- (void)testReadHistorySlabWindow {
+    ReadHistorySlab slab;
+    XCTAssertTrue(ReadHistorySlabInit(&slab, 3, 0));
+    ReadHistorySlabRecord(&slab, 5, 2);
+    ReadHistoryView first = ReadHistorySlabView(&slab, 5);
+    ReadHistorySlabAdvance(&slab);
+    ReadHistorySlabRecord(&slab, 5, 1);
+    ReadHistorySlabRecord(&slab, 500, 4);
+
+    ReadHistoryView view = ReadHistorySlabView(&slab, 5);
+    XCTAssertEqual(ReadHistoryViewCount(view, 0), 1u);
+    XCTAssertEqual(ReadHistoryViewCount(view, 1), 2u);
+    XCTAssertEqual(ReadHistoryViewCount(first, 0), 2u);
+    XCTAssertEqual(ReadHistoryViewCount(ReadHistorySlabView(&slab, 500), 0), 4u);
+
+    ReadHistorySlabAdvance(&slab);
+    ReadHistorySlabAdvance(&slab);
+    XCTAssertEqual(ReadHistoryViewCount(first, 0), 0u);
+    XCTAssertTrue(ReadHistorySlabIsVisible(&slab, 5));
+    ReadHistorySlabAdvance(&slab);
+    XCTAssertFalse(ReadHistorySlabIsVisible(&slab, 5));
+    XCTAssertFalse(ReadHistorySlabIsVisible(&slab, 500));
+    XCTAssertEqual(slab.totalReads[5], 3u);
+    ReadHistorySlabFree(&slab);
+}
+
+- (void)testReadHistorySlabCountsPastUInt16 {
+    ReadHistorySlab slab;
+    XCTAssertTrue(ReadHistorySlabInit(&slab, 2, 0));
+    ReadHistorySlabRecord(&slab, 0, 70000);
+    ReadHistorySlabRecord(&slab, 0, 5000);
+    XCTAssertEqual(ReadHistoryViewCount(ReadHistorySlabView(&slab, 0), 0), 75000u);
+    XCTAssertEqual(slab.windowTotals[0], 75000u);
+    ReadHistorySlabRecord(&slab, 1, UINT32_MAX);
+    ReadHistorySlabRecord(&slab, 1, 1);
+    XCTAssertEqual(ReadHistoryViewCount(ReadHistorySlabView(&slab, 1), 0), UINT32_MAX);
+    ReadHistorySlabAdvance(&slab);
+    ReadHistorySlabAdvance(&slab);
+    XCTAssertFalse(ReadHistorySlabIsVisible(&slab, 1));
+    ReadHistorySlabFree(&slab);
+}
+
+// historyDepth 20 with 10k tags: one interval tick should be microseconds
+- (void)testReadHistorySlabAdvancePerformance {
+    __block ReadHistorySlab slab;
+    ReadHistorySlabInit(&slab, 20, 10000);
+    for (uint32_t i = 0; i < 10000; i++) {
+        ReadHistorySlabRecord(&slab, i, 1);
+    }
+    [self measureBlock:^{
+        for (int i = 0; i < 1000; i++) {
+            ReadHistorySlabRecord(&slab, (uint32_t)i * 7 % 10000, 1);
+            ReadHistorySlabAdvance(&slab);
+        }
+    }];
+    ReadHistorySlabFree(&slab);
+}
+
+#pragma mark - RawFindQueue
+
+- (void)testRawFindQueueDropsWhenFull {
+    RawFindQueue queue;
+    XCTAssertTrue(RawFindQueueInit(&queue, 16));
+    RawFind find;
+    memset(&find, 0, sizeof(find));
+    for (int i = 0; i < 20; i++) {
+        find.frequency = i;
+        XCTAssertEqual(RawFindQueuePush(&queue, &find), i < 16);
+    }
+    RawFind finds[32];
+    XCTAssertEqual(RawFindQueuePop(&queue, finds, 32), 16u);
+    XCTAssertEqual(finds[15].frequency, 15);
+
+    RawFindQueueStats stats;
+    RawFindQueueGetStats(&queue, &stats);
+    XCTAssertEqual(stats.pushed, 16ull);
+    XCTAssertEqual(stats.dropped, 4ull);
+    XCTAssertEqual(stats.popped, 16ull);
+    XCTAssertEqual(stats.highWater, 16u);
+    RawFindQueueFree(&queue);
+}
+
+- (void)testRawFindQueueHighWaterIsTrueDepth {
+    RawFindQueue queue;
+    XCTAssertTrue(RawFindQueueInit(&queue, 64));
+    RawFind find;
+    memset(&find, 0, sizeof(find));
+    RawFind finds[64];
+    // Never more than one waiting, however stale the producer's view of the head
+    for (int i = 0; i < 200; i++) {
+        XCTAssertTrue(RawFindQueuePush(&queue, &find));
+        XCTAssertEqual(RawFindQueuePop(&queue, finds, 64), 1u);
+    }
+    RawFindQueueStats stats;
+    RawFindQueueGetStats(&queue, &stats);
+    XCTAssertEqual(stats.highWater, 1u);
+
+    for (int i = 0; i < 10; i++) {
+        XCTAssertTrue(RawFindQueuePush(&queue, &find));
+    }
+    RawFindQueueGetStats(&queue, &stats);
+    XCTAssertEqual(stats.highWater, 10u);
+    XCTAssertEqual(stats.pushed, 210ull);
+    RawFindQueueFree(&queue);
+}
+
+- (void)testRawFindQueueAcrossThreads {
+    static const int numFinds = 1000000;
+    __block RawFindQueue queue;
+    XCTAssertTrue(RawFindQueueInit(&queue, 1024));
+    dispatch_async(dispatch_get_global_queue(DISPATCH_QUEUE_PRIORITY_HIGH, 0), ^{
+        RawFind find;
+        memset(&find, 0, sizeof(find));
+        for (int i = 0; i < numFinds; ) {
+            find.frequency = i;
+            if (RawFindQueuePush(&queue, &find)) {
+                i++;
+            }
+        }
+    });
+    RawFind finds[64];
+    int next = 0;
+    BOOL inOrder = YES;
+    while (next < numFinds) {
+        uint32_t count = RawFindQueuePop(&queue, finds, 64);
+        for (uint32_t i = 0; i < count; i++) {
+            inOrder = inOrder && finds[i].frequency == next;
+            next++;
+        }
+    }
+    XCTAssertTrue(inOrder);
+    RawFindQueueFree(&queue);
+}
+
+#pragma mark - EpcFilter
+
+- (void)testEpcFilterFindAndIgnore {
+    static const int numEpcs = 50000;
+    uint8_t bytes[UGI_STANDARD_EPC_LENGTH];
+    EpcKey *keys = malloc(numEpcs * sizeof(EpcKey));
+    for (int i = 0; i < numEpcs; i++) {
+        fillEpcBytes(bytes, i * 2);
+        keys[i] = EpcKeyMake(bytes, sizeof(bytes));
+    }
+    EpcFilter *find = EpcFilterCreate(keys, numEpcs, false);
+    EpcFilter *ignore = EpcFilterCreate(keys, numEpcs, true);
+    int acceptedOthers = 0;
+    for (int i = 0; i < numEpcs; i++) {
+        XCTAssertTrue(EpcFilterAccepts(find, &keys[i]));
+        XCTAssertFalse(EpcFilterAccepts(ignore, &keys[i]));
+        fillEpcBytes(bytes, i * 2 + 1);
+        EpcKey other = EpcKeyMake(bytes, sizeof(bytes));
+        acceptedOthers += EpcFilterAccepts(find, &other);
+        XCTAssertTrue(EpcFilterAccepts(ignore, &other));
+    }
+    XCTAssertEqual(acceptedOthers, 0);
+    EpcFilterFree(find);
+    EpcFilterFree(ignore);
+    free(keys);
+}
+
+- (void)testEpcFilterPerformance {
+    static const int numEpcs = 50000;
+    uint8_t bytes[UGI_STANDARD_EPC_LENGTH];
+    EpcKey *keys = malloc(numEpcs * 2 * sizeof(EpcKey));
+    for (int i = 0; i < numEpcs * 2; i++) {
+        fillEpcBytes(bytes, i);
+        keys[i] = EpcKeyMake(bytes, sizeof(bytes));
+    }
+    EpcFilter *filter = EpcFilterCreate(keys, numEpcs, false);
+    // The Bloom step alone passes under 1% of the EPCs not in the list
+    int falsePositives = 0;
+    for (int i = numEpcs; i < numEpcs * 2; i++) {
+        falsePositives += EpcFilterMayContain(filter, &keys[i]);
+    }
+    XCTAssertLessThan(falsePositives, numEpcs / 100);
+    [self measureBlock:^{
+        int accepted = 0;
+        for (int pass = 0; pass < 10; pass++) {
+            for (int i = 0; i < numEpcs * 2; i++) {
+                accepted += EpcFilterAccepts(filter, &keys[i]);
+            }
+        }
+        XCTAssertEqual(accepted, numEpcs * 10);
+    }];
+    EpcFilterFree(filter);
+    free(keys);
+}
+
+- (void)testReaderSimulatorIsDeterministic {
+    ReaderSimulatorConfig config;
+    ReaderSimulatorDefaultConfig(&config);
+    config.numTags = 500;
+    config.packetLossRate = 0.01;
+    config.crcErrorRate = 0.01;
+    static const uint32_t maxFinds = 100000;
+    RawFind *a = malloc(maxFinds * sizeof(RawFind));
+    RawFind *b = malloc(maxFinds * sizeof(RawFind));
+    ReaderSimulator simA, simB;
+    XCTAssertTrue(ReaderSimulatorInit(&simA, &config, 0));
+    XCTAssertTrue(ReaderSimulatorInit(&simB, &config, 0));
+    uint32_t countA = ReaderSimulatorRun(&simA, 2, a, maxFinds);
+    uint32_t countB = 0;
+    for (int i = 0; i < 200; i++) {
+        countB += ReaderSimulatorRun(&simB, 0.01, b + countB, maxFinds - countB);
+    }
+    XCTAssertGreaterThan(countA, 0);
+    XCTAssertEqual(countA, countB);
+    for (uint32_t i = 0; i < MIN(countA, countB); i++) {
+        XCTAssertTrue(EpcKeyEqual(&a[i].epc, &b[i].epc));
+    }
+    XCTAssertEqual(simA.stats.packetsSent, simA.stats.packetsReceived + simA.stats.packetsLost + simA.stats.crcMismatches);
+    XCTAssertEqual(simA.stats.rawTagFinds, countA);
+    ReaderSimulatorFree(&simA);
+    ReaderSimulatorFree(&simB);
+    free(a);
+    free(b);
+}
+
+- (void)testHexCodecMatchesUgiUtil {
+    uint8_t bytes[64], decoded[64];
+    char hex[HEX_ENCODED_LENGTH(64)];
+    for (int length = 0; length <= 64; length++) {
+        for (int i = 0; i < length; i++) {
+            bytes[i] = (uint8_t)arc4random();
+        }
+        HexEncode(bytes, length, hex);
+        NSString *expected = [UgiUtil bytesToString:bytes length:length];
+        XCTAssertEqualObjects([[NSString alloc] initWithBytes:hex length:length * 2 encoding:NSASCIIStringEncoding], expected);
+        NSString *lowercase = [expected lowercaseString];
+        XCTAssertTrue(HexDecode(lowercase.UTF8String, lowercase.length, decoded));
+        XCTAssertEqual(memcmp(bytes, decoded, length), 0);
+        NSData *data = [NSData dataWithBytes:bytes length:length];
+        XCTAssertEqualObjects([UgiUtil hexStringForData:data], [UgiUtil dataToString:data]);
+        XCTAssertEqualObjects([UgiUtil dataFromHexString:lowercase], [UgiUtil stringToData:expected]);
+    }
+    XCTAssertNil([UgiUtil dataFromHexString:@"E2G0"]);
+    XCTAssertFalse(HexDecode("E2003", 5, decoded));
+    XCTAssertFalse(HexDecode("E2003G11E2003411E2003411E2003411", 32, decoded));
+
+    uint8_t epcBytes[UGI_STANDARD_EPC_LENGTH];
+    fillEpcBytes(epcBytes, 12345);
+    UgiEpc *epc = [UgiEpc epcFromBytes:[NSData dataWithBytes:epcBytes length:sizeof(epcBytes)]];
+    XCTAssertEqualObjects([epc hexString], [epc toString]);
+    XCTAssertEqualObjects([UgiEpc epcFromHexString:[[epc toString] lowercaseString]].data, epc.data);
+    XCTAssertNil([UgiEpc epcFromHexString:@"E20"]);
+}
+
+- (void)testHexCodecPerformance {
+    static const int numEpcs = 50000;
+    uint8_t *bytes = malloc(numEpcs * UGI_STANDARD_EPC_LENGTH);
+    for (int i = 0; i < numEpcs; i++) {
+        fillEpcBytes(bytes + i * UGI_STANDARD_EPC_LENGTH, i);
+    }
+    [self measureBlock:^{
+        char hex[HEX_ENCODED_LENGTH(UGI_STANDARD_EPC_LENGTH)];
+        uint8_t decoded[UGI_STANDARD_EPC_LENGTH];
+        int matches = 0;
+        for (int i = 0; i < numEpcs; i++) {
+            HexEncode(bytes + i * UGI_STANDARD_EPC_LENGTH, UGI_STANDARD_EPC_LENGTH, hex);
+            HexDecode(hex, sizeof(hex), decoded);
+            matches += memcmp(decoded, bytes + i * UGI_STANDARD_EPC_LENGTH, UGI_STANDARD_EPC_LENGTH) == 0;
+        }
+        XCTAssertEqual(matches, numEpcs);
+    }];
+    free(bytes);
+}
+
+- (void)testSessionWriterWritesWholeBlocks {
+    ReaderSimulatorConfig config;
+    ReaderSimulatorDefaultConfig(&config);
+    config.numTags = 2000;
+    static const uint32_t maxFinds = 50000;
+    RawFind *finds = malloc(maxFinds * sizeof(RawFind));
+    ReaderSimulator simulator;
+    XCTAssertTrue(ReaderSimulatorInit(&simulator, &config, CFAbsoluteTimeGetCurrent()));
+    uint32_t count = ReaderSimulatorRun(&simulator, 30, finds, maxFinds);
+
+    NSString *path = [NSTemporaryDirectory() stringByAppendingPathComponent:@"testSessionWriter.session"];
+    SessionWriter writer;
+    XCTAssertTrue(SessionWriterOpen(&writer, path.fileSystemRepresentation));
+    for (uint32_t i = 0; i < count; i++) {
+        XCTAssertTrue(SessionWriterAppend(&writer, &finds[i]));
+    }
+    XCTAssertTrue(SessionWriterClose(&writer));
+    XCTAssertEqual(writer.stats.finds, count);
+
+    NSData *file = [NSData dataWithContentsOfFile:path];
+    XCTAssertEqual(file.length, writer.stats.blocks * SESSION_BLOCK_SIZE);
+    uint64_t findsInBlocks = 0;
+    for (NSUInteger offset = 0; offset < file.length; offset += SESSION_BLOCK_SIZE) {
+        const SessionBlockHeader *header = (const SessionBlockHeader *)((const uint8_t *)file.bytes + offset);
+        XCTAssertEqual(header->magic, SESSION_BLOCK_MAGIC);
+        XCTAssertEqual(header->blockNumber, offset / SESSION_BLOCK_SIZE);
+        XCTAssertLessThanOrEqual(header->columnOffsets[SESSION_COLUMN_COUNT], SESSION_BLOCK_SIZE);
+        findsInBlocks += header->numFinds;
+    }
+    XCTAssertEqual(findsInBlocks, count);
+    NSLog(@"%u finds in %llu bytes, %.1f bytes per find", count, writer.stats.bytes, (double)writer.stats.bytes / count);
+
+    [[NSFileManager defaultManager] removeItemAtPath:path error:nil];
+    ReaderSimulatorFree(&simulator);
+    free(finds);
+}
+
+- (void)testSessionReaderQueries {
+    ReaderSimulatorConfig config;
+    ReaderSimulatorDefaultConfig(&config);
+    config.numTags = 5000;
+    config.sweepSeconds = 120;
+    config.tagsInView = 100;
+    static const uint32_t maxFinds = 100000;
+    RawFind *finds = malloc(maxFinds * sizeof(RawFind));
+    ReaderSimulator simulator;
+    double start = CFAbsoluteTimeGetCurrent();
+    XCTAssertTrue(ReaderSimulatorInit(&simulator, &config, start));
+    uint32_t count = ReaderSimulatorRun(&simulator, 120, finds, maxFinds);
+
+    NSString *path = [NSTemporaryDirectory() stringByAppendingPathComponent:@"testSessionReader.session"];
+    SessionWriter writer;
+    XCTAssertTrue(SessionWriterOpen(&writer, path.fileSystemRepresentation));
+    for (uint32_t i = 0; i < count; i++) {
+        SessionWriterAppend(&writer, &finds[i]);
+    }
+    XCTAssertTrue(SessionWriterClose(&writer));
+
+    SessionReader reader;
+    XCTAssertTrue(SessionReaderOpen(&reader, path.fileSystemRepresentation));
+    XCTAssertEqual(reader.numFinds, count);
+
+    // Last seen, against a scan of the finds
+    for (uint32_t tag = 0; tag < config.numTags; tag += 101) {
+        EpcKey key = ReaderSimulatorTagEpc(&config, tag);
+        double expected = 0, lastSeen = 0;
+        for (uint32_t i = 0; i < count; i++) {
+            if (EpcKeyEqual(&finds[i].epc, &key)) {
+                expected = finds[i].timestamp;
+            }
+        }
+        XCTAssertEqual(SessionReaderLastSeen(&reader, &key, &lastSeen), expected != 0);
+        XCTAssertEqualWithAccuracy(lastSeen, expected, 1e-6);
+    }
+
+    // Seen between, against a scan of the finds
+    double from = start + 30.5, to = start + 41.25;
+    EpcTable seen, expected;
+    EpcTableInit(&seen, 64);
+    EpcTableInit(&expected, 64);
+    XCTAssertTrue(SessionReaderEpcsSeenBetween(&reader, from, to, &seen));
+    bool inserted;
+    for (uint32_t i = 0; i < count; i++) {
+        if (finds[i].timestamp >= from && finds[i].timestamp <= to) {
+            EpcTableInsert(&expected, &finds[i].epc, &inserted);
+        }
+    }
+    XCTAssertEqual(seen.count, expected.count);
+    for (uint32_t i = 0; i < expected.count; i++) {
+        XCTAssertNotEqual(EpcTableFind(&seen, &expected.keys[i]), EPC_TABLE_NOT_FOUND);
+    }
+
+    // Blocks decode back to the finds
+    RawFind *decoded = malloc(SESSION_BLOCK_SIZE * sizeof(RawFind));
+    uint32_t next = 0;
+    for (uint32_t block = 0; block < reader.numBlocks; block++) {
+        XCTAssertTrue(SessionReaderVerifyBlock(&reader, block));
+        uint32_t numDecoded = SessionReaderDecodeBlock(&reader, block, decoded, SESSION_BLOCK_SIZE);
+        XCTAssertEqual(numDecoded, reader.blocks[block].numFinds);
+        for (uint32_t i = 0; i < numDecoded && next < count; i++, next++) {
+            XCTAssertTrue(EpcKeyEqual(&decoded[i].epc, &finds[next].epc));
+            XCTAssertEqual(decoded[i].frequency, finds[next].frequency);
+        }
+    }
+    XCTAssertEqual(next, count);
+
+    free(decoded);
+    EpcTableFree(&seen);
+    EpcTableFree(&expected);
+    SessionReaderClose(&reader);
+    [[NSFileManager defaultManager] removeItemAtPath:path error:nil];
+    ReaderSimulatorFree(&simulator);
+    free(finds);
+}
+
+static NSArray *makeEpcs(int count) {
+    NSMutableArray *epcs = [NSMutableArray arrayWithCapacity:count];
+    uint8_t bytes[UGI_STANDARD_EPC_LENGTH];
+    for (int i = 0; i < count; i++) {
+        fillEpcBytes(bytes, i);
+        [epcs addObject:[UgiEpc epcFromBytes:[NSData dataWithBytes:bytes length:sizeof(bytes)]]];
+    }
+    return epcs;
+}
+
+- (void)testJsonPlanOutput {
+    NSDictionary *value = @{ @"name": @"Fern \"Boston\"\n",
+                             @"count": @42,
+                             @"negative": @(-7),
+                             @"ratio": @0.25,
+                             @"visible": @YES,
+                             @"missing": [NSNull null],
+                             @"epcs": makeEpcs(3) };
+    NSData *json = [value toJsonData];
+    XCTAssertNotNil(json);
+    NSError *error;
+    NSDictionary *parsed = [NSJSONSerialization JSONObjectWithData:json options:0 error:&error];
+    XCTAssertNotNil(parsed, @"%@", error);
+    XCTAssertEqualObjects(parsed[@"name"], value[@"name"]);
+    XCTAssertEqualObjects(parsed[@"count"], @42);
+    XCTAssertEqualObjects(parsed[@"negative"], @(-7));
+    XCTAssertEqualObjects(parsed[@"ratio"], @0.25);
+    XCTAssertEqualObjects(parsed[@"visible"], @YES);
+    XCTAssertEqualObjects(parsed[@"missing"], [NSNull null]);
+    XCTAssertEqual([parsed[@"epcs"] count], 3);
+    XCTAssertEqualObjects(parsed[@"epcs"][2][@"data"], [value[@"epcs"][2] hexString]);
+
+    NSOutputStream *stream = [NSOutputStream outputStreamToMemory];
+    [stream open];
+    XCTAssertTrue([value[@"epcs"] writeJsonToStream:stream]);
+    [stream close];
+    XCTAssertEqualObjects([stream propertyForKey:NSStreamDataWrittenToMemoryStreamKey], [value[@"epcs"] toJsonData]);
+}
+
+- (void)testUgiJsonSerializePerformance {
+    NSArray *epcs = makeEpcs(100000);
+    [self measureBlock:^{
+        NSData *json = [epcs toJson:UGI_SERIALIZATION_CONTEXT_DEFAULT];
+        XCTAssertGreaterThan(json.length, 0);
+    }];
+}
+
+- (void)testJsonPlanSerializePerformance {
+    NSArray *epcs = makeEpcs(100000);
+    [self measureBlock:^{
+        NSData *json = [epcs toJsonData];
+        XCTAssertGreaterThan(json.length, 0);
+    }];
+}
+
+- (void)testJsonReaderAcrossChunkBoundaries {
+    const char *json = "{\"name\": \"caf\\u00e9 \\ud83c\\udf31\", \"counts\": [1, -2.5e3, true, null], \"empty\": {}}";
+    size_t length = strlen(json);
+    for (size_t chunk = 1; chunk <= length; chunk++) {
+        JsonReader reader;
+        XCTAssertTrue(JsonReaderInit(&reader, 256));
+        size_t fed = MIN(chunk, length);
+        JsonReaderFeed(&reader, (const uint8_t *)json, fed, fed == length);
+        NSMutableArray *tokens = [NSMutableArray array];
+        JsonToken token;
+        while ((token = JsonReaderNext(&reader)) != JSON_TOKEN_END && token != JSON_TOKEN_ERROR) {
+            if (token == JSON_TOKEN_NEED_INPUT) {
+                size_t more = MIN(chunk, length - fed);
+                JsonReaderFeed(&reader, (const uint8_t *)json + fed, more, fed + more == length);
+                fed += more;
+            } else if (token == JSON_TOKEN_STRING) {
+                [tokens addObject:@(JsonReaderString(&reader, NULL))];
+            } else {
+                [tokens addObject:@(token)];
+            }
+        }
+        XCTAssertEqual(token, JSON_TOKEN_END);
+        XCTAssertEqual(tokens.count, 14);
+        XCTAssertEqualObjects(tokens[2], @"caf\u00e9 \U0001F331");
+        JsonReaderFree(&reader);
+    }
+
+    const char *bad[] = { "[1,]", "{\"a\" 1}", "[01]", "{}x", "[1 2]", "\"abc", "[tru]",
+                          "\"\xff\"", "{\"\xc3\": 1}", "\"\xc0\xaf\"", "\"\xed\xa0\x80\"", "\"\xf4\x90\x80\x80\"" };
+    for (size_t i = 0; i < sizeof(bad) / sizeof(bad[0]); i++) {
+        JsonReader reader;
+        JsonReaderInit(&reader, 256);
+        JsonReaderFeed(&reader, (const uint8_t *)bad[i], strlen(bad[i]), true);
+        JsonToken token;
+        while ((token = JsonReaderNext(&reader)) != JSON_TOKEN_END && token != JSON_TOKEN_ERROR) {
+        }
+        XCTAssertEqual(token, JSON_TOKEN_ERROR, @"%s", bad[i]);
+        JsonReaderFree(&reader);
+    }
+}
+
+- (void)testJsonReaderGrowsTokenBuffer {
+    NSMutableString *json = [NSMutableString stringWithString:@"[\""];
+    for (int i = 0; i < 5000; i++) {
+        [json appendString:@"a"];
+    }
+    [json appendString:@"\"]"];
+    NSData *data = [json dataUsingEncoding:NSUTF8StringEncoding];
+
+    JsonReader reader;
+    XCTAssertTrue(JsonReaderInit(&reader, 8192));
+    JsonReaderFeed(&reader, data.bytes, data.length, true);
+    XCTAssertEqual(JsonReaderNext(&reader), JSON_TOKEN_BEGIN_ARRAY);
+    XCTAssertEqual(JsonReaderNext(&reader), JSON_TOKEN_STRING);
+    size_t length;
+    JsonReaderString(&reader, &length);
+    XCTAssertEqual(length, 5000);
+    JsonReaderFree(&reader);
+
+    // Longer than the limit
+    XCTAssertTrue(JsonReaderInit(&reader, 4096));
+    JsonReaderFeed(&reader, data.bytes, data.length, true);
+    XCTAssertEqual(JsonReaderNext(&reader), JSON_TOKEN_BEGIN_ARRAY);
+    XCTAssertEqual(JsonReaderNext(&reader), JSON_TOKEN_ERROR);
+    JsonReaderFree(&reader);
+}
+
+- (void)testJsonModelReaderRejectsInvalidUtf8 {
+    const char json[] = "{\"ok\": 1, \"\xff\xfe\": 2}";
+    NSError *error;
+    id read = [JsonModelReader readObjectOfClass:[NSDictionary class]
+                                        fromData:[NSData dataWithBytes:json length:sizeof(json) - 1]
+                                           error:&error];
+    XCTAssertNil(read);
+    XCTAssertNotNil(error);
+}
+
+- (void)testJsonModelReaderRoundTrip {
+    NSArray *epcs = makeEpcs(1000);
+    NSData *json = [epcs toJsonData];
+    NSError *error;
+    NSArray *read = [JsonModelReader readObjectOfClass:[UgiEpc class] fromData:json error:&error];
+    XCTAssertEqual(read.count, epcs.count, @"%@", error);
+    XCTAssertTrue([read.lastObject isKindOfClass:[UgiEpc class]]);
+    XCTAssertEqualObjects([read.lastObject data], [epcs.lastObject data]);
+
+    NSInputStream *stream = [NSInputStream inputStreamWithData:json];
+    [stream open];
+    EpcKey *keys;
+    uint32_t count;
+    XCTAssertTrue([JsonModelReader readEpcKeysFromStream:stream keys:&keys count:&count error:&error], @"%@", error);
+    XCTAssertEqual(count, epcs.count);
+    EpcKey expected = [epcs[500] epcKey];
+    XCTAssertTrue(EpcKeyEqual(&keys[500], &expected));
+    free(keys);
+    [stream close];
+}
+
+- (void)testJsonModelReaderPerformance {
+    NSData *json = [makeEpcs(100000) toJsonData];
+    [self measureBlock:^{
+        NSInputStream *stream = [NSInputStream inputStreamWithData:json];
+        [stream open];
+        EpcKey *keys;
+        uint32_t count;
+        XCTAssertTrue([JsonModelReader readEpcKeysFromStream:stream keys:&keys count:&count error:nil]);
+        XCTAssertEqual(count, 100000);
+        free(keys);
+        [stream close];
+    }];
+}
+
+- (void)testJournaledJsonRootSavesChangesOnly {
+    JournalTestRoot *root = [[JournalTestRoot alloc] initFromFile:@"JournalTest" initializationData:nil debug:NO];
+    NSString *path = root._filePath;
+    NSString *journalPath = [path stringByAppendingString:@".journal"];
+    [[NSFileManager defaultManager] removeItemAtPath:path error:nil];
+    [[NSFileManager defaultManager] removeItemAtPath:journalPath error:nil];
+    root = [[JournalTestRoot alloc] initFromFile:@"JournalTest" initializationData:nil debug:NO];
+
+    root.storeName = @"Store 12";
+    root.barcodes = [NSMutableArray array];
+    for (int i = 0; i < 2000; i++) {
+        [root.barcodes addObject:[NSString stringWithFormat:@"%012d", i]];
+    }
+    [root fieldChanged:@"barcodes"];
+    [root save];
+    XCTAssertEqual([root journalLength], 0);
+
+    // Each save only adds the new barcode and the counter
+    for (int i = 0; i < 100; i++) {
+        NSString *barcode = [NSString stringWithFormat:@"9%011d", i];
+        [root.barcodes addObject:barcode];
+        [root field:@"barcodes" appendedObjects:@[barcode]];
+        root.visits++;
+        unsigned long long before = [root journalLength];
+        [root save];
+        XCTAssertLessThan([root journalLength] - before, 200);
+    }
+
+    JournalTestRoot *reloaded = [[JournalTestRoot alloc] initFromFile:@"JournalTest" initializationData:nil debug:NO];
+    XCTAssertEqualObjects(reloaded.storeName, @"Store 12");
+    XCTAssertEqual(reloaded.visits, 100);
+    XCTAssertEqualObjects(reloaded.barcodes, root.barcodes);
+
+    // A batch torn by a crash is ignored
+    NSFileHandle *handle = [NSFileHandle fileHandleForWritingAtPath:journalPath];
+    [handle seekToEndOfFile];
+    [handle writeData:[@"JRNL partial record" dataUsingEncoding:NSUTF8StringEncoding]];
+    [handle closeFile];
+    reloaded = [[JournalTestRoot alloc] initFromFile:@"JournalTest" initializationData:nil debug:NO];
+    XCTAssertEqual(reloaded.visits, 100);
+    XCTAssertEqualObjects(reloaded.barcodes, root.barcodes);
+
+    [reloaded compact];
+    XCTAssertEqual([reloaded journalLength], 0);
+    reloaded = [[JournalTestRoot alloc] initFromFile:@"JournalTest" initializationData:nil debug:NO];
+    XCTAssertEqual(reloaded.visits, 100);
+    XCTAssertEqual(reloaded.barcodes.count, 2100);
+}
+
+- (void)testJournaledJsonRootKeepsChangesWhenSnapshotFails {
+    JournalTestRoot *root = [[JournalTestRoot alloc] initFromFile:@"JournalFailTest" initializationData:nil debug:NO];
+    NSString *path = root._filePath;
+    NSFileManager *files = [NSFileManager defaultManager];
+    [files removeItemAtPath:path error:nil];
+    [files removeItemAtPath:[path stringByAppendingString:@".journal"] error:nil];
+    root = [[JournalTestRoot alloc] initFromFile:@"JournalFailTest" initializationData:nil debug:NO];
+    root.storeName = @"Store 1";
+    [root save];
+    NSData *snapshot = [NSData dataWithContentsOfFile:path];
+    XCTAssertNotNil(snapshot);
+
+    // A directory in the snapshot's place can't be renamed over
+    root.storeName = @"Store 2";
+    [files removeItemAtPath:path error:nil];
+    [files createDirectoryAtPath:[path stringByAppendingPathComponent:@"blocker"] withIntermediateDirectories:YES attributes:nil error:nil];
+    [root compact];
+    [files removeItemAtPath:path error:nil];
+    [snapshot writeToFile:path atomically:YES];
+
+    // The change is still pending, so this save journals it
+    [root save];
+    JournalTestRoot *reloaded = [[JournalTestRoot alloc] initFromFile:@"JournalFailTest" initializationData:nil debug:NO];
+    XCTAssertEqualObjects(reloaded.storeName, @"Store 2");
+}
+
+- (void)testBarcodeIndexFindsEveryMatch {
+    BarcodeIndex index;
+    XCTAssertTrue(BarcodeIndexInit(&index, 0));
+    // 20,000 items over 10,000 barcodes, added out of order
+    for (uint32_t i = 0; i < 20000; i++) {
+        XCTAssertTrue(BarcodeIndexAdd(&index, 100000000000LL + (i * 7919) % 10000, i));
+    }
+    BarcodeIndexSort(&index);
+
+    uint32_t first;
+    XCTAssertEqual(BarcodeIndexFind(&index, 100000000000LL + 1234, &first), 2);
+    XCTAssertEqual(index.entries[first].barcode, 100000000000LL + 1234);
+    XCTAssertEqual((index.entries[first].item * 7919) % 10000, 1234);
+    XCTAssertEqual(BarcodeIndexFind(&index, 99, &first), 0);
+    XCTAssertEqual(BarcodeIndexFind(&index, 100000000000LL + 10000, &first), 0);
+
+    [self measureBlock:^{
+        uint32_t found = 0, position;
+        for (int64_t barcode = 0; barcode < 10000; barcode++) {
+            found += BarcodeIndexFind(&index, 100000000000LL + barcode, &position);
+        }
+        XCTAssertEqual(found, 20000);
+    }];
+    BarcodeIndexFree(&index);
+}
+
+- (void)testShortDateStringMatchesDateFormatter {
+    NSTimeZone *defaultTimeZone = [NSTimeZone defaultTimeZone];
+    NSDateFormatter *formatter = [[NSDateFormatter alloc] init];
+    [formatter setDateFormat:@"MM/dd/yyyy"];
+    for (NSString *name in @[ @"America/Los_Angeles", @"Australia/Lord_Howe", @"Asia/Kolkata", @"GMT" ]) {
+        NSTimeZone *timeZone = [NSTimeZone timeZoneWithName:name];
+        [NSTimeZone setDefaultTimeZone:timeZone];
+        [[NSNotificationCenter defaultCenter] postNotificationName:NSSystemTimeZoneDidChangeNotification object:nil];
+        formatter.timeZone = timeZone;
+
+        // Every 7 hours across 30 years, then either side of each daylight saving transition
+        for (double seconds = 946684800; seconds < 1893456000; seconds += 7 * 3600 + 17) {
+            NSDate *date = [NSDate dateWithTimeIntervalSince1970:seconds];
+            XCTAssertEqualObjects([Formatters shortDateString:date], [formatter stringFromDate:date], @"%@ %@", name, date);
+        }
+        NSDate *transition = [timeZone nextDaylightSavingTimeTransitionAfterDate:[NSDate dateWithTimeIntervalSince1970:946684800]];
+        for (int i = 0; transition && i < 60; i++) {
+            for (double delta = -1; delta <= 1; delta++) {
+                NSDate *date = [transition dateByAddingTimeInterval:delta];
+                XCTAssertEqualObjects([Formatters shortDateString:date], [formatter stringFromDate:date], @"%@ %@", name, date);
+            }
+            transition = [timeZone nextDaylightSavingTimeTransitionAfterDate:transition];
+        }
+    }
+    [NSTimeZone setDefaultTimeZone:defaultTimeZone];
+    [[NSNotificationCenter defaultCenter] postNotificationName:NSSystemTimeZoneDidChangeNotification object:nil];
+
+    XCTAssertNil([Formatters shortDateString:nil]);
+    XCTAssertEqualObjects([Formatters numberFromString:@"012345678901"], @12345678901LL);
+    XCTAssertEqualObjects([Formatters numberFromString:@"1,234"], @1234);
+    XCTAssertNil([Formatters numberFromString:@"12ab"]);
+}
+
+- (void)testShortDateStringPerformance {
+    // The dates of 10,000 items, formatted three ways
+    NSMutableArray *dates = [NSMutableArray arrayWithCapacity:10000];
+    for (int i = 0; i < 10000; i++) {
+        [dates addObject:[NSDate dateWithTimeIntervalSince1970:1388534400 + i * 3571.0]];
+    }
+    NSTimeInterval (^time)(void (^)(NSDate *)) = ^NSTimeInterval(void (^format)(NSDate *)) {
+        NSDate *start = [NSDate date];
+        for (NSDate *date in dates) {
+            format(date);
+        }
+        return -[start timeIntervalSinceNow];
+    };
+    NSTimeInterval perCall = time(^(NSDate *date) {
+        NSDateFormatter *formatter = [[NSDateFormatter alloc] init];
+        [formatter setDateFormat:@"MM/dd/yyyy"];
+        [formatter stringFromDate:date];
+    });
+    NSDateFormatter *shared = [[NSDateFormatter alloc] init];
+    [shared setDateFormat:@"MM/dd/yyyy"];
+    NSTimeInterval sharedFormatter = time(^(NSDate *date) {
+        [shared stringFromDate:date];
+    });
+    NSTimeInterval fastPath = time(^(NSDate *date) {
+        [Formatters shortDateString:date];
+    });
+    NSLog(@"Per item: new formatter %.2f us, shared formatter %.2f us, fast path %.2f us",
+          perCall * 1e6 / dates.count, sharedFormatter * 1e6 / dates.count, fastPath * 1e6 / dates.count);
+    XCTAssertLessThan(fastPath, perCall);
+
+    [self measureBlock:^{
+        for (NSDate *date in dates) {
+            [Formatters shortDateString:date];
+        }
+    }];
+}
+
+- (void)testVisibleTagListDiffsReplayOntoTable {
+    // 3,000 plants, each frame a few hundred coming into or going out of range
+    NSArray *tags = listTestTags(3000);
+    VisibleTagList *list = [[VisibleTagList alloc] init];
+    NSMutableArray *table = [NSMutableArray array];
+    NSMutableSet *visible = [NSMutableSet set];
+    srandom(18);
+    for (int frame = 0; frame < 200; frame++) {
+        for (int i = 0; i < 300; i++) {
+            UgiTag *tag = tags[random() % tags.count];
+            BOOL isVisible = random() % 3 != 0;
+            [list setTag:tag visible:isVisible];
+            if (isVisible) {
+                [visible addObject:tag];
+            } else {
+                [visible removeObject:tag];
+            }
+        }
+        // What UITableView does with a batch: deletions at old rows, then insertions at new ones
+        VisibleTagListChanges *changes = [list applyPendingChanges];
+        XCTAssertFalse(list.hasPendingChanges);
+        [table removeObjectsAtIndexes:changes.deletedRows];
+        [changes.insertedRows enumerateIndexesUsingBlock:^(NSUInteger row, BOOL *stop) {
+            [table insertObject:list.rows[row] atIndex:row];
+        }];
+        XCTAssertEqualObjects(table, list.rows);
+        XCTAssertEqualObjects([NSSet setWithArray:list.rows], visible);
+    }
+
+    // A tag that comes and goes within a frame is never shown
+    UgiTag *tag = [visible anyObject];
+    [list setTag:tag visible:NO];
+    [list setTag:tag visible:YES];
+    XCTAssertNil([list applyPendingChanges]);
+
+    [list removeAllTags];
+    XCTAssertEqual(list.rows.count, 0);
+}
+
+- (void)testVisibleTagListFramePerformance {
+    NSArray *tags = listTestTags(3000);
+    VisibleTagList *list = [[VisibleTagList alloc] init];
+    for (UgiTag *tag in tags) {
+        [list setTag:tag visible:YES];
+    }
+    [list applyPendingChanges];
+
+    // 100 frames of 50 plants leaving and 50 coming back, against a full room
+    [self measureBlock:^{
+        for (int frame = 0; frame < 100; frame++) {
+            for (int i = 0; i < 50; i++) {
+                [list setTag:tags[(frame * 50 + i) % tags.count] visible:NO];
+                [list setTag:tags[(frame * 50 + i + 1500) % tags.count] visible:YES];
+            }
+            [list applyPendingChanges];
+        }
+    }];
+}
+
+- (void)testPrefetchQueueKeepsNearestTags {
+    PrefetchQueue queue;
+    XCTAssertTrue(PrefetchQueueInit(&queue, 100));
+    // 1,000 tags found in a shuffled order, at -90..-40 dBm
+    NSMutableArray *priorities = [NSMutableArray array];
+    srandom(19);
+    for (uint32_t i = 0; i < 1000; i++) {
+        uint8_t bytes[12] = { 0x30, 0, 0, 0, 0, 0, 0, 0, (uint8_t)(i >> 24), (uint8_t)(i >> 16), (uint8_t)(i >> 8), (uint8_t)i };
+        EpcKey key = EpcKeyMake(bytes, sizeof(bytes));
+        float rssi = -90 + (random() % 5000) / 100.0f;
+        PrefetchQueuePush(&queue, &key, rssi);
+        [priorities addObject:@(rssi)];
+    }
+    XCTAssertEqual(queue.count, 100);
+
+    // The 100 nearest come out, nearest first
+    [priorities sortUsingComparator:^NSComparisonResult(NSNumber *a, NSNumber *b) { return [b compare:a]; }];
+    PrefetchQueueEntry entry;
+    for (int i = 0; i < 100; i++) {
+        XCTAssertTrue(PrefetchQueuePop(&queue, &entry));
+        XCTAssertEqual(entry.priority, [priorities[i] floatValue]);
+    }
+    XCTAssertFalse(PrefetchQueuePop(&queue, &entry));
+    PrefetchQueueFree(&queue);
+}
+
+- (void)testOfflineWriteQueueCoalescesAndSurvivesRestart {
+    NSString *path = [NSTemporaryDirectory() stringByAppendingPathComponent:@"WriteQueueTest"];
+    [[NSFileManager defaultManager] removeItemAtPath:path error:nil];
+    [[NSFileManager defaultManager] removeItemAtPath:[path stringByAppendingString:@".journal"] error:nil];
+
+    OfflineWriteQueue *queue = [[OfflineWriteQueue alloc] initWithPath:path];
+    NSString *userId = [queue setValues:@{ @"username": @"grower" } ofObjectWithClassName:@"User" objectId:nil];
+    XCTAssertEqualObjects([queue setValues:@{ @"shift": @"night" } ofObjectWithClassName:@"User" objectId:userId], userId);
+    for (int i = 0; i < 500; i++) {
+        [queue setValues:@{ @"phase": @"flowering", @"flowering": [NSDate date], @"age": @(i) }
+   ofObjectWithClassName:@"Inventory"
+                objectId:@"plant1"];
+    }
+    [queue setValues:@{ @"epc": [NSNull null] } ofObjectWithClassName:@"Inventory" objectId:@"plant2"];
+    XCTAssertEqual(queue.pendingCount, 3);
+
+    // Reopened from the journal (and any snapshot taken along the way)
+    [queue waitUntilWritten];
+    queue = nil;
+    queue = [[OfflineWriteQueue alloc] initWithPath:path];
+    XCTAssertEqual(queue.pendingCount, 3);
+
+    // Enough writes to snapshot the table a few times over
+    for (int i = 0; i < 5000; i++) {
+        [queue setValues:@{ @"name": [NSString stringWithFormat:@"Plant %d", i] }
+   ofObjectWithClassName:@"Inventory"
+                objectId:[NSString stringWithFormat:@"plant%d", i % 10]];
+    }
+    XCTAssertEqual(queue.pendingCount, 11);
+    [queue waitUntilWritten];
+    queue = nil;
+    queue = [[OfflineWriteQueue alloc] initWithPath:path];
+    XCTAssertEqual(queue.pendingCount, 11);
+}
+
+- (void)testLocalLoginServiceReturnsSessionAndProjection {
+    LocalLoginService *service = [[LocalLoginService alloc] init];
+    NSString *objectId = [service addUserWithUsername:@"grower" password:@"secret" fields:@{ @"shift": @"night" }];
+
+    BFTask *task = [service logInWithUsername:@"grower" password:@"secret"];
+    LoginSession *session = task.result;
+    XCTAssertNotNil(session);
+    XCTAssertTrue(session.sessionToken.length > 0);
+    XCTAssertEqualObjects(session.user.objectId, objectId);
+    XCTAssertEqualObjects(session.user[@"username"], @"grower");
+    XCTAssertNil(session.user[@"password"]);
+    XCTAssertNil(session.user[@"shift"]);
+
+    BFTask *badPassword = [service logInWithUsername:@"grower" password:@"wrong"];
+    XCTAssertEqualObjects(badPassword.error.domain, LoginServiceErrorDomain);
+    XCTAssertEqual(badPassword.error.code, LOGIN_SERVICE_ERROR_BAD_LOGIN);
+    BFTask *noUser = [service logInWithUsername:@"nobody" password:@"secret"];
+    XCTAssertEqual(noUser.error.code, LOGIN_SERVICE_ERROR_BAD_LOGIN);
+    XCTAssertEqual(service.loginCount, 3);
+
+    // Usernames are unique
+    BFTask *taken = [service signUpWithUsername:@"grower" password:@"other"];
+    XCTAssertEqual(taken.error.code, LOGIN_SERVICE_ERROR_USERNAME_TAKEN);
+    BFTask *signedUp = [service signUpWithUsername:@"trimmer" password:@"shears"];
+    XCTAssertEqualObjects([signedUp.result user][@"username"], @"trimmer");
+    XCTAssertNotNil([[service logInWithUsername:@"trimmer" password:@"shears"] result]);
+}
+
+- (void)testCloudLoginServiceMapsErrors {
+    NSError *notFound = [NSError errorWithDomain:PFParseErrorDomain code:kPFErrorObjectNotFound userInfo:nil];
+    NSError *error = [CloudLoginService loginErrorWithCloudError:notFound];
+    XCTAssertEqualObjects(error.domain, LoginServiceErrorDomain);
+    XCTAssertEqual(error.code, LOGIN_SERVICE_ERROR_BAD_LOGIN);
+    XCTAssertEqualObjects(error.userInfo[NSUnderlyingErrorKey], notFound);
+
+    NSError *badLogin = [NSError errorWithDomain:PFParseErrorDomain code:kPFScriptError userInfo:@{ @"error": @"BAD_LOGIN" }];
+    XCTAssertEqual([CloudLoginService loginErrorWithCloudError:badLogin].code, LOGIN_SERVICE_ERROR_BAD_LOGIN);
+    NSError *taken = [NSError errorWithDomain:PFParseErrorDomain code:kPFScriptError userInfo:@{ @"error": @"USERNAME_TAKEN" }];
+    XCTAssertEqual([CloudLoginService loginErrorWithCloudError:taken].code, LOGIN_SERVICE_ERROR_USERNAME_TAKEN);
+
+    // Anything else is passed on for the caller to report
+    NSError *script = [NSError errorWithDomain:PFParseErrorDomain code:kPFScriptError userInfo:@{ @"error": @"boom" }];
+    XCTAssertEqualObjects([CloudLoginService loginErrorWithCloudError:script], script);
+    NSError *offline = [NSError errorWithDomain:PFParseErrorDomain code:kPFErrorConnectionFailed userInfo:nil];
+    XCTAssertEqualObjects([CloudLoginService loginErrorWithCloudError:offline], offline);
+    NSError *timeout = [NSError errorWithDomain:NSURLErrorDomain code:NSURLErrorTimedOut userInfo:nil];
+    XCTAssertEqualObjects([CloudLoginService loginErrorWithCloudError:timeout], timeout);
+}
+
+- (void)testLoginSessionParsesResponse {
+    LoginSession *session = [LoginSession sessionWithResponse:@{ @"sessionToken": @"token",
+                                                                 @"user": @{ @"objectId": @"u1",
+                                                                             @"username": @"grower",
+                                                                             @"password": @"leaked" } }];
+    XCTAssertEqualObjects(session.sessionToken, @"token");
+    XCTAssertEqualObjects(session.user.objectId, @"u1");
+    XCTAssertEqualObjects(session.user[@"username"], @"grower");
+    XCTAssertNil(session.user[@"password"]);
+
+    session = [LoginSession sessionWithResponse:@{ @"sessionToken": @"token",
+                                                   @"user": @{ @"objectId": @"u1", @"username": [NSNull null] } }];
+    XCTAssertNotNil(session);
+    XCTAssertNil(session.user[@"username"]);
+
+    XCTAssertNil([LoginSession sessionWithResponse:nil]);
+    XCTAssertNil([LoginSession sessionWithResponse:@[]]);
+    XCTAssertNil([LoginSession sessionWithResponse:@{ @"user": @{ @"objectId": @"u1" } }]);
+    XCTAssertNil([LoginSession sessionWithResponse:@{ @"sessionToken": @"token", @"user": @"u1" }]);
+    XCTAssertNil([LoginSession sessionWithResponse:@{ @"sessionToken": @"token", @"user": @{ @"objectId": @1 } }]);
+}
+
+- (void)testInventoryItemDecodesTypedFields {
+    NSDate *clone = [NSDate dateWithTimeIntervalSince1970:1417392000];
+    PFObject *object = [PFObject objectWithClassName:InventoryClassName];
+    object[@"barcode"] = @(4012345);
+    object[@"epc"] = @"e2801130200020a1";
+    object[@"name"] = @"Plant 7";
+    object[@"age"] = @"12";        // Wrong type: left out
+    object[@"phase"] = @"vegetative";
+    object[@"clone"] = clone;
+    object[@"password"] = @"ignored";
+
+    InventoryItem *item = [InventoryItem itemWithObject:object];
+    XCTAssertEqual(item.barcode, 4012345);
+    XCTAssertEqualObjects(item.epc, @"E2801130200020A1");
+    XCTAssertEqualObjects(item.name, @"Plant 7");
+    XCTAssertNil(item.age);
+    XCTAssertEqualObjects(item.phase, @"vegetative");
+    XCTAssertEqualObjects(item.clone, clone);
+    XCTAssertNil(item.flowering);
+
+    PFObject *update = [PFObject objectWithClassName:InventoryClassName];
+    update[@"phase"] = @"flowering";
+    update[@"name"] = @"Renamed";
+    InventoryItem *updated = [item itemByApplyingKeys:@[ @"phase", @"unknown" ] ofObject:update];
+    XCTAssertEqualObjects(updated.phase, @"flowering");
+    XCTAssertEqualObjects(updated.name, @"Plant 7");
+    XCTAssertEqual(updated.barcode, 4012345);
+
+    NSArray *keys = [InventoryItem keys];
+    XCTAssertEqual(keys.count, 8);
+    XCTAssertFalse([keys containsObject:@"password"]);
+}
+
+- (void)testReaderCommandQueueRunsCommandsInOrder {
+    ReaderCommandQueue *queue = [[ReaderCommandQueue alloc] init];
+    NSMutableArray *started = [NSMutableArray array];
+    NSMutableArray *sources = [NSMutableArray array];
+    NSMutableArray *tasks = [NSMutableArray array];
+    for (int i = 0; i < 3; i++) {
+        [tasks addObject:[queue enqueue:^BFTask *{
+            BFTaskCompletionSource *source = [BFTaskCompletionSource taskCompletionSource];
+            [started addObject:@(i)];
+            [sources addObject:source];
+            return source.task;
+        }]];
+    }
+    XCTAssertEqualObjects(started, @[ @0 ]);
+    XCTAssertEqual(queue.pendingCount, 3);
+
+    // The next command starts from the completion of the one before, failed or not
+    [sources[0] setError:[NSError errorWithDomain:@"test" code:1 userInfo:nil]];
+    XCTAssertEqualObjects(started, (@[ @0, @1 ]));
+    XCTAssertNotNil([tasks[0] error]);
+    [sources[1] setResult:@"tid"];
+    XCTAssertEqualObjects(started, (@[ @0, @1, @2 ]));
+    XCTAssertEqualObjects([tasks[1] result], @"tid");
+    [sources[2] setResult:nil];
+    XCTAssertTrue([tasks[2] isCompleted]);
+    XCTAssertEqual(queue.pendingCount, 0);
+}
+
+- (void)testBulkSaverRetriesWithBackoff {
+    BulkSaver *saver = [[BulkSaver alloc] init];
+    saver.retryDelay = 0.05;
+    saver.maxAttempts = 3;
+    NSMutableArray *attempts = [NSMutableArray array];
+    saver.saveBlock = ^BFTask *(NSArray *objects) {
+        [attempts addObject:[NSDate date]];
+        if (attempts.count < 3) {
+            return [BFTask taskWithError:[NSError errorWithDomain:NSURLErrorDomain code:NSURLErrorTimedOut userInfo:nil]];
+        }
+        return [BFTask taskWithResult:objects];
+    };
+    NSArray *objects = @[ [PFObject objectWithClassName:@"Inventory"] ];
+    BFTask *task = [saver saveObjects:objects progress:nil];
+    NSDate *deadline = [NSDate dateWithTimeIntervalSinceNow:5];
+    while (!task.isCompleted && [deadline timeIntervalSinceNow] > 0) {
+        [[NSRunLoop currentRunLoop] runUntilDate:[NSDate dateWithTimeIntervalSinceNow:0.01]];
+    }
+    XCTAssertEqualObjects(task.result, objects);
+    XCTAssertEqual(attempts.count, 3);
+    // retryDelay, then twice that, each less up to half for jitter
+    XCTAssertGreaterThanOrEqual([attempts[1] timeIntervalSinceDate:attempts[0]], 0.025);
+    XCTAssertGreaterThanOrEqual([attempts[2] timeIntervalSinceDate:attempts[1]], 0.05);
+
+    // Out of attempts
+    [attempts removeAllObjects];
+    saver.saveBlock = ^BFTask *(NSArray *objects) {
+        [attempts addObject:[NSDate date]];
+        return [BFTask taskWithError:[NSError errorWithDomain:NSURLErrorDomain code:NSURLErrorTimedOut userInfo:nil]];
+    };
+    task = [saver saveObjects:objects progress:nil];
+    deadline = [NSDate dateWithTimeIntervalSinceNow:5];
+    while (!task.isCompleted && [deadline timeIntervalSinceNow] > 0) {
+        [[NSRunLoop currentRunLoop] runUntilDate:[NSDate dateWithTimeIntervalSinceNow:0.01]];
+    }
+    XCTAssertEqual(task.error.code, BULK_SAVER_ERROR_INCOMPLETE);
+    XCTAssertEqual(attempts.count, 3);
+
+    // Not worth retrying
+    [attempts removeAllObjects];
+    saver.saveBlock = ^BFTask *(NSArray *objects) {
+        [attempts addObject:[NSDate date]];
+        return [BFTask taskWithError:[NSError errorWithDomain:PFParseErrorDomain code:kPFErrorObjectNotFound userInfo:nil]];
+    };
+    task = [saver saveObjects:objects progress:nil];
+    XCTAssertEqual(task.error.code, BULK_SAVER_ERROR_INCOMPLETE);
+    XCTAssertEqual(attempts.count, 1);
+}
+
+- (void)testBulkSaverReportsPartialFailure {
+    BulkSaver *saver = [[BulkSaver alloc] init];
+    saver.batchSize = 2;
+    // The first batch fails after saving its first object (saved objects have an
+    // objectId and nothing dirty); the second is saved
+    PFObject *saved = [PFObject objectWithoutDataWithClassName:@"Inventory" objectId:@"plant1"];
+    PFObject *unsaved = [PFObject objectWithClassName:@"Inventory"];
+    unsaved[@"name"] = @"Plant 2";
+    PFObject *third = [PFObject objectWithClassName:@"Inventory"];
+    PFObject *fourth = [PFObject objectWithClassName:@"Inventory"];
+    saver.saveBlock = ^BFTask *(NSArray *objects) {
+        if ([objects containsObject:unsaved]) {
+            return [BFTask taskWithError:[NSError errorWithDomain:PFParseErrorDomain code:kPFErrorInvalidACL userInfo:nil]];
+        }
+        return [BFTask taskWithResult:objects];
+    };
+    NSMutableArray *progress = [NSMutableArray array];
+    BFTask *task = [saver saveObjects:@[ saved, unsaved, third, fourth ] progress:^(NSUInteger count, NSUInteger total) {
+        [progress addObject:@(count)];
+    }];
+
+    XCTAssertEqualObjects(task.error.domain, BulkSaverErrorDomain);
+    XCTAssertEqual(task.error.code, BULK_SAVER_ERROR_INCOMPLETE);
+    XCTAssertEqualObjects(task.error.userInfo[BulkSaverFailedObjectsKey], @[ unsaved ]);
+    XCTAssertEqualObjects([NSSet setWithArray:task.error.userInfo[BulkSaverSavedObjectsKey]],
+                          ([NSSet setWithObjects:saved, third, fourth, nil]));
+    XCTAssertEqual([task.error.userInfo[NSUnderlyingErrorKey] code], kPFErrorInvalidACL);
+    XCTAssertEqualObjects(progress, @[ @3 ]);
+}
+
+- (void)testOfflineWriteQueueKeepsObjectsCreatedByFailedFlush {
+    NSString *path = [NSTemporaryDirectory() stringByAppendingPathComponent:@"WriteQueueCreatedTest"];
+    [[NSFileManager defaultManager] removeItemAtPath:path error:nil];
+    [[NSFileManager defaultManager] removeItemAtPath:[path stringByAppendingString:@".journal"] error:nil];
+
+    OfflineWriteQueue *queue = [[OfflineWriteQueue alloc] initWithPath:path];
+    XCTAssertThrowsSpecificNamed([queue setValues:@{ @"photo": [NSData data] } ofObjectWithClassName:@"Inventory" objectId:nil],
+                                 NSException, NSInvalidArgumentException);
+    XCTAssertEqual(queue.pendingCount, 0);
+
+    // The batch creates the object, then fails
+    NSString *localId = [queue setValues:@{ @"name": @"Plant 1" } ofObjectWithClassName:@"Inventory" objectId:nil];
+    queue.saver.saveBlock = ^BFTask *(NSArray *objects) {
+        for (PFObject *object in objects) {
+            object.objectId = object.objectId ?: @"plant1";
+        }
+        return [BFTask taskWithError:[NSError errorWithDomain:PFParseErrorDomain code:kPFErrorInvalidACL userInfo:nil]];
+    };
+    __block NSDictionary *created;
+    id observer = [[NSNotificationCenter defaultCenter] addObserverForName:OfflineWriteQueueDidFlushNotification
+                                                                    object:queue
+                                                                     queue:nil
+                                                                usingBlock:^(NSNotification *note) {
+        created = note.userInfo[OfflineWriteQueueCreatedObjectIdsKey];
+    }];
+    BFTask *flush = [queue flush];
+    NSDate *deadline = [NSDate dateWithTimeIntervalSinceNow:5];
+    while (!flush.isCompleted && [deadline timeIntervalSinceNow] > 0) {
+        [[NSRunLoop currentRunLoop] runUntilDate:[NSDate dateWithTimeIntervalSinceNow:0.01]];
+    }
+    [[NSNotificationCenter defaultCenter] removeObserver:observer];
+    XCTAssertNotNil(flush.error);
+
+    // Requeued against the new object, not created a second time; the local id is done with
+    XCTAssertEqual(queue.pendingCount, 1);
+    XCTAssertEqualObjects(created, @{ localId: @"plant1" });
+    XCTAssertThrowsSpecificNamed([queue setValues:@{ @"age": @3 } ofObjectWithClassName:@"Inventory" objectId:localId],
+                                 NSException, NSInvalidArgumentException);
+    XCTAssertEqualObjects([queue setValues:@{ @"age": @3 } ofObjectWithClassName:@"Inventory" objectId:created[localId]], @"plant1");
+    XCTAssertEqual(queue.pendingCount, 1);
+
+    // Still one write to the created object after a restart
+    [queue waitUntilWritten];
+    queue = nil;
+    queue = [[OfflineWriteQueue alloc] initWithPath:path];
+    XCTAssertEqualObjects([queue setValues:@{ @"age": @4 } ofObjectWithClassName:@"Inventory" objectId:@"plant1"], @"plant1");
+    XCTAssertEqual(queue.pendingCount, 1);
+}
+
+- (void)testBarcodeSearchDropsSupersededResults {
+    InventoryStore *store = [[InventoryStore alloc] initFromFile:@"BarcodeSearchTest" initializationData:nil debug:NO];
+    BarcodeSearchController *search = [[BarcodeSearchController alloc] initWithStore:store];
+    SearchTestDelegate *delegate = [[SearchTestDelegate alloc] init];
+    delegate.barcodes = [NSMutableArray array];
+    search.delegate = delegate;
+    NSMutableArray *queries = [NSMutableArray array];
+    search.queryBlock = ^PFQuery *(NSNumber *barcode) {
+        SearchTestQuery *query = [[SearchTestQuery alloc] initWithClassName:InventoryClassName];
+        query.barcode = barcode;
+        [queries addObject:query];
+        return query;
+    };
+
+    // A newer search cancels the older one, whose answer is dropped
+    [search searchTextNow:@"111"];
+    [search searchTextNow:@"222"];
+    XCTAssertEqual(queries.count, 2);
+    XCTAssertTrue([queries[0] cancelled]);
+    [[queries[0] source] setResult:@[]];
+    [[queries[1] source] setResult:@[]];
+    XCTAssertEqualObjects(delegate.barcodes, @[ @222 ]);
+
+    // So does text that isn't a barcode, cleared or not, typed or searched
+    [search searchTextNow:@"333"];
+    [search searchTextNow:@"33a"];
+    XCTAssertTrue([queries[2] cancelled]);
+    [[queries[2] source] setResult:@[]];
+    [search searchTextNow:@"444"];
+    [search searchTextNow:@""];
+    XCTAssertTrue([queries[3] cancelled]);
+    [[queries[3] source] setResult:@[]];
+    [search searchTextNow:@"555"];
+    [search searchText:@""];
+    XCTAssertTrue([queries[4] cancelled]);
+    [[queries[4] source] setResult:@[]];
+    XCTAssertEqualObjects(delegate.barcodes, @[ @222 ]);
+
+    // Searching the same barcode again after that starts a new query
+    [search searchTextNow:@"444"];
+    XCTAssertEqual(queries.count, 6);
+    XCTAssertEqualObjects([queries[5] barcode], @444);
+    [[queries[5] source] setResult:@[]];
+    XCTAssertEqualObjects(delegate.barcodes, (@[ @222, @444 ]));
+}
+
+- (void)testSimulatedRawFindsKeepFrequencyAndRssi {
+    ReaderSimulatorConfig config;
+    ReaderSimulatorDefaultConfig(&config);
+    config.numTags = 50;
+    SimulatedReaderTransport *transport = [[SimulatedReaderTransport alloc] initWithConfig:&config];
+    transport.speed = 0;
+    transport.durationSeconds = 2;
+    [transport openConnection];
+
+    InventoryController *controller = [InventoryController singleton];
+    controller.transport = transport;
+    StopTestDelegate *delegate = [[StopTestDelegate alloc] init];
+    delegate.stopped = [self expectationWithDescription:@"inventory stopped"];
+    controller.delegate = delegate;
+    __block uint64_t numFinds = 0;
+    __block uint64_t withFrequency = 0;
+    __block uint64_t withRssi = 0;
+    controller.rawFindHandler = ^(const RawFind *finds, uint32_t count) {
+        for (uint32_t i = 0; i < count; i++) {
+            numFinds++;
+            withFrequency += finds[i].frequency != 0;
+            withRssi += finds[i].rssiI != 0;
+        }
+    };
+    [controller startInventoryWithConfiguration:[UgiRfidConfiguration configWithInventoryType:UGI_INVENTORY_TYPE_INVENTORY_DISTANCE]];
+    [self waitForExpectationsWithTimeout:30 handler:nil];
+    [controller stopInventory];
+    controller.rawFindHandler = nil;
+    controller.delegate = nil;
+    controller.transport = [[UgiReaderTransport alloc] init];
+    [transport closeConnection];
+
+    XCTAssertGreaterThan(numFinds, 0ull);
+    XCTAssertEqual(withFrequency, numFinds);
+    XCTAssertEqual(withRssi, numFinds);
+}
+
+- (void)testInventoryResolverChunksAndFillsStore {
+    InventoryStore *store = [[InventoryStore alloc] initFromFile:@"ResolverTest" initializationData:nil debug:NO];
+    NSString *path = store._filePath;
+    [[NSFileManager defaultManager] removeItemAtPath:path error:nil];
+    [[NSFileManager defaultManager] removeItemAtPath:[path stringByAppendingString:@".journal"] error:nil];
+    store = [[InventoryStore alloc] initFromFile:@"ResolverTest" initializationData:nil debug:NO];
+    PFObject *(^plant)(NSString *, long long) = ^PFObject *(NSString *objectId, long long barcode) {
+        PFObject *object = [PFObject objectWithoutDataWithClassName:InventoryClassName objectId:objectId];
+        object[@"barcode"] = @(barcode);
+        return object;
+    };
+    [store addObjects:@[ plant(@"plant0", 100) ]];
+
+    InventoryResolver *resolver = [[InventoryResolver alloc] initWithStore:store];
+    resolver.chunkSize = 2;
+    resolver.maxConcurrentQueries = 1;
+    NSMutableArray *queries = [NSMutableArray array];
+    resolver.queryBlock = ^PFQuery *(NSString *key, NSArray *values) {
+        XCTAssertEqualObjects(key, @"barcode");
+        SearchTestQuery *query = [[SearchTestQuery alloc] initWithClassName:InventoryClassName];
+        query.values = values;
+        [queries addObject:query];
+        return query;
+    };
+
+    // The stored barcode is handed over straight away; the rest go out two at a time,
+    // one query at a time
+    NSMutableArray *deliveries = [NSMutableArray array];
+    BFTask *first = [resolver resolveBarcodes:@[ @100, @101, @102, @103, @104, @105 ] handler:^(NSDictionary *resolved) {
+        [deliveries addObject:[NSSet setWithArray:resolved.allKeys]];
+    }];
+    XCTAssertEqualObjects(deliveries, @[ [NSSet setWithObject:@100] ]);
+    XCTAssertEqual(queries.count, 1);
+    XCTAssertEqualObjects([queries[0] values], (@[ @101, @102 ]));
+
+    // A barcode already being fetched isn't asked for again
+    BFTask *second = [resolver resolveBarcodes:@[ @101, @106 ] handler:nil];
+    XCTAssertEqual(queries.count, 1);
+
+    [[queries[0] source] setResult:@[ plant(@"plant1", 101), plant(@"plant2", 102) ]];
+    XCTAssertEqual(queries.count, 2);
+    XCTAssertEqualObjects([queries[1] values], (@[ @103, @104 ]));
+    [[queries[1] source] setResult:@[ plant(@"plant3", 103) ]];
+    XCTAssertEqualObjects([queries[2] values], @[ @105 ]);
+    [[queries[2] source] setResult:@[]];
+    XCTAssertEqualObjects([queries[3] values], @[ @106 ]);
+    [[queries[3] source] setResult:@[ plant(@"plant6", 106) ]];
+    XCTAssertEqual(queries.count, 4);
+
+    NSDate *deadline = [NSDate dateWithTimeIntervalSinceNow:5];
+    while ((!first.isCompleted || !second.isCompleted) && [deadline timeIntervalSinceNow] > 0) {
+        [[NSRunLoop currentRunLoop] runUntilDate:[NSDate dateWithTimeIntervalSinceNow:0.01]];
+    }
+    XCTAssertEqualObjects([NSSet setWithArray:[first.result allKeys]], ([NSSet setWithObjects:@100, @101, @102, @103, nil]));
+    XCTAssertEqualObjects([first.result[@102] objectId], @"plant2");
+    XCTAssertEqualObjects(deliveries, (@[ [NSSet setWithObject:@100],
+                                         [NSSet setWithObjects:@101, @102, nil],
+                                         [NSSet setWithObject:@103] ]));
+    XCTAssertEqualObjects([NSSet setWithArray:[second.result allKeys]], ([NSSet setWithObjects:@101, @106, nil]));
+
+    // What came back is in the store, so asking again doesn't query
+    XCTAssertEqualObjects([[store itemForBarcode:106] objectId], @"plant6");
+    BFTask *again = [resolver resolveBarcodes:@[ @101, @102, @106 ] handler:nil];
+    XCTAssertEqual(queries.count, 4);
+    XCTAssertEqual([again.result count], 3);
+}
+
+- (void)testJsonPlanMatchesUgiJsonHooks {
+    PlanTestPart *counted = [[PlanTestPart alloc] init];
+    counted.label = @"tray";
+    counted.count = 12;
+    PlanTestPart *empty = [[PlanTestPart alloc] init];
+    empty.label = @"bench";
+    PlanTestModel *model = [[PlanTestModel alloc] init];
+    model.name = @"Fern";
+    model.age = 30;
+    model.secret = YES;
+    model.barcode = 123456789012LL;
+    model.parts = @[ counted, empty ];
+
+    NSError *error;
+    id expected = [NSJSONSerialization JSONObjectWithData:[model toJson:UGI_SERIALIZATION_CONTEXT_DEFAULT] options:0 error:&error];
+    XCTAssertNotNil(expected, @"%@", error);
+    counted.seenRoot = nil;
+    empty.seenRoot = nil;
+    id actual = [NSJSONSerialization JSONObjectWithData:[model toJsonData] options:0 error:&error];
+    XCTAssertNotNil(actual, @"%@", error);
+    XCTAssertEqualObjects(actual, expected);
+
+    // Primitive fields go through shouldSerializeField:, and the root's context reaches its parts
+    XCTAssertNil(actual[@"age"]);
+    XCTAssertNil(actual[@"secret"]);
+    XCTAssertEqualObjects(actual[@"barcode"], @123456789012LL);
+    XCTAssertEqualObjects(actual[@"parts"][0][@"count"], @12);
+    XCTAssertNil(actual[@"parts"][1][@"count"]);
+    XCTAssertEqual(counted.seenRoot, model);
+    XCTAssertEqual(empty.seenRoot, model);
+}
+
+- (void)testBarcodeIndexMergeMatchesRebuild {
+    // Merge changed and new items in, a batch at a time, and compare with an index built from scratch
+    int64_t barcodes[600];
+    uint32_t numItems = 300;
+    BarcodeIndex index;
+    XCTAssertTrue(BarcodeIndexInit(&index, 0));
+    for (uint32_t i = 0; i < numItems; i++) {
+        barcodes[i] = (i * 7919) % 50;
+        BarcodeIndexAdd(&index, barcodes[i], i);
+    }
+    BarcodeIndexSort(&index);
+    for (uint32_t batch = 0; batch < 10; batch++) {
+        BarcodeIndexEntry entries[30];
+        for (uint32_t i = 0; i < 30; i++) {
+            // Alternate between changing one of the first 300 items and adding one
+            uint32_t item = i % 2 ? numItems++ : (batch * 31 + i * 17) % 300;
+            barcodes[item] = (batch * 13 + i * 7) % 60;
+            entries[i].barcode = barcodes[item];
+            entries[i].item = item;
+        }
+        XCTAssertTrue(BarcodeIndexMerge(&index, entries, 30));
+
+        BarcodeIndex rebuilt;
+        XCTAssertTrue(BarcodeIndexInit(&rebuilt, numItems));
+        for (uint32_t i = 0; i < numItems; i++) {
+            BarcodeIndexAdd(&rebuilt, barcodes[i], i);
+        }
+        BarcodeIndexSort(&rebuilt);
+        XCTAssertEqual(index.count, rebuilt.count);
+        for (uint32_t i = 0; i < MIN(index.count, rebuilt.count); i++) {
+            XCTAssertEqual(index.entries[i].barcode, rebuilt.entries[i].barcode);
+            XCTAssertEqual(index.entries[i].item, rebuilt.entries[i].item);
+        }
+        BarcodeIndexFree(&rebuilt);
+    }
+    BarcodeIndexFree(&index);
+}
+
+- (void)testInventoryStoreUpdatesIndexesOnMerge {
+    InventoryStore *store = [[InventoryStore alloc] initFromFile:@"StoreMergeTest" initializationData:nil debug:NO];
+    NSString *path = store._filePath;
+    [[NSFileManager defaultManager] removeItemAtPath:path error:nil];
+    [[NSFileManager defaultManager] removeItemAtPath:[path stringByAppendingString:@".journal"] error:nil];
+    store = [[InventoryStore alloc] initFromFile:@"StoreMergeTest" initializationData:nil debug:NO];
+    PFObject *(^plant)(NSString *, long long, NSString *) = ^PFObject *(NSString *objectId, long long barcode, NSString *epc) {
+        PFObject *object = [PFObject objectWithoutDataWithClassName:InventoryClassName objectId:objectId];
+        object[@"barcode"] = @(barcode);
+        if (epc) {
+            object[@"epc"] = epc;
+        }
+        return object;
+    };
+    [store addObjects:@[ plant(@"plant1", 100, @"AA01"), plant(@"plant2", 200, nil) ]];
+
+    // A new item, a changed barcode and a first EPC, merged in place
+    [store addObjects:@[ plant(@"plant3", 300, @"AA03"), plant(@"plant2", 250, @"AA02") ]];
+    XCTAssertEqual([store itemsForBarcode:200].count, 0);
+    XCTAssertEqualObjects([[store itemForBarcode:250] objectId], @"plant2");
+    XCTAssertEqualObjects([[store itemForBarcode:300] objectId], @"plant3");
+    EpcKey key;
+    XCTAssertTrue([UgiEpc parseHexString:@"AA02" toKey:&key]);
+    XCTAssertEqualObjects([[store itemForEpcKey:&key] objectId], @"plant2");
+
+    // An EPC moving off an item is dropped from the EPC index
+    [store addObjects:@[ plant(@"plant1", 100, @"AA09") ]];
+    XCTAssertTrue([UgiEpc parseHexString:@"AA01" toKey:&key]);
+    XCTAssertNil([store itemForEpcKey:&key]);
+    XCTAssertTrue([UgiEpc parseHexString:@"AA09" toKey:&key]);
+    XCTAssertEqualObjects([[store itemForEpcKey:&key] objectId], @"plant1");
+    XCTAssertEqualObjects([[store itemForBarcode:100] objectId], @"plant1");
+}
+
+- (void)testSessionReaderSkipsByEpcPrefix {
+    ReaderSimulatorConfig config;
+    ReaderSimulatorDefaultConfig(&config);
+    config.numTags = 5000;
+    config.sweepSeconds = 120;
+    config.tagsInView = 100;
+    static const uint32_t maxFinds = 100000;
+    RawFind *finds = malloc(maxFinds * sizeof(RawFind));
+    ReaderSimulator simulator;
+    double start = CFAbsoluteTimeGetCurrent();
+    XCTAssertTrue(ReaderSimulatorInit(&simulator, &config, start));
+    uint32_t count = ReaderSimulatorRun(&simulator, 120, finds, maxFinds);
+    // Tags swept past in the second minute have another prefix
+    for (uint32_t i = 0; i < count; i++) {
+        if (finds[i].timestamp > start + 60) {
+            EpcKey key = finds[i].epc;
+            key.bytes[0] = 0x30;
+            finds[i].epc = EpcKeyMake(key.bytes, key.length);
+        }
+    }
+
+    NSString *path = [NSTemporaryDirectory() stringByAppendingPathComponent:@"testSessionReaderPrefix.session"];
+    SessionWriter writer;
+    XCTAssertTrue(SessionWriterOpen(&writer, path.fileSystemRepresentation));
+    for (uint32_t i = 0; i < count; i++) {
+        SessionWriterAppend(&writer, &finds[i]);
+    }
+    XCTAssertTrue(SessionWriterClose(&writer));
+
+    SessionReader reader;
+    XCTAssertTrue(SessionReaderOpen(&reader, path.fileSystemRepresentation));
+    uint32_t minPrefix = 0x30000000, maxPrefix = 0x30FFFFFF;
+    XCTAssertTrue(SessionReaderMayMatch(&reader, start, start + 120, minPrefix, maxPrefix));
+    XCTAssertFalse(SessionReaderMayMatch(&reader, start, start + 120, 0xF0000000, UINT32_MAX));
+    XCTAssertFalse(SessionReaderMayMatch(&reader, start + 500, start + 600, 0, UINT32_MAX));
+
+    // Straddling the change of prefix, and the whole session, against a scan of the finds
+    double ranges[][2] = { { 30.5, 41.25 }, { 55, 70 }, { 0, 120 } };
+    for (int range = 0; range < 3; range++) {
+        double from = start + ranges[range][0], to = start + ranges[range][1];
+        EpcTable seen, expected;
+        EpcTableInit(&seen, 64);
+        EpcTableInit(&expected, 64);
+        XCTAssertTrue(SessionReaderEpcsWithPrefixesSeenBetween(&reader, from, to, minPrefix, maxPrefix, &seen));
+        bool inserted;
+        for (uint32_t i = 0; i < count; i++) {
+            if (finds[i].timestamp >= from && finds[i].timestamp <= to && finds[i].epc.bytes[0] == 0x30) {
+                EpcTableInsert(&expected, &finds[i].epc, &inserted);
+            }
+        }
+        XCTAssertEqual(seen.count, expected.count);
+        for (uint32_t i = 0; i < expected.count; i++) {
+            XCTAssertNotEqual(EpcTableFind(&seen, &expected.keys[i]), EPC_TABLE_NOT_FOUND);
+        }
+        EpcTableFree(&seen);
+        EpcTableFree(&expected);
+    }
+
+    SessionReaderClose(&reader);
+    [[NSFileManager defaultManager] removeItemAtPath:path error:nil];
+    ReaderSimulatorFree(&simulator);
+    free(finds);
+}
+
+- (void)testInventoryPhaseChangeQueuedOfflineIsFlushed {
+    InventoryStore *store = [[InventoryStore alloc] initFromFile:@"PhaseQueueTest" initializationData:nil debug:NO];
+    [[NSFileManager defaultManager] removeItemAtPath:store._filePath error:nil];
+    [[NSFileManager defaultManager] removeItemAtPath:[store._filePath stringByAppendingString:@".journal"] error:nil];
+    store = [[InventoryStore alloc] initFromFile:@"PhaseQueueTest" initializationData:nil debug:NO];
+    NSString *path = [NSTemporaryDirectory() stringByAppendingPathComponent:@"PhaseQueueTest"];
+    [[NSFileManager defaultManager] removeItemAtPath:path error:nil];
+    [[NSFileManager defaultManager] removeItemAtPath:[path stringByAppendingString:@".journal"] error:nil];
+    PFObject *plant1 = [PFObject objectWithoutDataWithClassName:InventoryClassName objectId:@"plant1"];
+    plant1[@"barcode"] = @100;
+    plant1[@"phase"] = @"vegetative";
+    PFObject *plant2 = [PFObject objectWithoutDataWithClassName:InventoryClassName objectId:@"plant2"];
+    plant2[@"barcode"] = @200;
+    NSArray *items = [store addObjects:@[ plant1, plant2 ]];
+    BFTask *(^finish)(BFTask *) = ^BFTask *(BFTask *task) {
+        NSDate *deadline = [NSDate dateWithTimeIntervalSinceNow:5];
+        while (!task.isCompleted && [deadline timeIntervalSinceNow] > 0) {
+            [[NSRunLoop currentRunLoop] runUntilDate:[NSDate dateWithTimeIntervalSinceNow:0.01]];
+        }
+        return task;
+    };
+
+    // Offline: the edit shows at once and stays queued
+    OfflineWriteQueue *queue = [[OfflineWriteQueue alloc] initWithPath:path];
+    queue.saver.maxAttempts = 1;
+    queue.saver.saveBlock = ^BFTask *(NSArray *objects) {
+        return [BFTask taskWithError:[NSError errorWithDomain:NSURLErrorDomain code:NSURLErrorNotConnectedToInternet userInfo:nil]];
+    };
+    NSDate *date = [NSDate dateWithTimeIntervalSince1970:1419465600];
+    NSArray *moved = [store setPhase:@"flowering" dateKey:@"flowering" date:date ofItems:items queue:queue];
+    XCTAssertEqual(moved.count, 2);
+    XCTAssertEqualObjects([store itemForBarcode:100].phase, @"flowering");
+    XCTAssertEqualObjects([store itemForBarcode:200].flowering, date);
+    XCTAssertNotNil(finish([queue flush]).error);
+    XCTAssertEqual(queue.pendingCount, 2);
+
+    // Journaled, so a restart still has the writes
+    [queue waitUntilWritten];
+    queue = nil;
+    queue = [[OfflineWriteQueue alloc] initWithPath:path];
+    XCTAssertEqual(queue.pendingCount, 2);
+
+    // Back online: both go out, with only the keys that changed
+    __block NSArray *sent;
+    queue.saver.saveBlock = ^BFTask *(NSArray *objects) {
+        sent = objects;
+        return [BFTask taskWithResult:objects];
+    };
+    XCTAssertEqualObjects(finish([queue flush]).result, @2);
+    XCTAssertEqual(queue.pendingCount, 0);
+    XCTAssertEqual(sent.count, 2);
+    for (PFObject *object in sent) {
+        XCTAssertEqualObjects(object[@"phase"], @"flowering");
+        XCTAssertEqualWithAccuracy([object[@"flowering"] timeIntervalSince1970], date.timeIntervalSince1970, 0.001);
+        XCTAssertNil(object[@"barcode"]);
+    }
+
+    // User profile writes go the same way, but never a password
+    LoginSession *session = [[LoginSession alloc] initWithSessionToken:@"token"
+                                                                  user:[PFObject objectWithoutDataWithClassName:@"User" objectId:@"user1"]];
+    XCTAssertThrowsSpecificNamed([session setProfileValues:@{ @"password": @"secret" } queue:queue],
+                                 NSException, NSInvalidArgumentException);
+    XCTAssertEqual(queue.pendingCount, 0);
+    [session setProfileValues:@{ @"shift": @"night" } queue:queue];
+    XCTAssertEqualObjects(session.user[@"shift"], @"night");
+    XCTAssertEqual(queue.pendingCount, 1);
+}
+
+- (void)testInventoryEndsWhenTransportStopsByItself {
+    ReaderSimulatorConfig config;
+    ReaderSimulatorDefaultConfig(&config);
+    config.numTags = 20;
+    SimulatedReaderTransport *transport = [[SimulatedReaderTransport alloc] initWithConfig:&config];
+    transport.speed = 0;
+    transport.durationSeconds = 1;
+    [transport openConnection];
+
+    InventoryController *controller = [InventoryController singleton];
+    controller.transport = transport;
+    StopTestDelegate *delegate = [[StopTestDelegate alloc] init];
+    delegate.stopped = [self expectationWithDescription:@"inventory stopped"];
+    controller.delegate = delegate;
+    UgiRfidConfiguration *configuration = [UgiRfidConfiguration configWithInventoryType:UGI_INVENTORY_TYPE_INVENTORY_DISTANCE];
+    [controller startInventoryWithConfiguration:configuration];
+    XCTAssertTrue(controller.isRunning);
+    [self waitForExpectationsWithTimeout:30 handler:nil];
+
+    // Stopped without stopInventory, and free to start again
+    XCTAssertFalse(controller.isRunning);
+    XCTAssertNil(controller.inventory);
+    XCTAssertGreaterThan(controller.tags.count, 0u);
+    delegate.stopped = [self expectationWithDescription:@"second inventory stopped"];
+    [controller startInventoryWithConfiguration:configuration];
+    XCTAssertTrue(controller.isRunning);
+    [self waitForExpectationsWithTimeout:30 handler:nil];
+    XCTAssertFalse(controller.isRunning);
+
+    controller.delegate = nil;
+    controller.transport = [[UgiReaderTransport alloc] init];
+    [transport closeConnection];
+}
+
+- (void)testTagEpcStringIsCachedPerEpc {
+    UgiTag *tag = [listTestTags(1) firstObject];
+    NSString *first = tag.epcString;
+    XCTAssertEqualObjects(first, [tag.epc hexString]);
+    XCTAssertTrue(tag.epcString == first);
+
+    // New EPC data, so a new string
+    uint8_t bytes[12] = { 0x30, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0x12, 0x34 };
+    tag.epc.data = [NSData dataWithBytes:bytes length:sizeof(bytes)];
+    NSString *second = tag.epcString;
+    XCTAssertFalse(second == first);
+    XCTAssertEqualObjects(second, @"300000000000000000001234");
+    XCTAssertTrue(tag.epcString == second);
+}
+
 @end
@@ -0,0 +1,420 @@
+//
+//  InventoryBenchmarkTests.m
+//  FlowTrialTests
+//
+//  Created by Wade Sellers on 12/21/14.
+//  Copyright (c) 2014 Wade Sellers. All rights reserved.
+//
+
+#import <UIKit/UIKit.h>
+#import <XCTest/XCTest.h>
+#import <mach/mach.h>
+#import <mach/mach_time.h>
+#import <malloc/malloc.h>
+#import "InventoryController.h"
+#import "SimulatedReaderTransport.h"
+#import "UgiReaderTransport.h"
+
+//
+// End to end inventory benchmark: simulated raw finds go in through a
+// SimulatedReaderTransport, InventoryController does its bookkeeping and the
+// benchmark delegate measures what comes out.
+//
+// Each configuration is run twice. Throughput, allocations and memory use come from
+// a run with a plain delegate, as the app's are; latency comes from a second run
+// whose delegate also implements inventoryFilterLowLevel: to timestamp finds, which
+// costs a UgiEpc per find.
+//
+// Allocations are counted process-wide while the plain run is going, so the
+// allocations per find include the test's own small, fixed overhead. Peak RSS is the
+// process's high-water mark, which never comes down; configurations run from fewest
+// tags to most, so each one's peak is its own unless an earlier run went higher.
+//
+// Results are written as JSON to $INVENTORY_BENCHMARK_OUTPUT, or to
+// InventoryBenchmark.json in the temporary directory.
+//
+
+#define BENCHMARK_READS_PER_SECOND 20000
+#define BENCHMARK_SIMULATED_SECONDS 2
+#define BENCHMARK_TIMEOUT_SECONDS 120
+#define BENCHMARK_HEAP_SAMPLE_SECONDS 0.01
+
+///////////////////////////////////////////////////////////////////////////////////////
+#pragma mark - Memory use
+///////////////////////////////////////////////////////////////////////////////////////
+
+//
+// malloc_logger is the hook malloc stack logging uses; every allocation and free
+// in the process goes through it while it is set
+//
+typedef void (malloc_logger_t)(uint32_t type, uintptr_t arg1, uintptr_t arg2, uintptr_t arg3, uintptr_t result, uint32_t numHotFramesToSkip);
+extern malloc_logger_t *malloc_logger;
+
+#define MALLOC_LOG_TYPE_ALLOCATE 2
+
+static malloc_logger_t *previousMallocLogger;
+static uint64_t allocationCount;
+
+//
+// Counts allocations, reallocs included, and passes the event on to any logger
+// that was already installed
+//
+static void countAllocations(uint32_t type, uintptr_t arg1, uintptr_t arg2, uintptr_t arg3, uintptr_t result, uint32_t numHotFramesToSkip) {
+    if (type & MALLOC_LOG_TYPE_ALLOCATE) {
+        __atomic_fetch_add(&allocationCount, 1, __ATOMIC_RELAXED);
+    }
+    if (previousMallocLogger) {
+        previousMallocLogger(type, arg1, arg2, arg3, result, numHotFramesToSkip);
+    }
+}
+
+static void startCountingAllocations() {
+    __atomic_store_n(&allocationCount, 0, __ATOMIC_RELAXED);
+    previousMallocLogger = malloc_logger;
+    malloc_logger = countAllocations;
+}
+
+static uint64_t stopCountingAllocations() {
+    malloc_logger = previousMallocLogger;
+    return __atomic_load_n(&allocationCount, __ATOMIC_RELAXED);
+}
+
+//
+// The process's peak resident set size so far, in bytes
+//
+static uint64_t peakResidentBytes() {
+    mach_task_basic_info_data_t info;
+    mach_msg_type_number_t count = MACH_TASK_BASIC_INFO_COUNT;
+    if (task_info(mach_task_self(), MACH_TASK_BASIC_INFO, (task_info_t)&info, &count) != KERN_SUCCESS) {
+        return 0;
+    }
+    return info.resident_size_max;
+}
+
+//
+// Bytes and blocks in use across every malloc zone
+//
+static malloc_statistics_t heapInUse() {
+    malloc_statistics_t stats;
+    malloc_zone_statistics(NULL, &stats);
+    return stats;
+}
+
+static int compareDoubles(const void *a, const void *b) {
+    double x = *(const double *)a, y = *(const double *)b;
+    return x < y ? -1 : x > y ? 1 : 0;
+}
+
+static uint32_t tagNumberForEpcBytes(const uint8_t *bytes, NSUInteger length) {
+    // ReaderSimulatorTagEpc puts the tag number in the last 4 bytes
+    return ((uint32_t)bytes[length - 4] << 24) | ((uint32_t)bytes[length - 3] << 16) |
+           ((uint32_t)bytes[length - 2] << 8) | bytes[length - 1];
+}
+
+///////////////////////////////////////////////////////////////////////////////////////
+#pragma mark - BenchmarkDelegate
+///////////////////////////////////////////////////////////////////////////////////////
+
+/**
+ Counts what reaches the main thread, and nothing more: no low-level filter, so finds
+ take the same path as with the app's delegates
+ */
+@interface BenchmarkDelegate : NSObject <InventoryControllerDelegate>
+
+@property (nonatomic) XCTestExpectation *stopped;
+@property (readonly, nonatomic) uint64_t findsDelivered;
+
+@end
+
+@implementation BenchmarkDelegate
+
+- (void) inventoryTagFound:(UgiTag *)tag
+   withDetailedPerReadData:(NSArray *)detailedPerReadData {
+    _findsDelivered++;
+}
+
+- (void) inventoryTagSubsequentFindsBatch:(const TagFindBatch *)batch {
+    _findsDelivered += batch->totalFinds;
+}
+
+- (void) inventoryDidStopWithResult:(UgiInventoryCompletedReturnValues)result {
+    [self.stopped fulfill];
+}
+
+@end
+
+///////////////////////////////////////////////////////////////////////////////////////
+#pragma mark - LatencyDelegate
+///////////////////////////////////////////////////////////////////////////////////////
+
+/**
+ Measures find-to-callback latency: the first find of a tag not yet reported is
+ timestamped on the reader thread (inventoryFilterLowLevel:), and the latency is taken
+ when the tag next reaches the main thread as a first find or in a batch.
+ */
+@interface LatencyDelegate : NSObject <InventoryControllerDelegate>
+
+@property (nonatomic) XCTestExpectation *stopped;
+@property (readonly, nonatomic) uint32_t latencyCount;
+
+- (id) initWithNumTags:(uint32_t)numTags;
+- (double) latencyPercentile:(double)percentile;
+
+@end
+
+@implementation LatencyDelegate {
+    uint32_t _numTags;
+    uint64_t *_pendingSince;        // mach_absolute_time of the oldest unreported find, per tag number
+    NSMutableData *_tagNumbers;     // Tag number, per InventoryController tag index
+    double *_latencies;
+    uint32_t _latencyCapacity;
+    mach_timebase_info_data_t _timebase;
+}
+
+- (id) initWithNumTags:(uint32_t)numTags {
+    self = [super init];
+    if (self) {
+        _numTags = numTags;
+        _pendingSince = calloc(numTags, sizeof(uint64_t));
+        _tagNumbers = [NSMutableData data];
+        mach_timebase_info(&_timebase);
+    }
+    return self;
+}
+
+- (void) dealloc {
+    free(_pendingSince);
+    free(_latencies);
+}
+
+- (void) recordLatencyForTagNumber:(uint32_t)tagNumber now:(uint64_t)now {
+    if (tagNumber >= _numTags) {
+        return;
+    }
+    uint64_t since = __atomic_exchange_n(&_pendingSince[tagNumber], 0, __ATOMIC_ACQ_REL);
+    if (since == 0) {
+        return;
+    }
+    if (_latencyCount == _latencyCapacity) {
+        _latencyCapacity = _latencyCapacity ? _latencyCapacity * 2 : 4096;
+        _latencies = realloc(_latencies, _latencyCapacity * sizeof(double));
+    }
+    _latencies[_latencyCount++] = (double)(now - since) * _timebase.numer / _timebase.denom / NSEC_PER_USEC;
+}
+
+- (double) latencyPercentile:(double)percentile {
+    if (_latencyCount == 0) {
+        return 0;
+    }
+    qsort(_latencies, _latencyCount, sizeof(double), compareDoubles);
+    uint32_t index = (uint32_t)(percentile / 100 * (_latencyCount - 1));
+    return _latencies[index];
+}
+
+- (BOOL) inventoryFilterLowLevel:(UgiEpc *)epc {
+    NSData *data = epc.data;
+    uint32_t tagNumber = tagNumberForEpcBytes(data.bytes, data.length);
+    if (tagNumber < _numTags) {
+        uint64_t expected = 0;
+        __atomic_compare_exchange_n(&_pendingSince[tagNumber], &expected, mach_absolute_time(),
+                                    NO, __ATOMIC_ACQ_REL, __ATOMIC_ACQUIRE);
+    }
+    return NO;
+}
+
+- (void) inventoryTagFound:(UgiTag *)tag
+   withDetailedPerReadData:(NSArray *)detailedPerReadData {
+    NSData *data = tag.epc.data;
+    uint32_t tagNumber = tagNumberForEpcBytes(data.bytes, data.length);
+    [_tagNumbers appendBytes:&tagNumber length:sizeof(tagNumber)];
+    [self recordLatencyForTagNumber:tagNumber now:mach_absolute_time()];
+}
+
+- (void) inventoryTagSubsequentFindsBatch:(const TagFindBatch *)batch {
+    const uint32_t *tagNumbers = _tagNumbers.bytes;
+    uint32_t numTagNumbers = (uint32_t)(_tagNumbers.length / sizeof(uint32_t));
+    uint64_t now = mach_absolute_time();
+    for (uint32_t i = 0; i < batch->count; i++) {
+        if (batch->tagIndexes[i] < numTagNumbers) {
+            [self recordLatencyForTagNumber:tagNumbers[batch->tagIndexes[i]] now:now];
+        }
+    }
+}
+
+- (void) inventoryDidStopWithResult:(UgiInventoryCompletedReturnValues)result {
+    [self.stopped fulfill];
+}
+
+@end
+
+///////////////////////////////////////////////////////////////////////////////////////
+#pragma mark - InventoryBenchmarkTests
+///////////////////////////////////////////////////////////////////////////////////////
+
+@interface InventoryBenchmarkTests : XCTestCase
+
+@end
+
+@implementation InventoryBenchmarkTests
+
+//
+// Shape the simulated population like the preset's use: locating sees a handful of
+// nearby tags, counting sees everything, from further away
+//
+- (void) configureSimulator:(ReaderSimulatorConfig *)config
+           forInventoryType:(UgiInventoryTypes)inventoryType
+                    numTags:(uint32_t)numTags {
+    ReaderSimulatorDefaultConfig(config);
+    config->numTags = numTags;
+    config->readsPerSecond = BENCHMARK_READS_PER_SECOND;
+    switch (inventoryType) {
+        case UGI_INVENTORY_TYPE_LOCATE_DISTANCE:
+            config->tagsInView = MIN(numTags, 50);
+            config->rssiMean = -65;
+            break;
+        case UGI_INVENTORY_TYPE_LOCATE_SHORT_RANGE:
+            config->tagsInView = MIN(numTags, 10);
+            config->rssiMean = -50;
+            break;
+        case UGI_INVENTORY_TYPE_LOCATE_VERY_SHORT_RANGE:
+            config->tagsInView = MIN(numTags, 3);
+            config->rssiMean = -40;
+            break;
+        case UGI_INVENTORY_TYPE_INVENTORY_SHORT_RANGE:
+            config->tagsInView = numTags;
+            config->rssiMean = -55;
+            break;
+        case UGI_INVENTORY_TYPE_INVENTORY_DISTANCE:
+        default:
+            config->tagsInView = numTags;
+            config->rssiMean = -70;
+            break;
+    }
+}
+
+//
+// Run one inventory to the end of the simulation with a delegate; returns the
+// transport's counters and the wall-clock time
+//
+- (ReaderSimulatorStats) runWithInventoryType:(UgiInventoryTypes)inventoryType
+                                      numTags:(uint32_t)numTags
+                                     delegate:(id<InventoryControllerDelegate>)delegate
+                                      seconds:(double *)seconds {
+    ReaderSimulatorConfig config;
+    [self configureSimulator:&config forInventoryType:inventoryType numTags:numTags];
+    SimulatedReaderTransport *transport = [[SimulatedReaderTransport alloc] initWithConfig:&config];
+    transport.speed = 0;
+    transport.durationSeconds = BENCHMARK_SIMULATED_SECONDS;
+    [transport openConnection];
+
+    InventoryController *controller = [InventoryController singleton];
+    controller.transport = transport;
+    controller.delegate = delegate;
+
+    CFAbsoluteTime start = CFAbsoluteTimeGetCurrent();
+    [controller startInventoryWithConfiguration:[UgiRfidConfiguration configWithInventoryType:inventoryType]];
+    [self waitForExpectationsWithTimeout:BENCHMARK_TIMEOUT_SECONDS handler:nil];
+    // The timed run ends the inventory by itself
+    XCTAssertFalse(controller.isRunning);
+    *seconds = CFAbsoluteTimeGetCurrent() - start;
+
+    controller.delegate = nil;
+    controller.transport = [[UgiReaderTransport alloc] init];
+    [transport closeConnection];
+    return transport.stats;
+}
+
+- (NSDictionary *) measureInventoryType:(UgiInventoryTypes)inventoryType
+                                numTags:(uint32_t)numTags {
+    // Throughput, allocations and memory use, sampling the heap on the main thread
+    // while the expectation wait runs the run loop
+    BenchmarkDelegate *delegate = [[BenchmarkDelegate alloc] init];
+    delegate.stopped = [self expectationWithDescription:@"inventory stopped"];
+    malloc_statistics_t before = heapInUse();
+    __block size_t peakBytes = before.size_in_use;
+    dispatch_source_t sampler = dispatch_source_create(DISPATCH_SOURCE_TYPE_TIMER, 0, 0, dispatch_get_main_queue());
+    uint64_t interval = (uint64_t)(BENCHMARK_HEAP_SAMPLE_SECONDS * NSEC_PER_SEC);
+    dispatch_source_set_timer(sampler, dispatch_time(DISPATCH_TIME_NOW, (int64_t)interval), interval, interval / 10);
+    dispatch_source_set_event_handler(sampler, ^{
+        peakBytes = MAX(peakBytes, heapInUse().size_in_use);
+    });
+    dispatch_resume(sampler);
+    double seconds;
+    startCountingAllocations();
+    ReaderSimulatorStats stats = [self runWithInventoryType:inventoryType numTags:numTags delegate:delegate seconds:&seconds];
+    uint64_t allocations = stopCountingAllocations();
+    uint64_t peakRss = peakResidentBytes();
+    dispatch_source_cancel(sampler);
+    malloc_statistics_t after = heapInUse();
+    peakBytes = MAX(peakBytes, after.size_in_use);
+    NSUInteger uniqueTags = [InventoryController singleton].tags.count;
+    XCTAssertGreaterThan(delegate.findsDelivered, 0);
+
+    // Latency, with the timestamping filter
+    LatencyDelegate *latencyDelegate = [[LatencyDelegate alloc] initWithNumTags:numTags];
+    latencyDelegate.stopped = [self expectationWithDescription:@"latency inventory stopped"];
+    double latencySeconds;
+    [self runWithInventoryType:inventoryType numTags:numTags delegate:latencyDelegate seconds:&latencySeconds];
+
+    return @{ @"inventoryType": [UgiRfidConfiguration nameForInventoryType:inventoryType],
+              @"numTags": @(numTags),
+              @"rawFinds": @(stats.rawTagFinds),
+              @"findsDelivered": @(delegate.findsDelivered),
+              @"uniqueTags": @(uniqueTags),
+              @"seconds": @(seconds),
+              @"findsPerSecond": @(stats.rawTagFinds / seconds),
+              @"latencySamples": @(latencyDelegate.latencyCount),
+              @"latencyP50Usec": @([latencyDelegate latencyPercentile:50]),
+              @"latencyP99Usec": @([latencyDelegate latencyPercentile:99]),
+              @"allocations": @(allocations),
+              @"allocationsPerFind": @(stats.rawTagFinds ? (double)allocations / stats.rawTagFinds : 0),
+              @"peakRssBytes": @(peakRss),
+              @"peakHeapBytes": @(peakBytes - before.size_in_use),
+              @"retainedHeapBytes": @((int64_t)after.size_in_use - (int64_t)before.size_in_use),
+              @"retainedHeapBlocks": @((int64_t)after.blocks_in_use - (int64_t)before.blocks_in_use) };
+}
+
+- (void)testInventoryThroughput {
+    static const uint32_t tagCounts[] = { 100, 1000, 10000, 100000 };
+    static const UgiInventoryTypes inventoryTypes[] = {
+        UGI_INVENTORY_TYPE_LOCATE_DISTANCE,
+        UGI_INVENTORY_TYPE_INVENTORY_SHORT_RANGE,
+        UGI_INVENTORY_TYPE_INVENTORY_DISTANCE,
+        UGI_INVENTORY_TYPE_LOCATE_SHORT_RANGE,
+        UGI_INVENTORY_TYPE_LOCATE_VERY_SHORT_RANGE
+    };
+
+    NSMutableArray *results = [NSMutableArray array];
+    for (size_t i = 0; i < sizeof(tagCounts) / sizeof(tagCounts[0]); i++) {
+        for (size_t j = 0; j < sizeof(inventoryTypes) / sizeof(inventoryTypes[0]); j++) {
+            @autoreleasepool {
+                NSDictionary *result = [self measureInventoryType:inventoryTypes[j] numTags:tagCounts[i]];
+                NSLog(@"%@ %@ tags: %.0f finds/sec, p50 %.0fus, p99 %.0fus, %.3f allocations/find, peak RSS %@ bytes, peak heap +%@ bytes, %@ blocks kept",
+                      result[@"inventoryType"], result[@"numTags"], [result[@"findsPerSecond"] doubleValue],
+                      [result[@"latencyP50Usec"] doubleValue], [result[@"latencyP99Usec"] doubleValue],
+                      [result[@"allocationsPerFind"] doubleValue], result[@"peakRssBytes"],
+                      result[@"peakHeapBytes"], result[@"retainedHeapBlocks"]);
+                [results addObject:result];
+            }
+        }
+    }
+
+    UIDevice *device = [UIDevice currentDevice];
+    NSDictionary *report = @{ @"date": @([[NSDate date] timeIntervalSince1970]),
+                              @"device": device.model,
+                              @"systemVersion": device.systemVersion,
+                              @"readsPerSecond": @(BENCHMARK_READS_PER_SECOND),
+                              @"simulatedSeconds": @(BENCHMARK_SIMULATED_SECONDS),
+                              @"results": results };
+    NSError *error;
+    NSData *json = [NSJSONSerialization dataWithJSONObject:report options:NSJSONWritingPrettyPrinted error:&error];
+    XCTAssertNotNil(json, @"%@", error);
+    NSString *path = [NSProcessInfo processInfo].environment[@"INVENTORY_BENCHMARK_OUTPUT"];
+    if (path.length == 0) {
+        path = [NSTemporaryDirectory() stringByAppendingPathComponent:@"InventoryBenchmark.json"];
+    }
+    XCTAssertTrue([json writeToFile:path atomically:YES]);
+    NSLog(@"Inventory benchmark results written to %@", path);
+}
+
+@end
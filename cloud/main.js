@@ -0,0 +1,133 @@
+//
+//  main.js
+//  FlowTrial Cloud Code
+//
+//  Created by Wade Sellers on 12/31/14.
+//  Copyright (c) 2014 Wade Sellers. All rights reserved.
+//
+//  Functions called by CloudLoginService. Deploy with `parse deploy`.
+//
+
+var USER_CLASS = "User";
+var SESSION_CLASS = "UserSession";
+
+// Error messages the app maps to LoginService error codes (CloudLoginService)
+var BAD_LOGIN = "BAD_LOGIN";
+var USERNAME_TAKEN = "USERNAME_TAKEN";
+
+//
+// Keys of the User to send back: those asked for, never the password
+//
+function projectedKeys(request) {
+    var keys = request.params.keys;
+    if (!(keys instanceof Array)) {
+        return ["username"];
+    }
+    return keys.filter(function(key) {
+        return typeof key === "string" && key !== "password" && key !== "objectId";
+    });
+}
+
+//
+// The User with this username, or undefined
+//
+function findUser(username, keys) {
+    var query = new Parse.Query(USER_CLASS);
+    query.equalTo("username", username);
+    query.select(keys.concat(["password"]));
+    return query.first({ useMasterKey: true });
+}
+
+//
+// Start a session for a user: its token is the objectId of a UserSession only the
+// master key can read
+//
+function startSession(user, keys) {
+    var session = new Parse.Object(SESSION_CLASS);
+    session.set("user", user);
+    session.setACL(new Parse.ACL());
+    return session.save(null, { useMasterKey: true }).then(function(session) {
+        var fields = { objectId: user.id };
+        keys.forEach(function(key) {
+            if (user.has(key)) {
+                fields[key] = user.get(key);
+            }
+        });
+        return { sessionToken: session.id, user: fields };
+    });
+}
+
+function validCredentials(params) {
+    return typeof params.username === "string" && params.username.length > 0 &&
+           typeof params.password === "string" && params.password.length > 0;
+}
+
+//
+// Usernames are unique however a User is saved
+//
+Parse.Cloud.beforeSave(USER_CLASS, function(request, response) {
+    var user = request.object;
+    if (!user.dirty("username")) {
+        response.success();
+        return;
+    }
+    var query = new Parse.Query(USER_CLASS);
+    query.equalTo("username", user.get("username"));
+    if (user.id) {
+        query.notEqualTo("objectId", user.id);
+    }
+    query.first({ useMasterKey: true }).then(function(existing) {
+        if (existing) {
+            response.error(USERNAME_TAKEN);
+        } else {
+            response.success();
+        }
+    }, function(error) {
+        response.error(error.message);
+    });
+});
+
+//
+// { username, password, keys } -> { sessionToken, user: { objectId, keys... } }
+//
+Parse.Cloud.define("logIn", function(request, response) {
+    var params = request.params;
+    if (!validCredentials(params)) {
+        response.error(BAD_LOGIN);
+        return;
+    }
+    var keys = projectedKeys(request);
+    findUser(params.username, keys).then(function(user) {
+        if (!user || user.get("password") !== params.password) {
+            return Parse.Promise.error(BAD_LOGIN);
+        }
+        return startSession(user, keys);
+    }).then(function(result) {
+        response.success(result);
+    }, function(error) {
+        response.error(typeof error === "string" ? error : error.message);
+    });
+});
+
+//
+// { username, password, keys } -> a session for the new User, as logIn
+//
+Parse.Cloud.define("signUp", function(request, response) {
+    var params = request.params;
+    if (!validCredentials(params)) {
+        response.error(BAD_LOGIN);
+        return;
+    }
+    var keys = projectedKeys(request);
+    var user = new Parse.Object(USER_CLASS);
+    user.set("username", params.username);
+    user.set("password", params.password);
+    // beforeSave turns away a username already in use
+    user.save(null, { useMasterKey: true }).then(function(user) {
+        return startSession(user, keys);
+    }).then(function(result) {
+        response.success(result);
+    }, function(error) {
+        response.error(typeof error === "string" ? error : error.message);
+    });
+});